@@ -353,6 +353,9 @@ int mainEncryptDecrpyt(uint32_t activityLevel)
     }
     while (!programExecuted);
 
+    // Logs are written asynchronously, make sure they're in the log file
+    veil::vtl0::logger::logger::Flush();
+
     // Wait for a key press before exiting
     std::cout << "\n\nPress any key to exit..." << std::endl;
     _getch();
@@ -396,6 +399,42 @@ int mainThreadPool(uint32_t /*activityLevel*/)
     return 0;
 }
 
+int mainTaskpoolBenchmarks(uint32_t /*activityLevel*/)
+{
+    std::wcout << L"Running sample: Taskpool benchmarks..." << std::endl;
+
+    // Create app+user enclave identity
+    auto ownerId = veil::vtl0::appmodel::owner_id();
+
+    // Load enclave
+    auto flags = ENCLAVE_VBS_FLAG_DEBUG;
+
+    // 8 benchmark threads, plus the thread that calls into the enclave to run the benchmark
+    constexpr DWORD THREAD_COUNT = 9;
+
+    auto enclave = veil::vtl0::enclave::create(ENCLAVE_TYPE_VBS, ownerId, flags, veil::vtl0::enclave::megabytes(512));
+    veil::vtl0::enclave::load_image(enclave.get(), L"sampleenclave.dll");
+    veil::vtl0::enclave::initialize(enclave.get(), THREAD_COUNT);
+
+    // Register framework callbacks
+    veil::vtl0::enclave_api::register_callbacks(enclave.get());
+
+    // Initialize enclave interface
+    auto enclaveInterface = VbsEnclave::Trusted::Stubs::SampleEnclave(enclave.get());
+    THROW_IF_FAILED(enclaveInterface.RegisterVtl0Callbacks());
+
+    // Call into enclave to 'RunTaskpoolBenchmarks' export
+    THROW_IF_FAILED(enclaveInterface.RunTaskpoolBenchmarks(THREAD_COUNT - 1));
+
+    std::wcout << L"Finished sample: Taskpool benchmarks..." << std::endl;
+
+    // Wait for a key press before exiting
+    std::cout << "\n\nPress any key to exit..." << std::endl;
+    _getch();
+
+    return 0;
+}
+
 int mainEncryptDecrpytThreadpool(uint32_t activityLevel)
 {
     std::wcout << L"Running sample: Encrypt decrypt in taskpool..." << std::endl;
@@ -483,6 +522,9 @@ int mainEncryptDecrpytThreadpool(uint32_t activityLevel)
 
     std::wcout << L"Finished sample: Encrypt Decrypt in taskpool..." << std::endl;
 
+    // Logs are written asynchronously, make sure they're in the log file
+    veil::vtl0::logger::logger::Flush();
+
     // Wait for a key press before exiting
     std::cout << "\n\nPress any key to exit..." << std::endl;
     _getch();
@@ -517,10 +559,11 @@ int main(int argc, char* argv[])
         std::cout << "1. Encrypt, decrypt a string using enclave\n";
         std::cout << "2. Explore executing a threadpool in the enclave\n";
         std::cout << "3. Encrypt, decrypt multiple strings using threadpool and enclave\n";
+        std::cout << "4. Benchmark the taskpool in the enclave\n";
         std::cout << "Enter your choice: ";
         if (!(std::cin >> choice)) // Check if input is not an integer
         {
-            std::cout << "Invalid input. Please enter a valid option (1, 2 or 3).\n";
+            std::cout << "Invalid input. Please enter a valid option (1, 2, 3 or 4).\n";
             std::cin.clear(); // Clear the error flag
             std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n'); // Discard invalid input
             continue;
@@ -543,11 +586,19 @@ int main(int argc, char* argv[])
                 programExecuted = true;
                 break;
 
+            case 4:
+                mainTaskpoolBenchmarks(activityLevel);
+                programExecuted = true;
+                break;
+
             default:
                 std::cout << "Invalid choice. Please try again.\n";
         }
     }
     while (!programExecuted);
 
+    // Write the logs that are still queued (including the enclave's) before exiting
+    veil::vtl0::logger::logger::Flush();
+
     return 0;
 }
@@ -4,10 +4,19 @@
 #include "pch.h"
 
 #include <array>
+#include <atomic>
+#include <deque>
+#include <numeric>
 #include <stdexcept>
 
+#include <veil\enclave\binary_log.vtl1.h>
+#include <veil\enclave\channel.vtl1.h>
 #include <veil\enclave\crypto.vtl1.h>
+#include <veil\enclave\log_buffer.vtl1.h>
 #include <veil\enclave\logger.vtl1.h>
+#include <veil\enclave\parallel.vtl1.h>
+#include <veil\enclave\task.vtl1.h>
+#include <veil\enclave\task_graph.vtl1.h>
 #include <veil\enclave\taskpool.vtl1.h>
 #include <veil\enclave\vtl0_functions.vtl1.h>
 
@@ -161,6 +170,549 @@ namespace RunTaskpoolExamples
         }
     }
 
+    void Test_EnclaveWorkerLoop(uint32_t threadCount)
+    {
+        using namespace veil::vtl1::vtl0_functions;
+
+        debug_print(L"Creating taskpool with '%d' threads running an enclave worker loop...", threadCount);
+
+        constexpr uint32_t c_taskCount = 1000;
+        auto tasks = std::vector<veil::vtl1::future<uint32_t>>();
+        tasks.reserve(c_taskCount);
+
+        // taskpool
+        {
+            auto taskpool = veil::vtl1::taskpool(threadCount, true, veil::vtl1::taskpool_dispatch::enclave_worker_loop);
+
+            // Small tasks are handed to the workers without leaving the enclave
+            for (uint32_t i = 0; i < c_taskCount; i++)
+            {
+                tasks.push_back(taskpool.queue_task([=] ()
+                {
+                    return i;
+                }));
+            }
+
+            uint64_t sum = 0;
+            for (auto& task : tasks)
+            {
+                sum += task.get();
+            }
+
+            if (sum != (static_cast<uint64_t>(c_taskCount) * (c_taskCount - 1)) / 2)
+            {
+                debug_print(L"ERROR: Enclave worker loop tasks returned the wrong results.");
+            }
+            else
+            {
+                debug_print(L"SUCCESS: Enclave worker loop ran all '%d' tasks.", c_taskCount);
+            }
+
+            debug_print(L"Waiting for taskpool to destruct...");
+        }
+    }
+
+    void Test_Continuations(uint32_t threadCount)
+    {
+        using namespace veil::vtl1::vtl0_functions;
+
+        debug_print(L"Creating taskpool with '%d' threads...", threadCount);
+
+        auto taskpool = veil::vtl1::taskpool(threadCount, true);
+
+        // Chain continuations, none of them block a thread while waiting
+        auto length = taskpool.queue_task([] ()
+        {
+            return std::wstring(L"continuation");
+        }).then(taskpool, [] (veil::vtl1::future<std::wstring> previous)
+        {
+            return previous.get().size();
+        });
+
+        // Wait for all of a batch of tasks
+        auto tasks = std::vector<veil::vtl1::future<uint32_t>>();
+        for (uint32_t i = 0; i < threadCount; i++)
+        {
+            tasks.push_back(taskpool.queue_task([=] ()
+            {
+                return i;
+            }));
+        }
+
+        auto sum = veil::vtl1::when_all(std::move(tasks)).then(taskpool, [] (veil::vtl1::future<std::vector<veil::vtl1::future<uint32_t>>> all)
+        {
+            uint32_t total = 0;
+            for (auto& task : all.get())
+            {
+                total += task.get();
+            }
+            return total;
+        });
+
+        // Wait for the first of two promises, the other one is never satisfied
+        auto first = veil::vtl1::promise<uint32_t>();
+        auto never = veil::vtl1::promise<uint32_t>();
+        auto inputs = std::vector<veil::vtl1::future<uint32_t>>();
+        inputs.push_back(never.get_future());
+        inputs.push_back(first.get_future());
+        auto any = veil::vtl1::when_any(std::move(inputs));
+        first.set_value(1);
+        auto anyResult = any.get();
+        never.set_value(0);
+
+        if (length.get() != 12 || sum.get() != (threadCount * (threadCount - 1)) / 2 || anyResult.index != 1)
+        {
+            debug_print(L"ERROR: Continuations returned the wrong results.");
+        }
+        else
+        {
+            debug_print(L"SUCCESS: Continuations ran after their futures were ready.");
+        }
+    }
+
+    veil::vtl1::task<uint32_t> SquareOnTaskpool(veil::vtl1::taskpool& taskpool, uint32_t value)
+    {
+        // Move onto a taskpool thread, then wait for another task without blocking it
+        co_await taskpool.schedule();
+        co_return co_await taskpool.queue_task([=] ()
+        {
+            return value * value;
+        });
+    }
+
+    veil::vtl1::task<uint32_t> SumOfSquares(veil::vtl1::taskpool& taskpool, uint32_t count)
+    {
+        uint32_t sum = 0;
+        for (uint32_t i = 0; i < count; i++)
+        {
+            sum += co_await SquareOnTaskpool(taskpool, i);
+        }
+        co_return sum;
+    }
+
+    void Test_Coroutines(uint32_t threadCount)
+    {
+        using namespace veil::vtl1::vtl0_functions;
+
+        debug_print(L"Creating taskpool with '%d' threads...", threadCount);
+
+        auto taskpool = veil::vtl1::taskpool(threadCount, true);
+
+        // Keep more coroutines in flight than the taskpool has threads
+        constexpr uint32_t c_coroutineCount = 32;
+        constexpr uint32_t c_squareCount = 10;
+        auto results = std::vector<veil::vtl1::future<uint32_t>>();
+        for (uint32_t i = 0; i < c_coroutineCount; i++)
+        {
+            results.push_back(veil::vtl1::start(SumOfSquares(taskpool, c_squareCount)));
+        }
+
+        bool succeeded = true;
+        for (auto& result : results)
+        {
+            // 0^2 + 1^2 + ... + 9^2
+            succeeded = (result.get() == 285) && succeeded;
+        }
+
+        if (!succeeded)
+        {
+            debug_print(L"ERROR: Coroutines returned the wrong results.");
+        }
+        else
+        {
+            debug_print(L"SUCCESS: '%d' coroutines completed on the taskpool.", c_coroutineCount);
+        }
+    }
+
+    void Test_ParallelAlgorithms(uint32_t threadCount)
+    {
+        using namespace veil::vtl1::vtl0_functions;
+
+        debug_print(L"Creating taskpool with '%d' threads...", threadCount);
+
+        auto taskpool = veil::vtl1::taskpool(threadCount, true);
+
+        constexpr uint32_t c_elementCount = 1000;
+        auto values = std::vector<uint32_t>(c_elementCount);
+
+        // Fill, square and sum the values, each with one call instead of a task per element
+        veil::vtl1::parallel_for(taskpool, 0, values.size(), [&] (size_t i)
+        {
+            values[i] = static_cast<uint32_t>(i);
+        });
+
+        auto squares = veil::vtl1::parallel_transform(taskpool, values, [] (uint32_t value)
+        {
+            return static_cast<uint64_t>(value) * value;
+        }, {veil::vtl1::parallel_chunking::static_chunks});
+
+        auto sum = veil::vtl1::parallel_reduce(taskpool, squares, uint64_t {0}, std::plus<>{});
+
+        // 0^2 + 1^2 + ... + 999^2
+        if (sum != 332833500)
+        {
+            debug_print(L"ERROR: Parallel algorithms returned the wrong results.");
+        }
+        else
+        {
+            debug_print(L"SUCCESS: Parallel algorithms processed '%d' elements.", c_elementCount);
+        }
+    }
+
+    void Test_DelayedTasks(uint32_t threadCount)
+    {
+        using namespace veil::vtl1::vtl0_functions;
+
+        debug_print(L"Creating taskpool with '%d' threads...", threadCount);
+
+        auto taskpool = veil::vtl1::taskpool(threadCount, true);
+
+        // The delays run down in VTL0, no enclave thread is held until the tasks are due
+        auto later = taskpool.queue_task_after(std::chrono::milliseconds(200), [] ()
+        {
+            return 2;
+        });
+        auto sooner = taskpool.queue_task_after(std::chrono::milliseconds(100), [] ()
+        {
+            return 1;
+        });
+
+        std::atomic<uint32_t> runCount = 0;
+        {
+            auto periodic = taskpool.queue_periodic(std::chrono::milliseconds(50), [&runCount] ()
+            {
+                runCount++;
+            });
+
+            veil::vtl1::sleep(500);
+        }
+
+        if (sooner.get() != 1 || later.get() != 2 || runCount == 0)
+        {
+            debug_print(L"ERROR: Delayed tasks didn't run.");
+        }
+        else
+        {
+            debug_print(L"SUCCESS: Delayed tasks ran, and the periodic task ran '%d' times.", runCount.load());
+        }
+    }
+
+    void Test_Priorities(uint32_t /*threadCount*/)
+    {
+        using namespace veil::vtl1::vtl0_functions;
+
+        // A single thread, so the order tasks are taken in is the order they run in
+        debug_print(L"Creating taskpool with '%d' threads...", 1);
+
+        auto taskpool = veil::vtl1::taskpool(1, true);
+
+        // Keep the thread busy while the other tasks are queued
+        auto busy = taskpool.queue_task([] ()
+        {
+            veil::vtl1::sleep(200);
+        });
+
+        std::atomic<uint32_t> sequence = 0;
+        auto low = taskpool.queue_task(veil::vtl1::task_priority::low, [&sequence] ()
+        {
+            return sequence++;
+        });
+        auto high = taskpool.queue_task(veil::vtl1::task_priority::high, [&sequence] ()
+        {
+            return sequence++;
+        });
+
+        busy.get();
+        auto lowPosition = low.get();
+        auto highPosition = high.get();
+
+        if (highPosition > lowPosition)
+        {
+            debug_print(L"ERROR: Low priority task ran before the high priority task.");
+        }
+        else
+        {
+            debug_print(L"SUCCESS: High priority task ran first.");
+        }
+    }
+
+    void Test_PriorityAging(uint32_t threadCount)
+    {
+        using namespace veil::vtl1::vtl0_functions;
+
+        // At least two threads, so tasks get stolen from other threads' deques
+        auto poolThreadCount = std::max(threadCount, 2U);
+        debug_print(L"Creating taskpool with '%d' threads...", poolThreadCount);
+
+        auto taskpool = veil::vtl1::taskpool(poolThreadCount, true);
+
+        constexpr uint32_t c_lowTaskCount = 8;
+        std::atomic<uint32_t> lowRunCount = 0;
+        std::vector<veil::vtl1::future<void>> lowTasks;
+        for (uint32_t i = 0; i < c_lowTaskCount; i++)
+        {
+            lowTasks.push_back(taskpool.queue_task(veil::vtl1::task_priority::low, [&lowRunCount] ()
+            {
+                lowRunCount++;
+            }));
+        }
+
+        // Keep every thread busy with high priority tasks, whichever deque they land on, until the low
+        // priority tasks have run. Aging must let them through while the high priority load continues.
+        constexpr uint32_t c_maxHighTaskCount = 5000;
+        uint32_t highTaskCount = 0;
+        std::deque<veil::vtl1::future<void>> highTasks;
+        while (lowRunCount < c_lowTaskCount && highTaskCount < c_maxHighTaskCount)
+        {
+            while (highTasks.size() < poolThreadCount * 4)
+            {
+                highTasks.push_back(taskpool.queue_task(veil::vtl1::task_priority::high, [] ()
+                {
+                    veil::vtl1::sleep(1);
+                }));
+                highTaskCount++;
+            }
+
+            highTasks.front().get();
+            highTasks.pop_front();
+        }
+
+        auto lowRunDuringLoad = lowRunCount.load();
+
+        for (auto& highTask : highTasks)
+        {
+            highTask.get();
+        }
+
+        for (auto& lowTask : lowTasks)
+        {
+            lowTask.get();
+        }
+
+        if (lowRunDuringLoad < c_lowTaskCount)
+        {
+            debug_print(L"ERROR: Only '%d' of '%d' low priority tasks ran during '%d' high priority tasks.", lowRunDuringLoad, c_lowTaskCount, highTaskCount);
+        }
+        else
+        {
+            debug_print(L"SUCCESS: Low priority tasks ran while '%d' high priority tasks were queued.", highTaskCount);
+        }
+    }
+
+    void Test_AdaptiveThreadCount(uint32_t threadCount)
+    {
+        using namespace veil::vtl1::vtl0_functions;
+
+        debug_print(L"Creating taskpool with '1' to '%d' threads...", threadCount);
+
+        auto taskpool = veil::vtl1::taskpool(veil::vtl1::taskpool_thread_limits {.minThreadCount = 1, .maxThreadCount = threadCount});
+
+        // A burst of long tasks, threads are added once tasks have waited for a free one
+        std::atomic<uint32_t> running = 0;
+        std::atomic<uint32_t> maxRunning = 0;
+        auto tasks = std::vector<veil::vtl1::future<void>> {};
+        for (uint32_t i = 0; i < threadCount; i++)
+        {
+            tasks.push_back(taskpool.queue_task([&running, &maxRunning] ()
+            {
+                auto nowRunning = ++running;
+                auto previousMax = maxRunning.load();
+                while (nowRunning > previousMax && !maxRunning.compare_exchange_weak(previousMax, nowRunning))
+                {
+                }
+
+                veil::vtl1::sleep(200);
+                running--;
+            }));
+        }
+
+        for (auto& task : tasks)
+        {
+            task.get();
+        }
+
+        if (threadCount > 1 && maxRunning < 2)
+        {
+            debug_print(L"ERROR: Taskpool didn't add threads for the burst.");
+        }
+        else
+        {
+            debug_print(L"SUCCESS: Taskpool ran up to '%d' tasks at once.", maxRunning.load());
+        }
+    }
+
+    void Test_TaskGraph(uint32_t threadCount)
+    {
+        using namespace veil::vtl1::vtl0_functions;
+
+        debug_print(L"Creating taskpool with '%d' threads...", threadCount);
+
+        auto taskpool = veil::vtl1::taskpool(threadCount, true);
+
+        // derive key -> transform every record -> sum, without a task blocking on another task's future
+        constexpr uint32_t c_recordCount = 16;
+        auto key = uint64_t {};
+        auto records = std::vector<uint64_t>(c_recordCount);
+        auto sum = uint64_t {};
+
+        auto graph = veil::vtl1::task_graph {};
+        auto deriveKey = graph.add_node([&key] ()
+        {
+            key = 7;
+        });
+
+        auto transforms = std::vector<veil::vtl1::task_graph::node_id> {};
+        for (uint32_t i = 0; i < c_recordCount; i++)
+        {
+            transforms.push_back(graph.add_node([&key, &records, i] ()
+            {
+                records[i] = key * i;
+            }, {deriveKey}));
+        }
+
+        graph.add_node([&records, &sum] ()
+        {
+            sum = std::accumulate(records.begin(), records.end(), uint64_t {0});
+        }, transforms);
+
+        // The graph is built once and run as many times as needed
+        constexpr uint32_t c_runCount = 3;
+        auto allCorrect = true;
+        for (uint32_t run = 0; run < c_runCount; run++)
+        {
+            sum = 0;
+            graph.run(taskpool).get();
+            allCorrect = allCorrect && sum == 7 * (c_recordCount * (c_recordCount - 1) / 2);
+        }
+
+        if (!allCorrect)
+        {
+            debug_print(L"ERROR: Task graph produced a wrong result.");
+        }
+        else
+        {
+            debug_print(L"SUCCESS: Task graph of '%d' nodes ran '%d' times.", static_cast<uint32_t>(graph.size()), c_runCount);
+        }
+    }
+
+    void Test_BinaryLog(uint32_t threadCount)
+    {
+        using namespace veil::vtl1::vtl0_functions;
+
+        debug_print(L"Creating taskpool with '%d' threads...", threadCount);
+
+        auto taskpool = veil::vtl1::taskpool(threadCount, true);
+
+        // An empty path sends the records to the host's console, where they're formatted
+        auto log = veil::vtl1::logger::binary_log {L""};
+
+        constexpr uint32_t c_taskCount = 8;
+        auto tasks = std::vector<veil::vtl1::future<void>>();
+        for (uint32_t i = 0; i < c_taskCount; i++)
+        {
+            tasks.push_back(taskpool.queue_task([&log, i] ()
+            {
+                log.log(L"Binary log record from task %u, %ls, hr=0x%08X", i, L"formatted in VTL0", S_OK);
+            }));
+        }
+        for (auto& task : tasks)
+        {
+            task.get();
+        }
+        log.flush();
+
+        auto stats = log.stats();
+        if (stats.flushedCount != c_taskCount || stats.droppedCount != 0)
+        {
+            debug_print(L"ERROR: Binary log flushed '%llu' records and dropped '%llu'.", stats.flushedCount, stats.droppedCount);
+        }
+        else
+        {
+            debug_print(L"SUCCESS: Binary log flushed '%llu' records in '%llu' batches.", stats.flushedCount, stats.batchCount);
+        }
+    }
+
+    void Test_Channel(uint32_t threadCount)
+    {
+        using namespace veil::vtl1::vtl0_functions;
+
+        debug_print(L"Creating taskpool with '%d' threads...", threadCount);
+
+        auto taskpool = veil::vtl1::taskpool(threadCount, true);
+
+        // A producer task streams values to the calling thread through a small channel, so it
+        // blocks whenever it gets too far ahead
+        constexpr uint32_t c_valueCount = 1000;
+        auto values = std::make_shared<veil::vtl1::channel<uint32_t>>(16);
+
+        auto producer = taskpool.queue_task([values] ()
+        {
+            for (uint32_t i = 0; i < c_valueCount; i++)
+            {
+                values->send(i);
+            }
+            values->close();
+        });
+
+        auto sum = uint64_t {};
+        auto count = uint32_t {};
+        while (auto value = values->receive())
+        {
+            sum += *value;
+            count++;
+        }
+        producer.get();
+
+        if (count != c_valueCount || sum != static_cast<uint64_t>(c_valueCount) * (c_valueCount - 1) / 2)
+        {
+            debug_print(L"ERROR: Channel lost or duplicated values.");
+        }
+        else
+        {
+            debug_print(L"SUCCESS: Channel delivered '%d' values.", count);
+        }
+    }
+
+    void Test_Telemetry(uint32_t threadCount)
+    {
+        using namespace veil::vtl1::vtl0_functions;
+
+        debug_print(L"Creating taskpool with '%d' threads and telemetry...", threadCount);
+
+        auto taskpool = veil::vtl1::taskpool(threadCount);
+        taskpool.enable_telemetry();
+
+        // More tasks than threads, so some have to wait in the queue
+        auto tasks = std::vector<veil::vtl1::future<void>> {};
+        for (uint32_t i = 0; i < threadCount * 4; i++)
+        {
+            tasks.push_back(taskpool.queue_task([] ()
+            {
+                veil::vtl1::sleep(5);
+            }));
+        }
+
+        for (auto& task : tasks)
+        {
+            task.get();
+        }
+
+        auto telemetry = taskpool.telemetry();
+        debug_print(L"Queue wait: mean %llu us, p99 under %llu us", telemetry.queueWait.mean_microseconds(), telemetry.queueWait.percentile_microseconds(99));
+        debug_print(L"Run time: mean %llu us, max %llu us", telemetry.runTime.mean_microseconds(), telemetry.runTime.maxMicroseconds);
+        debug_print(L"Max queue depth: %llu, max active threads: %llu", telemetry.maxQueueDepth[1], telemetry.maxActiveThreadCount);
+
+        // A task's run time is recorded just after its future completes, its queue wait before it starts
+        if (telemetry.queueWait.count != tasks.size())
+        {
+            debug_print(L"ERROR: Telemetry didn't record every task.");
+        }
+        else
+        {
+            debug_print(L"SUCCESS: Telemetry recorded '%llu' tasks.", telemetry.queueWait.count);
+        }
+    }
+
     void UsageExample(uint32_t threadCount)
     {
         using namespace veil::vtl1::vtl0_functions;
@@ -253,6 +805,139 @@ namespace RunTaskpoolExamples
     }
 }
 
+namespace RunObjectTableBenchmarks
+{
+    // Resolves weak_object_table entries from many enclave threads at once, which is the lookup every
+    // taskpool_run_task call-in makes to find its taskpool.
+    void ResolutionThroughput(uint32_t threadCount)
+    {
+        using namespace veil::vtl1::vtl0_functions;
+
+        constexpr uint32_t c_entryCount = 64;
+        constexpr uint32_t c_resolutionsPerThread = 1'000'000;
+
+        auto table = veil::vtl1::weak_object_table<uint32_t>();
+        auto objects = std::vector<std::shared_ptr<uint32_t>>();
+        auto ids = std::vector<uint64_t>();
+        for (uint32_t i = 0; i < c_entryCount; i++)
+        {
+            objects.push_back(std::make_shared<uint32_t>(i));
+            ids.push_back(table.store(objects.back()));
+        }
+
+        // 1, 2, 4, ... threads, finishing with threadCount
+        auto workerCounts = std::vector<uint32_t>();
+        for (uint32_t workers = 1; workers < threadCount; workers *= 2)
+        {
+            workerCounts.push_back(workers);
+        }
+        workerCounts.push_back(threadCount);
+
+        LARGE_INTEGER frequency;
+        THROW_IF_WIN32_BOOL_FALSE(QueryPerformanceFrequency(&frequency));
+
+        for (auto workers : workerCounts)
+        {
+            // Workers stay in the enclave, so only the lookups are measured
+            auto taskpool = veil::vtl1::taskpool(workers, true, veil::vtl1::taskpool_dispatch::enclave_worker_loop);
+            auto tasks = std::vector<veil::vtl1::future<void>>();
+
+            LARGE_INTEGER start;
+            THROW_IF_WIN32_BOOL_FALSE(QueryPerformanceCounter(&start));
+
+            for (uint32_t i = 0; i < workers; i++)
+            {
+                tasks.push_back(taskpool.queue_task([&table, &ids, i] ()
+                {
+                    for (uint32_t r = 0; r < c_resolutionsPerThread; r++)
+                    {
+                        auto strong = table.resolve_strong_reference(ids[(r + i) % c_entryCount]);
+                        THROW_HR_IF(E_UNEXPECTED, !strong);
+                    }
+                }));
+            }
+
+            for (auto& task : tasks)
+            {
+                task.get();
+            }
+
+            LARGE_INTEGER end;
+            THROW_IF_WIN32_BOOL_FALSE(QueryPerformanceCounter(&end));
+
+            auto seconds = static_cast<double>(end.QuadPart - start.QuadPart) / frequency.QuadPart;
+            auto resolutions = static_cast<double>(workers) * c_resolutionsPerThread;
+            debug_print(L"%.0f thread(s): %.0f resolutions/sec, %.1f ns per resolution per thread",
+                static_cast<double>(workers),
+                resolutions / seconds,
+                seconds * 1e9 / c_resolutionsPerThread);
+        }
+    }
+}
+
+namespace RunTaskpoolBenchmarks
+{
+    // Queues and waits for small tasks (with a typical capture), reporting per task once the taskpool has
+    // warmed up the task records taken from the enclave heap rather than reused from the taskpool's pool, and
+    // the callouts made to schedule tasks in VTL0 (whose argument marshalling allocates from the enclave heap).
+    // Both are counted where they happen, see taskpool_telemetry.
+    void AllocationsPerTask(uint32_t threadCount)
+    {
+        using namespace veil::vtl1::vtl0_functions;
+
+        constexpr uint32_t c_warmupTaskCount = 1'000;
+        constexpr uint32_t c_taskCount = 100'000;
+
+        for (auto dispatch : {veil::vtl1::taskpool_dispatch::per_task_call, veil::vtl1::taskpool_dispatch::enclave_worker_loop})
+        {
+            auto taskpool = veil::vtl1::taskpool(threadCount, true, dispatch);
+            auto capture = std::array<uint64_t, 4> {1, 2, 3, 4};
+
+            for (uint32_t i = 0; i < c_warmupTaskCount; i++)
+            {
+                taskpool.queue_task([capture, i] () { return capture[0] + i; }).get();
+            }
+
+            auto before = taskpool.telemetry();
+
+            uint64_t sum = 0;
+            for (uint32_t i = 0; i < c_taskCount; i++)
+            {
+                sum += taskpool.queue_task([capture, i] () { return capture[1] + i; }).get();
+            }
+
+            auto after = taskpool.telemetry();
+            auto taskRecords = after.taskHeapAllocationCount - before.taskHeapAllocationCount;
+            auto callouts = after.scheduleCalloutCount - before.scheduleCalloutCount;
+            auto format = dispatch == veil::vtl1::taskpool_dispatch::per_task_call ?
+                L"per_task_call: %.3f task records from the heap per task, %.3f schedule callouts per task (checksum %.0f)" :
+                L"enclave_worker_loop: %.3f task records from the heap per task, %.3f schedule callouts per task (checksum %.0f)";
+            debug_print(format,
+                static_cast<double>(taskRecords) / c_taskCount,
+                static_cast<double>(callouts) / c_taskCount,
+                static_cast<double>(sum));
+        }
+    }
+}
+
+//
+// Taskpool benchmarks
+//
+HRESULT VbsEnclave::Trusted::Implementation::RunTaskpoolBenchmarks(_In_ const std::uint32_t threadCount)
+{
+    using namespace veil::vtl1::vtl0_functions;
+
+    debug_print(L"BENCHMARK: weak_object_table resolve_strong_reference throughput");
+    RunObjectTableBenchmarks::ResolutionThroughput(threadCount);
+    debug_print(L"");
+
+    debug_print(L"BENCHMARK: taskpool queue_task allocations");
+    RunTaskpoolBenchmarks::AllocationsPerTask(threadCount);
+    debug_print(L"");
+
+    return S_OK;
+}
+
 //
 // Taskpool
 //
@@ -272,6 +957,54 @@ HRESULT VbsEnclave::Trusted::Implementation::RunTaskpoolExample(_In_ const std::
     RunTaskpoolExamples::Test_Cancellation(threadCount);
     debug_print(L"");
 
+    debug_print(L"TEST: Taskpool enclave worker loop");
+    RunTaskpoolExamples::Test_EnclaveWorkerLoop(threadCount);
+    debug_print(L"");
+
+    debug_print(L"TEST: Taskpool continuations");
+    RunTaskpoolExamples::Test_Continuations(threadCount);
+    debug_print(L"");
+
+    debug_print(L"TEST: Taskpool coroutines");
+    RunTaskpoolExamples::Test_Coroutines(threadCount);
+    debug_print(L"");
+
+    debug_print(L"TEST: Taskpool parallel algorithms");
+    RunTaskpoolExamples::Test_ParallelAlgorithms(threadCount);
+    debug_print(L"");
+
+    debug_print(L"TEST: Taskpool delayed and periodic tasks");
+    RunTaskpoolExamples::Test_DelayedTasks(threadCount);
+    debug_print(L"");
+
+    debug_print(L"TEST: Taskpool priorities");
+    RunTaskpoolExamples::Test_Priorities(threadCount);
+    debug_print(L"");
+
+    debug_print(L"TEST: Taskpool priority aging under load");
+    RunTaskpoolExamples::Test_PriorityAging(threadCount);
+    debug_print(L"");
+
+    debug_print(L"TEST: Taskpool adaptive thread count");
+    RunTaskpoolExamples::Test_AdaptiveThreadCount(threadCount);
+    debug_print(L"");
+
+    debug_print(L"TEST: Task graph");
+    RunTaskpoolExamples::Test_TaskGraph(threadCount);
+    debug_print(L"");
+
+    debug_print(L"TEST: Channel");
+    RunTaskpoolExamples::Test_Channel(threadCount);
+    debug_print(L"");
+
+    debug_print(L"TEST: Binary log");
+    RunTaskpoolExamples::Test_BinaryLog(threadCount);
+    debug_print(L"");
+
+    debug_print(L"TEST: Taskpool telemetry");
+    RunTaskpoolExamples::Test_Telemetry(threadCount);
+    debug_print(L"");
+
     debug_print(L"USAGE");
     RunTaskpoolExamples::UsageExample(threadCount);
     debug_print(L"");
@@ -292,7 +1025,10 @@ HRESULT VbsEnclave::Trusted::Implementation::RunEncryptionKeyExample_CreateEncry
     
     auto activityLevel = (veil::any::logger::eventLevel)activity_level;
 
-    veil::vtl1::logger::add_log_from_enclave(
+    // Collect this flow's logs and send them to the host together, instead of a callout per log
+    auto logs = veil::vtl1::logger::log_buffer {};
+
+    logs.add_log(
         L"[Enclave] In RunEncryptionKeyExample_CreateEncryptionKeyImpl", 
         veil::any::logger::eventLevel::EVENT_LEVEL_CRITICAL,
         activityLevel,
@@ -301,7 +1037,7 @@ HRESULT VbsEnclave::Trusted::Implementation::RunEncryptionKeyExample_CreateEncry
     debug_print("");
     debug_print(L"[Create flow]");
     debug_print("");
-    veil::vtl1::logger::add_log_from_enclave(
+    logs.add_log(
         L"[Enclave] Create flow", 
         veil::any::logger::eventLevel::EVENT_LEVEL_VERBOSE,
         activityLevel,
@@ -311,7 +1047,7 @@ HRESULT VbsEnclave::Trusted::Implementation::RunEncryptionKeyExample_CreateEncry
 
     // Generate our encryption key
     debug_print(L"1. Generating our encryption key");
-    veil::vtl1::logger::add_log_from_enclave(
+    logs.add_log(
         L"[Enclave] Generating our encryption key",
         veil::any::logger::eventLevel::EVENT_LEVEL_INFO,
         activityLevel,
@@ -319,7 +1055,7 @@ HRESULT VbsEnclave::Trusted::Implementation::RunEncryptionKeyExample_CreateEncry
     auto encryptionKeyBytes = veil::vtl1::crypto::generate_symmetric_key_bytes();
     debug_print(L" ...CHECKPOINT: encryption key byte count: %d", encryptionKeyBytes.size());
     std::wstring logSizeStr = std::to_wstring(encryptionKeyBytes.size());
-    veil::vtl1::logger::add_log_from_enclave(
+    logs.add_log(
         L"[Enclave] Encryption key byte count: " + logSizeStr,
         veil::any::logger::eventLevel::EVENT_LEVEL_CRITICAL,
         activityLevel,
@@ -328,7 +1064,7 @@ HRESULT VbsEnclave::Trusted::Implementation::RunEncryptionKeyExample_CreateEncry
     
     // Seal it so only our enclave may open it
     debug_print(L"4. Sealing the serialized key material for our enclave only");
-    veil::vtl1::logger::add_log_from_enclave(
+    logs.add_log(
         L"[Enclave] Sealing the serialized key material for our enclave only",
         veil::any::logger::eventLevel::EVENT_LEVEL_INFO,
         activityLevel,
@@ -336,7 +1072,7 @@ HRESULT VbsEnclave::Trusted::Implementation::RunEncryptionKeyExample_CreateEncry
     auto sealedKeyMaterial = veil::vtl1::crypto::seal_data(encryptionKeyBytes, ENCLAVE_IDENTITY_POLICY_SEAL_SAME_IMAGE, ENCLAVE_RUNTIME_POLICY_ALLOW_FULL_DEBUG);
     debug_print(L" ...CHECKPOINT: sealed key material byte count: %d", sealedKeyMaterial.size());
     logSizeStr = std::to_wstring(sealedKeyMaterial.size());
-    veil::vtl1::logger::add_log_from_enclave(
+    logs.add_log(
         L"[Enclave] Sealed key material byte count: " + logSizeStr,
         veil::any::logger::eventLevel::EVENT_LEVEL_CRITICAL,
         activityLevel,
@@ -349,6 +1085,8 @@ HRESULT VbsEnclave::Trusted::Implementation::RunEncryptionKeyExample_CreateEncry
     // Return the secured encryption key to vtl0 host caller...
     securedEncryptionKeyBytes.assign(sealedKeyMaterial.begin(), sealedKeyMaterial.end());
 
+    logs.flush();
+
     return S_OK;
 }
 
@@ -6,6 +6,8 @@
 #include <CmdlineArgumentsParser.h>
 #include <Edl\Parser.h>
 #include <CodeGeneration\CodeGeneration.h>
+#include <CodeGeneration\GenerationManifest.h>
+#include <BatchCodeGeneration.h>
 #include <wil\result_macros.h>
 
 using namespace EdlProcessor;
@@ -33,7 +35,35 @@ int main(int argc, char* argv[])
 
     try
     {
-        auto edl_parser = EdlParser(argument_parser.EdlFilePath(), argument_parser.ImportDirectories());
+        if (argument_parser.IsBatchMode())
+        {
+            return BatchCodeGenerator(argument_parser.BatchFile(), argument_parser.ParseCacheDirectory()).Run();
+        }
+
+        auto manifest = GenerationManifest(
+            GetGenerationManifestPath(
+                argument_parser.OutDirectory(),
+                argument_parser.VirtualTrustLayer(),
+                argument_parser.EdlFilePath()),
+            CreateOptionsFingerprint(argument_parser));
+
+        if (manifest.IsUpToDate())
+        {
+            PrintStatus(Status::Info, std::format(
+                "Generated files for {} are up to date, skipping code generation",
+                argument_parser.EdlFilePath().filename().generic_string()));
+
+            return S_OK;
+        }
+
+        std::shared_ptr<EdlParseCache> parse_cache {};
+
+        if (!argument_parser.ParseCacheDirectory().empty())
+        {
+            parse_cache = std::make_shared<EdlParseCache>(argument_parser.ParseCacheDirectory());
+        }
+
+        auto edl_parser = EdlParser(argument_parser.EdlFilePath(), argument_parser.ImportDirectories(), parse_cache);
         Edl edl = edl_parser.Parse();
 
         auto cpp_code_generator = CppCodeGenerator(
@@ -46,6 +76,7 @@ int main(int argc, char* argv[])
             argument_parser.FlatbufferCompiler());
 
         cpp_code_generator.Generate();
+        manifest.Save(edl_parser.ParsedFiles(), cpp_code_generator.GeneratedFiles());
     }
     catch (const std::exception& exception)
     {
@@ -0,0 +1,69 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+#include <pch.h>
+#include <CmdlineArgumentsParser.h>
+#include <CodeGeneration\GenerationManifest.h>
+#include <Edl\Parser.h>
+#include <chrono>
+
+using namespace CmdlineParsingHelpers;
+using namespace EdlProcessor;
+
+namespace CodeGeneration
+{
+    enum class BatchJobStatus
+    {
+        Pending,
+        UpToDate,
+        Generated,
+        Failed,
+    };
+
+    struct BatchJob
+    {
+        BatchJob(std::uint32_t line_number, CmdlineArgumentsParser&& arguments);
+
+        std::uint32_t m_line_number {};
+        CmdlineArgumentsParser m_arguments;
+        GenerationManifest m_manifest;
+        Edl m_edl {};
+        std::vector<std::filesystem::path> m_parsed_files {};
+        std::shared_ptr<EdlParseCache> m_parse_cache {};
+        BatchJobStatus m_status {BatchJobStatus::Pending};
+    };
+
+    // Processes every job listed in a batch file within a single edlcodegen run. Each line of the
+    // batch file contains the commandline arguments for one job. The .edl files for all jobs are
+    // parsed first using a shared EdlParseCache, so an .edl file used by multiple jobs (e.g once for the
+    // HostApp and once for the Enclave) or imported by multiple .edl files is only parsed once. Code
+    // is then generated for the jobs in parallel, so every job must generate into its own output
+    // directory and VTL. A summary with the time spent in each phase is printed once all jobs
+    // complete. When a parse cache directory is provided, parsed .edl files are also shared with
+    // later edlcodegen runs through it. A job that sets its own parse cache directory uses a cache
+    // for that directory instead, shared with the other jobs that set the same one.
+    class BatchCodeGenerator
+    {
+    public:
+        BatchCodeGenerator(
+            const std::filesystem::path& batch_file_path,
+            const std::filesystem::path& parse_cache_directory = {});
+
+        HRESULT Run();
+
+    private:
+        bool ReadJobs();
+        bool ValidateJobOutputDirectory(const BatchJob& job) const;
+        std::shared_ptr<EdlParseCache> GetJobParseCache(const BatchJob& job);
+        void ParseJob(BatchJob& job);
+        void GenerateJob(BatchJob& job);
+        void FailJob(BatchJob& job, std::string_view error_message);
+        void PrintSummary(std::chrono::steady_clock::duration elapsed_time) const;
+
+        std::filesystem::path m_batch_file_path {};
+        std::vector<BatchJob> m_jobs {};
+        std::shared_ptr<EdlParseCache> m_parse_cache {};
+        std::map<std::filesystem::path, std::shared_ptr<EdlParseCache>> m_job_parse_caches {};
+    };
+}
@@ -35,6 +35,12 @@ namespace CmdlineParsingHelpers
 
         std::vector<std::filesystem::path> ImportDirectories() const { return m_import_directories; }
 
+        std::filesystem::path BatchFile() const { return m_batch_file_path; }
+
+        bool IsBatchMode() const { return !m_batch_file_path.empty(); }
+
+        std::filesystem::path ParseCacheDirectory() const { return m_parse_cache_directory; }
+
     private:
 
         bool ParseArguments(int argc, char* argv[]);
@@ -51,5 +57,7 @@ namespace CmdlineParsingHelpers
         SupportedLanguageKind m_supported_language = SupportedLanguageKind::Unknown;
         const uint32_t m_required_args = 4;
         std::vector<std::filesystem::path> m_import_directories;
+        std::filesystem::path m_batch_file_path {};
+        std::filesystem::path m_parse_cache_directory {};
     };
 }
@@ -37,6 +37,16 @@ namespace CmdlineParsingHelpers
             << "  --Vtl0ClassName <name_of_class>                      name of the vtl0 class that will be generated for use by the hostapp. (By default this is the name of the .edl file with the word 'Wrapper' appended to it).\n"
             << "  --Namespace <name_of_class>                          name of the namespace that all generated code will be encapsulated in. (By default this is the name of the .edl file).\n"
             << "  --FlatbuffersCompilerPath <absolute_path_to_file>    Absolute path to the flatbuffer compiler for the language provided in '--Language'. (By default this is the current directory.). The executable must be called flatc.exe and must be an official version of the flatbuffer compiler. \n"
+            << "\n"
+            << "Batch mode:\n"
+            << "  --BatchFile <filePath>                               Path to a response file where each line contains the arguments above for a single job. Every job in the file is\n"
+            << "                                                       processed in a single run. Each .edl file is only parsed once and code is generated for the jobs in parallel.\n"
+            << "                                                       Empty lines and lines starting with '#' are ignored.\n"
+            << "\n"
+            << "Caching:\n"
+            << "  --ParseCacheDirectory <DirectoryPath>                Directory where parsed .edl files are cached between runs, so .edl files that are imported by many .edl files\n"
+            << "                                                       are only parsed once. Can be combined with '--BatchFile', and a job in the batch file can set its own\n"
+            << "                                                       directory. (By default parsed .edl files are not cached on disk).\n"
             << std::endl;
     }
 
@@ -235,6 +245,86 @@ namespace CmdlineParsingHelpers
         return str.substr(first, (last - first + 1));
     }
 
+    static ErrorId inline GetBatchFilePathFromArgs(
+        std::uint32_t index,
+        char* args[],
+        std::uint32_t args_size,
+        std::filesystem::path& batch_file_path)
+    {
+        batch_file_path = "";
+        if (index >= args_size)
+        {
+            PRINT_AND_RETURN_ERROR(ErrorId::BatchFileNoMoreArgs);
+        }
+
+        std::filesystem::path item_path(args[index]);
+
+        if (!std::filesystem::is_regular_file(item_path))
+        {
+            PRINT_AND_RETURN_ERROR(ErrorId::BatchFileDoesNotExist, item_path.generic_string());
+        }
+
+        batch_file_path = std::move(item_path);
+        return ErrorId::Success;
+    }
+
+    static ErrorId inline GetParseCacheDirectoryFromArgs(
+        std::uint32_t index,
+        char* args[],
+        std::uint32_t args_size,
+        std::filesystem::path& parse_cache_directory)
+    {
+        parse_cache_directory = "";
+        if (index >= args_size)
+        {
+            PRINT_AND_RETURN_ERROR(ErrorId::ParseCacheDirectoryNoMoreArgs);
+        }
+
+        // The directory is created when the first parsed .edl file is cached.
+        parse_cache_directory = args[index];
+        return ErrorId::Success;
+    }
+
+    // Splits a line of commandline arguments on whitespace. Arguments wrapped in double
+    // quotes may contain whitespace, the quotes themselves are removed.
+    static inline std::vector<std::string> SplitCommandLine(std::string_view line)
+    {
+        std::vector<std::string> arguments;
+        std::string argument;
+        bool in_quotes = false;
+        bool has_argument = false;
+
+        for (char character : line)
+        {
+            if (character == '"')
+            {
+                in_quotes = !in_quotes;
+                has_argument = true;
+            }
+            else if (!in_quotes && std::isspace(static_cast<unsigned char>(character)))
+            {
+                if (has_argument)
+                {
+                    arguments.push_back(std::move(argument));
+                    argument.clear();
+                    has_argument = false;
+                }
+            }
+            else
+            {
+                argument.push_back(character);
+                has_argument = true;
+            }
+        }
+
+        if (has_argument)
+        {
+            arguments.push_back(std::move(argument));
+        }
+
+        return arguments;
+    }
+
     static inline std::vector<std::string> Split(const std::string& s, char delim = ';')
     {
         std::vector<std::string> tokens;
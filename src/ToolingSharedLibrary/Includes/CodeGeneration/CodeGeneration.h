@@ -7,6 +7,7 @@
 #include <CmdlineParsingHelpers.h>
 #include <CmdlineArgumentsParser.h>
 #include "CodeGenerationHelpers.h"
+#include "GenerationManifest.h"
 #include <Utils\Helpers.h>
 
 using namespace CmdlineParsingHelpers;
@@ -155,6 +156,10 @@ namespace CodeGeneration
 
         void Generate();
 
+        // Every file written or left untouched by the last call to Generate(), along with
+        // the hash of its content.
+        std::span<const GeneratedFile> GeneratedFiles() const { return m_generated_files; }
+
         void SaveTrustedHeader(
             CppCodeBuilder::HeaderKind header_kind,
             const std::filesystem::path& output_parent_folder,
@@ -174,7 +179,8 @@ namespace CodeGeneration
 
     private:
 
-        void SaveFileToOutputFolder(
+        // Returns false when the file already existed with identical content and was not rewritten.
+        bool SaveFileToOutputFolder(
             std::string_view file_name,
             const std::filesystem::path& output_folder,
             std::string_view file_content);
@@ -189,5 +195,6 @@ namespace CodeGeneration
         VirtualTrustLayerKind m_virtual_trust_layer_kind{};
         std::filesystem::path m_output_folder_path {};
         std::filesystem::path m_flatbuffer_compiler_path {};
+        std::vector<GeneratedFile> m_generated_files {};
     };
 }
@@ -46,6 +46,8 @@ table {} {{
 
 static inline constexpr std::string_view c_flatbuffer_fbs_filename = "FlatbufferTypes.fbs";
 
+static inline constexpr std::string_view c_flatbuffer_header_filename = "FlatbufferTypes.h";
+
 static inline std::string c_failed_to_compile_flatbuffer_msg = std::format("Compiling flatbuffer schema file: {}", c_flatbuffer_fbs_filename);
 
 static inline std::string c_succeeded_compiling_flatbuffer_msg = std::format("Flatbuffer schema {} compiled successfully", c_flatbuffer_fbs_filename);
@@ -0,0 +1,61 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+#include <pch.h>
+#include <CmdlineParsingHelpers.h>
+#include <CmdlineArgumentsParser.h>
+#include <Utils\Helpers.h>
+
+using namespace CmdlineParsingHelpers;
+
+namespace CodeGeneration
+{
+    // The manifest is named after the .edl file ('<edl-stem>.edlcodegen.manifest') so .edl files generated
+    // into the same output directory don't overwrite each other's manifest.
+    static inline constexpr std::string_view c_generation_manifest_file_name = "{}.edlcodegen.manifest";
+
+    struct GeneratedFile
+    {
+        std::filesystem::path m_path {};
+        std::uint64_t m_content_hash {};
+    };
+
+    // The manifest records the content hashes of every .edl file that went into a previous
+    // run (the developers .edl file and its resolved import chain), a fingerprint of the commandline
+    // options, the generator version and the content hashes of every file that was generated.
+    // When none of those have changed, edlcodegen can skip parsing and code generation entirely,
+    // leaving the generated files and their timestamps untouched.
+    class GenerationManifest
+    {
+    public:
+        GenerationManifest(
+            const std::filesystem::path& manifest_path,
+            std::string_view options_fingerprint);
+
+        // Returns true if the manifest on disk matches the current generator version and options,
+        // every input file still has the same content and every output file still exists unmodified.
+        bool IsUpToDate() const;
+
+        // Writes the manifest for this run. Files listed in the previous manifest that were not
+        // generated by this run are deleted.
+        void Save(
+            std::span<const std::filesystem::path> input_files,
+            std::span<const GeneratedFile> output_files) const;
+
+        const std::filesystem::path& ManifestPath() const { return m_manifest_path; }
+
+    private:
+        void RemoveStaleOutputs(std::span<const GeneratedFile> output_files) const;
+
+        std::filesystem::path m_manifest_path {};
+        std::uint64_t m_options_hash {};
+    };
+
+    std::filesystem::path GetGenerationManifestPath(
+        const std::filesystem::path& output_directory,
+        VirtualTrustLayerKind trust_layer,
+        const std::filesystem::path& edl_file_path);
+
+    std::string CreateOptionsFingerprint(const CmdlineArgumentsParser& argument_parser);
+}
@@ -12,27 +12,99 @@
 
 namespace EdlProcessor
 {
+    // Read only view of the content of an .edl file. The file is memory mapped when the page
+    // containing the end of the file has room for the null character that terminates the content,
+    // since the system fills the rest of that page with zeros. Otherwise (e.g the file size is a
+    // multiple of the page size) the content is read into a buffer with a null character appended.
+    // Either way Content().data()[Content().size()] is always readable and always '\0'.
+    class EdlFileView
+    {
+    public:
+        EdlFileView() = default;
+
+        bool TryOpen(const std::filesystem::path& file_path, bool allow_memory_mapping = true);
+
+        std::string_view Content() const { return m_content; }
+
+        bool IsMemoryMapped() const { return m_is_memory_mapped; }
+
+    private:
+        // Either the mapped view or the buffer. Copies of the view share it, so pointers into
+        // the content stay valid for as long as any copy is alive.
+        std::shared_ptr<const char> m_data {};
+        std::string_view m_content {};
+        bool m_is_memory_mapped {};
+    };
+
+    // A token stored as offsets into the content of the file. Tokens are only turned into
+    // Token objects when the parser asks for them.
+    struct LexedToken
+    {
+        std::uint32_t m_offset {};
+        std::uint32_t m_length {};
+        std::uint32_t m_line_number {};
+        std::uint32_t m_column_number {};
+    };
+
+    enum class LexingMode
+    {
+        // The file is memory mapped when possible, and comments and long runs of whitespace
+        // are skipped 16 characters at a time.
+        Vectorized,
+
+        // The file is read into a buffer and skipped one character at a time. The tokens are
+        // the same as with Vectorized, which the tests and benchmarks compare it against.
+        Scalar,
+    };
+
     // Responsible for analyzing an edl file and breaking its 
-    // elements into individual tokens at runtime by walking
-    // through an in memory string of the file content
-    // character by character.
+    // elements into individual tokens. The whole file is tokenized
+    // into a compact array on the first call to GetNextToken. Comments
+    // and long runs of whitespace are skipped 16 characters at a time.
     class LexicalAnalyzer
     {
     public:
         LexicalAnalyzer() = default;
-        LexicalAnalyzer(const std::filesystem::path& file_path);
+        LexicalAnalyzer(const std::filesystem::path& file_path, LexingMode mode = LexingMode::Vectorized);
 
         Token GetNextToken();
+
+        // All tokens in the file, ending with the end of file token. Tokenizes the file if
+        // it hasn't been already.
+        std::span<const LexedToken> LexedTokens();
+
+        bool IsMemoryMapped() const { return m_file.IsMemoryMapped(); }
+
+        // Hash of the content that was tokenized. Tokenizes the file if it hasn't been already.
+        std::uint64_t ContentHash();
+
     private:
-        void SkipWhiteSpaceAndComments();
         void RetrieveAndStoreContentFromEdlFile();
+        void TokenizeContent();
+        LexedToken ReadNextToken();
+        void SkipWhiteSpaceAndComments();
+        void SkipWhiteSpace();
+        bool TrySkipWhiteSpaceCharacter();
+        void SkipSingleLineComment();
+        void SkipMultiLineComment();
+        Token CreateToken(const LexedToken& lexed_token) const;
+        LexedToken CreateLexedToken(const char* start, const char* end) const;
 
         std::filesystem::path m_file_path;
+        LexingMode m_mode {LexingMode::Vectorized};
         bool m_file_contents_loaded{};
-        std::string m_file {};
+        EdlFileView m_file {};
+        const char* m_content_start {};
         const char* m_null_character_position{};
         const char* m_cur_position_character {};
         std::uint32_t m_line_number {};
         std::uint32_t m_column_number {};
+        std::vector<LexedToken> m_tokens {};
+        size_t m_next_token_index {};
+        std::uint64_t m_content_hash {};
+
+        // Set when the file contains an invalid token. It is thrown once the parser asks for
+        // that token, so errors are reported in the same order as if the file was lexed lazily.
+        std::exception_ptr m_lexing_error {};
     };
 }
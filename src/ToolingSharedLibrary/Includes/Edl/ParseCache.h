@@ -0,0 +1,64 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+#include <pch.h>
+#include <mutex>
+#include "Structures.h"
+
+namespace EdlProcessor
+{
+    struct CachedEdl
+    {
+        Edl m_edl {};
+        std::vector<std::filesystem::path> m_files {};
+
+        // Hash of the content each file in m_files was parsed from, in the same order
+        std::vector<std::uint64_t> m_file_hashes {};
+    };
+
+    // Shares parsed .edl files between EdlParser instances, so an .edl file that is used by
+    // multiple jobs in the same edlcodegen run only needs to be parsed once. Entries are keyed
+    // by the path of the file and the import directories used to resolve its imports.
+    //
+    // When a cache directory is provided, entries are also persisted to it in a compact binary
+    // form, so common imports (e.g the sdk's .edl files) are only parsed once across edlcodegen
+    // runs and projects. A persisted entry is only used when it was written by the same build of
+    // edlcodegen and the content of every file it was parsed from is unchanged.
+    // The hashes are those of the content the parser read, so a file that changed after it
+    // was parsed doesn't get the stale result stored under its new content.
+    class EdlParseCache
+    {
+    public:
+        EdlParseCache() = default;
+
+        explicit EdlParseCache(const std::filesystem::path& cache_directory);
+
+        std::shared_ptr<const CachedEdl> Find(
+            const std::filesystem::path& file_path,
+            std::span<const std::filesystem::path> import_directories);
+
+        void Store(
+            const std::filesystem::path& file_path,
+            std::span<const std::filesystem::path> import_directories,
+            CachedEdl cached_edl);
+
+    private:
+        static std::string CreateKey(
+            const std::filesystem::path& file_path,
+            std::span<const std::filesystem::path> import_directories);
+
+        std::filesystem::path GetCacheFilePath(std::string_view key) const;
+        std::shared_ptr<const CachedEdl> TryLoadFromDisk(const std::string& key) const;
+        void TrySaveToDisk(const std::string& key, const CachedEdl& cached_edl) const;
+
+        std::filesystem::path m_cache_directory {};
+        std::mutex m_lock {};
+        std::unordered_map<std::string, std::shared_ptr<const CachedEdl>> m_entries {};
+    };
+
+    // Converts a parsed .edl file to and from the binary form used by the on disk parse cache.
+    std::string SerializeCachedEdl(const CachedEdl& cached_edl);
+
+    bool TryDeserializeCachedEdl(std::string_view data, CachedEdl& cached_edl);
+}
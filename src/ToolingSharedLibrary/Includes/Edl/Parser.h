@@ -11,6 +11,7 @@
 #include <ErrorHelpers.h>
 #include <unordered_set>
 #include "LexicalAnalyzer.h"
+#include "ParseCache.h"
 #include "Utils.h"
 #include <Utils\Helpers.h>
 
@@ -43,6 +44,16 @@ namespace EdlProcessor
     {
         ParseStatus m_status {ParseStatus::NotSeen};
         Edl m_edl{};
+
+        // The file along with every file it imported, directly or indirectly.
+        std::vector<std::filesystem::path> m_files {};
+
+        // Hash of the content the file was parsed from (or the cached entry it came from was).
+        std::uint64_t m_content_hash {};
+
+        // False when a duplicate import was skipped while parsing the file. The resulting
+        // Edl then depends on what was parsed before it, so it can't be reused elsewhere.
+        bool m_is_self_contained {true};
     };
 
     class EdlParser
@@ -50,12 +61,17 @@ namespace EdlProcessor
     public:
         EdlParser(
             const std::filesystem::path& file_path, 
-            std::vector<std::filesystem::path> import_directories);
+            std::vector<std::filesystem::path> import_directories,
+            std::shared_ptr<EdlParseCache> parse_cache = nullptr);
 
         ~EdlParser() = default;
 
         Edl Parse();
 
+        // The developers .edl file along with every .edl file it imported, directly or
+        // indirectly. Only populated after Parse() completes successfully.
+        std::span<const std::filesystem::path> ParsedFiles() const { return m_parsed_files; }
+
     private:
         void ParseInternal(std::unordered_map<std::filesystem::path, ParsedState>& parsed_files);
         void ParseEnum();
@@ -81,6 +97,13 @@ namespace EdlProcessor
         void ValidateNonSizeAndCountAttributes(const Declaration& declaration);
         void UpdateTypeDeclarations(std::span<Declaration> declarations);
         void MergeEdl(const Edl& src_edl, Edl& dest_edl);
+        bool TryUseCachedImport(
+            const std::filesystem::path& import_file_path,
+            std::unordered_map<std::filesystem::path, ParsedState>& parsed_files);
+        void StoreInParseCache(
+            const Edl& edl,
+            const std::vector<std::filesystem::path>& files,
+            const std::unordered_map<std::filesystem::path, ParsedState>& parsed_files);
 
         inline void ThrowIfExpectedTokenNotNext(const char* token_expected_next);
         inline void ThrowIfExpectedTokenNotNext(char token_expected_next);
@@ -120,5 +143,8 @@ namespace EdlProcessor
         std::unordered_set<std::string> m_unresolved_types{};
         Edl m_edl {};
         std::vector<std::filesystem::path> m_import_directories {};
+        std::vector<std::filesystem::path> m_parsed_files {};
+        std::shared_ptr<EdlParseCache> m_parse_cache {};
+        std::size_t m_declared_function_count {};
     };
 }
@@ -87,16 +87,49 @@ namespace EdlProcessor
             return IsEmpty() ? "" : std::string(m_starting_character, m_ending_character);
         }
 
+        // Views the text of the token without copying it, e.g for lookups in an OrderedMap.
+        std::string_view ToStringView() const
+        {
+            return IsEmpty() ? std::string_view {} : std::string_view(m_starting_character, m_ending_character);
+        }
+
         static Token CreateEmptyToken()
         {
             const char* str = "\0\0";
             return Token(0, 0, str, str + 1);
         }
 
+        // Tokens normally point into the content of the .edl file owned by the LexicalAnalyzer.
+        // Tokens that are stored in the Edl object outlive the LexicalAnalyzer, so they
+        // need to own a copy of their text.
+        static Token CreateOwnedToken(
+            std::uint32_t line_number,
+            std::uint32_t column_number,
+            std::string_view text)
+        {
+            if (text.empty())
+            {
+                return CreateEmptyToken();
+            }
+
+            auto owned_text = std::make_shared<const std::string>(text);
+            Token token(line_number, column_number, owned_text->c_str(), owned_text->c_str() + owned_text->size());
+            token.m_owned_text = std::move(owned_text);
+            return token;
+        }
+
+        Token CreateOwnedCopy() const
+        {
+            return IsEmpty() ? CreateEmptyToken() : CreateOwnedToken(m_line_number, m_column_number, ToString());
+        }
+
         std::uint32_t m_line_number{};
         std::uint32_t m_column_number{};
         const char* m_starting_character{};
         const char* m_ending_character{};
+
+    private:
+        std::shared_ptr<const std::string> m_owned_text {};
     };
 
     enum class AttributeKind : std::uint32_t
@@ -504,6 +537,10 @@ namespace EdlProcessor
 
         std::string m_name{};
         std::string abi_m_name {};
+
+        // Position of the function among the functions declared by the .edl file and its imports,
+        // in the order they were parsed. The abi names are numbered in this order.
+        std::size_t m_declared_position {};
         Declaration m_return_info {DeclarationParentKind::Function};
         std::vector<Declaration> m_parameters{};
         std::filesystem::path m_parent_file{};
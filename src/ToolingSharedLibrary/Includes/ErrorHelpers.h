@@ -4,6 +4,7 @@
 #pragma once
 #include <pch.h>
 #include <winerror.h>
+#include <mutex>
 
 namespace ErrorHelpers
 {
@@ -86,6 +87,14 @@ namespace ErrorHelpers
         ImportDirectoryDoesNotExist,
         ImportedEdlFileDoesNotExist,
         ImportCycleFound,
+        BatchFileNoMoreArgs,
+        BatchFileDoesNotExist,
+        BatchFileHasNoJobs,
+        BatchFileCombinedWithOtherArgs,
+        BatchFileJobInvalid,
+        BatchFileJobsShareOutputDirectory,
+        BatchJobFailed,
+        ParseCacheDirectoryNoMoreArgs,
     };
 
     struct ErrorIdHash
@@ -119,6 +128,14 @@ namespace ErrorHelpers
         { ErrorId::ImportDirectoryDoesNotExist,"The import directory '{}' does not exist or is not a directory." },
         { ErrorId::ImportedEdlFileDoesNotExist, "import file '{}' was not found for '{}'. Check that the .edl file exists in your import directories." },
         { ErrorId::ImportCycleFound, "Import cycle found when attempting to import '{}' into '{}'." },
+        { ErrorId::BatchFileNoMoreArgs,"Unable to find batch file path. No more commandline arguments available to find batch file path." },
+        { ErrorId::BatchFileDoesNotExist,"The batch file '{}' does not exist." },
+        { ErrorId::BatchFileHasNoJobs,"The batch file '{}' does not contain any jobs." },
+        { ErrorId::BatchFileCombinedWithOtherArgs,"--BatchFile can't be combined with other arguments. Each job in the batch file must provide its own arguments." },
+        { ErrorId::BatchFileJobInvalid,"Invalid job on line '{}' of batch file '{}'." },
+        { ErrorId::BatchFileJobsShareOutputDirectory,"Jobs on lines '{}' and '{}' of batch file '{}' generate files into the same output directory '{}'." },
+        { ErrorId::BatchJobFailed,"Job on line '{}' of the batch file failed: {}" },
+        { ErrorId::ParseCacheDirectoryNoMoreArgs,"Unable to find parse cache directory. No more commandline arguments available to find the parse cache directory." },
 
         // Edl file lexical analysis errors
         { ErrorId::EdlCommentEndingNotFound, "EOF while looking for '*/' to match the '/*'" },
@@ -181,8 +198,15 @@ namespace ErrorHelpers
         return std::vformat(message, std::make_format_args(args...));
     }
 
+    // Batch mode generates several jobs in parallel. Writes from every thread go through this
+    // lock so a status line is never interleaved with another one. This is an inline variable
+    // rather than a static so all translation units share the same lock.
+    inline std::mutex g_print_status_lock {};
+
     static void inline PrintStatus(const Status& status, const std::string& message)
     {
+        std::lock_guard lock(g_print_status_lock);
+
         if (status == Status::Info)
         {
             std::cout << s_info_prefix + message << std::endl;
@@ -202,6 +226,7 @@ namespace ErrorHelpers
     {
         if (!(c_error_messages.contains(id)))
         {
+            std::lock_guard lock(g_print_status_lock);
             std::cerr << "Invalid error ID: " << static_cast<uint32_t>(id) << std::endl;
             return;
         }
@@ -0,0 +1,13 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+#include <pch.h>
+
+namespace Helpers
+{
+    // Identifies the build of edlcodegen.exe that is currently running. Data cached on disk by
+    // a different build (generation manifests, parsed .edl files) must not be reused, since that
+    // build may have produced different results.
+    const std::string& GetGeneratorVersion();
+}
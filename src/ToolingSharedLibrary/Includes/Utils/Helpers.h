@@ -3,79 +3,173 @@
 
 #pragma once
 #include <pch.h>
+#include <bit>
 #include <span>
 #include <ranges>
+#include <stdexcept>
 
 namespace Helpers
 {
-    // Simple OrderedMap class to maintain insertion order and fast lookup
+    static inline constexpr std::uint64_t c_fnv1a_offset_basis = 0xcbf29ce484222325ULL;
+    static inline constexpr std::uint64_t c_fnv1a_prime = 0x100000001b3ULL;
+
+    // 64-bit FNV-1a hash. Used to detect whether edl inputs or generated outputs changed
+    // between runs. This is not a cryptographic hash and must not be used as one.
+    inline std::uint64_t ComputeContentHash(
+        std::string_view content,
+        std::uint64_t hash = c_fnv1a_offset_basis)
+    {
+        for (unsigned char character : content)
+        {
+            hash ^= character;
+            hash *= c_fnv1a_prime;
+        }
+
+        return hash;
+    }
+
+    // Reads the file in text mode so the content matches what was written
+    // with a std::ofstream in text mode.
+    inline bool TryReadFileContent(const std::filesystem::path& file_path, std::string& content)
+    {
+        std::ifstream file(file_path.generic_string(), std::ios::in);
+
+        if (!file)
+        {
+            return false;
+        }
+
+        std::ostringstream string_stream;
+        string_stream << file.rdbuf();
+        content = std::move(string_stream).str();
+        return true;
+    }
+
+    inline bool TryComputeFileContentHash(const std::filesystem::path& file_path, std::uint64_t& hash)
+    {
+        std::string content {};
+
+        if (!TryReadFileContent(file_path, content))
+        {
+            return false;
+        }
+
+        hash = ComputeContentHash(content);
+        return true;
+    }
+
+    // Map that keeps its entries in insertion order. The entries are stored contiguously, so iterating
+    // over them is a linear scan, and each key is only stored once. Lookups go through an open
+    // addressing hash table of indices into the entries. std::string keys can be looked up with a
+    // std::string_view (e.g the text of a token) without allocating a temporary string.
+    //
+    // Like std::vector, inserting a new entry invalidates references and iterators to existing entries.
     template<typename Key, typename Value>
-    class OrderedMap 
+    class OrderedMap
     {
         public:
-            Value& at(const Key& key) { return m_map.at(key); }
-            const Value& at(const Key& key) const { return m_map.at(key); }
-            auto find(const Key& key) { return m_map.find(key); }
-            auto find(const Key& key) const { return m_map.find(key); }
-            std::span<const Key> keys() const { return m_keys; }
-            size_t size() const { return m_map.size(); }
-
-            // Technically if this was a true orderedmap doing begin() should return [key in order, value in order]
-            // not the unordered_map version. However we don't need this for our use cases. We just need this classes 
-            // keys() and values() methods to return their data in insertion order.
-            auto begin() const { return m_map.begin(); }
-            auto end() const { return m_map.end(); }
-            auto begin() { return m_map.begin(); }
-            auto end() { return m_map.end(); }
-
-            const Value& operator[](const Key& key) const { return m_map.at(key); }
-            bool contains(const Key& key) const { return m_map.contains(key); }
-            bool empty() const { return m_map.empty(); }
-            void clear()
+            using value_type = std::pair<Key, Value>;
+            using key_view = std::conditional_t<std::is_same_v<Key, std::string>, std::string_view, Key>;
+            using iterator = typename std::vector<value_type>::iterator;
+            using const_iterator = typename std::vector<value_type>::const_iterator;
+
+            Value& at(key_view key) { return m_entries[IndexOf(key)].second; }
+            const Value& at(key_view key) const { return m_entries[IndexOf(key)].second; }
+
+            iterator find(key_view key)
             {
-                m_map.clear();
-                m_keys.clear();
+                auto index = FindIndex(key);
+                return (index == c_empty_slot) ? m_entries.end() : m_entries.begin() + index;
             }
 
-            Value& operator[](const Key& key)
+            const_iterator find(key_view key) const
             {
-                if (!contains(key))
+                auto index = FindIndex(key);
+                return (index == c_empty_slot) ? m_entries.end() : m_entries.begin() + index;
+            }
+
+            auto keys() const { return std::views::keys(m_entries); }
+            auto values() const { return std::views::values(m_entries); }
+            auto values() { return std::views::values(m_entries); }
+
+            // Entries are iterated in insertion order as (key, value) pairs.
+            auto begin() const { return m_entries.begin(); }
+            auto end() const { return m_entries.end(); }
+            auto begin() { return m_entries.begin(); }
+            auto end() { return m_entries.end(); }
+
+            size_t size() const { return m_entries.size(); }
+            bool empty() const { return m_entries.empty(); }
+            bool contains(key_view key) const { return FindIndex(key) != c_empty_slot; }
+
+            const Value& operator[](key_view key) const { return at(key); }
+
+            Value& operator[](key_view key)
+            {
+                auto index = FindIndex(key);
+
+                if (index == c_empty_slot)
                 {
-                    m_keys.push_back(key);
+                    index = Append(Key(key), Value {});
                 }
 
-                return m_map[key];
+                return m_entries[index].second;
             }
 
+            void clear()
+            {
+                m_entries.clear();
+                m_slots.clear();
+            }
 
-            void insert(const Key key, const Value& value)
+            void reserve(size_t count)
             {
-                if (!contains(key))
+                m_entries.reserve(count);
+
+                if (NeedsRehash(count))
                 {
-                    m_keys.push_back(key);
+                    Rehash(count);
                 }
+            }
+
+            void insert(Key key, Value value)
+            {
+                auto index = FindIndex(key);
 
-                m_map[key] = value;
+                if (index == c_empty_slot)
+                {
+                    Append(std::move(key), std::move(value));
+                }
+                else
+                {
+                    m_entries[index].second = std::move(value);
+                }
             }
 
-            void insert_front(const Key key, const Value& value)
+            // This is O(n) since every entry after the front moves, so it should only
+            // be used for the rare entries that must come before all others.
+            void insert_front(Key key, Value value)
             {
-                if (!contains(key))
+                auto index = FindIndex(key);
+
+                if (index != c_empty_slot)
                 {
-                    m_keys.insert(m_keys.begin(), key);
+                    m_entries[index].second = std::move(value);
+                    return;
                 }
 
-                m_map[key] = value;
+                m_entries.emplace(m_entries.begin(), std::move(key), std::move(value));
+                Rehash(m_entries.size());
             }
 
             // Merge another OrderedMap into this one, preserving order and uniqueness
             void merge(const OrderedMap& other)
             {
-                for (const auto& key : other.m_keys)
+                for (const auto& [key, value] : other.m_entries)
                 {
                     if (!contains(key))
                     {
-                        insert(key, other.m_map.at(key));
+                        Append(key, value);
                     }
                 }
             }
@@ -84,37 +178,110 @@ namespace Helpers
             template<typename ConflictResolver>
             void merge(const OrderedMap& other, ConflictResolver resolver)
             {
-                for (const auto& key : other.m_keys)
+                for (const auto& [key, value] : other.m_entries)
                 {
-                    if (contains(key))
+                    auto index = FindIndex(key);
+
+                    if (index != c_empty_slot)
                     {
-                        resolver(key, other.m_map.at(key), m_map.at(key));
+                        resolver(key, value, m_entries[index].second);
                     }
                     else
                     {
-                        insert(key, other.m_map.at(key));
+                        Append(key, value);
+                    }
+                }
+            }
+
+        private:
+            static inline constexpr std::uint32_t c_empty_slot = UINT32_MAX;
+            static inline constexpr size_t c_minimum_slot_count = 16;
+
+            static size_t Hash(key_view key)
+            {
+                return std::hash<key_view> {}(key);
+            }
+
+            // Keep the table at most 3/4 full so probe sequences stay short.
+            bool NeedsRehash(size_t entry_count) const
+            {
+                return entry_count * 4 > m_slots.size() * 3;
+            }
+
+            std::uint32_t FindIndex(key_view key) const
+            {
+                if (m_slots.empty())
+                {
+                    return c_empty_slot;
+                }
+
+                auto mask = m_slots.size() - 1;
+
+                for (auto slot = Hash(key) & mask; ; slot = (slot + 1) & mask)
+                {
+                    auto index = m_slots[slot];
+
+                    if (index == c_empty_slot || key_view(m_entries[index].first) == key)
+                    {
+                        return index;
                     }
                 }
             }
 
-            auto values() const
+            std::uint32_t IndexOf(key_view key) const
             {
-                return m_keys | std::views::transform([this] (const std::string& key) -> const Value&
+                auto index = FindIndex(key);
+
+                if (index == c_empty_slot)
                 {
-                    return m_map.at(key);
-                });
+                    throw std::out_of_range("OrderedMap key not found");
+                }
+
+                return index;
             }
 
-            auto values()
+            void AddToSlots(std::uint32_t index)
             {
-                return m_keys | std::views::transform([this] (const std::string& key) -> Value&
+                auto mask = m_slots.size() - 1;
+                auto slot = Hash(m_entries[index].first) & mask;
+
+                while (m_slots[slot] != c_empty_slot)
                 {
-                    return m_map.at(key);
-                });
+                    slot = (slot + 1) & mask;
+                }
+
+                m_slots[slot] = index;
             }
 
-        private:
-            std::unordered_map<Key, Value> m_map;
-            std::vector<Key> m_keys; // Keys are kept in insertion order.
+            void Rehash(size_t entry_count)
+            {
+                auto slot_count = std::max(std::bit_ceil(entry_count + entry_count / 3 + 1), c_minimum_slot_count);
+                m_slots.assign(slot_count, c_empty_slot);
+
+                for (std::uint32_t index = 0; index < m_entries.size(); index++)
+                {
+                    AddToSlots(index);
+                }
+            }
+
+            std::uint32_t Append(Key key, Value value)
+            {
+                auto index = static_cast<std::uint32_t>(m_entries.size());
+                m_entries.emplace_back(std::move(key), std::move(value));
+
+                if (NeedsRehash(m_entries.size()))
+                {
+                    Rehash(m_entries.size() * 2);
+                }
+                else
+                {
+                    AddToSlots(index);
+                }
+
+                return index;
+            }
+
+            std::vector<value_type> m_entries {};
+            std::vector<std::uint32_t> m_slots {};
     };
 }
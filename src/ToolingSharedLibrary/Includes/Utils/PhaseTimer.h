@@ -0,0 +1,133 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+#include <pch.h>
+#include <array>
+#include <atomic>
+#include <chrono>
+
+namespace Helpers
+{
+    enum class CodeGenerationPhase : std::uint32_t
+    {
+        Lex,
+        Parse,
+        Validate,
+        Build,
+        SchemaCompile,
+        Write,
+        Count,
+    };
+
+    static inline constexpr std::array<std::string_view, static_cast<size_t>(CodeGenerationPhase::Count)> c_code_generation_phase_names =
+    {
+        "lex",
+        "parse",
+        "validate",
+        "build",
+        "schema compile",
+        "write",
+    };
+
+    // Called on the thread running a phase whenever it starts or stops running that phase, including
+    // when a nested phase pauses its parent and when the parent resumes. Lets the benchmarks measure
+    // things other than time, such as the peak heap usage, for each phase.
+    using PhaseListener = void (*)(CodeGenerationPhase phase, bool is_starting);
+
+    // Accumulated wall clock time spent in each phase across every thread in the process.
+    class PhaseTimings
+    {
+    public:
+        static PhaseTimings& Instance()
+        {
+            static PhaseTimings s_timings {};
+            return s_timings;
+        }
+
+        void Add(CodeGenerationPhase phase, std::chrono::nanoseconds duration)
+        {
+            m_nanoseconds[static_cast<size_t>(phase)].fetch_add(duration.count(), std::memory_order_relaxed);
+        }
+
+        std::chrono::nanoseconds Get(CodeGenerationPhase phase) const
+        {
+            return std::chrono::nanoseconds(m_nanoseconds[static_cast<size_t>(phase)].load(std::memory_order_relaxed));
+        }
+
+        void Reset()
+        {
+            for (auto& nanoseconds : m_nanoseconds)
+            {
+                nanoseconds.store(0, std::memory_order_relaxed);
+            }
+        }
+
+        void SetListener(PhaseListener listener)
+        {
+            m_listener.store(listener, std::memory_order_relaxed);
+        }
+
+        void Notify(CodeGenerationPhase phase, bool is_starting) const
+        {
+            if (auto listener = m_listener.load(std::memory_order_relaxed))
+            {
+                listener(phase, is_starting);
+            }
+        }
+
+    private:
+        std::array<std::atomic<std::int64_t>, static_cast<size_t>(CodeGenerationPhase::Count)> m_nanoseconds {};
+        std::atomic<PhaseListener> m_listener {};
+    };
+
+    // Times the enclosing scope and adds it to the given phase. Timers nest per thread and the time is
+    // exclusive, e.g the time spent lexing while a parse timer is active is only counted as lex time.
+    class ScopedPhaseTimer
+    {
+    public:
+        explicit ScopedPhaseTimer(CodeGenerationPhase phase)
+            : m_phase(phase), m_parent(t_active_timer), m_start(std::chrono::steady_clock::now())
+        {
+            if (m_parent)
+            {
+                m_parent->Pause(m_start);
+                PhaseTimings::Instance().Notify(m_parent->m_phase, false);
+            }
+
+            t_active_timer = this;
+            PhaseTimings::Instance().Notify(m_phase, true);
+        }
+
+        ~ScopedPhaseTimer()
+        {
+            auto now = std::chrono::steady_clock::now();
+            Pause(now);
+            PhaseTimings::Instance().Notify(m_phase, false);
+            PhaseTimings::Instance().Add(m_phase, m_elapsed);
+            t_active_timer = m_parent;
+
+            if (m_parent)
+            {
+                PhaseTimings::Instance().Notify(m_parent->m_phase, true);
+                m_parent->m_start = now;
+            }
+        }
+
+        ScopedPhaseTimer(const ScopedPhaseTimer&) = delete;
+        ScopedPhaseTimer& operator=(const ScopedPhaseTimer&) = delete;
+
+    private:
+        void Pause(std::chrono::steady_clock::time_point now)
+        {
+            m_elapsed += now - m_start;
+        }
+
+        static inline thread_local ScopedPhaseTimer* t_active_timer = nullptr;
+
+        CodeGenerationPhase m_phase;
+        ScopedPhaseTimer* m_parent;
+        std::chrono::steady_clock::time_point m_start;
+        std::chrono::nanoseconds m_elapsed {};
+    };
+}
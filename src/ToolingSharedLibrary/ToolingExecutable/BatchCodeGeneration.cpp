@@ -0,0 +1,285 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#include <pch.h>
+#include <BatchCodeGeneration.h>
+#include <CodeGeneration\CodeGeneration.h>
+#include <Utils\PhaseTimer.h>
+#include <atomic>
+#include <thread>
+
+using namespace ErrorHelpers;
+using namespace Helpers;
+
+namespace CodeGeneration
+{
+    static inline constexpr char c_batch_file_comment_character = '#';
+
+    BatchJob::BatchJob(std::uint32_t line_number, CmdlineArgumentsParser&& arguments)
+        : m_line_number(line_number),
+          m_arguments(std::move(arguments)),
+          m_manifest(
+              GetGenerationManifestPath(
+                  m_arguments.OutDirectory(),
+                  m_arguments.VirtualTrustLayer(),
+                  m_arguments.EdlFilePath()),
+              CreateOptionsFingerprint(m_arguments))
+    {
+    }
+
+    BatchCodeGenerator::BatchCodeGenerator(
+        const std::filesystem::path& batch_file_path,
+        const std::filesystem::path& parse_cache_directory)
+        : m_batch_file_path(batch_file_path),
+          m_parse_cache(std::make_shared<EdlParseCache>(parse_cache_directory))
+    {
+    }
+
+    bool BatchCodeGenerator::ReadJobs()
+    {
+        std::string batch_file_content {};
+
+        if (!TryReadFileContent(m_batch_file_path, batch_file_content))
+        {
+            PrintError(ErrorId::BatchFileDoesNotExist, m_batch_file_path.generic_string());
+            return false;
+        }
+
+        std::istringstream batch_file_stream(batch_file_content);
+        std::string line {};
+        std::uint32_t line_number = 0U;
+
+        while (std::getline(batch_file_stream, line))
+        {
+            line_number++;
+            line = Trim(line);
+
+            if (line.empty() || line.front() == c_batch_file_comment_character)
+            {
+                continue;
+            }
+
+            // The first argument is normally the path of the exe, so add a placeholder for it.
+            auto arguments = SplitCommandLine(line);
+            arguments.insert(arguments.begin(), "edlcodegen.exe");
+
+            std::vector<char*> argv {};
+
+            for (auto& argument : arguments)
+            {
+                argv.push_back(argument.data());
+            }
+
+            auto job_arguments = CmdlineArgumentsParser(static_cast<int>(argv.size()), argv.data());
+
+            if (!job_arguments.ParseSuccessful() || job_arguments.ShouldDisplayHelp() || job_arguments.IsBatchMode())
+            {
+                PrintError(ErrorId::BatchFileJobInvalid, line_number, m_batch_file_path.generic_string());
+                return false;
+            }
+
+            auto& job = m_jobs.emplace_back(line_number, std::move(job_arguments));
+
+            if (!ValidateJobOutputDirectory(job))
+            {
+                return false;
+            }
+
+            job.m_parse_cache = GetJobParseCache(job);
+        }
+
+        if (m_jobs.empty())
+        {
+            PrintError(ErrorId::BatchFileHasNoJobs, m_batch_file_path.generic_string());
+            return false;
+        }
+
+        return true;
+    }
+
+    // Jobs are generated in parallel, so two jobs writing the same generated files (the headers
+    // for a VTL don't depend on the .edl file name) could leave them torn.
+    bool BatchCodeGenerator::ValidateJobOutputDirectory(const BatchJob& job) const
+    {
+        auto output_directory = [] (const BatchJob& job)
+        {
+            std::error_code error {};
+            auto directory = job.m_manifest.ManifestPath().parent_path();
+            auto canonical_directory = std::filesystem::weakly_canonical(directory, error);
+            return error ? directory.lexically_normal() : canonical_directory;
+        };
+
+        auto job_output_directory = output_directory(job);
+
+        for (auto& other_job : m_jobs)
+        {
+            if (&other_job != &job && output_directory(other_job) == job_output_directory)
+            {
+                PrintError(
+                    ErrorId::BatchFileJobsShareOutputDirectory,
+                    other_job.m_line_number,
+                    job.m_line_number,
+                    m_batch_file_path.generic_string(),
+                    job_output_directory.generic_string());
+
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    std::shared_ptr<EdlParseCache> BatchCodeGenerator::GetJobParseCache(const BatchJob& job)
+    {
+        auto job_cache_directory = job.m_arguments.ParseCacheDirectory();
+
+        if (job_cache_directory.empty())
+        {
+            return m_parse_cache;
+        }
+
+        auto& parse_cache = m_job_parse_caches[job_cache_directory.lexically_normal()];
+
+        if (!parse_cache)
+        {
+            parse_cache = std::make_shared<EdlParseCache>(job_cache_directory);
+        }
+
+        return parse_cache;
+    }
+
+    void BatchCodeGenerator::FailJob(BatchJob& job, std::string_view error_message)
+    {
+        job.m_status = BatchJobStatus::Failed;
+        PrintError(ErrorId::BatchJobFailed, job.m_line_number, error_message);
+    }
+
+    void BatchCodeGenerator::ParseJob(BatchJob& job)
+    {
+        try
+        {
+            auto edl_parser = EdlParser(job.m_arguments.EdlFilePath(), job.m_arguments.ImportDirectories(), job.m_parse_cache);
+            job.m_edl = edl_parser.Parse();
+
+            auto parsed_files = edl_parser.ParsedFiles();
+            job.m_parsed_files.assign(parsed_files.begin(), parsed_files.end());
+        }
+        catch (const std::exception& exception)
+        {
+            FailJob(job, exception.what());
+        }
+    }
+
+    void BatchCodeGenerator::GenerateJob(BatchJob& job)
+    {
+        try
+        {
+            auto cpp_code_generator = CppCodeGenerator(
+                std::move(job.m_edl),
+                job.m_arguments.OutDirectory(),
+                job.m_arguments.ErrorHandling(),
+                job.m_arguments.VirtualTrustLayer(),
+                job.m_arguments.GeneratedNamespace(),
+                job.m_arguments.Vtl0ClassName(),
+                job.m_arguments.FlatbufferCompiler());
+
+            cpp_code_generator.Generate();
+            job.m_manifest.Save(job.m_parsed_files, cpp_code_generator.GeneratedFiles());
+            job.m_status = BatchJobStatus::Generated;
+        }
+        catch (const std::exception& exception)
+        {
+            FailJob(job, exception.what());
+        }
+    }
+
+    HRESULT BatchCodeGenerator::Run()
+    {
+        auto start_time = std::chrono::steady_clock::now();
+        PhaseTimings::Instance().Reset();
+
+        if (!ReadJobs())
+        {
+            return E_INVALIDARG;
+        }
+
+        std::vector<BatchJob*> jobs_to_generate {};
+
+        // Parsing is done on a single thread so the parse cache is fully populated with
+        // shared imports before the next job needs them.
+        for (auto& job : m_jobs)
+        {
+            if (job.m_manifest.IsUpToDate())
+            {
+                job.m_status = BatchJobStatus::UpToDate;
+                continue;
+            }
+
+            ParseJob(job);
+
+            if (job.m_status != BatchJobStatus::Failed)
+            {
+                jobs_to_generate.push_back(&job);
+            }
+        }
+
+        if (!jobs_to_generate.empty())
+        {
+            auto thread_count = std::clamp<size_t>(std::thread::hardware_concurrency(), 1, jobs_to_generate.size());
+            std::atomic<size_t> next_job_index {};
+            std::vector<std::jthread> workers {};
+
+            for (size_t i = 0; i < thread_count; i++)
+            {
+                workers.emplace_back([&] ()
+                {
+                    for (auto job_index = next_job_index++; job_index < jobs_to_generate.size(); job_index = next_job_index++)
+                    {
+                        GenerateJob(*jobs_to_generate[job_index]);
+                    }
+                });
+            }
+        }
+
+        PrintSummary(std::chrono::steady_clock::now() - start_time);
+
+        auto job_failed = std::ranges::any_of(m_jobs, [] (const BatchJob& job)
+        {
+            return job.m_status == BatchJobStatus::Failed;
+        });
+
+        return job_failed ? E_FAIL : S_OK;
+    }
+
+    void BatchCodeGenerator::PrintSummary(std::chrono::steady_clock::duration elapsed_time) const
+    {
+        auto jobs_with_status = [this] (BatchJobStatus status)
+        {
+            return std::ranges::count_if(m_jobs, [status] (const BatchJob& job) { return job.m_status == status; });
+        };
+
+        using milliseconds = std::chrono::duration<double, std::milli>;
+
+        PrintStatus(Status::Info, std::format(
+            "Batch completed in {:.1f} ms. Jobs: {} total, {} generated, {} up to date, {} failed.",
+            milliseconds(elapsed_time).count(),
+            m_jobs.size(),
+            jobs_with_status(BatchJobStatus::Generated),
+            jobs_with_status(BatchJobStatus::UpToDate),
+            jobs_with_status(BatchJobStatus::Failed)));
+
+        // Phases that run on the worker threads are summed across threads,
+        // so they may add up to more than the total elapsed time.
+        auto& timings = PhaseTimings::Instance();
+
+        for (size_t phase = 0; phase < c_code_generation_phase_names.size(); phase++)
+        {
+            auto phase_time = timings.Get(static_cast<CodeGenerationPhase>(phase));
+
+            PrintStatus(Status::Info, std::format(
+                "  {:<16}{:>10.1f} ms",
+                c_code_generation_phase_names[phase],
+                milliseconds(phase_time).count()));
+        }
+    }
+}
@@ -84,6 +84,14 @@ bool CmdlineArgumentsParser::ParseArguments(int argc, char* argv[])
             CHECK_SUCCESS(GetFlatbuffersCompilerPathFromArgs(++i, argv, argc, m_flatbuffer_compiler_path));
             args_found++;
         }
+        else if (arg == "--BatchFile")
+        {
+            CHECK_SUCCESS(GetBatchFilePathFromArgs(++i, argv, argc, m_batch_file_path));
+        }
+        else if (arg == "--ParseCacheDirectory")
+        {
+            CHECK_SUCCESS(GetParseCacheDirectoryFromArgs(++i, argv, argc, m_parse_cache_directory));
+        }
         else
         {
             PrintError(ErrorId::InvalidArgument, arg);
@@ -91,6 +99,17 @@ bool CmdlineArgumentsParser::ParseArguments(int argc, char* argv[])
         }
     }
 
+    if (IsBatchMode())
+    {
+        if (args_found > 0)
+        {
+            PrintError(ErrorId::BatchFileCombinedWithOtherArgs);
+            return false;
+        }
+
+        return true;
+    }
+
     if (args_found < m_required_args)
     {
         PrintError(
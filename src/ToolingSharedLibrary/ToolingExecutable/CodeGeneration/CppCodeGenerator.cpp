@@ -8,11 +8,13 @@
 #include <ErrorHelpers.h>
 #include <CodeGeneration\Flatbuffers\Contants.h>
 #include <CodeGeneration\Flatbuffers\BuilderHelpers.h>
+#include <Utils\PhaseTimer.h>
 
 using namespace EdlProcessor;
 using namespace ErrorHelpers;
 using namespace CodeGeneration::CppCodeBuilder;
 using namespace CodeGeneration::Flatbuffers;
+using namespace Helpers;
 namespace CodeGeneration
 {
     CppCodeGenerator::CppCodeGenerator(
@@ -60,6 +62,9 @@ namespace CodeGeneration
     {
         using namespace CppCodeBuilder;
 
+        ScopedPhaseTimer timer(CodeGenerationPhase::Build);
+        m_generated_files.clear();
+
         std::string enclave_headers_output = std::format(c_output_folder_for_generated_trusted_functions, m_edl.m_name);
         std::string hostapp_headers_output = std::format(c_output_folder_for_generated_untrusted_functions, m_edl.m_name);
         auto enclave_headers_location = m_output_folder_path / enclave_headers_output;
@@ -155,8 +160,24 @@ namespace CodeGeneration
 
         SaveFileToOutputFolder("TypeMetadata.h", abi_save_location, abi_metadata_types_header);
 
-        SaveFileToOutputFolder(c_flatbuffer_fbs_filename, abi_save_location, flatbuffer_schema);
-        CompileFlatbufferFile(abi_save_location);
+        bool schema_changed = SaveFileToOutputFolder(c_flatbuffer_fbs_filename, abi_save_location, flatbuffer_schema);
+        auto flatbuffer_header_path = abi_save_location / c_flatbuffer_header_filename;
+
+        if (schema_changed || !std::filesystem::exists(flatbuffer_header_path))
+        {
+            CompileFlatbufferFile(abi_save_location);
+        }
+        else
+        {
+            PrintStatus(Status::Info, std::format("{} is unchanged, skipping flatbuffer compilation", c_flatbuffer_fbs_filename));
+        }
+
+        std::uint64_t flatbuffer_header_hash {};
+
+        if (TryComputeFileContentHash(flatbuffer_header_path, flatbuffer_header_hash))
+        {
+            m_generated_files.push_back({ flatbuffer_header_path, flatbuffer_header_hash });
+        }
     }
 
     void CppCodeGenerator::SaveTrustedHeader(
@@ -275,12 +296,23 @@ namespace CodeGeneration
         SaveFileToOutputFolder("Definitions.h", output_parent_folder, header_content);
     }
 
-    void CppCodeGenerator::SaveFileToOutputFolder(
+    bool CppCodeGenerator::SaveFileToOutputFolder(
         std::string_view file_name,
         const std::filesystem::path& output_folder,
         std::string_view file_content)
     {
+        ScopedPhaseTimer timer(CodeGenerationPhase::Write);
         auto output_file_path = output_folder / file_name;
+        m_generated_files.push_back({ output_file_path, ComputeContentHash(file_content) });
+
+        // Leave files with identical content untouched so their timestamps don't change. This
+        // prevents msbuild from recompiling everything that includes the generated files.
+        std::string existing_content {};
+
+        if (TryReadFileContent(output_file_path, existing_content) && existing_content == file_content)
+        {
+            return false;
+        }
 
         if (!std::filesystem::exists(output_folder) && !std::filesystem::create_directories(output_folder))
         {
@@ -295,6 +327,7 @@ namespace CodeGeneration
         {
             output_file << file_content;
             output_file.close();
+            return true;
         }
         else
         {
@@ -306,6 +339,7 @@ namespace CodeGeneration
 
     void CppCodeGenerator::CompileFlatbufferFile(std::filesystem::path save_location)
     {
+        ScopedPhaseTimer timer(CodeGenerationPhase::SchemaCompile);
         auto flatbuffer_schema_path = (save_location / c_flatbuffer_fbs_filename).generic_string();
 
         std::string flatbuffer_args = std::format(R"({} -o "{}" "{}")", c_cpp_gen_args, save_location.generic_string(), flatbuffer_schema_path);
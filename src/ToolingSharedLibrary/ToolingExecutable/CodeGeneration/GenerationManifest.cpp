@@ -0,0 +1,260 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#include <pch.h>
+#include <CodeGeneration\GenerationManifest.h>
+#include <CodeGeneration\Contants.h>
+#include <ErrorHelpers.h>
+#include <Exceptions.h>
+#include <Utils\GeneratorVersion.h>
+#include <charconv>
+
+using namespace ErrorHelpers;
+using namespace ToolingExceptions;
+using namespace Helpers;
+
+namespace CodeGeneration
+{
+    static inline constexpr std::string_view c_manifest_header = "edlcodegen-manifest 1";
+    static inline constexpr std::string_view c_manifest_generator_key = "generator";
+    static inline constexpr std::string_view c_manifest_options_key = "options";
+    static inline constexpr std::string_view c_manifest_input_key = "input";
+    static inline constexpr std::string_view c_manifest_output_key = "output";
+
+    GenerationManifest::GenerationManifest(
+        const std::filesystem::path& manifest_path,
+        std::string_view options_fingerprint)
+        : m_manifest_path(manifest_path),
+          m_options_hash(ComputeContentHash(options_fingerprint))
+    {
+    }
+
+    // Each entry line is in the form '<key> <value>' or '<key> <hash> <path>'. The path is always the
+    // remainder of the line so paths with spaces in them round trip.
+    static bool TryParseHashAndPath(
+        std::string_view line_value,
+        std::uint64_t& hash,
+        std::filesystem::path& file_path)
+    {
+        auto separator = line_value.find(' ');
+
+        if (separator == std::string_view::npos)
+        {
+            return false;
+        }
+
+        auto hash_string = line_value.substr(0, separator);
+        auto result = std::from_chars(hash_string.data(), hash_string.data() + hash_string.size(), hash, 16);
+
+        if (result.ec != std::errc {})
+        {
+            return false;
+        }
+
+        file_path = std::string(line_value.substr(separator + 1));
+        return !file_path.empty();
+    }
+
+    static bool FileHashMatches(const std::filesystem::path& file_path, std::uint64_t expected_hash)
+    {
+        std::uint64_t current_hash {};
+        return TryComputeFileContentHash(file_path, current_hash) && current_hash == expected_hash;
+    }
+
+    struct ManifestContent
+    {
+        std::string m_generator_version {};
+        std::string m_options_hash {};
+        std::vector<GeneratedFile> m_inputs {};
+        std::vector<GeneratedFile> m_outputs {};
+    };
+
+    static bool TryReadManifest(const std::filesystem::path& manifest_path, ManifestContent& manifest)
+    {
+        std::string manifest_content {};
+
+        if (!TryReadFileContent(manifest_path, manifest_content))
+        {
+            return false;
+        }
+
+        std::istringstream manifest_stream(manifest_content);
+        std::string line {};
+
+        if (!std::getline(manifest_stream, line) || line != c_manifest_header)
+        {
+            return false;
+        }
+
+        while (std::getline(manifest_stream, line))
+        {
+            std::string_view line_view = line;
+            auto separator = line_view.find(' ');
+
+            if (separator == std::string_view::npos)
+            {
+                return false;
+            }
+
+            auto key = line_view.substr(0, separator);
+            auto value = line_view.substr(separator + 1);
+
+            if (key == c_manifest_generator_key)
+            {
+                manifest.m_generator_version = value;
+            }
+            else if (key == c_manifest_options_key)
+            {
+                manifest.m_options_hash = value;
+            }
+            else if (key == c_manifest_input_key || key == c_manifest_output_key)
+            {
+                GeneratedFile entry {};
+
+                if (!TryParseHashAndPath(value, entry.m_content_hash, entry.m_path))
+                {
+                    return false;
+                }
+
+                auto& entries = (key == c_manifest_input_key) ? manifest.m_inputs : manifest.m_outputs;
+                entries.push_back(std::move(entry));
+            }
+            else
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    bool GenerationManifest::IsUpToDate() const
+    {
+        ManifestContent manifest {};
+
+        if (!TryReadManifest(m_manifest_path, manifest) ||
+            manifest.m_generator_version != GetGeneratorVersion() ||
+            manifest.m_options_hash != std::format("{:016x}", m_options_hash) ||
+            manifest.m_inputs.empty())
+        {
+            return false;
+        }
+
+        auto file_unchanged = [] (const GeneratedFile& file)
+        {
+            return FileHashMatches(file.m_path, file.m_content_hash);
+        };
+
+        return std::ranges::all_of(manifest.m_inputs, file_unchanged) &&
+               std::ranges::all_of(manifest.m_outputs, file_unchanged);
+    }
+
+    void GenerationManifest::RemoveStaleOutputs(std::span<const GeneratedFile> output_files) const
+    {
+        ManifestContent previous_manifest {};
+
+        if (!TryReadManifest(m_manifest_path, previous_manifest))
+        {
+            return;
+        }
+
+        // Files generated by a previous run that this run didn't produce (e.g the .edl file was
+        // renamed) would otherwise be picked up by the wildcard includes in the nuget targets.
+        for (auto& previous_output : previous_manifest.m_outputs)
+        {
+            auto still_generated = std::ranges::any_of(output_files, [&] (const GeneratedFile& file)
+            {
+                return file.m_path == previous_output.m_path;
+            });
+
+            if (!still_generated)
+            {
+                std::error_code error {};
+                std::filesystem::remove(previous_output.m_path, error);
+            }
+        }
+    }
+
+    void GenerationManifest::Save(
+        std::span<const std::filesystem::path> input_files,
+        std::span<const GeneratedFile> output_files) const
+    {
+        RemoveStaleOutputs(output_files);
+
+        std::ostringstream manifest_stream;
+        manifest_stream << c_manifest_header << "\n";
+        manifest_stream << std::format("{} {}\n", c_manifest_generator_key, GetGeneratorVersion());
+        manifest_stream << std::format("{} {:016x}\n", c_manifest_options_key, m_options_hash);
+
+        for (auto& input_file : input_files)
+        {
+            std::uint64_t hash {};
+
+            if (!TryComputeFileContentHash(input_file, hash))
+            {
+                // Without a hash for every input we can't tell if a later run is up to date.
+                // Don't leave a manifest behind so the next run does a full generation.
+                std::filesystem::remove(m_manifest_path);
+                return;
+            }
+
+            manifest_stream << std::format("{} {:016x} {}\n", c_manifest_input_key, hash, input_file.generic_string());
+        }
+
+        for (auto& output_file : output_files)
+        {
+            manifest_stream << std::format(
+                "{} {:016x} {}\n",
+                c_manifest_output_key,
+                output_file.m_content_hash,
+                output_file.m_path.generic_string());
+        }
+
+        std::filesystem::create_directories(m_manifest_path.parent_path());
+        std::ofstream manifest_file(m_manifest_path);
+
+        if (!manifest_file.is_open())
+        {
+            throw CodeGenerationException(
+                ErrorId::CodeGenUnableToOpenOutputFile,
+                m_manifest_path.generic_string());
+        }
+
+        manifest_file << manifest_stream.str();
+    }
+
+    std::filesystem::path GetGenerationManifestPath(
+        const std::filesystem::path& output_directory,
+        VirtualTrustLayerKind trust_layer,
+        const std::filesystem::path& edl_file_path)
+    {
+        auto output_folder = output_directory.empty() ? std::filesystem::current_path() : output_directory;
+        auto sub_folder = (trust_layer == VirtualTrustLayerKind::Enclave) ?
+            c_output_folder_for_generated_trusted_functions :
+            c_output_folder_for_generated_untrusted_functions;
+
+        auto manifest_file_name = std::format(c_generation_manifest_file_name, edl_file_path.stem().generic_string());
+
+        return output_folder / sub_folder / manifest_file_name;
+    }
+
+    std::string CreateOptionsFingerprint(const CmdlineArgumentsParser& argument_parser)
+    {
+        std::ostringstream fingerprint;
+        fingerprint << argument_parser.EdlFilePath().generic_string() << "\n";
+        fingerprint << argument_parser.OutDirectory().generic_string() << "\n";
+        fingerprint << static_cast<std::uint32_t>(argument_parser.SupportedLanguage()) << "\n";
+        fingerprint << static_cast<std::uint32_t>(argument_parser.ErrorHandling()) << "\n";
+        fingerprint << static_cast<std::uint32_t>(argument_parser.VirtualTrustLayer()) << "\n";
+        fingerprint << argument_parser.GeneratedNamespace() << "\n";
+        fingerprint << argument_parser.Vtl0ClassName() << "\n";
+        fingerprint << argument_parser.FlatbufferCompiler().generic_string() << "\n";
+
+        for (auto& import_directory : argument_parser.ImportDirectories())
+        {
+            fingerprint << import_directory.generic_string() << "\n";
+        }
+
+        return fingerprint.str();
+    }
+}
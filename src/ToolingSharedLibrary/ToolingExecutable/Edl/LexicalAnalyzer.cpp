@@ -12,104 +12,437 @@
 #include <Includes\ErrorHelpers.h>
 #include <Includes\Exceptions.h>
 #include <Edl\Utils.h>
+#include <Utils\Helpers.h>
+#include <Utils\PhaseTimer.h>
+#include <Windows.h>
+#include <wil\resource.h>
+#include <bit>
+
+#if defined(_M_X64)
+#include <emmintrin.h>
+#elif defined(_M_ARM64)
+#include <arm_neon.h>
+#endif
 
 using namespace ErrorHelpers;
 using namespace ToolingExceptions;
+using namespace Helpers;
 
 namespace EdlProcessor
 {
-    LexicalAnalyzer::LexicalAnalyzer(const std::filesystem::path& file_path)
-        : m_file_path(file_path)
+    static inline constexpr size_t c_block_size = 16;
+    static inline constexpr std::uint32_t c_tab_column_width = 4;
+
+    // 16 characters of the file that are compared at once. Bit i of each returned mask is
+    // set when character i of the block matches.
+    class CharacterBlock
+    {
+    public:
+        explicit CharacterBlock(const char* block)
+#if defined(_M_X64)
+            : m_characters(_mm_loadu_si128(reinterpret_cast<const __m128i*>(block)))
+#elif defined(_M_ARM64)
+            : m_characters(vld1q_u8(reinterpret_cast<const std::uint8_t*>(block)))
+#else
+            : m_characters(block)
+#endif
+        {
+        }
+
+        std::uint32_t Matches(char character) const
+        {
+#if defined(_M_X64)
+            auto result = _mm_cmpeq_epi8(m_characters, _mm_set1_epi8(character));
+            return static_cast<std::uint32_t>(_mm_movemask_epi8(result));
+#elif defined(_M_ARM64)
+            // Neon has no movemask, so weight each matching lane by its bit and add up each half.
+            static const std::uint8_t c_lane_bits[c_block_size] = { 1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128 };
+            auto result = vandq_u8(vceqq_u8(m_characters, vdupq_n_u8(static_cast<std::uint8_t>(character))), vld1q_u8(c_lane_bits));
+            return static_cast<std::uint32_t>(vaddv_u8(vget_low_u8(result))) |
+                   (static_cast<std::uint32_t>(vaddv_u8(vget_high_u8(result))) << 8);
+#else
+            std::uint32_t mask {};
+
+            for (size_t i = 0; i < c_block_size; i++)
+            {
+                mask |= static_cast<std::uint32_t>(m_characters[i] == character) << i;
+            }
+
+            return mask;
+#endif
+        }
+
+    private:
+#if defined(_M_X64)
+        __m128i m_characters;
+#elif defined(_M_ARM64)
+        uint8x16_t m_characters;
+#else
+        const char* m_characters;
+#endif
+    };
+
+    // Mask with the lowest 'count' bits set.
+    static std::uint32_t LowBits(size_t count)
     {
+        return (count >= 32) ? ~0U : ((1U << count) - 1U);
     }
 
-    void LexicalAnalyzer::RetrieveAndStoreContentFromEdlFile()
+    bool EdlFileView::TryOpen(const std::filesystem::path& file_path, bool allow_memory_mapping)
+    {
+        // Editors and build tools may have the .edl file open for writing, so allow
+        // that like std::ifstream does. A file can't be truncated while it is mapped.
+        wil::unique_hfile file(CreateFileW(
+            file_path.c_str(),
+            GENERIC_READ,
+            FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+            nullptr,
+            OPEN_EXISTING,
+            FILE_FLAG_SEQUENTIAL_SCAN,
+            nullptr));
+
+        LARGE_INTEGER file_size {};
+
+        if (!file || !GetFileSizeEx(file.get(), &file_size) || static_cast<std::uint64_t>(file_size.QuadPart) > UINT32_MAX)
+        {
+            return false;
+        }
+
+        auto content_size = static_cast<size_t>(file_size.QuadPart);
+        SYSTEM_INFO system_info {};
+        GetSystemInfo(&system_info);
+
+        if (allow_memory_mapping && content_size % system_info.dwPageSize != 0)
+        {
+            wil::unique_handle file_mapping(CreateFileMappingW(file.get(), nullptr, PAGE_READONLY, 0, 0, nullptr));
+            auto mapped_view = file_mapping ? MapViewOfFile(file_mapping.get(), FILE_MAP_READ, 0, 0, 0) : nullptr;
+
+            if (mapped_view)
+            {
+                m_data = std::shared_ptr<const char>(
+                    static_cast<const char*>(mapped_view),
+                    [] (const char* view) { UnmapViewOfFile(view); });
+
+                m_content = std::string_view(m_data.get(), content_size);
+                m_is_memory_mapped = true;
+                return true;
+            }
+        }
+
+        // There is no room for the null character after the content in the mapped view.
+        std::shared_ptr<char[]> buffer(new char[content_size + 1]);
+        size_t total_bytes_read = 0;
+
+        while (total_bytes_read < content_size)
+        {
+            DWORD bytes_read {};
+            auto bytes_to_read = static_cast<DWORD>(content_size - total_bytes_read);
+
+            if (!ReadFile(file.get(), buffer.get() + total_bytes_read, bytes_to_read, &bytes_read, nullptr) || bytes_read == 0)
+            {
+                return false;
+            }
+
+            total_bytes_read += bytes_read;
+        }
+
+        buffer[content_size] = END_OF_FILE_CHARACTER;
+        m_data = std::shared_ptr<const char>(buffer, buffer.get());
+        m_content = std::string_view(m_data.get(), content_size);
+        m_is_memory_mapped = false;
+        return true;
+    }
+
+    LexicalAnalyzer::LexicalAnalyzer(const std::filesystem::path& file_path, LexingMode mode)
+        : m_file_path(file_path), m_mode(mode)
     {
-        std::ifstream file(m_file_path.generic_string(), std::ios::in | std::ios::ate);
+    }
 
-        if (!file)
+    void LexicalAnalyzer::RetrieveAndStoreContentFromEdlFile()
+    {
+        if (!m_file.TryOpen(m_file_path, m_mode == LexingMode::Vectorized))
         {
             throw EdlAnalysisException(
                 ErrorId::EdlFailureToLoadFile,
                 m_file_path.filename().generic_string());
         }
 
-        std::streamsize last_character_position = file.tellg();
-        file.seekg(0, std::ios::beg);
-
-        // Add an extra null character at the end to symbolize the end of the content.
-        std::string file_contents(last_character_position + 1, '\0');
-        file.read(&file_contents[0], last_character_position);
-
-        m_file = std::move(file_contents);
-        m_null_character_position = &m_file[last_character_position + 1];
+        auto content = m_file.Content();
+        m_content_start = content.data();
+        m_null_character_position = content.data() + content.size();
         m_line_number = 1;
         m_column_number = 1;
-        m_cur_position_character = m_file.c_str();
+        m_cur_position_character = m_content_start;
     }
 
-    bool IsEndOfMultiLineComment(
-        const char* starting_character,
-        const char* null_character_position)
+    void LexicalAnalyzer::TokenizeContent()
     {
-        const char* next_character = starting_character ? starting_character + 1 : nullptr;
+        ScopedPhaseTimer timer(CodeGenerationPhase::Lex);
+        RetrieveAndStoreContentFromEdlFile();
+        m_content_hash = Helpers::ComputeContentHash(m_file.Content());
 
-        if (!starting_character || !next_character)
+        // .edl files average a little over one token for every 8 characters.
+        m_tokens.reserve(m_file.Content().size() / 8);
+
+        try
+        {
+            while (true)
+            {
+                auto lexed_token = ReadNextToken();
+                m_tokens.push_back(lexed_token);
+
+                if (m_content_start[lexed_token.m_offset] == END_OF_FILE_CHARACTER)
+                {
+                    break;
+                }
+            }
+        }
+        catch (const EdlAnalysisException&)
         {
-            return true;
+            m_lexing_error = std::current_exception();
         }
+    }
 
-        if (starting_character + 1 >= null_character_position)
+    std::span<const LexedToken> LexicalAnalyzer::LexedTokens()
+    {
+        if (!m_file_contents_loaded)
         {
-            return true;
+            TokenizeContent();
+            m_file_contents_loaded = true;
         }
 
-        return starting_character[0] == ASTERISK && next_character[0] == FORWARD_SLASH;
+        return m_tokens;
     }
 
-    bool IsEndOfSingleLineComment(const char* cur_position_character)
+    std::uint64_t LexicalAnalyzer::ContentHash()
+    {
+        LexedTokens();
+        return m_content_hash;
+    }
+
+    Token LexicalAnalyzer::GetNextToken()
     {
-        if (cur_position_character)
+        LexedTokens();
+
+        if (m_next_token_index == m_tokens.size())
         {
-            return cur_position_character[0] == NEW_LINE_CHARACTER;
+            // Only reachable when lexing stopped at an invalid token.
+            std::rethrow_exception(m_lexing_error);
         }
 
-        return false;
+        auto& lexed_token = m_tokens[m_next_token_index];
+
+        // Once the end of the file is reached keep returning the end of file token.
+        if (m_lexing_error || m_next_token_index + 1 < m_tokens.size())
+        {
+            m_next_token_index++;
+        }
+
+        return CreateToken(lexed_token);
     }
 
-    void LexicalAnalyzer::SkipWhiteSpaceAndComments()
+    Token LexicalAnalyzer::CreateToken(const LexedToken& lexed_token) const
     {
-        while (m_cur_position_character < m_null_character_position)
+        const char* start = m_content_start + lexed_token.m_offset;
+        return Token(lexed_token.m_line_number, lexed_token.m_column_number, start, start + lexed_token.m_length);
+    }
+
+    LexedToken LexicalAnalyzer::CreateLexedToken(const char* start, const char* end) const
+    {
+        return {
+            static_cast<std::uint32_t>(start - m_content_start),
+            static_cast<std::uint32_t>(end - start),
+            m_line_number,
+            m_column_number };
+    }
+
+    bool LexicalAnalyzer::TrySkipWhiteSpaceCharacter()
+    {
+        if (m_cur_position_character >= m_null_character_position)
         {
-            switch (m_cur_position_character[0])
+            return false;
+        }
+
+        switch (m_cur_position_character[0])
+        {
+            case HORIZONTAL_TAB:
             {
-                case HORIZONTAL_TAB:
-                {
-                    m_column_number += 4; // Treat Tabs as 4 characters
-                    ++m_cur_position_character;
-                    continue;
-                }
-                case WHITE_SPACE:
-                {
-                    m_column_number++;
-                    ++m_cur_position_character;
-                    continue;
-                }
-                case NEW_LINE_CHARACTER:
-                {
-                    m_line_number++;
-                    m_column_number = 1; // Reset column to first position
-                    ++m_cur_position_character;
-                    continue;
-                }
-                case CARRIAGE_RETURN:
-                case BACKSPACE:
-                case VERTICAL_TAB:
-                {
-                    ++m_cur_position_character;
-                    continue;
-                }
+                m_column_number += c_tab_column_width; // Treat Tabs as 4 characters
+                break;
+            }
+            case WHITE_SPACE:
+            {
+                m_column_number++;
+                break;
+            }
+            case NEW_LINE_CHARACTER:
+            {
+                m_line_number++;
+                m_column_number = 1; // Reset column to first position
+                break;
+            }
+            case CARRIAGE_RETURN:
+            case BACKSPACE:
+            case VERTICAL_TAB:
+            {
+                break;
+            }
+            default:
+            {
+                return false;
+            }
+        }
+
+        ++m_cur_position_character;
+        return true;
+    }
+
+    void LexicalAnalyzer::SkipWhiteSpace()
+    {
+        // Whitespace between tokens is usually only a few characters long, which is
+        // quicker to skip one character at a time.
+        for (size_t i = 0; i < c_block_size; i++)
+        {
+            if (!TrySkipWhiteSpaceCharacter())
+            {
+                return;
+            }
+        }
+
+        // Longer runs (e.g indentation and blank lines) are skipped 16 characters at a time. The
+        // position of the last new line gives the line and the spaces and tabs after it the column.
+        while (m_mode == LexingMode::Vectorized &&
+               static_cast<size_t>(m_null_character_position - m_cur_position_character) >= c_block_size)
+        {
+            CharacterBlock block(m_cur_position_character);
+            auto new_lines = block.Matches(NEW_LINE_CHARACTER);
+            auto spaces = block.Matches(WHITE_SPACE);
+            auto tabs = block.Matches(HORIZONTAL_TAB);
+            auto whitespace = new_lines | spaces | tabs |
+                block.Matches(CARRIAGE_RETURN) | block.Matches(BACKSPACE) | block.Matches(VERTICAL_TAB);
+
+            auto non_whitespace = ~whitespace & LowBits(c_block_size);
+            size_t whitespace_count = non_whitespace ? std::countr_zero(non_whitespace) : c_block_size;
+            auto skipped = LowBits(whitespace_count);
+            new_lines &= skipped;
+
+            if (new_lines)
+            {
+                m_line_number += std::popcount(new_lines);
+                m_column_number = 1;
+                skipped &= ~LowBits(std::bit_width(new_lines));
+            }
+
+            m_column_number += std::popcount(spaces & skipped);
+            m_column_number += c_tab_column_width * std::popcount(tabs & skipped);
+            m_cur_position_character += whitespace_count;
+
+            if (whitespace_count < c_block_size)
+            {
+                return;
+            }
+        }
+
+        while (TrySkipWhiteSpaceCharacter())
+        {
+        }
+    }
+
+    void LexicalAnalyzer::SkipSingleLineComment()
+    {
+        // The new line itself is handled as whitespace.
+        auto remaining_characters = static_cast<size_t>(m_null_character_position - m_cur_position_character);
+        auto new_line = std::memchr(m_cur_position_character, NEW_LINE_CHARACTER, remaining_characters);
+        m_cur_position_character = new_line ? static_cast<const char*>(new_line) : m_null_character_position;
+    }
+
+    void LexicalAnalyzer::SkipMultiLineComment()
+    {
+        auto start_col_num = m_column_number;
+        auto start_line_num = m_line_number;
+
+        // move past start of /*
+        m_cur_position_character += 2;
+
+        const char* comment_start = m_cur_position_character;
+        const char* comment_end = nullptr;
+        const char* last_new_line = nullptr;
+        const char* position = m_cur_position_character;
+
+        while (m_mode == LexingMode::Vectorized &&
+               !comment_end &&
+               static_cast<size_t>(m_null_character_position - position) >= c_block_size)
+        {
+            CharacterBlock block(position);
+            auto asterisks = block.Matches(ASTERISK);
+            auto comment_endings = asterisks & (block.Matches(FORWARD_SLASH) >> 1);
+
+            // The '/' after an '*' in the last character of the block is in the next block.
+            if ((asterisks >> (c_block_size - 1)) && position[c_block_size] == FORWARD_SLASH)
+            {
+                comment_endings |= 1U << (c_block_size - 1);
+            }
+
+            size_t characters_in_comment = c_block_size;
+
+            if (comment_endings)
+            {
+                characters_in_comment = std::countr_zero(comment_endings);
+                comment_end = position + characters_in_comment;
+            }
+
+            auto new_lines = block.Matches(NEW_LINE_CHARACTER) & LowBits(characters_in_comment);
+
+            if (new_lines)
+            {
+                m_line_number += std::popcount(new_lines);
+                last_new_line = position + std::bit_width(new_lines) - 1;
+            }
+
+            position += characters_in_comment;
+        }
+
+        for (; !comment_end && position + 1 < m_null_character_position; ++position)
+        {
+            if (position[0] == ASTERISK && position[1] == FORWARD_SLASH)
+            {
+                comment_end = position;
             }
+            else if (position[0] == NEW_LINE_CHARACTER)
+            {
+                m_line_number++;
+                last_new_line = position;
+            }
+        }
+
+        if (!comment_end)
+        {
+            throw EdlAnalysisException(
+                ErrorId::EdlCommentEndingNotFound,
+                m_file_path.filename().generic_string(),
+                start_line_num,
+                start_col_num);
+        }
+
+        // Every character in the comment moves the column, a new line resets it.
+        if (last_new_line)
+        {
+            m_column_number = 1 + static_cast<std::uint32_t>(comment_end - (last_new_line + 1));
+        }
+        else
+        {
+            m_column_number += static_cast<std::uint32_t>(comment_end - comment_start);
+        }
+
+        // Move past */
+        m_cur_position_character = comment_end + 2;
+    }
+
+    void LexicalAnalyzer::SkipWhiteSpaceAndComments()
+    {
+        while (m_cur_position_character < m_null_character_position)
+        {
+            SkipWhiteSpace();
 
             // Move past comments
             if (m_cur_position_character[0] == FORWARD_SLASH &&
@@ -117,51 +450,17 @@ namespace EdlProcessor
             {
                 if (m_cur_position_character[1] == FORWARD_SLASH)
                 {
-                    // skip past single line comment.
-                    while (!IsEndOfSingleLineComment(m_cur_position_character))
-                    {
-                        ++m_cur_position_character;
-                    }
-
+                    SkipSingleLineComment();
                     continue;
                 }
 
-                // Skip past multi-line comment.
                 if (m_cur_position_character[1] == ASTERISK)
                 {
-                    auto start_col_num = m_column_number;
-                    auto start_line_num = m_line_number;
-
-                    // move past start of /*
-                    m_cur_position_character += 2; 
-
-                    while (!IsEndOfMultiLineComment(m_cur_position_character, m_null_character_position))
-                    {
-                        ++m_column_number;
-
-                        if (m_cur_position_character[0] == NEW_LINE_CHARACTER)
-                        {
-                            m_line_number++;
-                            m_column_number = 1;
-                        }
-
-                        ++m_cur_position_character;
-                    }
-
-                    if (m_cur_position_character + 1 >= m_null_character_position)
-                    {
-                        throw EdlAnalysisException(
-                            ErrorId::EdlCommentEndingNotFound,
-                            m_file_path.filename().generic_string(),
-                            start_line_num,
-                            start_col_num);
-                    }
-
-                    // Move past */
-                    m_cur_position_character += 2; 
+                    SkipMultiLineComment();
                     continue;
                 }
             }
+
             break;
         }
     }
@@ -175,20 +474,16 @@ namespace EdlProcessor
     {
         if (start_of_string)
         {
-            return start_of_string[0] == DOUBLE_QUOTE || start_of_string[0] == NEW_LINE_CHARACTER;
+            return start_of_string[0] == DOUBLE_QUOTE ||
+                   start_of_string[0] == NEW_LINE_CHARACTER ||
+                   start_of_string[0] == END_OF_FILE_CHARACTER;
         }
         
         return false;
     }
 
-    Token LexicalAnalyzer::GetNextToken()
+    LexedToken LexicalAnalyzer::ReadNextToken()
     {
-        if (!m_file_contents_loaded)
-        {
-            RetrieveAndStoreContentFromEdlFile();
-            m_file_contents_loaded = true;
-        }
-
         SkipWhiteSpaceAndComments();
 
         switch (m_cur_position_character[0])
@@ -207,25 +502,14 @@ namespace EdlProcessor
             case EQUAL_SIGN:
             {
                 // Tokenize special structural characters 
-                auto token = Token(
-                    m_line_number,
-                    m_column_number,
-                    m_cur_position_character,
-                    m_cur_position_character + 1);
-
+                auto token = CreateLexedToken(m_cur_position_character, m_cur_position_character + 1);
                 m_cur_position_character++;
                 m_column_number++;
                 return token;
             }
             case END_OF_FILE_CHARACTER: // Should be the end of the file
             {
-                auto token = Token(
-                    m_line_number,
-                    m_column_number,
-                    m_cur_position_character,
-                    m_cur_position_character);
-
-                return token;
+                return CreateLexedToken(m_cur_position_character, m_cur_position_character);
             }
         }
 
@@ -234,49 +518,40 @@ namespace EdlProcessor
         // identifiers.
         if (IsStartOfIdentifier(m_cur_position_character[0]) || IsHexPrefix(m_cur_position_character))
         {
-            auto token = Token(
-                m_line_number,
-                m_column_number,
-                m_cur_position_character,
-                m_cur_position_character + 1);
+            auto token_start = m_cur_position_character;
+            auto token = CreateLexedToken(token_start, token_start + 1);
 
             while (isalnum(m_cur_position_character[0]) || (m_cur_position_character[0] == UNDERSCORE))
             {
                 m_cur_position_character++;
             }
 
-            token.m_ending_character = m_cur_position_character;
-            m_column_number += static_cast<uint32_t>(m_cur_position_character - token.m_starting_character);
+            token.m_length = static_cast<std::uint32_t>(m_cur_position_character - token_start);
+            m_column_number += token.m_length;
             return token;
         }
 
         // Tokenize integer literals
         if (std::isdigit(m_cur_position_character[0]))
         {
-            auto token = Token(
-                m_line_number,
-                m_column_number,
-                m_cur_position_character,
-                m_cur_position_character + 1);
+            auto token_start = m_cur_position_character;
+            auto token = CreateLexedToken(token_start, token_start + 1);
 
             while (isdigit(m_cur_position_character[0]))
             {
                 m_cur_position_character++;
             }
 
-            token.m_ending_character = m_cur_position_character;
-            m_column_number += static_cast<uint32_t>(m_cur_position_character - token.m_starting_character);
+            token.m_length = static_cast<std::uint32_t>(m_cur_position_character - token_start);
+            m_column_number += token.m_length;
             return token;
         }
 
         // Tokenize string literals
         if (m_cur_position_character[0] == DOUBLE_QUOTE)
         {
-            auto token = Token(
-                m_line_number,
-                m_column_number,
-                m_cur_position_character,
-                m_cur_position_character + 1);
+            auto token_start = m_cur_position_character;
+            auto token = CreateLexedToken(token_start, token_start + 1);
 
             ++m_cur_position_character;
 
@@ -294,8 +569,9 @@ namespace EdlProcessor
                     m_column_number);
             }
 
-            token.m_ending_character = ++m_cur_position_character;
-            m_column_number += static_cast<uint32_t>(m_cur_position_character - token.m_starting_character);
+            ++m_cur_position_character;
+            token.m_length = static_cast<std::uint32_t>(m_cur_position_character - token_start);
+            m_column_number += token.m_length;
             return token;
         }
 
@@ -0,0 +1,665 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#include <pch.h>
+#include <Edl\LexicalAnalyzer.h>
+#include <Edl\ParseCache.h>
+#include <Utils\GeneratorVersion.h>
+#include <random>
+#include <stdexcept>
+
+using namespace Helpers;
+
+namespace EdlProcessor
+{
+    static inline constexpr std::string_view c_parse_cache_file_header = "edlcodegen-parse-cache";
+    static inline constexpr std::uint64_t c_parse_cache_format_version = 3;
+    static inline constexpr std::string_view c_parse_cache_file_extension = ".edlcache";
+
+    // Far deeper than any type an .edl file can declare (e.g vector<vector<T>>). The limit only
+    // keeps a corrupt entry from recursing until the stack overflows.
+    static inline constexpr std::uint32_t c_max_cached_type_depth = 32;
+
+    // Integers are written as LEB128 varints since most of them (line numbers, enum kinds,
+    // string lengths) are small. Strings are written as their length followed by their content.
+    class EdlCacheWriter
+    {
+    public:
+        void WriteUInt(std::uint64_t value)
+        {
+            while (value >= 0x80)
+            {
+                m_data.push_back(static_cast<char>((value & 0x7F) | 0x80));
+                value >>= 7;
+            }
+
+            m_data.push_back(static_cast<char>(value));
+        }
+
+        void WriteBool(bool value)
+        {
+            m_data.push_back(value ? 1 : 0);
+        }
+
+        void WriteString(std::string_view value)
+        {
+            WriteUInt(value.size());
+            m_data.append(value);
+        }
+
+        std::string& Data() { return m_data; }
+
+    private:
+        std::string m_data {};
+    };
+
+    // Throws std::out_of_range when the data ends before the value being read, which
+    // TryDeserializeCachedEdl and TryLoadFromDisk treat as an invalid cache entry.
+    class EdlCacheReader
+    {
+    public:
+        EdlCacheReader(std::string_view data)
+            : m_data(data)
+        {
+        }
+
+        std::uint64_t ReadUInt()
+        {
+            std::uint64_t value {};
+
+            for (std::uint32_t shift = 0; shift < 64; shift += 7)
+            {
+                auto byte = static_cast<std::uint8_t>(ReadBytes(1)[0]);
+                value |= static_cast<std::uint64_t>(byte & 0x7F) << shift;
+
+                if ((byte & 0x80) == 0)
+                {
+                    return value;
+                }
+            }
+
+            throw std::out_of_range("Invalid integer in edl parse cache entry");
+        }
+
+        std::uint32_t ReadUInt32()
+        {
+            return static_cast<std::uint32_t>(ReadUInt());
+        }
+
+        // Reads the number of elements that follow, each of which is written using at least one
+        // byte. Bounding it by the remaining data keeps a corrupt count from being used to size
+        // an allocation.
+        std::uint64_t ReadCount()
+        {
+            auto count = ReadUInt();
+
+            if (count > m_data.size() - m_position)
+            {
+                throw std::out_of_range("Invalid element count in edl parse cache entry");
+            }
+
+            return count;
+        }
+
+        bool ReadBool()
+        {
+            return ReadBytes(1)[0] != 0;
+        }
+
+        std::string ReadString()
+        {
+            auto size = ReadUInt();
+            return std::string(ReadBytes(size));
+        }
+
+        std::string_view ReadBytes(std::uint64_t size)
+        {
+            if (size > m_data.size() - m_position)
+            {
+                throw std::out_of_range("Edl parse cache entry is truncated");
+            }
+
+            auto bytes = m_data.substr(m_position, size);
+            m_position += size;
+            return bytes;
+        }
+
+        bool AtEnd() const { return m_position == m_data.size(); }
+
+    private:
+        std::string_view m_data {};
+        size_t m_position {};
+    };
+
+    static void WriteToken(EdlCacheWriter& writer, const Token& token)
+    {
+        writer.WriteUInt(token.m_line_number);
+        writer.WriteUInt(token.m_column_number);
+        writer.WriteString(token.ToString());
+    }
+
+    static Token ReadToken(EdlCacheReader& reader)
+    {
+        auto line_number = reader.ReadUInt32();
+        auto column_number = reader.ReadUInt32();
+        return Token::CreateOwnedToken(line_number, column_number, reader.ReadString());
+    }
+
+    static void WriteTypeInfo(EdlCacheWriter& writer, const EdlTypeInfo& type_info)
+    {
+        writer.WriteUInt(static_cast<std::uint32_t>(type_info.m_type_kind));
+        writer.WriteBool(type_info.is_pointer);
+        writer.WriteString(type_info.m_name);
+        writer.WriteBool(type_info.inner_type != nullptr);
+
+        if (type_info.inner_type)
+        {
+            WriteTypeInfo(writer, *type_info.inner_type);
+        }
+    }
+
+    static EdlTypeKind ReadTypeKind(EdlCacheReader& reader)
+    {
+        auto type_kind = reader.ReadUInt32();
+
+        if (type_kind > static_cast<std::uint32_t>(EdlTypeKind::Vector))
+        {
+            throw std::out_of_range("Invalid type kind in edl parse cache entry");
+        }
+
+        return static_cast<EdlTypeKind>(type_kind);
+    }
+
+    static EdlTypeInfo ReadTypeInfo(EdlCacheReader& reader, std::uint32_t depth = 0)
+    {
+        if (depth >= c_max_cached_type_depth)
+        {
+            throw std::out_of_range("Type nesting in edl parse cache entry is too deep");
+        }
+
+        EdlTypeInfo type_info {};
+        type_info.m_type_kind = ReadTypeKind(reader);
+        type_info.is_pointer = reader.ReadBool();
+        type_info.m_name = reader.ReadString();
+
+        if (reader.ReadBool())
+        {
+            type_info.inner_type = std::make_shared<EdlTypeInfo>(ReadTypeInfo(reader, depth + 1));
+        }
+
+        return type_info;
+    }
+
+    static void WriteDeclaration(EdlCacheWriter& writer, const Declaration& declaration)
+    {
+        writer.WriteUInt(static_cast<std::uint32_t>(declaration.m_parent_kind));
+        writer.WriteString(declaration.m_name);
+        WriteTypeInfo(writer, declaration.m_edl_type_info);
+        writer.WriteUInt(declaration.m_array_dimensions.size());
+
+        for (auto& dimension : declaration.m_array_dimensions)
+        {
+            writer.WriteString(dimension);
+        }
+
+        writer.WriteBool(declaration.m_attribute_info.has_value());
+
+        if (declaration.m_attribute_info)
+        {
+            auto& attribute_info = declaration.m_attribute_info.value();
+            writer.WriteBool(attribute_info.m_in_present);
+            writer.WriteBool(attribute_info.m_out_present);
+            writer.WriteBool(attribute_info.m_in_and_out_present);
+            WriteToken(writer, attribute_info.m_size_info);
+            WriteToken(writer, attribute_info.m_count_info);
+        }
+    }
+
+    static Declaration ReadDeclaration(EdlCacheReader& reader)
+    {
+        auto parent_kind = reader.ReadUInt32();
+
+        if (parent_kind > static_cast<std::uint32_t>(DeclarationParentKind::Function))
+        {
+            throw std::out_of_range("Invalid declaration parent kind in edl parse cache entry");
+        }
+
+        Declaration declaration(static_cast<DeclarationParentKind>(parent_kind));
+        declaration.m_name = reader.ReadString();
+        declaration.m_edl_type_info = ReadTypeInfo(reader);
+        declaration.m_array_dimensions.resize(reader.ReadCount());
+
+        for (auto& dimension : declaration.m_array_dimensions)
+        {
+            dimension = reader.ReadString();
+        }
+
+        if (reader.ReadBool())
+        {
+            ParsedAttributeInfo attribute_info {};
+            attribute_info.m_in_present = reader.ReadBool();
+            attribute_info.m_out_present = reader.ReadBool();
+            attribute_info.m_in_and_out_present = reader.ReadBool();
+            attribute_info.m_size_info = ReadToken(reader);
+            attribute_info.m_count_info = ReadToken(reader);
+            declaration.m_attribute_info = std::move(attribute_info);
+        }
+
+        return declaration;
+    }
+
+    static void WriteDeclarations(EdlCacheWriter& writer, const std::vector<Declaration>& declarations)
+    {
+        writer.WriteUInt(declarations.size());
+
+        for (auto& declaration : declarations)
+        {
+            WriteDeclaration(writer, declaration);
+        }
+    }
+
+    static std::vector<Declaration> ReadDeclarations(EdlCacheReader& reader)
+    {
+        std::vector<Declaration> declarations {};
+        auto count = reader.ReadUInt();
+
+        for (std::uint64_t i = 0; i < count; i++)
+        {
+            declarations.push_back(ReadDeclaration(reader));
+        }
+
+        return declarations;
+    }
+
+    static void WriteEnumType(EdlCacheWriter& writer, const EnumType& enum_type)
+    {
+        writer.WriteString(enum_type.m_name);
+        writer.WriteBool(enum_type.m_value.has_value());
+
+        if (enum_type.m_value)
+        {
+            writer.WriteString(enum_type.m_value.value());
+        }
+
+        writer.WriteUInt(enum_type.m_declared_position);
+        writer.WriteBool(enum_type.m_is_hex);
+        writer.WriteBool(enum_type.m_is_default_value);
+        writer.WriteString(enum_type.m_parent_file.generic_string());
+    }
+
+    static EnumType ReadEnumType(EdlCacheReader& reader)
+    {
+        EnumType enum_type {};
+        enum_type.m_name = reader.ReadString();
+
+        if (reader.ReadBool())
+        {
+            enum_type.m_value = reader.ReadString();
+        }
+
+        enum_type.m_declared_position = reader.ReadUInt();
+        enum_type.m_is_hex = reader.ReadBool();
+        enum_type.m_is_default_value = reader.ReadBool();
+        enum_type.m_parent_file = reader.ReadString();
+        return enum_type;
+    }
+
+    static void WriteDeveloperType(EdlCacheWriter& writer, const DeveloperType& developer_type)
+    {
+        writer.WriteString(developer_type.m_name);
+        writer.WriteUInt(static_cast<std::uint32_t>(developer_type.m_type_kind));
+        WriteDeclarations(writer, developer_type.m_fields);
+        writer.WriteUInt(developer_type.m_items.size());
+
+        for (auto& [item_name, item] : developer_type.m_items)
+        {
+            writer.WriteString(item_name);
+            WriteEnumType(writer, item);
+        }
+
+        writer.WriteBool(developer_type.m_contains_inner_pointer);
+        writer.WriteBool(developer_type.m_contains_container_type);
+        writer.WriteString(developer_type.m_parent_file.generic_string());
+    }
+
+    static DeveloperType ReadDeveloperType(EdlCacheReader& reader)
+    {
+        auto name = reader.ReadString();
+        DeveloperType developer_type(name, ReadTypeKind(reader));
+        developer_type.m_fields = ReadDeclarations(reader);
+        auto item_count = reader.ReadUInt();
+
+        for (std::uint64_t i = 0; i < item_count; i++)
+        {
+            auto item_name = reader.ReadString();
+            developer_type.m_items.insert(std::move(item_name), ReadEnumType(reader));
+        }
+
+        developer_type.m_contains_inner_pointer = reader.ReadBool();
+        developer_type.m_contains_container_type = reader.ReadBool();
+        developer_type.m_parent_file = reader.ReadString();
+        return developer_type;
+    }
+
+    static void WriteFunctions(EdlCacheWriter& writer, const OrderedMap<std::string, Function>& functions)
+    {
+        writer.WriteUInt(functions.size());
+
+        for (auto& [signature, function] : functions)
+        {
+            writer.WriteString(signature);
+            writer.WriteString(function.m_name);
+            writer.WriteString(function.abi_m_name);
+            writer.WriteUInt(function.m_declared_position);
+            WriteDeclaration(writer, function.m_return_info);
+            WriteDeclarations(writer, function.m_parameters);
+            writer.WriteString(function.m_parent_file.generic_string());
+        }
+    }
+
+    static OrderedMap<std::string, Function> ReadFunctions(EdlCacheReader& reader)
+    {
+        OrderedMap<std::string, Function> functions {};
+        auto count = reader.ReadUInt();
+
+        for (std::uint64_t i = 0; i < count; i++)
+        {
+            auto signature = reader.ReadString();
+            Function function {};
+            function.m_name = reader.ReadString();
+            function.abi_m_name = reader.ReadString();
+            function.m_declared_position = static_cast<std::size_t>(reader.ReadUInt());
+            function.m_return_info = ReadDeclaration(reader);
+            function.m_parameters = ReadDeclarations(reader);
+            function.m_parent_file = reader.ReadString();
+            functions.insert(std::move(signature), std::move(function));
+        }
+
+        return functions;
+    }
+
+    std::string SerializeCachedEdl(const CachedEdl& cached_edl)
+    {
+        EdlCacheWriter writer {};
+        auto& edl = cached_edl.m_edl;
+        writer.WriteString(edl.m_name);
+        writer.WriteUInt(edl.m_developer_types.size());
+
+        for (auto& [type_name, developer_type] : edl.m_developer_types)
+        {
+            writer.WriteString(type_name);
+            WriteDeveloperType(writer, developer_type);
+        }
+
+        WriteFunctions(writer, edl.m_trusted_functions);
+        WriteFunctions(writer, edl.m_untrusted_functions);
+        writer.WriteUInt(cached_edl.m_files.size());
+
+        for (auto& file : cached_edl.m_files)
+        {
+            writer.WriteString(file.generic_string());
+        }
+
+        return std::move(writer.Data());
+    }
+
+    bool TryDeserializeCachedEdl(std::string_view data, CachedEdl& cached_edl)
+    {
+        try
+        {
+            EdlCacheReader reader(data);
+            CachedEdl result {};
+            result.m_edl.m_name = reader.ReadString();
+            auto developer_type_count = reader.ReadUInt();
+
+            for (std::uint64_t i = 0; i < developer_type_count; i++)
+            {
+                auto type_name = reader.ReadString();
+                result.m_edl.m_developer_types.insert(std::move(type_name), ReadDeveloperType(reader));
+            }
+
+            result.m_edl.m_trusted_functions = ReadFunctions(reader);
+            result.m_edl.m_untrusted_functions = ReadFunctions(reader);
+            auto file_count = reader.ReadUInt();
+
+            for (std::uint64_t i = 0; i < file_count; i++)
+            {
+                result.m_files.push_back(reader.ReadString());
+            }
+
+            if (!reader.AtEnd())
+            {
+                return false;
+            }
+
+            cached_edl = std::move(result);
+            return true;
+        }
+        catch (const std::exception&)
+        {
+            return false;
+        }
+    }
+
+    EdlParseCache::EdlParseCache(const std::filesystem::path& cache_directory)
+        : m_cache_directory(cache_directory)
+    {
+    }
+
+    // Paths are used as written instead of being canonicalized. The paths of imported files are built
+    // from the import directories as written, and EdlParser relies on a file always being spelt the same
+    // way to detect duplicate imports. Relative paths are only meaningful with the current directory.
+    std::string EdlParseCache::CreateKey(
+        const std::filesystem::path& file_path,
+        std::span<const std::filesystem::path> import_directories)
+    {
+        std::string key = file_path.generic_string();
+        bool has_relative_path = file_path.is_relative();
+
+        for (auto& import_directory : import_directories)
+        {
+            key += std::format("\n{}", import_directory.generic_string());
+            has_relative_path = has_relative_path || import_directory.is_relative();
+        }
+
+        if (has_relative_path)
+        {
+            key += std::format("\n{}", std::filesystem::current_path().generic_string());
+        }
+
+        return key;
+    }
+
+    std::shared_ptr<const CachedEdl> EdlParseCache::Find(
+        const std::filesystem::path& file_path,
+        std::span<const std::filesystem::path> import_directories)
+    {
+        auto key = CreateKey(file_path, import_directories);
+
+        {
+            std::lock_guard lock(m_lock);
+            auto entry = m_entries.find(key);
+
+            if (entry != m_entries.end())
+            {
+                return entry->second;
+            }
+        }
+
+        auto entry = TryLoadFromDisk(key);
+
+        if (entry)
+        {
+            std::lock_guard lock(m_lock);
+            entry = m_entries.try_emplace(std::move(key), std::move(entry)).first->second;
+        }
+
+        return entry;
+    }
+
+    void EdlParseCache::Store(
+        const std::filesystem::path& file_path,
+        std::span<const std::filesystem::path> import_directories,
+        CachedEdl cached_edl)
+    {
+        auto key = CreateKey(file_path, import_directories);
+        auto entry = std::make_shared<const CachedEdl>(std::move(cached_edl));
+        bool inserted {};
+
+        {
+            std::lock_guard lock(m_lock);
+            inserted = m_entries.try_emplace(key, entry).second;
+        }
+
+        if (inserted)
+        {
+            TrySaveToDisk(key, *entry);
+        }
+    }
+
+    std::filesystem::path EdlParseCache::GetCacheFilePath(std::string_view key) const
+    {
+        auto file_name = std::format("{:016x}{}", ComputeContentHash(key), c_parse_cache_file_extension);
+        return m_cache_directory / file_name;
+    }
+
+    // A cache file contains a header followed by the serialized CachedEdl. The header holds the
+    // format version, the build of edlcodegen that wrote it, the full key of the entry (file names are
+    // only a hash of it), a hash of the serialized CachedEdl to detect corrupted files and the content
+    // hash of every .edl file the entry was parsed from, in the same order as CachedEdl::m_files.
+    // Hashes the file the same way the lexer hashes the content it tokenizes.
+    static bool TryComputeEdlFileHash(const std::filesystem::path& file_path, std::uint64_t& hash)
+    {
+        EdlFileView file_view {};
+
+        if (!file_view.TryOpen(file_path))
+        {
+            return false;
+        }
+
+        hash = ComputeContentHash(file_view.Content());
+        return true;
+    }
+
+    std::shared_ptr<const CachedEdl> EdlParseCache::TryLoadFromDisk(const std::string& key) const
+    {
+        if (m_cache_directory.empty())
+        {
+            return nullptr;
+        }
+
+        std::ifstream cache_file(GetCacheFilePath(key), std::ios::in | std::ios::binary);
+
+        if (!cache_file)
+        {
+            return nullptr;
+        }
+
+        std::ostringstream string_stream;
+        string_stream << cache_file.rdbuf();
+        std::string data = std::move(string_stream).str();
+
+        try
+        {
+            EdlCacheReader reader(data);
+
+            if (reader.ReadString() != c_parse_cache_file_header ||
+                reader.ReadUInt() != c_parse_cache_format_version ||
+                reader.ReadString() != GetGeneratorVersion() ||
+                reader.ReadString() != key)
+            {
+                return nullptr;
+            }
+
+            auto payload_hash = reader.ReadUInt();
+            std::vector<std::uint64_t> file_hashes(reader.ReadCount());
+
+            for (auto& file_hash : file_hashes)
+            {
+                file_hash = reader.ReadUInt();
+            }
+
+            auto payload = reader.ReadBytes(reader.ReadUInt());
+            CachedEdl cached_edl {};
+
+            if (ComputeContentHash(payload) != payload_hash ||
+                !TryDeserializeCachedEdl(payload, cached_edl) ||
+                cached_edl.m_files.size() != file_hashes.size())
+            {
+                return nullptr;
+            }
+
+            for (size_t i = 0; i < file_hashes.size(); i++)
+            {
+                std::uint64_t current_hash {};
+
+                if (!TryComputeEdlFileHash(cached_edl.m_files[i], current_hash) || current_hash != file_hashes[i])
+                {
+                    return nullptr;
+                }
+            }
+
+            cached_edl.m_file_hashes = std::move(file_hashes);
+
+            return std::make_shared<const CachedEdl>(std::move(cached_edl));
+        }
+        catch (const std::exception&)
+        {
+            // The cache is best effort, a corrupt entry or a failure reading it is treated as a miss.
+            return nullptr;
+        }
+    }
+
+    // The cache is best effort, failing to write an entry only means it will be parsed again next time.
+    void EdlParseCache::TrySaveToDisk(const std::string& key, const CachedEdl& cached_edl) const
+    {
+        if (m_cache_directory.empty() || cached_edl.m_file_hashes.size() != cached_edl.m_files.size())
+        {
+            return;
+        }
+
+        EdlCacheWriter writer {};
+        writer.WriteString(c_parse_cache_file_header);
+        writer.WriteUInt(c_parse_cache_format_version);
+        writer.WriteString(GetGeneratorVersion());
+        writer.WriteString(key);
+
+        auto payload = SerializeCachedEdl(cached_edl);
+        writer.WriteUInt(ComputeContentHash(payload));
+        writer.WriteUInt(cached_edl.m_file_hashes.size());
+
+        for (auto file_hash : cached_edl.m_file_hashes)
+        {
+            writer.WriteUInt(file_hash);
+        }
+
+        writer.WriteString(payload);
+
+        std::error_code error {};
+        std::filesystem::create_directories(m_cache_directory, error);
+
+        // Multiple edlcodegen processes may cache the same file at the same time, so write to
+        // a uniquely named file first and then move it in place. Readers never see a partial file.
+        auto cache_file_path = GetCacheFilePath(key);
+        auto temp_file_path = cache_file_path;
+        temp_file_path += std::format(".{:08x}.tmp", std::random_device {}());
+
+        {
+            std::ofstream temp_file(temp_file_path, std::ios::out | std::ios::binary | std::ios::trunc);
+
+            if (!temp_file || !temp_file.write(writer.Data().data(), writer.Data().size()))
+            {
+                temp_file.close();
+                std::filesystem::remove(temp_file_path, error);
+                return;
+            }
+        }
+
+        std::filesystem::rename(temp_file_path, cache_file_path, error);
+
+        if (error)
+        {
+            std::filesystem::remove(temp_file_path, error);
+        }
+    }
+}
@@ -9,9 +9,11 @@
 #include <pch.h>
 #include <Edl\Parser.h>
 #include <Exceptions.h>
+#include <Utils\PhaseTimer.h>
 #include <Windows.h>
 
 using namespace ToolingExceptions;
+using namespace Helpers;
 
 namespace EdlProcessor
 {
@@ -19,15 +21,44 @@ namespace EdlProcessor
 
     EdlParser::EdlParser(
         const std::filesystem::path& file_path, 
-        std::vector<std::filesystem::path> import_directories) :
+        std::vector<std::filesystem::path> import_directories,
+        std::shared_ptr<EdlParseCache> parse_cache) :
             m_import_directories(std::move(import_directories)),
             m_file_path(file_path),
             m_file_name(m_file_path.filename().replace_extension()),
             m_cur_line(1),
-            m_cur_column(1)
+            m_cur_column(1),
+            m_parse_cache(std::move(parse_cache))
     {
     }
 
+    // Since we allow developer functions to contain the same name but with different
+    // parameters, we need to make sure the non developer facing functions are unique
+    // in our abi layer. So we append a number to the function name. The numbers are assigned
+    // once the whole .edl file has been parsed so that they only depend on its content, and not
+    // on what else was parsed by the process before it. They follow the order the functions were
+    // declared in, trusted and untrusted ones alike.
+    static void AssignAbiFunctionNames(Edl& edl)
+    {
+        std::vector<Function*> functions {};
+
+        for (auto& map : {std::ref(edl.m_trusted_functions), std::ref(edl.m_untrusted_functions)})
+        {
+            for (auto& function : map.get().values())
+            {
+                functions.push_back(&function);
+            }
+        }
+
+        std::ranges::sort(functions, {}, &Function::m_declared_position);
+        std::size_t abi_function_index {};
+
+        for (auto function : functions)
+        {
+            function->abi_m_name = std::format("{}_{}", function->m_name, abi_function_index++);
+        }
+    }
+
     Token EdlParser::PeekAtCurrentToken()
     {
         return m_cur_token;
@@ -128,21 +159,56 @@ namespace EdlProcessor
 
     Edl EdlParser::Parse()
     {
+        if (m_parse_cache)
+        {
+            if (auto cached_edl = m_parse_cache->Find(m_file_path, m_import_directories))
+            {
+                PrintStatus(Status::Info, std::format("Using previously parsed {}", m_file_name.generic_string()));
+                m_parsed_files = cached_edl->m_files;
+                std::ranges::sort(m_parsed_files);
+
+                Edl edl = cached_edl->m_edl;
+                AssignAbiFunctionNames(edl);
+                return edl;
+            }
+        }
+
         std::unordered_map<std::filesystem::path, ParsedState> parsed_files;
         ParseInternal(parsed_files);
-        return parsed_files[m_file_path].m_edl;
+
+        m_parsed_files.clear();
+
+        for (auto& [file_path, parse_state] : parsed_files)
+        {
+            m_parsed_files.push_back(file_path);
+        }
+
+        std::ranges::sort(m_parsed_files);
+
+        if (m_parse_cache)
+        {
+            // Nothing was parsed before the top level file, so even if duplicate imports were skipped
+            // while parsing it, their content was merged in by another import and the result is complete.
+            StoreInParseCache(parsed_files[m_file_path].m_edl, m_parsed_files, parsed_files);
+        }
+
+        Edl edl = parsed_files[m_file_path].m_edl;
+        AssignAbiFunctionNames(edl);
+        return edl;
     }
 
     void EdlParser::ParseInternal(std::unordered_map<std::filesystem::path, ParsedState>& parsed_files)
     {
+        ScopedPhaseTimer timer(CodeGenerationPhase::Parse);
         std::string status = std::format("Processing {}", m_file_name.generic_string());
         PrintStatus(Status::Info, status);
-        parsed_files[m_file_path] = { ParseStatus::Parsing, m_file_name.generic_string() };
+        parsed_files[m_file_path] = { ParseStatus::Parsing, Edl { m_file_name.generic_string() }, { m_file_path } };
 
         // Start LexicalAnalyzer so we can walk through .edl file.
         m_lexical_analyzer = LexicalAnalyzer{m_file_path};
         m_cur_token = m_lexical_analyzer.GetNextToken();
         m_next_token = m_lexical_analyzer.GetNextToken();
+        parsed_files[m_file_path].m_content_hash = m_lexical_analyzer.ContentHash();
 
         ThrowIfExpectedTokenNotNext(EDL_ENCLAVE_KEYWORD);
         ThrowIfExpectedTokenNotNext(LEFT_CURLY_BRACKET);
@@ -152,8 +218,29 @@ namespace EdlProcessor
 
         status = std::format("Completed parsing {} successfully", m_file_name.generic_string());
         PrintStatus(Status::Info, status);
-        parsed_files[m_file_path].m_status = ParseStatus::Parsed;
-        parsed_files[m_file_path].m_edl = std::move(m_edl);
+        auto& parsed_state = parsed_files[m_file_path];
+        parsed_state.m_status = ParseStatus::Parsed;
+        parsed_state.m_edl = std::move(m_edl);
+
+        if (m_parse_cache && parsed_state.m_is_self_contained)
+        {
+            StoreInParseCache(parsed_state.m_edl, parsed_state.m_files, parsed_files);
+        }
+    }
+
+    void EdlParser::StoreInParseCache(
+        const Edl& edl,
+        const std::vector<std::filesystem::path>& files,
+        const std::unordered_map<std::filesystem::path, ParsedState>& parsed_files)
+    {
+        CachedEdl cached_edl { edl, files };
+
+        for (auto& file : files)
+        {
+            cached_edl.m_file_hashes.push_back(parsed_files.at(file).m_content_hash);
+        }
+
+        m_parse_cache->Store(m_file_path, m_import_directories, std::move(cached_edl));
     }
 
     bool AreFilePathsTheSame(
@@ -197,8 +284,24 @@ namespace EdlProcessor
                 }
             });
 
-        dest_edl.m_trusted_functions.merge(src_edl.m_trusted_functions);
-        dest_edl.m_untrusted_functions.merge(src_edl.m_untrusted_functions);
+        // The imported functions were numbered from zero in their own parse. They come after the
+        // functions this file declared before the import statement.
+        auto trusted_functions = src_edl.m_trusted_functions;
+        auto untrusted_functions = src_edl.m_untrusted_functions;
+        std::size_t next_declared_position = m_declared_function_count;
+
+        for (auto& map : {std::ref(trusted_functions), std::ref(untrusted_functions)})
+        {
+            for (auto& function : map.get().values())
+            {
+                function.m_declared_position += m_declared_function_count;
+                next_declared_position = std::max(next_declared_position, function.m_declared_position + 1);
+            }
+        }
+
+        m_declared_function_count = next_declared_position;
+        dest_edl.m_trusted_functions.merge(trusted_functions);
+        dest_edl.m_untrusted_functions.merge(untrusted_functions);
     }
 
     void EdlParser::ParseBody(std::unordered_map<std::filesystem::path, ParsedState>& parsed_files)
@@ -238,6 +341,7 @@ namespace EdlProcessor
             }
         }
 
+        ScopedPhaseTimer timer(CodeGenerationPhase::Validate);
         UpdateDeveloperTypeMetadata();
         PerformFinalValidations();
     }
@@ -507,6 +611,7 @@ namespace EdlProcessor
             Function parsed_function = ParseFunctionDeclaration();
             std::string function_signature = parsed_function.GetDeclarationSignature();
             parsed_function.m_parent_file = m_file_path;
+            parsed_function.m_declared_position = m_declared_function_count;
 
             if (func_map.contains(function_signature))
             {
@@ -518,12 +623,8 @@ namespace EdlProcessor
                     parsed_function.m_name);
             }
 
-            // Since we allow developer functions to contain the same name but with different
-            // parameters, we need to make sure the non developer facing functions are unique
-            // in our abi layer. So we append a number to the function name.
-            static std::size_t m_abi_function_index {};
-            parsed_function.abi_m_name = std::format("{}_{}", parsed_function.m_name, m_abi_function_index++);
             func_map.insert(function_signature, parsed_function);
+            m_declared_function_count++;
         }
 
         ThrowIfExpectedTokenNotNext(RIGHT_CURLY_BRACKET);
@@ -675,11 +776,11 @@ namespace EdlProcessor
 
                 if (attribute == AttributeKind::Size)
                 {
-                    attributeInfo.m_size_info = attribute_value;
+                    attributeInfo.m_size_info = attribute_value.CreateOwnedCopy();
                 }
                 else if (attribute == AttributeKind::Count)
                 {
-                    attributeInfo.m_count_info = attribute_value;
+                    attributeInfo.m_count_info = attribute_value.CreateOwnedCopy();
                 }
             }
             else if (attribute == AttributeKind::In)
@@ -1097,7 +1198,7 @@ namespace EdlProcessor
                 if (m_edl.m_developer_types.contains(EDL_ANONYMOUS_ENUM_KEYWORD))
                 {
                     DeveloperType& type = m_edl.m_developer_types.at(EDL_ANONYMOUS_ENUM_KEYWORD);
-                    if (type.m_items.contains(token.ToString()))
+                    if (type.m_items.contains(token.ToStringView()))
                     {
                         continue;
                     }
@@ -1225,16 +1326,78 @@ namespace EdlProcessor
             {
                 // Ignore duplicate imports. As long as we've parsed
                 // the imported file at least once we're ok.
+                parsed_files.at(m_file_path).m_is_self_contained = false;
                 return;
             }
         }
 
-        EdlParser parser(full_file_path, m_import_directories);
+        if (TryUseCachedImport(full_file_path, parsed_files))
+        {
+            return;
+        }
+
+        EdlParser parser(full_file_path, m_import_directories, m_parse_cache);
         parser.ParseInternal(parsed_files);
 
+        auto& imported_state = parsed_files.at(full_file_path);
+        auto& current_state = parsed_files.at(m_file_path);
+        current_state.m_files.insert(current_state.m_files.end(), imported_state.m_files.begin(), imported_state.m_files.end());
+        current_state.m_is_self_contained = current_state.m_is_self_contained && imported_state.m_is_self_contained;
+
+        // Merge imported edl object data into the current edl object.
+        MergeEdl(imported_state.m_edl, m_edl);
+    }
+
+    bool EdlParser::TryUseCachedImport(
+        const std::filesystem::path& import_file_path,
+        std::unordered_map<std::filesystem::path, ParsedState>& parsed_files)
+    {
+        if (!m_parse_cache)
+        {
+            return false;
+        }
+
+        auto cached_edl = m_parse_cache->Find(import_file_path, m_import_directories);
+
+        if (!cached_edl)
+        {
+            return false;
+        }
+
+        PrintStatus(Status::Info, std::format("Using previously parsed {}", import_file_path.stem().generic_string()));
+        auto& current_state = parsed_files.at(m_file_path);
+
+        for (size_t i = 0; i < cached_edl->m_files.size(); i++)
+        {
+            auto& file = cached_edl->m_files[i];
+            auto [parse_data, inserted] = parsed_files.try_emplace(file);
+
+            if (inserted)
+            {
+                parse_data->second.m_status = ParseStatus::Parsed;
+                parse_data->second.m_content_hash = cached_edl->m_file_hashes[i];
+                current_state.m_files.push_back(file);
+            }
+            else if (parse_data->second.m_status == ParseStatus::Parsing)
+            {
+                throw EdlAnalysisException(
+                    ErrorId::ImportCycleFound,
+                    m_file_name,
+                    m_cur_line,
+                    m_cur_column,
+                    import_file_path.filename().generic_string(),
+                    m_file_path.filename().generic_string());
+            }
+            else
+            {
+                // Part of the cached import was already merged in by another import.
+                current_state.m_is_self_contained = false;
+            }
+        }
+
         // Merge imported edl object data into the current edl object.
-        auto& imported_edl = parsed_files.at(full_file_path).m_edl;
-        MergeEdl(imported_edl, m_edl);
+        MergeEdl(cached_edl->m_edl, m_edl);
+        return true;
     }
 
 }
@@ -0,0 +1,42 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#include <pch.h>
+#include <Utils\GeneratorVersion.h>
+#include <Windows.h>
+
+namespace Helpers
+{
+    // Defined in this one translation unit so every caller sees the same __DATE__ and __TIME__.
+    // The size and last write time of the executable are included since __DATE__ and __TIME__
+    // only change when this file is recompiled, not when only the generators are.
+    const std::string& GetGeneratorVersion()
+    {
+        static const std::string s_generator_version = [] ()
+        {
+            std::string version = std::format("edlcodegen {} {}", __DATE__, __TIME__);
+            std::wstring module_path(MAX_PATH, L'\0');
+            auto length = GetModuleFileNameW(nullptr, module_path.data(), static_cast<DWORD>(module_path.size()));
+
+            if (length == 0 || length >= module_path.size())
+            {
+                return version;
+            }
+
+            module_path.resize(length);
+            std::error_code size_error {};
+            std::error_code time_error {};
+            auto file_size = std::filesystem::file_size(module_path, size_error);
+            auto last_write_time = std::filesystem::last_write_time(module_path, time_error);
+
+            if (!size_error && !time_error)
+            {
+                version += std::format(" {} {}", file_size, last_write_time.time_since_epoch().count());
+            }
+
+            return version;
+        }();
+
+        return s_generator_version;
+    }
+}
@@ -0,0 +1,351 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+namespace veil::any::binary_log
+{
+    //
+    // Binary log records, which carry the id of a printf style format string and the raw bytes of its
+    // arguments, so the enclave doesn't format anything. A record is a record_header followed by
+    // header.size - sizeof(record_header) bytes of payload:
+    //
+    //  - record_type::definition: the format string of header.formatId, as UTF-16 code units
+    //  - record_type::message: its arguments, each an argument_type byte followed by the value
+    //    (4 or 8 bytes, or a uint16_t length and the characters for strings)
+    //
+    // Multi-byte values are stored as is (little endian), without alignment. A stream of records
+    // carries the definition of each format id before its first message.
+    //
+
+    enum class record_type : uint8_t
+    {
+        definition = 1,
+        message = 2,
+    };
+
+    enum class argument_type : uint8_t
+    {
+        int32 = 1,
+        uint32,
+        int64,
+        uint64,
+        float64,
+        pointer,
+
+        // uint16_t length, then that many 1 byte characters
+        string,
+
+        // uint16_t length, then that many UTF-16 code units
+        wstring,
+    };
+
+    struct record_header
+    {
+        record_type type;
+        uint8_t reserved;
+
+        // Size of the record, header included
+        uint16_t size;
+
+        uint32_t formatId;
+
+        // Microseconds on the enclave's performance counter when the message was logged, 0 for definitions
+        uint64_t timestamp;
+    };
+
+    static_assert(sizeof(record_header) == 16);
+
+    // Id of a format string (FNV-1a of its characters), computed at compile time for literals
+    template <typename CharT>
+    constexpr uint32_t format_id(std::basic_string_view<CharT> format) noexcept
+    {
+        uint32_t hash = 2166136261u;
+        for (auto ch : format)
+        {
+            hash = (hash ^ static_cast<uint32_t>(static_cast<std::make_unsigned_t<CharT>>(ch))) * 16777619u;
+        }
+        return hash;
+    }
+
+    //
+    // Appends values to a fixed size buffer. Strings are truncated to what fits, other values that
+    // don't fit are left out (full() says whether anything was).
+    //
+    class record_writer
+    {
+    public:
+        explicit record_writer(std::span<uint8_t> buffer) noexcept
+            : m_buffer(buffer)
+        {
+        }
+
+        size_t size() const noexcept
+        {
+            return m_size;
+        }
+
+        bool full() const noexcept
+        {
+            return m_full;
+        }
+
+        template <typename T>
+        void write_value(const T& value) noexcept
+        {
+            static_assert(std::is_trivially_copyable_v<T>);
+            if (m_buffer.size() - m_size < sizeof(T))
+            {
+                m_full = true;
+                return;
+            }
+            std::memcpy(m_buffer.data() + m_size, &value, sizeof(T));
+            m_size += sizeof(T);
+        }
+
+        void write_header(record_type type, uint32_t formatId, uint64_t timestamp) noexcept
+        {
+            write_value(record_header {type, 0, 0, formatId, timestamp});
+        }
+
+        // Sets the header's size to everything written so far
+        void finish() noexcept
+        {
+            auto size = static_cast<uint16_t>(m_size);
+            std::memcpy(m_buffer.data() + offsetof(record_header, size), &size, sizeof(size));
+        }
+
+        template <typename CharT>
+        void write_characters(std::basic_string_view<CharT> characters) noexcept
+        {
+            constexpr auto c_unitSize = sizeof(CharT) == 1 ? 1 : sizeof(uint16_t);
+            auto room = (m_buffer.size() - m_size) / c_unitSize;
+            if (room < characters.size())
+            {
+                m_full = true;
+                characters = characters.substr(0, room);
+            }
+
+            if constexpr (sizeof(CharT) == 1 || sizeof(CharT) == sizeof(uint16_t))
+            {
+                std::memcpy(m_buffer.data() + m_size, characters.data(), characters.size() * c_unitSize);
+                m_size += characters.size() * c_unitSize;
+            }
+            else
+            {
+                for (auto ch : characters)
+                {
+                    write_value(static_cast<uint16_t>(ch));
+                }
+            }
+        }
+
+        // Writes a definition's format string as UTF-16 code units, narrow ones are widened a character at a time
+        template <typename CharT>
+        void write_format(std::basic_string_view<CharT> format) noexcept
+        {
+            if constexpr (sizeof(CharT) == 1)
+            {
+                for (auto ch : format)
+                {
+                    write_value(static_cast<uint16_t>(static_cast<unsigned char>(ch)));
+                }
+            }
+            else
+            {
+                write_characters(format);
+            }
+        }
+
+        template <typename T>
+        void write_argument(const T& value) noexcept
+        {
+            using type = std::remove_cvref_t<T>;
+            if constexpr (std::is_enum_v<type>)
+            {
+                write_argument(static_cast<std::underlying_type_t<type>>(value));
+            }
+            else if constexpr (std::is_same_v<type, bool>)
+            {
+                write_argument(static_cast<int32_t>(value));
+            }
+            else if constexpr (std::is_same_v<type, const char*> || std::is_same_v<type, char*>)
+            {
+                write_string(argument_type::string, value ? std::string_view(value) : std::string_view("(null)"));
+            }
+            else if constexpr (std::is_same_v<type, const wchar_t*> || std::is_same_v<type, wchar_t*>)
+            {
+                write_string(argument_type::wstring, value ? std::wstring_view(value) : std::wstring_view(L"(null)"));
+            }
+            else if constexpr (std::is_convertible_v<const type&, std::string_view>)
+            {
+                write_string(argument_type::string, std::string_view(value));
+            }
+            else if constexpr (std::is_convertible_v<const type&, std::wstring_view>)
+            {
+                write_string(argument_type::wstring, std::wstring_view(value));
+            }
+            else if constexpr (std::is_integral_v<type> && sizeof(type) <= sizeof(uint32_t))
+            {
+                if constexpr (std::is_signed_v<type>)
+                {
+                    write_tagged(argument_type::int32, static_cast<int32_t>(value));
+                }
+                else
+                {
+                    write_tagged(argument_type::uint32, static_cast<uint32_t>(value));
+                }
+            }
+            else if constexpr (std::is_integral_v<type>)
+            {
+                if constexpr (std::is_signed_v<type>)
+                {
+                    write_tagged(argument_type::int64, static_cast<int64_t>(value));
+                }
+                else
+                {
+                    write_tagged(argument_type::uint64, static_cast<uint64_t>(value));
+                }
+            }
+            else if constexpr (std::is_floating_point_v<type>)
+            {
+                write_tagged(argument_type::float64, static_cast<double>(value));
+            }
+            else if constexpr (std::is_pointer_v<type>)
+            {
+                write_tagged(argument_type::pointer, static_cast<uint64_t>(reinterpret_cast<uintptr_t>(value)));
+            }
+            else if constexpr (std::is_null_pointer_v<type>)
+            {
+                write_tagged(argument_type::pointer, uint64_t {});
+            }
+            else
+            {
+                static_assert(!sizeof(type), "Unsupported binary log argument type");
+            }
+        }
+
+    private:
+        template <typename T>
+        void write_tagged(argument_type type, T value) noexcept
+        {
+            if (m_buffer.size() - m_size < 1 + sizeof(T))
+            {
+                m_full = true;
+                return;
+            }
+            write_value(type);
+            write_value(value);
+        }
+
+        template <typename CharT>
+        void write_string(argument_type type, std::basic_string_view<CharT> value) noexcept
+        {
+            constexpr auto c_unitSize = sizeof(CharT) == 1 ? 1 : sizeof(uint16_t);
+            if (m_buffer.size() - m_size < 1 + sizeof(uint16_t))
+            {
+                m_full = true;
+                return;
+            }
+
+            auto room = (m_buffer.size() - m_size - 1 - sizeof(uint16_t)) / c_unitSize;
+            auto length = static_cast<uint16_t>(std::min<size_t>({value.size(), room, UINT16_MAX}));
+            write_value(type);
+            write_value(length);
+            write_characters(value.substr(0, length));
+            m_full = m_full || length < value.size();
+        }
+
+        std::span<uint8_t> m_buffer;
+        size_t m_size {};
+        bool m_full {};
+    };
+
+    //
+    // Reads values back from a record (or a stream of them). Reads past the end return std::nullopt.
+    //
+    class record_reader
+    {
+    public:
+        explicit record_reader(std::span<const uint8_t> bytes) noexcept
+            : m_bytes(bytes)
+        {
+        }
+
+        bool empty() const noexcept
+        {
+            return m_offset >= m_bytes.size();
+        }
+
+        template <typename T>
+        std::optional<T> read_value() noexcept
+        {
+            static_assert(std::is_trivially_copyable_v<T>);
+            if (m_bytes.size() - m_offset < sizeof(T))
+            {
+                return std::nullopt;
+            }
+            T value;
+            std::memcpy(&value, m_bytes.data() + m_offset, sizeof(T));
+            m_offset += sizeof(T);
+            return value;
+        }
+
+        // Next record of a stream, std::nullopt at the end (or if the stream is truncated)
+        std::optional<std::pair<record_header, std::span<const uint8_t>>> read_record() noexcept
+        {
+            auto header = read_value<record_header>();
+            if (!header || header->size < sizeof(record_header) || m_bytes.size() - m_offset < header->size - sizeof(record_header))
+            {
+                m_offset = m_bytes.size();
+                return std::nullopt;
+            }
+
+            auto payload = m_bytes.subspan(m_offset, header->size - sizeof(record_header));
+            m_offset += payload.size();
+            return std::pair {*header, payload};
+        }
+
+        // Reads length characters, 1 byte (argument_type::string) or UTF-16 code units (the others) each
+        std::optional<std::wstring> read_characters(size_t length, bool narrow) noexcept
+        try
+        {
+            auto unitSize = narrow ? size_t {1} : sizeof(uint16_t);
+            if ((m_bytes.size() - m_offset) / unitSize < length)
+            {
+                return std::nullopt;
+            }
+
+            auto characters = std::wstring(length, L'\0');
+            for (size_t i = 0; i < length; i++)
+            {
+                characters[i] = narrow ? static_cast<wchar_t>(*read_value<uint8_t>()) : static_cast<wchar_t>(*read_value<uint16_t>());
+            }
+            return characters;
+        }
+        catch (...)
+        {
+            return std::nullopt;
+        }
+
+        std::span<const uint8_t> remaining() const noexcept
+        {
+            return m_bytes.subspan(m_offset);
+        }
+
+    private:
+        std::span<const uint8_t> m_bytes;
+        size_t m_offset {};
+    };
+}
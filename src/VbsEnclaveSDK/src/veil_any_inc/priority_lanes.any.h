@@ -0,0 +1,156 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <deque>
+
+namespace veil::any::implementation
+{
+    //
+    // FIFO lanes of queued values (e.g. task handles), one lane per task priority, lane 0 being the
+    // most urgent.
+    //
+    // Lanes are drained with strict priority plus aging: pop takes from the most urgent lane that isn't
+    // empty, and every lane it passes over ages by one. A lane that has been passed over c_agingLimit
+    // times is popped next regardless of priority, so less urgent work still makes progress under a
+    // constant stream of urgent work (at least one pop in every c_agingLimit + 1).
+    //
+    // Not thread safe, the owner serializes access.
+    //
+    template <typename T>
+    class priority_lanes
+    {
+    public:
+        // high, normal, low
+        static inline constexpr size_t c_laneCount = 3;
+        static inline constexpr uint32_t c_agingLimit = 16;
+
+        // Lanes past the last one are treated as the least urgent lane
+        static size_t clamp_lane(size_t lane) noexcept
+        {
+            return std::min(lane, c_laneCount - 1);
+        }
+
+        void push(size_t lane, T value)
+        {
+            m_lanes[clamp_lane(lane)].m_values.push_back(std::move(value));
+        }
+
+        template <typename It>
+        void push(size_t lane, It first, It last)
+        {
+            auto& values = m_lanes[clamp_lane(lane)].m_values;
+            values.insert(values.end(), first, last);
+        }
+
+        bool empty() const noexcept
+        {
+            return std::all_of(m_lanes.begin(), m_lanes.end(), [](const auto& lane) { return lane.m_values.empty(); });
+        }
+
+        size_t size(size_t lane) const noexcept
+        {
+            return m_lanes[clamp_lane(lane)].m_values.size();
+        }
+
+        // The lane the next pop takes from, or c_laneCount if every lane is empty
+        size_t next_lane() const noexcept
+        {
+            // An aged lane goes first (the least urgent one, if several have aged)
+            for (size_t lane = c_laneCount; lane-- > 0;)
+            {
+                if (!m_lanes[lane].m_values.empty() && has_aged(lane))
+                {
+                    return lane;
+                }
+            }
+
+            for (size_t lane = 0; lane < c_laneCount; lane++)
+            {
+                if (!m_lanes[lane].m_values.empty())
+                {
+                    return lane;
+                }
+            }
+
+            return c_laneCount;
+        }
+
+        // Whether a lane has been passed over enough times to be popped ahead of more urgent lanes
+        bool has_aged(size_t lane) const noexcept
+        {
+            return m_lanes[clamp_lane(lane)].m_passedOver >= c_agingLimit;
+        }
+
+        // Pops the next value by priority and aging, returning the lane it came from (or c_laneCount if
+        // every lane is empty)
+        size_t try_pop(T& value)
+        {
+            auto lane = next_lane();
+            if (lane == c_laneCount)
+            {
+                return lane;
+            }
+
+            pop_front(lane, value);
+            age_below(lane);
+            return lane;
+        }
+
+        // Ages every waiting lane less urgent than 'lane', for when the owner took a value from that
+        // lane somewhere else (e.g. stole it from another thread's lanes) and so passed over them
+        void age_below(size_t lane) noexcept
+        {
+            for (auto passed = clamp_lane(lane) + 1; passed < c_laneCount; passed++)
+            {
+                if (!m_lanes[passed].m_values.empty())
+                {
+                    m_lanes[passed].m_passedOver++;
+                }
+            }
+        }
+
+        // Pops the oldest value of a specific lane (e.g. for work stealing), without aging the others
+        bool try_pop_lane(size_t lane, T& value)
+        {
+            lane = clamp_lane(lane);
+            if (m_lanes[lane].m_values.empty())
+            {
+                return false;
+            }
+
+            pop_front(lane, value);
+            return true;
+        }
+
+        void clear() noexcept
+        {
+            for (auto& lane : m_lanes)
+            {
+                lane.m_values.clear();
+                lane.m_passedOver = 0;
+            }
+        }
+
+    private:
+        struct lane_queue
+        {
+            std::deque<T> m_values;
+            uint32_t m_passedOver {};
+        };
+
+        void pop_front(size_t laneIndex, T& value)
+        {
+            auto& lane = m_lanes[laneIndex];
+            value = std::move(lane.m_values.front());
+            lane.m_values.pop_front();
+            lane.m_passedOver = 0;
+        }
+
+        std::array<lane_queue, c_laneCount> m_lanes;
+    };
+}
@@ -0,0 +1,220 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <vector>
+
+#include <wil/result_macros.h>
+
+namespace veil::any
+{
+    //
+    // Distribution of durations in power-of-two microsecond buckets: bucket 0 counts durations under
+    // 1us, bucket i counts [2^(i-1), 2^i) us, and the last bucket counts everything longer.
+    //
+    struct duration_histogram
+    {
+        static inline constexpr size_t c_bucketCount = 32;
+
+        std::array<uint64_t, c_bucketCount> buckets {};
+        uint64_t count {};
+        uint64_t totalMicroseconds {};
+        uint64_t maxMicroseconds {};
+
+        static size_t bucket_of(uint64_t microseconds) noexcept
+        {
+            return std::min<size_t>(std::bit_width(microseconds), c_bucketCount - 1);
+        }
+
+        uint64_t mean_microseconds() const noexcept
+        {
+            return count == 0 ? 0 : totalMicroseconds / count;
+        }
+
+        // Upper bound of the bucket that holds the given percentile (0 to 100) of the durations
+        uint64_t percentile_microseconds(double percentile) const noexcept
+        {
+            auto rank = static_cast<uint64_t>(static_cast<double>(count) * std::clamp(percentile, 0.0, 100.0) / 100.0);
+            uint64_t seen = 0;
+            for (size_t bucket = 0; bucket < c_bucketCount; bucket++)
+            {
+                seen += buckets[bucket];
+                if (seen > rank || bucket == c_bucketCount - 1)
+                {
+                    return std::min(uint64_t {1} << bucket, maxMicroseconds);
+                }
+            }
+            return maxMicroseconds;
+        }
+
+        void merge(const duration_histogram& other) noexcept
+        {
+            for (size_t bucket = 0; bucket < c_bucketCount; bucket++)
+            {
+                buckets[bucket] += other.buckets[bucket];
+            }
+            count += other.count;
+            totalMicroseconds += other.totalMicroseconds;
+            maxMicroseconds = std::max(maxMicroseconds, other.maxMicroseconds);
+        }
+    };
+
+    //
+    // Snapshot of a taskpool's counters, see veil::vtl1::taskpool::telemetry. Histograms are only
+    // recorded while telemetry is enabled, the other counters are always kept.
+    //
+    struct taskpool_telemetry
+    {
+        // Time from a task being queued (or its delay running out) to it starting to run
+        duration_histogram queueWait;
+
+        // Time tasks took to run
+        duration_histogram runTime;
+
+        // Tasks waiting to run in each priority lane (high, normal, low), and the most that have waited at once
+        std::array<uint64_t, 3> queueDepth {};
+        std::array<uint64_t, 3> maxQueueDepth {};
+
+        // Backing threads, and how many of them are running a task
+        uint64_t threadCount {};
+        uint64_t activeThreadCount {};
+        uint64_t maxActiveThreadCount {};
+
+        // Tasks dropped by cancel_queued_tasks
+        uint64_t cancelledTaskCount {};
+
+        // Tasks whose record had to be allocated from the enclave heap, because no freed record could be reused
+        uint64_t taskHeapAllocationCount {};
+
+        // Callouts made to get tasks scheduled by the VTL0 backing threads (each one marshals its arguments
+        // through the enclave heap), none with taskpool_dispatch::enclave_worker_loop
+        uint64_t scheduleCalloutCount {};
+
+        // Combines the counters kept in VTL0 with the ones kept in VTL1 (each side only fills its own)
+        void merge(const taskpool_telemetry& other) noexcept
+        {
+            queueWait.merge(other.queueWait);
+            runTime.merge(other.runTime);
+            for (size_t lane = 0; lane < queueDepth.size(); lane++)
+            {
+                queueDepth[lane] += other.queueDepth[lane];
+                maxQueueDepth[lane] = std::max(maxQueueDepth[lane], other.maxQueueDepth[lane]);
+            }
+            threadCount += other.threadCount;
+            activeThreadCount += other.activeThreadCount;
+            maxActiveThreadCount = std::max(maxActiveThreadCount, other.maxActiveThreadCount);
+            cancelledTaskCount += other.cancelledTaskCount;
+            taskHeapAllocationCount += other.taskHeapAllocationCount;
+            scheduleCalloutCount += other.scheduleCalloutCount;
+        }
+    };
+}
+
+namespace veil::any::implementation
+{
+    //
+    // Lock-free recorder behind a duration_histogram. Recording is a handful of relaxed atomic adds.
+    //
+    class duration_histogram_recorder
+    {
+    public:
+        void record(uint64_t microseconds) noexcept
+        {
+            m_buckets[duration_histogram::bucket_of(microseconds)].fetch_add(1, std::memory_order_relaxed);
+            m_count.fetch_add(1, std::memory_order_relaxed);
+            m_totalMicroseconds.fetch_add(microseconds, std::memory_order_relaxed);
+
+            auto maxMicroseconds = m_maxMicroseconds.load(std::memory_order_relaxed);
+            while (microseconds > maxMicroseconds && !m_maxMicroseconds.compare_exchange_weak(maxMicroseconds, microseconds, std::memory_order_relaxed))
+            {
+            }
+        }
+
+        duration_histogram snapshot() const noexcept
+        {
+            auto histogram = duration_histogram {};
+            for (size_t bucket = 0; bucket < duration_histogram::c_bucketCount; bucket++)
+            {
+                histogram.buckets[bucket] = m_buckets[bucket].load(std::memory_order_relaxed);
+            }
+            histogram.count = m_count.load(std::memory_order_relaxed);
+            histogram.totalMicroseconds = m_totalMicroseconds.load(std::memory_order_relaxed);
+            histogram.maxMicroseconds = m_maxMicroseconds.load(std::memory_order_relaxed);
+            return histogram;
+        }
+
+    private:
+        std::array<std::atomic<uint64_t>, duration_histogram::c_bucketCount> m_buckets {};
+        std::atomic<uint64_t> m_count {};
+        std::atomic<uint64_t> m_totalMicroseconds {};
+        std::atomic<uint64_t> m_maxMicroseconds {};
+    };
+
+    // Telemetry crosses the VTL boundary flattened into a vector<uint64_t>, in declaration order
+    namespace taskpool_telemetry_abi
+    {
+        inline constexpr size_t c_histogramSize = duration_histogram::c_bucketCount + 3;
+        inline constexpr size_t c_size = 2 * c_histogramSize + 2 * 3 + 6;
+
+        inline void write(std::vector<uint64_t>& out, const duration_histogram& histogram)
+        {
+            out.insert(out.end(), histogram.buckets.begin(), histogram.buckets.end());
+            out.push_back(histogram.count);
+            out.push_back(histogram.totalMicroseconds);
+            out.push_back(histogram.maxMicroseconds);
+        }
+
+        inline const uint64_t* read(const uint64_t* in, duration_histogram& histogram)
+        {
+            std::copy_n(in, duration_histogram::c_bucketCount, histogram.buckets.begin());
+            in += duration_histogram::c_bucketCount;
+            histogram.count = *in++;
+            histogram.totalMicroseconds = *in++;
+            histogram.maxMicroseconds = *in++;
+            return in;
+        }
+
+        inline std::vector<uint64_t> to_abi(const taskpool_telemetry& telemetry)
+        {
+            auto out = std::vector<uint64_t> {};
+            out.reserve(c_size);
+            write(out, telemetry.queueWait);
+            write(out, telemetry.runTime);
+            out.insert(out.end(), telemetry.queueDepth.begin(), telemetry.queueDepth.end());
+            out.insert(out.end(), telemetry.maxQueueDepth.begin(), telemetry.maxQueueDepth.end());
+            out.push_back(telemetry.threadCount);
+            out.push_back(telemetry.activeThreadCount);
+            out.push_back(telemetry.maxActiveThreadCount);
+            out.push_back(telemetry.cancelledTaskCount);
+            out.push_back(telemetry.taskHeapAllocationCount);
+            out.push_back(telemetry.scheduleCalloutCount);
+            return out;
+        }
+
+        inline taskpool_telemetry from_abi(const std::vector<uint64_t>& in)
+        {
+            THROW_HR_IF(E_INVALIDARG, in.size() != c_size);
+
+            auto telemetry = taskpool_telemetry {};
+            auto cursor = read(in.data(), telemetry.queueWait);
+            cursor = read(cursor, telemetry.runTime);
+            std::copy_n(cursor, telemetry.queueDepth.size(), telemetry.queueDepth.begin());
+            cursor += telemetry.queueDepth.size();
+            std::copy_n(cursor, telemetry.maxQueueDepth.size(), telemetry.maxQueueDepth.begin());
+            cursor += telemetry.maxQueueDepth.size();
+            telemetry.threadCount = *cursor++;
+            telemetry.activeThreadCount = *cursor++;
+            telemetry.maxActiveThreadCount = *cursor++;
+            telemetry.cancelledTaskCount = *cursor++;
+            telemetry.taskHeapAllocationCount = *cursor++;
+            telemetry.scheduleCalloutCount = *cursor++;
+            return telemetry;
+        }
+    }
+}
@@ -0,0 +1,371 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "binary_log.any.h"
+#include "log_buffer.vtl1.h"
+#include "utils.vtl1.h"
+
+/*
+
+[Feature]
+    Provides a binary log (veil::vtl1::logger::binary_log) for hot paths. It records the id of a printf
+    style format string, a timestamp and the raw bytes of the arguments, and leaves the formatting to
+    VTL0: the host formats the records on its log writer thread (see veil::vtl0::logger::log_writer),
+    or veil::vtl0::logger::binary_log_decoder formats records that were saved as is.
+
+[Usage]
+
+    void usage(veil::vtl1::taskpool& taskpool, const std::wstring& logFilePath)
+    {
+        // Records go to logFilePath, or to the host's console (like debug_print) for an empty path
+        auto log = veil::vtl1::logger::binary_log {logFilePath};
+        auto periodicFlush = log.flush_periodically(taskpool, std::chrono::seconds(1));
+
+        // The format string must be a literal, its id is computed at compile time
+        log.log(L"[Enclave] Decrypted record %u (%zu bytes) for %ls", recordIndex, record.size(), userName);
+        log.log("[Enclave] hr=0x%08X", hr);
+
+        log.flush();
+    }
+
+[Implementation]
+
+    A message is encoded straight into a fixed size record (c_maxRecordSize bytes, see binary_log.any.h
+    for the layout), which goes into the same lock-free ring as a veil::vtl1::logger::log_buffer's
+    records. Flushing copies the buffered records into one byte vector, sent with a single
+    add_binary_logs callout.
+
+    Format strings are sent once per binary_log, the first time they're used: that thread queues a
+    definition record ahead of its message, so the host gets the definition before the message in
+    the same (or an earlier) batch, without a callout of its own. The definition record only points
+    at the format string literal, which is encoded when the batch is flushed, so long format strings
+    don't have to fit into a record. A table of the format ids that were already queued makes later
+    uses a single atomic load. Threads that use a format while another thread is still defining it
+    queue a definition of their own (the host keeps the last one).
+
+    The table has a fixed number of slots, and a format id is only looked for in a few slots from
+    its hash. When those are taken by other formats, one of them is evicted (and is defined again
+    the next time it's used), so the table never fills up.
+
+[Behavior]
+
+    Arguments may be integers (including enums and bool), floating point numbers, pointers and
+    narrow or wide strings (string literals, pointers, std::string(_view), std::wstring(_view)).
+    Argument types are recorded along with the values, so the host formats each one with its
+    conversion's flags, width and precision, whatever length modifier the format string uses.
+
+    Strings that don't fit into the record are truncated, and arguments after them are left out.
+    Format ids are hashes of the format strings, so two different format strings logged to the same
+    binary_log could (very rarely) share an id, and one would be printed with the other's format.
+
+    Buffering, flushing and the counters work like log_buffer's (see log_buffer.vtl1.h). Definition
+    records count as records too. When a batch that carried definitions fails to send, the binary_log
+    forgets every format it has defined, so they're defined again the next time they're used.
+
+*/
+
+namespace veil::vtl1::logger
+{
+    //
+    // A format string literal with its id, computed at compile time (like std::format_string)
+    //
+    template <typename CharT>
+    struct basic_log_format
+    {
+        consteval basic_log_format(const CharT* format)
+            : m_format(format), m_id(veil::any::binary_log::format_id(std::basic_string_view<CharT>(format)))
+        {
+        }
+
+        std::basic_string_view<CharT> m_format;
+        uint32_t m_id;
+    };
+
+    using log_format = basic_log_format<char>;
+    using wlog_format = basic_log_format<wchar_t>;
+
+    namespace details
+    {
+        struct binary_log_record
+        {
+            static inline constexpr size_t c_maxRecordSize = 256;
+
+            // An encoded message
+            uint16_t m_size;
+            std::array<uint8_t, c_maxRecordSize> m_bytes;
+
+            // Or a definition, encoded when it's flushed: the format string literal (one of the two) and its id
+            bool m_isDefinition {};
+            uint32_t m_formatId {};
+            std::string_view m_format;
+            std::wstring_view m_wideFormat;
+        };
+
+        //
+        // The format ids a binary_log has queued the definition of. Open addressing, each slot is either
+        // free, claimed by the thread queuing a definition, or defined.
+        //
+        class binary_log_formats
+        {
+        public:
+            static inline constexpr size_t c_slotCount = 512;
+
+            // Number of slots an id is looked for in, from the slot of its hash
+            static inline constexpr size_t c_maxProbes = 16;
+
+            //
+            // Returns true if id is defined. Otherwise the caller has to queue the definition, and
+            // claimedSlot is set if the caller claimed a slot for the id (publish() or release() it
+            // once queued). It isn't when another thread is still queuing the definition, or when
+            // another thread just took the slot the id would evict.
+            //
+            bool is_defined(uint32_t id, std::atomic<uint64_t>*& claimedSlot) noexcept
+            {
+                claimedSlot = nullptr;
+                for (size_t probe = 0; probe < c_maxProbes; probe++)
+                {
+                    auto& slot = m_slots[(id + probe) & (c_slotCount - 1)];
+                    auto entry = slot.load(std::memory_order_acquire);
+                    if (entry == 0 && slot.compare_exchange_strong(entry, make_entry(id, c_claimed), std::memory_order_acq_rel))
+                    {
+                        claimedSlot = &slot;
+                        return false;
+                    }
+
+                    // entry is the slot's current value, even when the compare-exchange failed
+                    if ((entry >> 2) == id)
+                    {
+                        return (entry & c_defined) != 0;
+                    }
+                }
+
+                // Every slot the id could use holds another format, evict the one in the id's own slot
+                auto& slot = m_slots[id & (c_slotCount - 1)];
+                auto entry = slot.load(std::memory_order_acquire);
+                if ((entry & c_defined) != 0 && slot.compare_exchange_strong(entry, make_entry(id, c_claimed), std::memory_order_acq_rel))
+                {
+                    claimedSlot = &slot;
+                }
+                return false;
+            }
+
+            // Marks the id as defined once its definition is queued, unless forget_all() freed the slot since
+            static void publish(std::atomic<uint64_t>& slot, uint32_t id) noexcept
+            {
+                auto entry = make_entry(id, c_claimed);
+                slot.compare_exchange_strong(entry, make_entry(id, c_defined), std::memory_order_acq_rel);
+            }
+
+            // Frees the slot, when the definition couldn't be queued
+            static void release(std::atomic<uint64_t>& slot, uint32_t id) noexcept
+            {
+                auto entry = make_entry(id, c_claimed);
+                slot.compare_exchange_strong(entry, 0, std::memory_order_acq_rel);
+            }
+
+            // Frees every slot, when definitions were lost on the way to VTL0
+            void forget_all() noexcept
+            {
+                for (auto& slot : m_slots)
+                {
+                    slot.store(0, std::memory_order_release);
+                }
+            }
+
+        private:
+            static inline constexpr uint64_t c_claimed = 1;
+            static inline constexpr uint64_t c_defined = 2;
+
+            static constexpr uint64_t make_entry(uint32_t id, uint64_t state) noexcept
+            {
+                return (uint64_t {id} << 2) | state;
+            }
+
+            std::array<std::atomic<uint64_t>, c_slotCount> m_slots {};
+        };
+
+        //
+        // Binary records, sent with the add_binary_logs callout
+        //
+        class binary_log_batch
+        {
+        public:
+            using record = binary_log_record;
+
+            binary_log_batch(std::wstring logFilePath, std::shared_ptr<binary_log_formats> formats)
+                : m_logFilePath(std::move(logFilePath)), m_formats(std::move(formats))
+            {
+            }
+
+            size_t size() const noexcept
+            {
+                return m_count;
+            }
+
+            void clear() noexcept
+            {
+                m_records.clear();
+                m_count = 0;
+                m_hasDefinitions = false;
+            }
+
+            void add(record& record, uint64_t /*now*/)
+            {
+                if (record.m_isDefinition)
+                {
+                    if (!record.m_wideFormat.empty())
+                    {
+                        add_definition(record.m_formatId, record.m_wideFormat);
+                    }
+                    else
+                    {
+                        add_definition(record.m_formatId, record.m_format);
+                    }
+                    m_hasDefinitions = true;
+                }
+                else
+                {
+                    m_records.insert(m_records.end(), record.m_bytes.begin(), record.m_bytes.begin() + record.m_size);
+                }
+                m_count++;
+            }
+
+            HRESULT send(uint64_t now)
+            {
+                auto hr = implementation::callouts::add_binary_logs(m_records, m_logFilePath, now);
+                if (FAILED(hr) && m_hasDefinitions)
+                {
+                    // VTL0 doesn't have these definitions, so define every format again when it's next used
+                    m_formats->forget_all();
+                }
+                return hr;
+            }
+
+        private:
+            template <typename CharT>
+            void add_definition(uint32_t formatId, std::basic_string_view<CharT> format)
+            {
+                auto offset = m_records.size();
+                m_records.resize(offset + std::min<size_t>(sizeof(veil::any::binary_log::record_header) + format.size() * sizeof(uint16_t), UINT16_MAX));
+
+                auto writer = veil::any::binary_log::record_writer(std::span<uint8_t>(m_records).subspan(offset));
+                writer.write_header(veil::any::binary_log::record_type::definition, formatId, 0);
+                writer.write_format(format);
+                writer.finish();
+                m_records.resize(offset + writer.size());
+            }
+
+            std::wstring m_logFilePath;
+            std::shared_ptr<binary_log_formats> m_formats;
+
+            // Kept between batches to reuse its allocation
+            std::vector<uint8_t> m_records;
+            size_t m_count {};
+            bool m_hasDefinitions {};
+        };
+    }
+
+    //
+    // Buffers binary log records and sends them to VTL0 in batches, to be formatted there. Logging is
+    // thread safe.
+    //
+    class binary_log : public details::log_buffer_base<details::binary_log_batch>
+    {
+    public:
+        // Logs to logFilePath, or to the host's console if it's empty
+        explicit binary_log(std::wstring logFilePath, const log_buffer_options& options = {})
+            : binary_log(std::move(logFilePath), options, std::make_shared<details::binary_log_formats>())
+        {
+        }
+
+        template <typename... Args>
+        void log(wlog_format format, const Args&... args) noexcept
+        {
+            log_message(format.m_format, format.m_id, args...);
+        }
+
+        template <typename... Args>
+        void log(log_format format, const Args&... args) noexcept
+        {
+            log_message(format.m_format, format.m_id, args...);
+        }
+
+    private:
+        binary_log(std::wstring logFilePath, const log_buffer_options& options, std::shared_ptr<details::binary_log_formats> formats)
+            : log_buffer_base(options, std::move(logFilePath), formats),
+              m_formats(std::move(formats))
+        {
+        }
+
+        template <typename CharT, typename... Args>
+        void log_message(std::basic_string_view<CharT> format, uint32_t formatId, const Args&... args) noexcept
+        {
+            if (!define(format, formatId))
+            {
+                m_state->count_dropped();
+                return;
+            }
+
+            details::binary_log_record record;
+            auto writer = veil::any::binary_log::record_writer(record.m_bytes);
+            writer.write_header(veil::any::binary_log::record_type::message, formatId, veil::vtl1::performance_counter_microseconds());
+            (writer.write_argument(args), ...);
+            writer.finish();
+            record.m_size = static_cast<uint16_t>(writer.size());
+
+            m_state->add_record(std::move(record));
+        }
+
+        // Queues the format string's definition, unless it already has been. Returns false if that failed.
+        template <typename CharT>
+        bool define(std::basic_string_view<CharT> format, uint32_t formatId) noexcept
+        {
+            auto claimedSlot = static_cast<std::atomic<uint64_t>*>(nullptr);
+            if (m_formats->is_defined(formatId, claimedSlot))
+            {
+                return true;
+            }
+
+            // Only the literal is queued, the batch encodes the definition when it's flushed
+            details::binary_log_record definition;
+            definition.m_size = 0;
+            definition.m_isDefinition = true;
+            definition.m_formatId = formatId;
+            if constexpr (sizeof(CharT) == 1)
+            {
+                definition.m_format = format;
+            }
+            else
+            {
+                definition.m_wideFormat = format;
+            }
+            auto queued = m_state->add_record(std::move(definition));
+
+            if (claimedSlot)
+            {
+                if (queued)
+                {
+                    details::binary_log_formats::publish(*claimedSlot, formatId);
+                }
+                else
+                {
+                    details::binary_log_formats::release(*claimedSlot, formatId);
+                }
+            }
+            return queued;
+        }
+
+        std::shared_ptr<details::binary_log_formats> m_formats;
+    };
+}
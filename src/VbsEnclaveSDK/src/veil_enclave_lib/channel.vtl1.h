@@ -0,0 +1,415 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+/*
+
+[Feature]
+    Provides a bounded multi-producer multi-consumer queue (veil::vtl1::channel<T>) for streaming values
+    between enclave threads, e.g. between the stages of a decompress -> decrypt -> verify pipeline
+    running on a taskpool. Senders block while the channel is full, which keeps a fast stage from
+    running ahead of a slow one (back-pressure).
+
+[Usage]
+
+    void usage(veil::vtl1::taskpool& taskpool)
+    {
+        auto records = std::make_shared<veil::vtl1::channel<std::vector<uint8_t>>>(64);
+
+        // Producer stage
+        auto producer = taskpool.queue_task([records]() {
+            while (auto record = read_next_record()) {
+                if (!records->send(std::move(*record))) {
+                    break; // The consumer closed the channel
+                }
+            }
+            records->close();
+        });
+
+        // Consumer stage, receive() returns std::nullopt once the channel is closed and drained
+        while (auto record = records->receive()) {
+            verify(*record);
+        }
+        producer.get();
+
+        // Non-blocking variants
+        bool sent = records->try_send(std::vector<uint8_t>{1, 2, 3});   // false if full or closed
+        auto maybeRecord = records->try_receive();                     // std::nullopt if empty
+    }
+
+[Implementation]
+
+    A lock-free ring of cells, each with a sequence number that says whether the cell is free for the
+    sender claiming that position or holds a value for the receiver claiming it (see Dmitry Vyukov's
+    bounded MPMC queue). Senders and receivers each claim positions with a compare-exchange on their
+    own cursor, so they only contend with each other through the cells themselves.
+
+    Blocking sends and receives wait with std::atomic::wait (WaitOnAddress, see atomic_wait_compat.cpp)
+    on a counter that's bumped whenever space or a value becomes available. The other side only calls
+    notify when a thread has registered as waiting, so a channel that never fills up or runs dry
+    never leaves user mode.
+
+[Behavior]
+
+    After close(), sends fail, and receives drain the values that are left before returning std::nullopt.
+    A send that races with close() is either delivered (a receive returns it) or refused (it returns
+    false): senders check for close() again once they've claimed a cell, and a receive only gives up
+    once it has caught up with every cell claimed before the close. The capacity is rounded up to a
+    power of two. The channel isn't movable, share it between stages by reference or shared_ptr.
+
+    Blocking on a taskpool thread holds it for the duration, so a pipeline whose stages all block on
+    the same taskpool needs at least one thread per stage (or to run a stage on the calling thread).
+
+*/
+
+namespace veil::vtl1
+{
+    template <typename T>
+    class channel
+    {
+    public:
+        explicit channel(size_t capacity)
+            : m_capacity(std::bit_ceil(std::max<size_t>(capacity, 2))),
+              m_mask(m_capacity - 1),
+              m_cells(std::make_unique<cell[]>(m_capacity))
+        {
+            THROW_HR_IF(E_INVALIDARG, capacity == 0);
+
+            for (size_t i = 0; i < m_capacity; i++)
+            {
+                m_cells[i].m_sequence.store(i, std::memory_order_relaxed);
+            }
+        }
+
+        ~channel()
+        {
+            while (try_receive())
+            {
+            }
+        }
+
+        // Delete copy
+        channel(const channel&) = delete;
+        channel& operator=(const channel&) = delete;
+
+        // Delete move
+        channel(channel&&) = delete;
+        channel& operator=(channel&&) = delete;
+
+        size_t capacity() const noexcept
+        {
+            return m_capacity;
+        }
+
+        // Number of values in the channel, only a snapshot while other threads use it
+        size_t size() const noexcept
+        {
+            auto receivePosition = m_receivePosition.load(std::memory_order_acquire);
+            auto sendPosition = m_sendPosition.load(std::memory_order_acquire);
+            return sendPosition > receivePosition ? std::min(sendPosition - receivePosition, m_capacity) : 0;
+        }
+
+        bool is_closed() const noexcept
+        {
+            return m_closed.load(std::memory_order_acquire);
+        }
+
+        // Sends a value without blocking. Returns false (and leaves value untouched) if the channel is full or closed.
+        template <typename U = T>
+        bool try_send(U&& value)
+        {
+            if (is_closed() || !try_push(std::forward<U>(value)))
+            {
+                return false;
+            }
+
+            signal(m_valueAvailable, m_receiveWaiters);
+            return true;
+        }
+
+        // Sends a value, blocking while the channel is full. Returns false (and leaves value untouched) if
+        // the channel is closed.
+        template <typename U = T>
+        bool send(U&& value)
+        {
+            while (true)
+            {
+                if (try_send(std::forward<U>(value)))
+                {
+                    return true;
+                }
+
+                if (is_closed())
+                {
+                    return false;
+                }
+
+                // Check again after registering as a waiter, a receiver that made space since won't wake us
+                auto epoch = m_spaceAvailable.load(std::memory_order_seq_cst);
+                m_sendWaiters.fetch_add(1, std::memory_order_seq_cst);
+                if (is_full() && !is_closed())
+                {
+                    m_spaceAvailable.wait(epoch, std::memory_order_seq_cst);
+                }
+                m_sendWaiters.fetch_sub(1, std::memory_order_relaxed);
+            }
+        }
+
+        // Receives a value without blocking, std::nullopt if the channel is empty
+        std::optional<T> try_receive()
+        {
+            auto value = try_pop();
+            if (value)
+            {
+                signal(m_spaceAvailable, m_sendWaiters);
+            }
+            return value;
+        }
+
+        // Receives a value, blocking while the channel is empty. Returns std::nullopt once the channel is
+        // closed and every value sent before has been received.
+        std::optional<T> receive()
+        {
+            while (true)
+            {
+                if (auto value = try_receive())
+                {
+                    return value;
+                }
+
+                if (is_closed())
+                {
+                    // Values sent just before the close are still received
+                    return receive_remaining(m_sendPosition.load(std::memory_order_seq_cst));
+                }
+
+                // Check again after registering as a waiter, a sender that published since won't wake us
+                auto epoch = m_valueAvailable.load(std::memory_order_seq_cst);
+                m_receiveWaiters.fetch_add(1, std::memory_order_seq_cst);
+                if (is_empty() && !is_closed())
+                {
+                    m_valueAvailable.wait(epoch, std::memory_order_seq_cst);
+                }
+                m_receiveWaiters.fetch_sub(1, std::memory_order_relaxed);
+            }
+        }
+
+        // Refuses further sends and wakes every blocked sender and receiver
+        void close() noexcept
+        {
+            if (m_closed.exchange(true, std::memory_order_seq_cst))
+            {
+                return;
+            }
+
+            m_valueAvailable.fetch_add(1, std::memory_order_seq_cst);
+            m_valueAvailable.notify_all();
+            m_spaceAvailable.fetch_add(1, std::memory_order_seq_cst);
+            m_spaceAvailable.notify_all();
+        }
+
+    private:
+        //
+        // Receives what's left after close(). Every send that isn't refused claims its position before
+        // the close, so values are still coming for the positions up to end that senders have claimed
+        // but not published yet.
+        //
+        std::optional<T> receive_remaining(size_t end)
+        {
+            while (true)
+            {
+                if (auto value = try_receive())
+                {
+                    return value;
+                }
+
+                if (m_receivePosition.load(std::memory_order_seq_cst) >= end)
+                {
+                    return std::nullopt;
+                }
+
+                // Wait for the sender of the next position to publish its value (or refuse it)
+                auto epoch = m_valueAvailable.load(std::memory_order_seq_cst);
+                m_receiveWaiters.fetch_add(1, std::memory_order_seq_cst);
+                if (is_empty() && m_receivePosition.load(std::memory_order_seq_cst) < end)
+                {
+                    m_valueAvailable.wait(epoch, std::memory_order_seq_cst);
+                }
+                m_receiveWaiters.fetch_sub(1, std::memory_order_relaxed);
+            }
+        }
+
+        struct cell
+        {
+            std::atomic<size_t> m_sequence;
+            alignas(T) unsigned char m_storage[sizeof(T)];
+
+            T* value() noexcept
+            {
+                return std::launder(reinterpret_cast<T*>(m_storage));
+            }
+        };
+
+        template <typename U>
+        bool try_push(U&& value)
+        {
+            auto position = m_sendPosition.load(std::memory_order_relaxed);
+            while (true)
+            {
+                auto& cell = m_cells[position & m_mask];
+                auto sequence = cell.m_sequence.load(std::memory_order_acquire);
+                auto difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+                if (difference == 0)
+                {
+                    // The cell is free for this position, claim it
+                    if (m_sendPosition.compare_exchange_weak(position, position + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                    {
+                        // Checked again after the claim: either a receive draining after close() waits for
+                        // this position, or this sees the close and refuses the value. The position is
+                        // claimed, so mark the value as missing, the receiver skips it.
+                        if (m_closed.load(std::memory_order_seq_cst))
+                        {
+                            publish_missing(cell, position);
+                            return false;
+                        }
+
+                        if constexpr (std::is_nothrow_constructible_v<T, U&&>)
+                        {
+                            new (cell.m_storage) T(std::forward<U>(value));
+                        }
+                        else
+                        {
+                            try
+                            {
+                                new (cell.m_storage) T(std::forward<U>(value));
+                            }
+                            catch (...)
+                            {
+                                // The position is claimed, so it has to be filled. Mark the value as
+                                // missing, the receiver skips it.
+                                publish_missing(cell, position);
+                                throw;
+                            }
+                        }
+                        cell.m_sequence.store(position + 1, std::memory_order_release);
+                        return true;
+                    }
+                }
+                else if (difference < 0)
+                {
+                    // The cell still holds the value from a lap ago, the channel is full
+                    return false;
+                }
+                else
+                {
+                    // Another sender claimed this position
+                    position = m_sendPosition.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        std::optional<T> try_pop()
+        {
+            auto position = m_receivePosition.load(std::memory_order_relaxed);
+            while (true)
+            {
+                auto& cell = m_cells[position & m_mask];
+                auto sequence = cell.m_sequence.load(std::memory_order_acquire);
+                auto filled = sequence & ~c_emptyFlag;
+                auto difference = static_cast<intptr_t>(filled) - static_cast<intptr_t>(position + 1);
+                if (difference == 0)
+                {
+                    // The cell holds the value for this position, claim it
+                    if (m_receivePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                    {
+                        auto value = std::optional<T> {};
+                        if ((sequence & c_emptyFlag) == 0)
+                        {
+                            value.emplace(std::move(*cell.value()));
+                            cell.value()->~T();
+                        }
+
+                        // Free the cell for the sender one lap ahead
+                        cell.m_sequence.store(position + m_capacity, std::memory_order_release);
+                        if (value)
+                        {
+                            return value;
+                        }
+
+                        // The sender failed to construct its value, move on to the next position
+                        position = m_receivePosition.load(std::memory_order_relaxed);
+                    }
+                }
+                else if (difference < 0)
+                {
+                    // Nothing has been sent for this position yet, the channel is empty
+                    return std::nullopt;
+                }
+                else
+                {
+                    // Another receiver claimed this position
+                    position = m_receivePosition.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        // Fills a claimed position without a value, and wakes a receiver that may be waiting on it
+        void publish_missing(cell& cell, size_t position) noexcept
+        {
+            cell.m_sequence.store(position + 1 + c_emptyFlag, std::memory_order_release);
+            signal(m_valueAvailable, m_receiveWaiters);
+        }
+
+        bool is_full() const noexcept
+        {
+            auto position = m_sendPosition.load(std::memory_order_seq_cst);
+            auto sequence = m_cells[position & m_mask].m_sequence.load(std::memory_order_seq_cst);
+            return static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position) < 0;
+        }
+
+        bool is_empty() const noexcept
+        {
+            auto position = m_receivePosition.load(std::memory_order_seq_cst);
+            auto sequence = m_cells[position & m_mask].m_sequence.load(std::memory_order_seq_cst) & ~c_emptyFlag;
+            return static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position + 1) < 0;
+        }
+
+        // Bumps the epoch the other side waits on, and wakes one waiter (if any) for the value or space
+        static void signal(std::atomic<uint32_t>& epoch, const std::atomic<uint32_t>& waiters) noexcept
+        {
+            epoch.fetch_add(1, std::memory_order_seq_cst);
+            if (waiters.load(std::memory_order_seq_cst) != 0)
+            {
+                epoch.notify_one();
+            }
+        }
+
+        // Set in a cell's sequence when the sender's value failed to construct
+        static inline constexpr size_t c_emptyFlag = size_t {1} << (sizeof(size_t) * 8 - 1);
+
+        const size_t m_capacity;
+        const size_t m_mask;
+        std::unique_ptr<cell[]> m_cells;
+
+        // Senders and receivers each get their own cache line
+        alignas(64) std::atomic<size_t> m_sendPosition {};
+        alignas(64) std::atomic<size_t> m_receivePosition {};
+
+        alignas(64) std::atomic<uint32_t> m_valueAvailable {};
+        std::atomic<uint32_t> m_receiveWaiters {};
+        alignas(64) std::atomic<uint32_t> m_spaceAvailable {};
+        std::atomic<uint32_t> m_sendWaiters {};
+        std::atomic<bool> m_closed {};
+    };
+}
@@ -3,10 +3,15 @@
 
 #pragma once
 
+#include <atomic>
+#include <coroutine>
+#include <functional>
 #include <future>
 #include <memory>
 #include <optional>
+#include <vector>
 
+#include "task_function.vtl1.h"
 #include "utils.vtl1.h"
 
 /*
@@ -19,6 +24,14 @@
     );
     int result = fut.get(); // Blocks until the result 42 is ready.
 
+    // Continuations run on a taskpool once the future is ready, without a thread blocking on it
+    auto length = taskpool.queue_task([]() { return std::wstring(L"hello"); })
+        .then(taskpool, [](veil::vtl1::future<std::wstring> f) { return f.get().size(); });
+
+    // Combinators complete once all (or any) of their inputs are ready, also without blocking a thread
+    auto all = veil::vtl1::when_all(std::move(futures));        // future<std::vector<future<T>>>
+    auto any = veil::vtl1::when_any(std::move(otherFutures));   // future<when_any_result<T>>
+
 
 [Implementation]
 
@@ -26,6 +39,10 @@
     a future value), and can return a future. The future waits for the shared_state
     to be ready and then retrieves the value.
 
+    Continuations (then, when_all, when_any) are callbacks registered on the shared_state.
+    The thread that sets the value runs them right after publishing it, and each one either
+    queues the user's continuation onto a taskpool or completes a combinator's promise.
+
 */
 
 namespace veil::vtl1
@@ -40,7 +57,8 @@ namespace veil::vtl1
         // communicated between a promise and a future. Specialized for both 
         // general types and `void`.
         //
-        //  Note: Not thread-safe. Only for use by shared_state, which locks.
+        //  Note: Not thread-safe. Only for use by shared_state, which only lets
+        //        the claiming setter write it and only reads it once ready.
         //
         template <typename T>
         struct shared_state_value
@@ -56,6 +74,12 @@ namespace veil::vtl1
             shared_state_value& operator=(shared_state_value&& other) = delete;
             
             void set_value(const T& value) noexcept
+            {
+                m_value = value;
+            }
+
+            // Move-only values (e.g. the futures handed back by when_all) are moved in
+            void set_value(T&& value) noexcept
             {
                 m_value = std::move(value);
             }
@@ -96,6 +120,12 @@ namespace veil::vtl1
         // It manages the state of the operation, including value, exception, 
         // and readiness notifications.
         //
+        // Readiness is a single atomic word. The setter claims the state, stores the value (or
+        // exception), then publishes it with a release store. Waiters block on the word with
+        // std::atomic::wait (WaitOnAddress, see atomic_wait_compat.cpp), so waiting on a state
+        // that is already ready costs a single acquire load. Setters only wake waiters if one
+        // has flagged that it's blocked.
+        //
         template <typename T>
         struct shared_state
         {
@@ -109,15 +139,60 @@ namespace veil::vtl1
             shared_state(shared_state&& other) = delete;
             shared_state& operator=(shared_state&& other) = delete;
 
+            ~shared_state()
+            {
+                // Callbacks of a state that never became ready are dropped without running
+                auto head = m_continuations.load(std::memory_order_acquire);
+                if (head != closed())
+                {
+                    delete_continuations(head);
+                }
+            }
+
+            bool is_ready() const noexcept
+            {
+                return (m_state.load(std::memory_order_acquire) & c_statusMask) == c_ready;
+            }
+
             void wait_for_ready()
             {
-                auto lock = m_lock.lock_exclusive();
-                while (!m_ready)
+                auto state = m_state.load(std::memory_order_acquire);
+                while ((state & c_statusMask) != c_ready)
                 {
-                    m_cv.wait(lock);
+                    // Flag that there's a waiter before blocking, so the setter knows to wake us
+                    if ((state & c_waiting) == 0)
+                    {
+                        if (!m_state.compare_exchange_weak(state, state | c_waiting, std::memory_order_acquire))
+                        {
+                            continue;
+                        }
+                        state |= c_waiting;
+                    }
+
+                    m_state.wait(state, std::memory_order_acquire);
+                    state = m_state.load(std::memory_order_acquire);
                 }
             }
 
+            // Runs callback once the state is ready: right away if it already is, otherwise on the
+            // thread that sets the value (or exception). Callbacks must not throw, and are dropped
+            // without running if the state is destroyed before it's ready.
+            void on_ready(veil::vtl1::implementation::task_function callback)
+            {
+                auto node = std::unique_ptr<continuation>(new continuation {std::move(callback), nullptr});
+                if (!try_add_continuation(node))
+                {
+                    node->m_callback();
+                }
+            }
+
+            // Like on_ready, but returns false without running callback if the state is already ready
+            bool try_on_ready(veil::vtl1::implementation::task_function callback)
+            {
+                auto node = std::unique_ptr<continuation>(new continuation {std::move(callback), nullptr});
+                return try_add_continuation(node);
+            }
+
             constexpr T get_value()
             {
                 wait_for_ready();
@@ -127,14 +202,9 @@ namespace veil::vtl1
             // Unified set_value for void and non-void types
             void set_value(auto&&... args)
             {
-                auto lock = m_lock.lock_exclusive();
-                if (m_ready)
-                {
-                    throw std::future_error(std::future_errc::promise_already_satisfied);
-                }
+                claim();
                 m_valueholder.set_value(std::forward<decltype(args)>(args)...);
-                m_ready = true;
-                m_cv.notify_all();
+                publish();
             }
 
             std::exception_ptr get_exception()
@@ -145,25 +215,142 @@ namespace veil::vtl1
 
             void set_exception(std::exception_ptr&& e)
             {
-                auto lock = m_lock.lock_exclusive();
-                if (m_ready)
+                claim();
+                m_exception = std::move(e);
+                publish();
+            }
+
+            // Sets the exception unless the state was already set. Returns false if it was.
+            bool try_set_exception(std::exception_ptr&& e)
+            {
+                if (!try_claim())
                 {
-                    throw std::future_error(std::future_errc::promise_already_satisfied);
+                    return false;
                 }
                 m_exception = std::move(e);
-                m_ready = true;
-                m_cv.notify_all();
+                publish();
+                return true;
             }
 
         private:
+            static inline constexpr uint32_t c_pending = 0;
+            static inline constexpr uint32_t c_setting = 1;
+            static inline constexpr uint32_t c_ready = 2;
+            static inline constexpr uint32_t c_statusMask = 3;
+            static inline constexpr uint32_t c_waiting = 4;
+
+            // Only one setter gets to move the state out of pending
+            void claim()
+            {
+                if (!try_claim())
+                {
+                    throw std::future_error(std::future_errc::promise_already_satisfied);
+                }
+            }
+
+            bool try_claim() noexcept
+            {
+                auto state = m_state.load(std::memory_order_relaxed);
+                do
+                {
+                    if ((state & c_statusMask) != c_pending)
+                    {
+                        return false;
+                    }
+                }
+                while (!m_state.compare_exchange_weak(state, (state & c_waiting) | c_setting, std::memory_order_acquire, std::memory_order_relaxed));
+                return true;
+            }
+
+            void publish()
+            {
+                if ((m_state.exchange(c_ready, std::memory_order_release) & c_waiting) != 0)
+                {
+                    m_state.notify_all();
+                }
+
+                // Close the list so later callbacks run right away, then run the ones already registered
+                auto head = m_continuations.exchange(closed(), std::memory_order_acq_rel);
+                for (auto node = head; node; node = node->m_next)
+                {
+                    node->m_callback();
+                }
+                delete_continuations(head);
+            }
+
+            struct continuation
+            {
+                veil::vtl1::implementation::task_function m_callback;
+                continuation* m_next;
+            };
+
+            // Marks the continuation list once the state is ready
+            continuation* closed() noexcept
+            {
+                return reinterpret_cast<continuation*>(&m_continuations);
+            }
+
+            // Takes ownership of node unless the state is already ready
+            bool try_add_continuation(std::unique_ptr<continuation>& node)
+            {
+                auto head = m_continuations.load(std::memory_order_acquire);
+                do
+                {
+                    if (head == closed())
+                    {
+                        return false;
+                    }
+                    node->m_next = head;
+                }
+                while (!m_continuations.compare_exchange_weak(head, node.get(), std::memory_order_release, std::memory_order_acquire));
+
+                node.release();
+                return true;
+            }
+
+            static void delete_continuations(continuation* head) noexcept
+            {
+                while (head)
+                {
+                    delete std::exchange(head, head->m_next);
+                }
+            }
+
             shared_state_value<T> m_valueholder;
             std::exception_ptr m_exception{};
-            bool m_ready{};
-            wil::srwlock m_lock;
-            wil::condition_variable m_cv;
+            std::atomic<uint32_t> m_state{c_pending};
+            std::atomic<continuation*> m_continuations{};
         };
     }
 
+    template <typename T>
+    class future;
+
+    template <typename T>
+    class promise;
+
+    namespace details
+    {
+        template <typename T, typename F, typename R>
+        class then_task;
+    }
+
+    //
+    // Result of when_any: the index of the first future that became ready, and all the input futures.
+    //
+    template <typename T>
+    struct when_any_result
+    {
+        size_t index;
+        std::vector<future<T>> futures;
+    };
+
+    template <typename T>
+    future<std::vector<future<T>>> when_all(std::vector<future<T>> futures);
+
+    template <typename T>
+    future<when_any_result<T>> when_any(std::vector<future<T>> futures);
+
     //
     // Future mimics std::future (implemented here because of missing c++ runtime support)
     //
@@ -175,11 +362,13 @@ namespace veil::vtl1
         {
         }
 
+        // Blocks until the value is ready, like a std::future from std::async. Exceptions are only
+        // rethrown by get(), never from the destructor.
         ~future()
         {
             if (m_sharedState)
             {
-                get();
+                m_sharedState->wait_for_ready();
             }
         }
 
@@ -217,6 +406,101 @@ namespace veil::vtl1
             }
         }
 
+        bool valid() const noexcept
+        {
+            return m_sharedState != nullptr;
+        }
+
+        bool is_ready() const
+        {
+            if (!m_sharedState)
+            {
+                throw std::future_error(std::future_errc::no_state);
+            }
+            return m_sharedState->is_ready();
+        }
+
+        //
+        // Queues f onto the taskpool once this future is ready, and returns a future for f's result.
+        // f is called with the (ready) future, so it can get() the value or handle the exception.
+        // No thread is blocked while waiting. This future is consumed.
+        //
+        // The returned future holds f's exception if f throws, and std::future_errc::broken_promise if
+        // f never runs (this future's state is dropped without becoming ready, or the queued task is
+        // dropped by cancel_queued_tasks or the taskpool going away). f may be move-only.
+        //
+        // The taskpool must outlive the continuation being queued.
+        //
+        template <typename Taskpool, typename F>
+        [[nodiscard]] auto then(Taskpool& taskpool, F&& f) -> future<std::invoke_result_t<std::decay_t<F>&, future<T>>>
+        {
+            using return_type = std::invoke_result_t<std::decay_t<F>&, future<T>>;
+            using task_type = details::then_task<T, std::decay_t<F>, return_type>;
+
+            auto state = std::exchange(m_sharedState, nullptr);
+            if (!state)
+            {
+                throw std::future_error(std::future_errc::no_state);
+            }
+
+            auto result = std::make_shared<details::shared_state<return_type>>();
+            auto continuationFuture = future<return_type>(result);
+
+            // The callback is kept in the state's own continuation list, so it only holds the state weakly
+            // (whoever sets the state holds it while the callback runs)
+            state->on_ready([&taskpool, task = task_type(std::forward<F>(f), result), antecedent = std::weak_ptr(state), result]() mutable
+            {
+                try
+                {
+                    task.set_antecedent(antecedent.lock());
+
+                    // The continuation's own future carries the result, so the task's future isn't needed
+                    taskpool.queue_task(std::move(task)).detach();
+                }
+                catch (...)
+                {
+                    result->try_set_exception(std::current_exception());
+                }
+            });
+
+            return continuationFuture;
+        }
+
+        //
+        // Lets a coroutine (see task.vtl1.h) co_await the future without blocking a thread. The coroutine
+        // is resumed on the thread that sets the value. This future is consumed.
+        //
+        auto operator co_await() && noexcept
+        {
+            struct awaiter
+            {
+                future m_future;
+
+                bool await_ready() const
+                {
+                    return m_future.is_ready();
+                }
+
+                // Returns false, resuming the coroutine right away on this thread, if the future became
+                // ready after await_ready. Resuming it from inside the callback instead would nest a
+                // stack frame for every await on a chain of ready futures.
+                bool await_suspend(std::coroutine_handle<> handle)
+                {
+                    // Keep the state alive, the coroutine (and with it this awaiter) may be resumed and
+                    // destroyed before try_on_ready returns
+                    auto state = m_future.m_sharedState;
+                    return state->try_on_ready([handle]() { handle.resume(); });
+                }
+
+                T await_resume()
+                {
+                    return m_future.get();
+                }
+            };
+
+            return awaiter {std::move(*this)};
+        }
+
         // Consider removing detach since it's non-standard
         void detach()
         {
@@ -224,6 +508,12 @@ namespace veil::vtl1
         }
 
     private:
+        template <typename U>
+        friend future<std::vector<future<U>>> when_all(std::vector<future<U>> futures);
+
+        template <typename U>
+        friend future<when_any_result<U>> when_any(std::vector<future<U>> futures);
+
         std::shared_ptr<details::shared_state<T>> m_sharedState;
     };
 
@@ -271,4 +561,225 @@ namespace veil::vtl1
         std::shared_ptr<details::shared_state<T>> m_sharedState;
         bool m_alreadyRetrievedFuture{};
     };
+
+    namespace details
+    {
+        //
+        // The task future::then queues once the antecedent is ready. It completes the continuation's
+        // future with f's result or exception, or with broken_promise if it's dropped without running.
+        //
+        template <typename T, typename F, typename R>
+        class then_task
+        {
+        public:
+            template <typename G>
+            then_task(G&& f, std::shared_ptr<shared_state<R>> result)
+                : m_f(std::forward<G>(f)), m_result(std::move(result))
+            {
+            }
+
+            ~then_task()
+            {
+                if (m_result)
+                {
+                    m_result->try_set_exception(std::make_exception_ptr(std::future_error(std::future_errc::broken_promise)));
+                }
+            }
+
+            // Delete copy
+            then_task(const then_task&) = delete;
+            then_task& operator=(const then_task&) = delete;
+
+            // Allow move construction (a moved-from task completes nothing)
+            then_task(then_task&& other) = default;
+            then_task& operator=(then_task&& other) = delete;
+
+            void set_antecedent(std::shared_ptr<shared_state<T>> antecedent) noexcept
+            {
+                m_antecedent = std::move(antecedent);
+            }
+
+            void operator()()
+            {
+                auto result = std::exchange(m_result, nullptr);
+                try
+                {
+                    auto antecedent = future<T>(std::move(m_antecedent));
+                    if constexpr (std::is_void_v<R>)
+                    {
+                        m_f(std::move(antecedent));
+                        result->set_value();
+                    }
+                    else
+                    {
+                        result->set_value(m_f(std::move(antecedent)));
+                    }
+                }
+                catch (...)
+                {
+                    result->try_set_exception(std::current_exception());
+                }
+            }
+
+        private:
+            F m_f;
+            std::shared_ptr<shared_state<T>> m_antecedent;
+            std::shared_ptr<shared_state<R>> m_result;
+        };
+    }
+
+    //
+    // Returns a future that becomes ready once every input future is ready. The inputs are handed back
+    // (ready) in the same order, so each one can be get()-ed for its value or exception. No thread is
+    // blocked while waiting.
+    //
+    // The returned future holds std::future_errc::broken_promise if an input's state is dropped without
+    // becoming ready.
+    //
+    template <typename T>
+    future<std::vector<future<T>>> when_all(std::vector<future<T>> futures)
+    {
+        // Held by the callbacks, and only holds the inputs' states once they're ready (a state that
+        // isn't ready holds its callbacks), so an input that never becomes ready doesn't keep itself alive
+        struct context
+        {
+            ~context()
+            {
+                // An input was dropped without becoming ready, and every other callback is done
+                if (m_remaining != 0)
+                {
+                    m_promise.set_exception(std::make_exception_ptr(std::future_error(std::future_errc::broken_promise)));
+                }
+            }
+
+            std::vector<std::shared_ptr<details::shared_state<T>>> m_readyStates;
+            std::atomic<size_t> m_remaining {};
+            promise<std::vector<future<T>>> m_promise;
+        };
+
+        auto ctx = std::make_shared<context>();
+        auto result = ctx->m_promise.get_future();
+        if (futures.empty())
+        {
+            ctx->m_promise.set_value(std::move(futures));
+            return result;
+        }
+
+        for (auto& f : futures)
+        {
+            if (!f.valid())
+            {
+                throw std::future_error(std::future_errc::no_state);
+            }
+        }
+
+        // Take the states out of the futures, so the inputs are only held by whoever sets them
+        auto states = std::vector<std::shared_ptr<details::shared_state<T>>>{};
+        for (auto& f : futures)
+        {
+            states.push_back(std::exchange(f.m_sharedState, nullptr));
+        }
+        ctx->m_readyStates.resize(states.size());
+        ctx->m_remaining = states.size();
+
+        for (size_t i = 0; i < states.size(); i++)
+        {
+            states[i]->on_ready([ctx, i, state = std::weak_ptr(states[i])]()
+            {
+                // Whoever sets the state holds it while the callback runs
+                ctx->m_readyStates[i] = state.lock();
+                if (ctx->m_remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                {
+                    auto readyFutures = std::vector<future<T>>{};
+                    for (auto& readyState : ctx->m_readyStates)
+                    {
+                        readyFutures.emplace_back(std::move(readyState));
+                    }
+                    ctx->m_promise.set_value(std::move(readyFutures));
+                }
+            });
+        }
+
+        return result;
+    }
+
+    //
+    // Returns a future that becomes ready once any input future is ready. The result holds the index of
+    // that future along with all the inputs, so the others can still be waited on. No thread is blocked
+    // while waiting.
+    //
+    // Inputs whose state was dropped without becoming ready are handed back holding
+    // std::future_errc::broken_promise, as is the returned future if every input's state is dropped.
+    //
+    template <typename T>
+    future<when_any_result<T>> when_any(std::vector<future<T>> futures)
+    {
+        // Held by the callbacks and only holds the inputs' states weakly, see when_all
+        struct context
+        {
+            ~context()
+            {
+                if (!m_done)
+                {
+                    m_promise.set_exception(std::make_exception_ptr(std::future_error(std::future_errc::broken_promise)));
+                }
+            }
+
+            std::vector<std::weak_ptr<details::shared_state<T>>> m_states;
+            std::atomic<bool> m_done {};
+            promise<when_any_result<T>> m_promise;
+        };
+
+        auto ctx = std::make_shared<context>();
+        auto result = ctx->m_promise.get_future();
+        if (futures.empty())
+        {
+            ctx->m_done = true;
+            ctx->m_promise.set_value(when_any_result<T>{static_cast<size_t>(-1), std::move(futures)});
+            return result;
+        }
+
+        for (auto& f : futures)
+        {
+            if (!f.valid())
+            {
+                throw std::future_error(std::future_errc::no_state);
+            }
+        }
+
+        // Take the states out of the futures, so the inputs are only held by whoever sets them
+        auto states = std::vector<std::shared_ptr<details::shared_state<T>>>{};
+        for (auto& f : futures)
+        {
+            states.push_back(std::exchange(f.m_sharedState, nullptr));
+            ctx->m_states.push_back(states.back());
+        }
+
+        for (size_t i = 0; i < states.size(); i++)
+        {
+            states[i]->on_ready([ctx, i]()
+            {
+                if (ctx->m_done.exchange(true, std::memory_order_acq_rel))
+                {
+                    return;
+                }
+
+                // The winner is held by whoever is setting it, the others by whoever will
+                auto inputs = std::vector<future<T>>{};
+                for (auto& weakState : ctx->m_states)
+                {
+                    auto state = weakState.lock();
+                    if (!state)
+                    {
+                        state = std::make_shared<details::shared_state<T>>();
+                        state->set_exception(std::make_exception_ptr(std::future_error(std::future_errc::broken_promise)));
+                    }
+                    inputs.emplace_back(std::move(state));
+                }
+                ctx->m_promise.set_value(when_any_result<T>{i, std::move(inputs)});
+            });
+        }
+
+        return result;
+    }
 }
@@ -0,0 +1,413 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include "channel.vtl1.h"
+#include "logger.vtl1.h"
+#include "taskpool.vtl1.h"
+#include "utils.vtl1.h"
+
+/*
+
+[Feature]
+    Provides a log buffer (veil::vtl1::logger::log_buffer) that collects enclave log records and sends
+    them to VTL0 in batches, instead of making an add_log callout (a VTL1->VTL0 transition) per line on
+    the logging thread like add_log_from_enclave does.
+
+[Usage]
+
+    void usage(veil::vtl1::taskpool& taskpool, std::wstring_view logFilePath, veil::any::logger::eventLevel runtimeLogLevel)
+    {
+        auto logs = veil::vtl1::logger::log_buffer {};
+
+        // Also flush every second on the taskpool, so quiet periods don't hold records back
+        auto periodicFlush = logs.flush_periodically(taskpool, std::chrono::seconds(1));
+
+        logs.add_log(L"[Enclave] Unsealing key", veil::any::logger::eventLevel::EVENT_LEVEL_INFO, runtimeLogLevel, logFilePath);
+
+        // See how many records were lost to a full buffer, or to a failed callout
+        veil::vtl1::logger::log_buffer_stats stats = logs.stats();
+
+        // Send what's left before returning to the host (the destructor also does, without throwing)
+        logs.flush();
+    }
+
+[Implementation]
+
+    Records are appended to a veil::vtl1::channel (a lock-free ring), so logging threads don't take a
+    lock. The thread whose record brings the buffer to flushThreshold flushes it, as long as no other
+    thread is already flushing: the buffered records are drained and sent with a single add_logs callout
+    per batch of up to capacity records. flush_periodically queues try_flush on the taskpool.
+
+    Each record carries the time it was logged, and the callout passes its age, so VTL0 timestamps
+    records with the time they were logged rather than the time they were flushed.
+
+[Behavior]
+
+    A record that finds the buffer full counts as an overflow. Its thread flushes (unless another thread
+    already is) and retries once, and the record is dropped if there's still no room. Records of a batch
+    whose callout fails are dropped too, as are the records of a batch that a record couldn't be added
+    to (e.g. out of memory). Only flush() reports these failures, the flushes made while logging don't
+    throw.
+
+    Records are flushed in the order they were logged (across threads, in the order they made it into
+    the buffer).
+
+*/
+
+namespace veil::vtl1::logger
+{
+    struct log_buffer_options
+    {
+        // Maximum number of records held, rounded up to a power of two
+        size_t capacity = 1024;
+
+        // Number of buffered records that makes the logging thread flush (at most capacity)
+        size_t flushThreshold = 256;
+    };
+
+    struct log_buffer_stats
+    {
+        // Records that made it into the buffer
+        uint64_t loggedCount {};
+
+        // Records that were sent to VTL0, and the number of add_logs callouts that sent them
+        uint64_t flushedCount {};
+        uint64_t batchCount {};
+
+        // Records that found the buffer full
+        uint64_t overflowCount {};
+
+        // Records that were lost, because the buffer was still full after flushing or their callout failed
+        uint64_t droppedCount {};
+    };
+
+    namespace details
+    {
+        //
+        // Text records, sent with the add_logs callout
+        //
+        class text_log_batch
+        {
+        public:
+            struct record
+            {
+                std::wstring m_log;
+                std::wstring m_logFilePath;
+
+                // performance_counter_microseconds() when logged
+                uint64_t m_loggedAt;
+            };
+
+            size_t size() const noexcept
+            {
+                return m_logs.size();
+            }
+
+            void clear() noexcept
+            {
+                m_logs.clear();
+                m_logFilePaths.clear();
+                m_ages.clear();
+            }
+
+            void add(record& record, uint64_t now)
+            {
+                m_logs.push_back(std::move(record.m_log));
+                m_logFilePaths.push_back(std::move(record.m_logFilePath));
+                m_ages.push_back(now > record.m_loggedAt ? now - record.m_loggedAt : 0);
+            }
+
+            HRESULT send(uint64_t /*now*/)
+            {
+                return implementation::callouts::add_logs(m_logs, m_logFilePaths, m_ages);
+            }
+
+        private:
+            // Kept between batches to reuse their allocations
+            std::vector<std::wstring> m_logs;
+            std::vector<std::wstring> m_logFilePaths;
+            std::vector<uint64_t> m_ages;
+        };
+
+        //
+        // State of a log buffer, shared with the taskpool's periodic flush so a flush that's already
+        // running can finish after the log buffer is destroyed. Batch collects the records of a flush
+        // and sends them with a single callout.
+        //
+        template <typename Batch>
+        class log_buffer_state
+        {
+        public:
+            using record = typename Batch::record;
+
+            template <typename... BatchArgs>
+            explicit log_buffer_state(const log_buffer_options& options, BatchArgs&&... batchArgs)
+                : m_records(options.capacity),
+                  m_flushThreshold(std::clamp<size_t>(options.flushThreshold, 1, m_records.capacity())),
+                  m_batch(std::forward<BatchArgs>(batchArgs)...)
+            {
+            }
+
+            // Delete copy
+            log_buffer_state(const log_buffer_state&) = delete;
+            log_buffer_state& operator=(const log_buffer_state&) = delete;
+
+            // Delete move
+            log_buffer_state(log_buffer_state&&) = delete;
+            log_buffer_state& operator=(log_buffer_state&&) = delete;
+
+            // Returns false if the record was dropped
+            bool add_record(record&& record) noexcept
+            {
+                static_assert(std::is_nothrow_move_constructible_v<typename Batch::record>);
+
+                if (!m_records.try_send(std::move(record)))
+                {
+                    m_overflowCount.fetch_add(1, std::memory_order_relaxed);
+
+                    // Make room on this thread, unless another thread is already doing so
+                    try_flush();
+                    if (!m_records.try_send(std::move(record)))
+                    {
+                        count_dropped();
+                        return false;
+                    }
+                }
+                m_loggedCount.fetch_add(1, std::memory_order_relaxed);
+
+                if (m_records.size() >= m_flushThreshold)
+                {
+                    try_flush();
+                }
+                return true;
+            }
+
+            // Counts a record that was lost before making it into the buffer
+            void count_dropped() noexcept
+            {
+                m_droppedCount.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            void flush()
+            {
+                auto lock = m_flushLock.lock_exclusive();
+                flush_locked();
+            }
+
+            // Flushes unless another thread already is, without throwing
+            void try_flush() noexcept
+            {
+                auto lock = m_flushLock.try_lock_exclusive();
+                if (lock)
+                {
+                    try
+                    {
+                        flush_locked();
+                    }
+                    catch (...)
+                    {
+                        // The failed batch is already counted as dropped
+                    }
+                }
+            }
+
+            log_buffer_stats stats() const noexcept
+            {
+                auto stats = log_buffer_stats {};
+                stats.loggedCount = m_loggedCount.load(std::memory_order_relaxed);
+                stats.flushedCount = m_flushedCount.load(std::memory_order_relaxed);
+                stats.batchCount = m_batchCount.load(std::memory_order_relaxed);
+                stats.overflowCount = m_overflowCount.load(std::memory_order_relaxed);
+                stats.droppedCount = m_droppedCount.load(std::memory_order_relaxed);
+                return stats;
+            }
+
+        private:
+            // Sends batches until the buffer is empty, m_flushLock must be held
+            void flush_locked()
+            {
+                while (true)
+                {
+                    m_batch.clear();
+
+                    auto now = veil::vtl1::performance_counter_microseconds();
+                    while (m_batch.size() < m_records.capacity())
+                    {
+                        auto record = m_records.try_receive();
+                        if (!record)
+                        {
+                            break;
+                        }
+
+                        auto addedCount = m_batch.size();
+                        try
+                        {
+                            m_batch.add(*record, now);
+                        }
+                        catch (...)
+                        {
+                            // The records already received are lost with the batch, count them and the one
+                            // that failed (size() may already include part of it, so use the size from before)
+                            m_droppedCount.fetch_add(addedCount + 1, std::memory_order_relaxed);
+                            m_batch.clear();
+                            throw;
+                        }
+                    }
+
+                    auto batchSize = m_batch.size();
+                    if (batchSize == 0)
+                    {
+                        return;
+                    }
+
+                    auto hr = m_batch.send(now);
+                    if (FAILED(hr))
+                    {
+                        m_droppedCount.fetch_add(batchSize, std::memory_order_relaxed);
+                        THROW_HR(hr);
+                    }
+                    m_flushedCount.fetch_add(batchSize, std::memory_order_relaxed);
+                    m_batchCount.fetch_add(1, std::memory_order_relaxed);
+
+                    // A partial batch emptied the buffer, records logged since are left for the next flush
+                    if (batchSize < m_records.capacity())
+                    {
+                        return;
+                    }
+                }
+            }
+
+            veil::vtl1::channel<record> m_records;
+            const size_t m_flushThreshold;
+
+            // Serializes flushes, and guards the batch being sent
+            wil::srwlock m_flushLock;
+            Batch m_batch;
+
+            std::atomic<uint64_t> m_loggedCount {};
+            std::atomic<uint64_t> m_flushedCount {};
+            std::atomic<uint64_t> m_batchCount {};
+            std::atomic<uint64_t> m_overflowCount {};
+            std::atomic<uint64_t> m_droppedCount {};
+        };
+
+        //
+        // Flushing and counters, shared by log_buffer and binary_log
+        //
+        template <typename Batch>
+        class log_buffer_base
+        {
+        public:
+            // Sends the records that are left, like flush() but without throwing. A flush that's running
+            // on another thread (e.g. the periodic one) is waited for rather than skipped, so records it
+            // didn't drain aren't left behind.
+            ~log_buffer_base()
+            {
+                if (m_state)
+                {
+                    try
+                    {
+                        m_state->flush();
+                    }
+                    catch (...)
+                    {
+                        // The failed batch is already counted as dropped
+                    }
+                }
+            }
+
+            // Delete copy
+            log_buffer_base(const log_buffer_base&) = delete;
+            log_buffer_base& operator=(const log_buffer_base&) = delete;
+
+            // Allow move
+            log_buffer_base(log_buffer_base&&) = default;
+            log_buffer_base& operator=(log_buffer_base&&) = delete;
+
+            // Sends every buffered record to VTL0, throws if a callout fails (its records are dropped)
+            void flush()
+            {
+                m_state->flush();
+            }
+
+            // Flushes unless another thread already is, without throwing
+            void try_flush() noexcept
+            {
+                m_state->try_flush();
+            }
+
+            //
+            // Flushes on the taskpool every period, until the returned handle is cancelled or destroyed.
+            // The taskpool must outlive the handle.
+            //
+            [[nodiscard]] veil::vtl1::periodic_task flush_periodically(veil::vtl1::taskpool& taskpool, std::chrono::milliseconds period)
+            {
+                return taskpool.queue_periodic(period, [state = std::weak_ptr<log_buffer_state<Batch>>(m_state)]()
+                {
+                    if (auto lockedState = state.lock())
+                    {
+                        lockedState->try_flush();
+                    }
+                });
+            }
+
+            log_buffer_stats stats() const noexcept
+            {
+                return m_state->stats();
+            }
+
+        protected:
+            template <typename... BatchArgs>
+            explicit log_buffer_base(const log_buffer_options& options, BatchArgs&&... batchArgs)
+                : m_state(std::make_shared<log_buffer_state<Batch>>(options, std::forward<BatchArgs>(batchArgs)...))
+            {
+            }
+
+            std::shared_ptr<log_buffer_state<Batch>> m_state;
+        };
+    }
+
+    //
+    // Buffers enclave log records and sends them to VTL0 in batches. Logging is thread safe.
+    //
+    class log_buffer : public details::log_buffer_base<details::text_log_batch>
+    {
+    public:
+        explicit log_buffer(const log_buffer_options& options = {})
+            : log_buffer_base(options)
+        {
+        }
+
+        // Buffers a log record if logLevel is within runtimeLogLevel, like add_log_from_enclave
+        void add_log(
+            std::wstring_view log,
+            veil::any::logger::eventLevel logLevel,
+            veil::any::logger::eventLevel runtimeLogLevel,
+            std::wstring_view logFilePath) noexcept
+        {
+            if ((int)logLevel <= (int)runtimeLogLevel)
+            {
+                try
+                {
+                    m_state->add_record({std::wstring(log), std::wstring(logFilePath), veil::vtl1::performance_counter_microseconds()});
+                }
+                catch (...)
+                {
+                    // Copying the record failed, logging must not throw
+                    m_state->count_dropped();
+                }
+            }
+        }
+    };
+}
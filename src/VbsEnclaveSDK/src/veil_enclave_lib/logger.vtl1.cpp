@@ -13,4 +13,14 @@ namespace veil::vtl1::logger::implementation::callouts
     {
         THROW_IF_FAILED(veil_abi::Untrusted::Stubs::add_log({log.data()}, {logFilePath.data()}));
     }
+
+    HRESULT add_logs(const std::vector<std::wstring>& logs, const std::vector<std::wstring>& logFilePaths, const std::vector<uint64_t>& ageMicroseconds)
+    {
+        return veil_abi::Untrusted::Stubs::add_logs(logs, logFilePaths, ageMicroseconds);
+    }
+
+    HRESULT add_binary_logs(const std::vector<uint8_t>& records, const std::wstring& logFilePath, uint64_t timestamp)
+    {
+        return veil_abi::Untrusted::Stubs::add_binary_logs(records, logFilePath, timestamp);
+    }
 }
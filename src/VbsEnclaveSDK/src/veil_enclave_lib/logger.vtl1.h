@@ -1,6 +1,8 @@
 #pragma once
 
 #include <span>
+#include <string>
+#include <vector>
 
 #include <gsl/gsl_util>
 #include <wil/stl.h>
@@ -14,6 +16,12 @@ namespace veil::vtl1::logger
         namespace callouts
         {
             void add_log(std::wstring_view log, std::wstring_view logFilePath);
+
+            // Sends a batch of records with a single callout, ageMicroseconds is how long ago each was logged
+            HRESULT add_logs(const std::vector<std::wstring>& logs, const std::vector<std::wstring>& logFilePaths, const std::vector<uint64_t>& ageMicroseconds);
+
+            // Sends binary log records (see binary_log.any.h), timestamp is the performance counter (in microseconds) when sent
+            HRESULT add_binary_logs(const std::vector<uint8_t>& records, const std::wstring& logFilePath, uint64_t timestamp);
         }
     }
 
@@ -0,0 +1,213 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <optional>
+
+//
+// Provides freelists for memory that's allocated and freed at a high rate (task records, coroutine
+// frames), so steady-state work doesn't go to the enclave heap.
+//
+
+namespace veil::vtl1::details
+{
+    //
+    // Caches freed blocks in power-of-two size classes, so they can be reused by the next allocation of
+    // a similar size. Blocks larger than the biggest size class go to the heap.
+    //
+    // Each size class has a fixed number of cache entries, kept on two lock-free stacks: entries that
+    // hold a freed block, and entries that don't. Allocating pops the first and pushes the second, and
+    // freeing does the opposite, so neither takes a lock or allocates.
+    //
+    class size_class_pool
+    {
+    public:
+        size_class_pool() noexcept
+        {
+            for (auto& sizeClass : m_sizeClasses)
+            {
+                for (uint32_t entry = 0; entry < c_maxCachedBlocksPerSizeClass; entry++)
+                {
+                    sizeClass.push(sizeClass.m_emptyHead, entry);
+                }
+            }
+        }
+
+        ~size_class_pool()
+        {
+            for (auto& sizeClass : m_sizeClasses)
+            {
+                while (auto entry = sizeClass.pop(sizeClass.m_cachedHead))
+                {
+                    ::operator delete(sizeClass.m_entries[*entry].m_block);
+                }
+            }
+        }
+
+        // Delete copy
+        size_class_pool(const size_class_pool&) = delete;
+        size_class_pool& operator=(const size_class_pool&) = delete;
+
+        // Delete move
+        size_class_pool(size_class_pool&&) = delete;
+        size_class_pool& operator=(size_class_pool&&) = delete;
+
+        void* allocate(size_t size)
+        {
+            auto index = size_class_index(size);
+            if (index < c_sizeClassCount)
+            {
+                auto& sizeClass = m_sizeClasses[index];
+                if (auto entry = sizeClass.pop(sizeClass.m_cachedHead))
+                {
+                    auto block = sizeClass.m_entries[*entry].m_block;
+                    sizeClass.push(sizeClass.m_emptyHead, *entry);
+                    return block;
+                }
+                size = c_minBlockSize << index;
+            }
+
+            m_heapAllocationCount.fetch_add(1, std::memory_order_relaxed);
+            return ::operator new(size);
+        }
+
+        void deallocate(void* block, size_t size) noexcept
+        {
+            auto index = size_class_index(size);
+            if (index < c_sizeClassCount)
+            {
+                auto& sizeClass = m_sizeClasses[index];
+                if (auto entry = sizeClass.pop(sizeClass.m_emptyHead))
+                {
+                    sizeClass.m_entries[*entry].m_block = block;
+                    sizeClass.push(sizeClass.m_cachedHead, *entry);
+                    return;
+                }
+            }
+
+            ::operator delete(block);
+        }
+
+        // Number of allocations that couldn't reuse a cached block, and went to the heap
+        uint64_t heap_allocation_count() const noexcept
+        {
+            return m_heapAllocationCount.load(std::memory_order_relaxed);
+        }
+
+    private:
+        static inline constexpr size_t c_minBlockSize = 128;
+        static inline constexpr size_t c_sizeClassCount = 6; // 128 bytes to 4KB
+        static inline constexpr uint32_t c_maxCachedBlocksPerSizeClass = 256;
+
+        static size_t size_class_index(size_t size) noexcept
+        {
+            if (size <= c_minBlockSize)
+            {
+                return 0;
+            }
+            return std::bit_width((size - 1) / c_minBlockSize);
+        }
+
+        struct cache_entry
+        {
+            // Only touched by the thread that popped the entry
+            void* m_block {};
+
+            // Next entry (+1) on the entry's stack, 0 for the end of the stack
+            std::atomic<uint32_t> m_next {};
+        };
+
+        struct size_class
+        {
+            // The heads carry a tag that changes on every push and pop, so an entry that is popped and
+            // pushed again between a load and compare-exchange (ABA) is detected, like
+            // unique_object_table's free stack
+            std::optional<uint32_t> pop(std::atomic<uint64_t>& head) noexcept
+            {
+                auto current = head.load(std::memory_order_acquire);
+                while (static_cast<uint32_t>(current) != 0)
+                {
+                    auto entry = static_cast<uint32_t>(current) - 1;
+                    auto next = m_entries[entry].m_next.load(std::memory_order_relaxed);
+                    auto newHead = ((current >> 32) + 1) << 32 | next;
+                    if (head.compare_exchange_weak(current, newHead, std::memory_order_acquire))
+                    {
+                        return entry;
+                    }
+                }
+                return std::nullopt;
+            }
+
+            void push(std::atomic<uint64_t>& head, uint32_t entry) noexcept
+            {
+                auto current = head.load(std::memory_order_relaxed);
+                while (true)
+                {
+                    m_entries[entry].m_next.store(static_cast<uint32_t>(current), std::memory_order_relaxed);
+                    auto newHead = ((current >> 32) + 1) << 32 | (entry + 1);
+                    if (head.compare_exchange_weak(current, newHead, std::memory_order_release, std::memory_order_relaxed))
+                    {
+                        return;
+                    }
+                }
+            }
+
+            std::array<cache_entry, c_maxCachedBlocksPerSizeClass> m_entries;
+
+            // Tag (high 32 bits) and entry index + 1 (low 32 bits) of the top of each stack
+            std::atomic<uint64_t> m_cachedHead {};
+            std::atomic<uint64_t> m_emptyHead {};
+        };
+
+        std::array<size_class, c_sizeClassCount> m_sizeClasses;
+        std::atomic<uint64_t> m_heapAllocationCount {};
+    };
+
+    //
+    // Standard allocator over a size_class_pool (e.g. for std::allocate_shared). It holds a reference on
+    // the pool, so memory can outlive the object that owns the pool and still be returned to it.
+    //
+    template <typename T>
+    struct pool_allocator
+    {
+        using value_type = T;
+
+        static_assert(alignof(T) <= __STDCPP_DEFAULT_NEW_ALIGNMENT__, "Over-aligned types aren't supported");
+
+        explicit pool_allocator(std::shared_ptr<size_class_pool> pool) noexcept
+            : m_pool(std::move(pool))
+        {
+        }
+
+        template <typename U>
+        pool_allocator(const pool_allocator<U>& other) noexcept
+            : m_pool(other.m_pool)
+        {
+        }
+
+        T* allocate(size_t count)
+        {
+            return static_cast<T*>(m_pool->allocate(count * sizeof(T)));
+        }
+
+        void deallocate(T* block, size_t count) noexcept
+        {
+            m_pool->deallocate(block, count * sizeof(T));
+        }
+
+        template <typename U>
+        bool operator==(const pool_allocator<U>& other) const noexcept
+        {
+            return m_pool == other.m_pool;
+        }
+
+        std::shared_ptr<size_class_pool> m_pool;
+    };
+}
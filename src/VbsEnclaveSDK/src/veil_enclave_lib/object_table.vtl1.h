@@ -3,8 +3,12 @@
 
 #pragma once
 
-#include <unordered_map>
+#include <array>
+#include <atomic>
+#include <bit>
 #include <memory>
+#include <optional>
+#include <vector>
 
 #include "future.vtl1.h"
 
@@ -128,16 +132,125 @@ namespace veil::vtl1
         veil::vtl1::future<void> m_futureObjectProxyDestruction;
     };
 
+    namespace details
+    {
+        //
+        // Slots for an object table. Slots live in chunks that double in size, so a slot never moves
+        // once allocated and the array grows without a global lock.
+        //
+        // Object table ids encode a slot index (low 32 bits) and the slot's generation (high 32 bits).
+        // The generation is odd while the slot holds an object, and is bumped every time the slot is
+        // filled or emptied, so an id handed back by VTL0 after its object is gone (or its slot was
+        // reused) is rejected rather than resolving to someone else's object.
+        //
+        template <typename Slot>
+        class slot_array
+        {
+        public:
+            slot_array() = default;
+
+            ~slot_array()
+            {
+                for (auto& chunk : m_chunks)
+                {
+                    delete[] chunk.load(std::memory_order_acquire);
+                }
+            }
+
+            // Delete copy
+            slot_array(const slot_array&) = delete;
+            slot_array& operator=(const slot_array&) = delete;
+
+            // Delete move
+            slot_array(slot_array&& other) = delete;
+            slot_array& operator=(slot_array&& other) = delete;
+
+            static constexpr uint64_t make_id(uint32_t index, uint32_t generation) noexcept
+            {
+                return (static_cast<uint64_t>(generation) << 32) | index;
+            }
+
+            static constexpr uint32_t index_of(uint64_t handle) noexcept
+            {
+                return static_cast<uint32_t>(handle);
+            }
+
+            static constexpr uint32_t generation_of(uint64_t handle) noexcept
+            {
+                return static_cast<uint32_t>(handle >> 32);
+            }
+
+            static constexpr bool is_filled(uint32_t generation) noexcept
+            {
+                return (generation & 1) != 0;
+            }
+
+            Slot& operator[](uint32_t index) noexcept
+            {
+                auto chunk = chunk_of(index);
+                auto offset = index + c_firstChunkSize - (c_firstChunkSize << chunk);
+                return m_chunks[chunk].load(std::memory_order_acquire)[offset];
+            }
+
+            bool is_allocated(uint32_t index) noexcept
+            {
+                return index < size() && m_chunks[chunk_of(index)].load(std::memory_order_acquire) != nullptr;
+            }
+
+            size_t size() noexcept
+            {
+                return std::min<size_t>(m_slotCount.load(std::memory_order_acquire), c_maxSlotCount);
+            }
+
+            // Allocates a brand new slot, safe to call from many threads at once
+            uint32_t allocate()
+            {
+                auto index = m_slotCount.fetch_add(1, std::memory_order_acq_rel);
+                THROW_HR_IF(E_OUTOFMEMORY, index >= c_maxSlotCount);
+
+                auto chunk = chunk_of(index);
+                if (!m_chunks[chunk].load(std::memory_order_acquire))
+                {
+                    // Whoever installs the chunk first wins, everyone else throws theirs away
+                    auto newChunk = new Slot[c_firstChunkSize << chunk];
+                    Slot* expected = nullptr;
+                    if (!m_chunks[chunk].compare_exchange_strong(expected, newChunk, std::memory_order_acq_rel))
+                    {
+                        delete[] newChunk;
+                    }
+                }
+                return index;
+            }
+
+        private:
+            // Chunk N holds c_firstChunkSize << N slots
+            static inline constexpr size_t c_firstChunkSize = 64;
+            static inline constexpr size_t c_chunkCount = 26;
+            static inline constexpr size_t c_maxSlotCount = (c_firstChunkSize << c_chunkCount) - c_firstChunkSize;
+
+            static constexpr size_t chunk_of(uint32_t index) noexcept
+            {
+                return std::bit_width((index + c_firstChunkSize) / c_firstChunkSize) - 1;
+            }
+
+            std::array<std::atomic<Slot*>, c_chunkCount> m_chunks {};
+            std::atomic<uint32_t> m_slotCount {};
+        };
+    }
+
     //
     // Table for storing unique objects.
     // 
     // The unique entry ids are for safe for sharing as a 'handle' to the object with VTL0 code.
     //
+    // Store and take never take a lock: free slots are kept on a lock-free stack, and taking an
+    // object is a compare-exchange on its slot's generation (see details::slot_array).
+    //
     template <typename T>
     class unique_object_table
     {
     public:
-        using id = size_t;
+        using id = uint64_t;
 
         unique_object_table() = default;
 
@@ -145,55 +258,152 @@ namespace veil::vtl1
         unique_object_table(const unique_object_table&) = delete;
         unique_object_table& operator=(const unique_object_table&) = delete;
 
-        // Allow move
-        unique_object_table(unique_object_table&& other) noexcept = default;
-        unique_object_table& operator=(unique_object_table&& other) noexcept = default;
+        // Delete move
+        unique_object_table(unique_object_table&& other) = delete;
+        unique_object_table& operator=(unique_object_table&& other) = delete;
 
-        id peek_next_id()
+        id store(T&& object)
         {
-            auto lock = m_lock.lock_exclusive();
-            return m_id;
+            auto index = acquire_slot();
+            auto& entry = m_slots[index];
+
+            // The slot is ours until the generation is published, nobody else can touch the object
+            entry.m_object.emplace(std::move(object));
+            auto generation = entry.m_generation.load(std::memory_order_relaxed) + 1;
+            entry.m_generation.store(generation, std::memory_order_release);
+            return slots::make_id(index, generation);
         }
 
-        id store(T&& object)
+        // Stores all objects, returning their ids in the same order
+        std::vector<id> store_all(std::vector<T>&& objects)
         {
-            auto lock = m_lock.lock_exclusive();
-            id id = m_id++;
-            m_objects.emplace(id, std::move(object));
-            return id;
+            auto ids = std::vector<id>{};
+            ids.reserve(objects.size());
+            for (auto& object : objects)
+            {
+                ids.push_back(store(std::move(object)));
+            }
+            return ids;
         }
 
         std::optional<T> try_take(id handle)
         {
-            auto lock = m_lock.lock_exclusive();
-            auto it = m_objects.find(handle);
-            if (it != m_objects.end())
+            auto index = slots::index_of(handle);
+            if (!m_slots.is_allocated(index))
+            {
+                return std::nullopt;
+            }
+
+            // Only one caller can move the slot from the handle's (filled) generation to the next (empty) one
+            auto& entry = m_slots[index];
+            auto generation = slots::generation_of(handle);
+            if (!slots::is_filled(generation) || !entry.m_generation.compare_exchange_strong(generation, generation + 1, std::memory_order_acquire))
             {
-                auto node = m_objects.extract(it);
-                return std::optional<T>{std::move(node.mapped())};
+                return std::nullopt;
             }
-            return std::nullopt;
+
+            auto object = std::optional<T>{std::move(*entry.m_object)};
+            entry.m_object.reset();
+            release_slot(index);
+            return object;
         }
 
-        void clear()
+        T take(id handle)
         {
-            auto lock = m_lock.lock_exclusive();
-            m_objects.clear();
+            if (auto object = try_take(handle))
+            {
+                return std::move(*object);
+            }
+            THROW_WIN32_MSG(ERROR_INVALID_INDEX, "Object handle doesn't exist: %d", static_cast<int>(handle));
         }
 
-        T&& take(id handle)
+        // True if the handle was issued by this table, but its object has since been taken or cleared
+        bool is_expired(id handle)
         {
-            if (auto&& object = try_take(handle))
+            auto index = slots::index_of(handle);
+            if (!m_slots.is_allocated(index))
             {
-                return std::move(object);
+                return false;
             }
-            THROW_WIN32_MSG(ERROR_INVALID_INDEX, "Object handle doesn't exist: %d", static_cast<int>(handle));
+
+            auto generation = slots::generation_of(handle);
+            auto current = m_slots[index].m_generation.load(std::memory_order_acquire);
+            return slots::is_filled(generation) && static_cast<int32_t>(current - generation) > 0;
+        }
+
+        // Returns the number of objects that were dropped
+        size_t clear()
+        {
+            size_t clearedCount = 0;
+            auto slotCount = m_slots.size();
+            for (uint32_t index = 0; index < slotCount; index++)
+            {
+                if (!m_slots.is_allocated(index))
+                {
+                    continue;
+                }
+
+                auto generation = m_slots[index].m_generation.load(std::memory_order_acquire);
+                if (slots::is_filled(generation) && try_take(slots::make_id(index, generation)))
+                {
+                    clearedCount++;
+                }
+            }
+            return clearedCount;
         }
 
     private:
-        id m_id = 1;
-        std::unordered_map<id, T> m_objects;
-        wil::srwlock m_lock;
+        struct slot
+        {
+            std::atomic<uint32_t> m_generation {};
+
+            // Next slot index (+1) on the free stack, 0 for the end of the stack
+            std::atomic<uint32_t> m_nextFree {};
+
+            std::optional<T> m_object;
+        };
+
+        using slots = details::slot_array<slot>;
+
+        uint32_t acquire_slot()
+        {
+            // Pop the free stack. The head carries a tag that changes on every push and pop, so a
+            // slot that is popped and pushed again between our load and compare-exchange (ABA) is detected.
+            auto head = m_freeHead.load(std::memory_order_acquire);
+            while (static_cast<uint32_t>(head) != 0)
+            {
+                auto index = static_cast<uint32_t>(head) - 1;
+                auto next = m_slots[index].m_nextFree.load(std::memory_order_relaxed);
+                auto newHead = ((head >> 32) + 1) << 32 | next;
+                if (m_freeHead.compare_exchange_weak(head, newHead, std::memory_order_acquire))
+                {
+                    return index;
+                }
+            }
+
+            // Free stack is empty, so use a brand new slot
+            return m_slots.allocate();
+        }
+
+        void release_slot(uint32_t index)
+        {
+            auto& entry = m_slots[index];
+            auto head = m_freeHead.load(std::memory_order_relaxed);
+            while (true)
+            {
+                entry.m_nextFree.store(static_cast<uint32_t>(head), std::memory_order_relaxed);
+                auto newHead = ((head >> 32) + 1) << 32 | (index + 1);
+                if (m_freeHead.compare_exchange_weak(head, newHead, std::memory_order_release, std::memory_order_relaxed))
+                {
+                    return;
+                }
+            }
+        }
+
+        slots m_slots;
+
+        // Tag (high 32 bits) and slot index + 1 (low 32 bits) of the top of the free stack
+        std::atomic<uint64_t> m_freeHead {};
     };
 
 
@@ -202,11 +412,19 @@ namespace veil::vtl1
     // 
     // The unique entry ids are for safe for sharing as a 'handle' to the object with VTL0 code.
     //
+    // Lookups (get, resolve_strong_reference) are on the hot path of every task call-in, so they
+    // never take a lock. A reader pins the slot by bumping its reader count, then checks the slot
+    // still has the id's generation before copying the weak_ptr. store and erase are rare, so they
+    // stay serialized by a lock; erase bumps the generation (turning new readers away) and waits for
+    // pinned readers to leave before it destroys the weak_ptr. Readers only copy a weak_ptr, so erase
+    // spins briefly, then flags that it's waiting and blocks with std::atomic::wait (WaitOnAddress,
+    // see atomic_wait_compat.cpp) until the last reader wakes it.
+    //
     template <typename T>
     class weak_object_table
     {
     public:
-        using id = size_t;
+        using id = uint64_t;
 
         weak_object_table() = default;
 
@@ -214,53 +432,139 @@ namespace veil::vtl1
         weak_object_table(const weak_object_table&) = delete;
         weak_object_table& operator=(const weak_object_table&) = delete;
 
-        // Allow move
-        weak_object_table(weak_object_table&& other) noexcept = default;
-        weak_object_table& operator=(weak_object_table&& other) noexcept = default;
+        // Delete move
+        weak_object_table(weak_object_table&& other) = delete;
+        weak_object_table& operator=(weak_object_table&& other) = delete;
 
         id store(std::weak_ptr<T> object)
         {
             auto lock = m_lock.lock_exclusive();
-            id id = m_id++;
-            m_objects.emplace(id, std::move(object));
-            return id;
+
+            uint32_t index;
+            if (!m_freeSlots.empty())
+            {
+                index = m_freeSlots.back();
+                m_freeSlots.pop_back();
+            }
+            else
+            {
+                index = m_slots.allocate();
+            }
+
+            auto& entry = m_slots[index];
+            entry.m_object = std::move(object);
+            auto generation = entry.m_generation.load(std::memory_order_relaxed) + 1;
+            entry.m_generation.store(generation, std::memory_order_seq_cst);
+            return slots::make_id(index, generation);
         }
 
         void erase(id handle)
         {
             auto lock = m_lock.lock_exclusive();
-            m_objects.erase(handle);
+
+            auto index = slots::index_of(handle);
+            if (!m_slots.is_allocated(index))
+            {
+                return;
+            }
+
+            auto& entry = m_slots[index];
+            auto generation = slots::generation_of(handle);
+            if (!slots::is_filled(generation) || entry.m_generation.load(std::memory_order_relaxed) != generation)
+            {
+                return;
+            }
+
+            // Turn new readers away, then wait for the ones already pinning the slot to leave
+            entry.m_generation.store(generation + 1, std::memory_order_seq_cst);
+            wait_for_readers(entry);
+
+            entry.m_object.reset();
+            m_freeSlots.push_back(index);
         }
 
         std::weak_ptr<T> get(id handle)
         {
-            auto lock = m_lock.lock_shared();
-            auto it = m_objects.find(handle);
-            if (it == m_objects.end())
+            std::weak_ptr<T> object;
+            read(handle, [&](const std::weak_ptr<T>& entry) { object = entry; });
+            return object;
+        }
+
+        std::shared_ptr<T> resolve_strong_reference(id handle)
+        {
+            std::shared_ptr<T> strong;
+            read(handle, [&](const std::weak_ptr<T>& entry) { strong = entry.lock(); });
+            return strong;
+        }
+
+    private:
+        // Number of times erase checks for readers before it blocks
+        static inline constexpr uint32_t c_eraseSpinCount = 64;
+
+        // Set in a slot's reader count while erase is blocked waiting for it to drop to 0
+        static inline constexpr uint32_t c_eraseWaiting = 0x80000000;
+
+        struct slot
+        {
+            std::atomic<uint32_t> m_generation {};
+            std::atomic<uint32_t> m_readers {};
+            std::weak_ptr<T> m_object;
+        };
+
+        using slots = details::slot_array<slot>;
+
+        static void wait_for_readers(slot& entry)
+        {
+            for (uint32_t spin = 0; spin < c_eraseSpinCount; spin++)
+            {
+                if (entry.m_readers.load(std::memory_order_seq_cst) == 0)
+                {
+                    return;
+                }
+                YieldProcessor();
+            }
+
+            // Flag that we're blocked, so the last reader to leave wakes us
+            auto readers = entry.m_readers.fetch_or(c_eraseWaiting, std::memory_order_seq_cst) | c_eraseWaiting;
+            while (readers != c_eraseWaiting)
             {
-                return {};
+                entry.m_readers.wait(readers, std::memory_order_acquire);
+                readers = entry.m_readers.load(std::memory_order_acquire);
             }
-            return it->second;
+            entry.m_readers.fetch_and(~c_eraseWaiting, std::memory_order_relaxed);
         }
 
-        std::shared_ptr<T> resolve_strong_reference(id handle)
+        template <typename F>
+        void read(id handle, F&& reader)
         {
-            auto lock = m_lock.lock_shared();
-            auto it = m_objects.find(handle);
-            if (it == m_objects.end())
+            auto index = slots::index_of(handle);
+            if (!m_slots.is_allocated(index))
             {
-                return nullptr;
+                return;
             }
-            if (auto strong = it->second.lock())
+
+            auto generation = slots::generation_of(handle);
+            if (!slots::is_filled(generation))
             {
-                return strong;
+                return;
+            }
+
+            // Pin the slot before checking the generation, so erase either sees us or we see its new generation
+            auto& entry = m_slots[index];
+            entry.m_readers.fetch_add(1, std::memory_order_seq_cst);
+            if (entry.m_generation.load(std::memory_order_seq_cst) == generation)
+            {
+                reader(entry.m_object);
+            }
+
+            if (entry.m_readers.fetch_sub(1, std::memory_order_release) == (c_eraseWaiting | 1))
+            {
+                entry.m_readers.notify_all();
             }
-            return nullptr;
         }
 
-    private:
-        id m_id = 1;
-        std::unordered_map<id, std::weak_ptr<T>> m_objects;
+        slots m_slots;
+        std::vector<uint32_t> m_freeSlots;
         wil::srwlock m_lock;
     };
 
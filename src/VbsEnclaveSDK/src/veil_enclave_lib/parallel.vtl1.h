@@ -0,0 +1,324 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <ranges>
+#include <vector>
+
+#include "taskpool.vtl1.h"
+
+/*
+
+[Feature]
+    Provides data-parallel algorithms on a veil::vtl1::taskpool (parallel_for, parallel_transform and
+    parallel_reduce), so fanning a loop out over the backing threads doesn't need a hand-rolled
+    vector of futures.
+
+[Usage]
+
+    void usage(veil::vtl1::taskpool& taskpool, std::vector<std::vector<uint8_t>>& buffers)
+    {
+        // Run a loop body for every index
+        veil::vtl1::parallel_for(taskpool, 0, buffers.size(), [&](size_t i) {
+            decrypt_in_place(buffers[i]);
+        });
+
+        // Map every element
+        std::vector<hash> hashes = veil::vtl1::parallel_transform(taskpool, buffers, [](const std::vector<uint8_t>& buffer) {
+            return compute_hash(buffer);
+        });
+
+        // Combine every element (the operation must be associative, and commutative with adaptive chunking)
+        auto sizes = buffers | std::views::transform([](const auto& buffer) { return buffer.size(); });
+        size_t total = veil::vtl1::parallel_reduce(taskpool, sizes, size_t{0}, std::plus<>{});
+
+        // Even chunks, for loops where every element costs the same
+        veil::vtl1::parallel_for(taskpool, 0, buffers.size(), body, {veil::vtl1::parallel_chunking::static_chunks});
+    }
+
+[Implementation]
+
+    The range is split across <thread count> + 1 workers, where the extra worker is the calling thread.
+    The other workers are queued with a single taskpool.queue_tasks call.
+
+    Chunking:
+        static_chunks: each worker gets one contiguous chunk of (about) the same size. The calling thread
+                       runs the final chunk.
+        adaptive:      workers repeatedly grab small chunks from a shared cursor until the range is
+                       exhausted, so uneven elements (or busy backing threads) don't leave workers idle.
+
+    Once the calling thread is done with its own work, it runs the work of every queued worker that
+    hasn't started yet, so the algorithms never wait on a backing thread that isn't running (and can be
+    used from inside a task of the same taskpool).
+
+[Behavior]
+
+    The first exception thrown by the loop body stops workers from starting new chunks, and is rethrown
+    on the calling thread once every running chunk has finished.
+
+*/
+
+namespace veil::vtl1
+{
+    enum class parallel_chunking
+    {
+        static_chunks,
+        adaptive,
+    };
+
+    struct parallel_options
+    {
+        parallel_chunking chunking = parallel_chunking::adaptive;
+
+        // Chunks never get smaller than this, raise it when the body is cheap compared to scheduling a worker
+        size_t minChunkSize = 1;
+    };
+
+    namespace details
+    {
+        //
+        // State shared by the calling thread and the queued workers. It's reference counted because a
+        // worker that the calling thread already ran on its behalf can still start (as a no-op) later.
+        //
+        struct parallel_context
+        {
+            parallel_context(size_t queuedWorkerCount)
+                : m_workerClaimed(queuedWorkerCount)
+            {
+            }
+
+            // Returns true for whichever thread gets to run a queued worker's share of the range
+            bool try_claim(size_t worker) noexcept
+            {
+                return !m_workerClaimed[worker].exchange(true, std::memory_order_acq_rel);
+            }
+
+            void run(size_t worker) noexcept
+            {
+                try
+                {
+                    m_work(worker);
+                }
+                catch (...)
+                {
+                    if (!m_failed.exchange(true, std::memory_order_acq_rel))
+                    {
+                        m_exception = std::current_exception();
+                    }
+                }
+            }
+
+            bool failed() const noexcept
+            {
+                return m_failed.load(std::memory_order_acquire);
+            }
+
+            std::vector<std::atomic<bool>> m_workerClaimed;
+            std::atomic<size_t> m_nextIndex {};
+            std::atomic<bool> m_failed {};
+            std::exception_ptr m_exception;
+            std::function<void(size_t)> m_work;
+        };
+
+        // Adaptive chunking aims for this many chunks per worker
+        inline constexpr size_t c_adaptiveChunksPerWorker = 4;
+
+        inline size_t parallel_worker_count(const veil::vtl1::taskpool& taskpool, size_t count, const parallel_options& options)
+        {
+            auto minChunkSize = std::max<size_t>(options.minChunkSize, 1);
+            auto maxWorkers = (count + minChunkSize - 1) / minChunkSize;
+            return std::min<size_t>(static_cast<size_t>(taskpool.thread_count()) + 1, maxWorkers);
+        }
+
+        //
+        // Splits [0, count) into chunks and calls runChunk(worker, begin, end) for each of them, spread
+        // across the taskpool and the calling thread. Chunks run by the same worker are never run
+        // concurrently, and with static chunking worker i's chunk comes before worker i + 1's.
+        //
+        template <typename RunChunk>
+        void run_chunked(veil::vtl1::taskpool& taskpool, size_t count, const parallel_options& options, size_t workerCount, RunChunk& runChunk)
+        {
+            if (count == 0)
+            {
+                return;
+            }
+
+            if (workerCount <= 1)
+            {
+                runChunk(size_t {0}, size_t {0}, count);
+                return;
+            }
+
+            auto minChunkSize = std::max<size_t>(options.minChunkSize, 1);
+            auto adaptiveChunkSize = std::max<size_t>(minChunkSize, count / (workerCount * c_adaptiveChunksPerWorker));
+            auto chunking = options.chunking;
+
+            auto context = std::make_shared<parallel_context>(workerCount - 1);
+            context->m_work = [&runChunk, count, workerCount, adaptiveChunkSize, chunking, context = context.get()](size_t worker)
+            {
+                if (chunking == parallel_chunking::static_chunks)
+                {
+                    if (!context->failed())
+                    {
+                        runChunk(worker, (count * worker) / workerCount, (count * (worker + 1)) / workerCount);
+                    }
+                    return;
+                }
+
+                while (!context->failed())
+                {
+                    auto begin = context->m_nextIndex.fetch_add(adaptiveChunkSize, std::memory_order_relaxed);
+                    if (begin >= count)
+                    {
+                        break;
+                    }
+                    runChunk(worker, begin, std::min(begin + adaptiveChunkSize, count));
+                }
+            };
+
+            // Queue every worker but the last one, which is the calling thread
+            auto workers = std::vector<std::function<void()>> {};
+            workers.reserve(workerCount - 1);
+            for (size_t worker = 0; worker < workerCount - 1; worker++)
+            {
+                workers.push_back([context, worker]()
+                {
+                    if (context->try_claim(worker))
+                    {
+                        context->run(worker);
+                    }
+                });
+            }
+
+            auto futures = taskpool.queue_tasks(std::move(workers));
+
+            context->run(workerCount - 1);
+
+            // Run the share of every worker that hasn't started yet, then wait for the ones that have
+            for (size_t worker = 0; worker < workerCount - 1; worker++)
+            {
+                if (context->try_claim(worker))
+                {
+                    context->run(worker);
+                    futures[worker].detach();
+                }
+            }
+
+            for (auto& future : futures)
+            {
+                if (future.valid())
+                {
+                    future.get();
+                }
+            }
+
+            if (context->m_exception)
+            {
+                std::rethrow_exception(context->m_exception);
+            }
+        }
+    }
+
+    //
+    // Calls body(i) for every i in [begin, end).
+    //
+    template <typename F>
+    void parallel_for(veil::vtl1::taskpool& taskpool, size_t begin, size_t end, F&& body, const parallel_options& options = {})
+    {
+        if (end <= begin)
+        {
+            return;
+        }
+
+        auto count = end - begin;
+        auto runChunk = [&](size_t, size_t chunkBegin, size_t chunkEnd)
+        {
+            for (auto i = chunkBegin; i < chunkEnd; i++)
+            {
+                body(begin + i);
+            }
+        };
+
+        details::run_chunked(taskpool, count, options, details::parallel_worker_count(taskpool, count, options), runChunk);
+    }
+
+    //
+    // Returns f(element) for every element of the input, in the same order. The result type must be
+    // default constructible.
+    //
+    template <std::ranges::random_access_range R, typename F>
+        requires std::ranges::sized_range<R>
+    [[nodiscard]] auto parallel_transform(veil::vtl1::taskpool& taskpool, R&& input, F&& f, const parallel_options& options = {})
+        -> std::vector<std::decay_t<std::invoke_result_t<F&, std::ranges::range_reference_t<R>>>>
+    {
+        using result_type = std::decay_t<std::invoke_result_t<F&, std::ranges::range_reference_t<R>>>;
+
+        auto count = static_cast<size_t>(std::ranges::size(input));
+        auto results = std::vector<result_type>(count);
+        auto first = std::ranges::begin(input);
+
+        auto runChunk = [&](size_t, size_t chunkBegin, size_t chunkEnd)
+        {
+            for (auto i = chunkBegin; i < chunkEnd; i++)
+            {
+                results[i] = f(first[i]);
+            }
+        };
+
+        details::run_chunked(taskpool, count, options, details::parallel_worker_count(taskpool, count, options), runChunk);
+        return results;
+    }
+
+    //
+    // Combines init and every element of the input with op, like std::reduce. op must be associative,
+    // and also commutative with adaptive chunking (chunks are combined in the order workers grab them).
+    //
+    template <std::ranges::random_access_range R, typename T, typename Op>
+        requires std::ranges::sized_range<R>
+    [[nodiscard]] T parallel_reduce(veil::vtl1::taskpool& taskpool, R&& input, T init, Op&& op, const parallel_options& options = {})
+    {
+        auto count = static_cast<size_t>(std::ranges::size(input));
+        auto workerCount = details::parallel_worker_count(taskpool, count, options);
+        auto first = std::ranges::begin(input);
+
+        // Each worker folds its chunks into its own partial result
+        auto partials = std::vector<std::optional<T>>(std::max<size_t>(workerCount, 1));
+
+        auto runChunk = [&](size_t worker, size_t chunkBegin, size_t chunkEnd)
+        {
+            T chunkResult = static_cast<T>(first[chunkBegin]);
+            for (auto i = chunkBegin + 1; i < chunkEnd; i++)
+            {
+                chunkResult = op(std::move(chunkResult), first[i]);
+            }
+
+            auto& partial = partials[worker];
+            if (partial)
+            {
+                partial = op(std::move(*partial), std::move(chunkResult));
+            }
+            else
+            {
+                partial.emplace(std::move(chunkResult));
+            }
+        };
+
+        details::run_chunked(taskpool, count, options, workerCount, runChunk);
+
+        for (auto& partial : partials)
+        {
+            if (partial)
+            {
+                init = op(std::move(init), std::move(*partial));
+            }
+        }
+        return init;
+    }
+}
@@ -0,0 +1,343 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <coroutine>
+#include <exception>
+#include <memory>
+#include <optional>
+
+#include "future.vtl1.h"
+#include "memory_pool.vtl1.h"
+
+/*
+
+[Feature]
+    Provides a coroutine type for vtl1 code (veil::vtl1::task<T>), so enclave request handlers can be
+    written with co_await instead of parking one of the enclave's few threads on every outstanding
+    operation.
+
+    The following can be co_await-ed from a task:
+        - Another task<T>
+        - A veil::vtl1::future<T> (e.g. the result of taskpool.queue_task)
+        - taskpool.schedule(), which moves the coroutine onto one of the taskpool's threads
+
+[Usage]
+
+    veil::vtl1::task<size_t> handle_request(veil::vtl1::taskpool& taskpool, std::vector<uint8_t> request)
+    {
+        // Continue on a taskpool thread, so the calling thread is released
+        co_await taskpool.schedule();
+
+        // Run a VTL0 callout on another taskpool thread, without blocking this one while it runs (the
+        // generated ABI only has synchronous callouts, so one thread still waits on the callout)
+        auto response = co_await taskpool.queue_task([]() { return call_out_to_vtl0(); });
+
+        // Wait for other coroutines
+        auto checksum = co_await compute_checksum(std::move(request));
+
+        co_return response.size() + checksum;
+    }
+
+    void usage(veil::vtl1::taskpool& taskpool)
+    {
+        // Tasks are lazy, they don't run until they're co_await-ed or started
+        veil::vtl1::future<size_t> result = veil::vtl1::start(handle_request(taskpool, {1, 2, 3}));
+        size_t x = result.get();
+    }
+
+[Implementation]
+
+    task<T> is lazily started and resumes its awaiter (symmetric transfer) when it completes, so a
+    chain of tasks runs without any thread blocking.
+
+    co_await-ing a future registers a continuation on the future's shared state. The coroutine is
+    resumed by whichever thread sets the value, so co_await taskpool.schedule() afterwards if the
+    rest of the coroutine shouldn't run on that thread.
+
+    Coroutine frames are allocated from a pool of size classes (details::size_class_pool), so
+    keeping many operations in flight doesn't hit the enclave heap for every call.
+
+[Behavior]
+
+    If the taskpool drops the task queued by taskpool.schedule() (cancel_queued_tasks, or the taskpool
+    being destroyed with mustFinishAllQueuedTasks=false), the coroutine is resumed on the thread that
+    dropped it and co_await throws std::future_error(broken_promise). Unless the coroutine catches it,
+    the exception completes the task (and the future returned by start()), and the frame is freed. A
+    coroutine that catches it while the taskpool is being destroyed must not use the taskpool again.
+    If queuing the task fails, co_await throws the error queue_task failed with (e.g. the failed
+    callout's HRESULT) instead of broken_promise.
+
+*/
+
+namespace veil::vtl1
+{
+    template <typename T = void>
+    class task;
+
+    namespace details
+    {
+        inline size_class_pool& get_coroutine_frame_pool()
+        {
+            static size_class_pool s_coroutineFramePool;
+            return s_coroutineFramePool;
+        }
+
+        struct task_promise_base
+        {
+            static void* operator new(size_t size)
+            {
+                return get_coroutine_frame_pool().allocate(size);
+            }
+
+            static void operator delete(void* frame, size_t size) noexcept
+            {
+                get_coroutine_frame_pool().deallocate(frame, size);
+            }
+
+            // Tasks are lazy, they run once they're co_await-ed
+            std::suspend_always initial_suspend() noexcept
+            {
+                return {};
+            }
+
+            struct final_awaiter
+            {
+                bool await_ready() const noexcept
+                {
+                    return false;
+                }
+
+                template <typename Promise>
+                std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept
+                {
+                    // Resume whoever co_await-ed this task
+                    if (auto continuation = handle.promise().m_continuation)
+                    {
+                        return continuation;
+                    }
+                    return std::noop_coroutine();
+                }
+
+                void await_resume() const noexcept
+                {
+                }
+            };
+
+            final_awaiter final_suspend() noexcept
+            {
+                return {};
+            }
+
+            void unhandled_exception() noexcept
+            {
+                m_exception = std::current_exception();
+            }
+
+            void rethrow_if_exception()
+            {
+                if (m_exception)
+                {
+                    std::rethrow_exception(m_exception);
+                }
+            }
+
+            std::coroutine_handle<> m_continuation;
+            std::exception_ptr m_exception;
+        };
+
+        template <typename T>
+        struct task_promise : task_promise_base
+        {
+            task<T> get_return_object() noexcept;
+
+            void return_value(T value)
+            {
+                m_value.emplace(std::move(value));
+            }
+
+            T take_result()
+            {
+                rethrow_if_exception();
+                return std::move(*m_value);
+            }
+
+            std::optional<T> m_value;
+        };
+
+        template <>
+        struct task_promise<void> : task_promise_base
+        {
+            task<void> get_return_object() noexcept;
+
+            void return_void() noexcept
+            {
+            }
+
+            void take_result()
+            {
+                rethrow_if_exception();
+            }
+        };
+    }
+
+    //
+    // A lazily started coroutine that produces a T (or an exception).
+    //
+    template <typename T>
+    class task
+    {
+    public:
+        using promise_type = details::task_promise<T>;
+
+        explicit task(std::coroutine_handle<promise_type> handle) noexcept
+            : m_handle(handle)
+        {
+        }
+
+        ~task()
+        {
+            if (m_handle)
+            {
+                m_handle.destroy();
+            }
+        }
+
+        // Delete copy
+        task(const task&) = delete;
+        task& operator=(const task&) = delete;
+
+        // Allow move
+        task(task&& other) noexcept
+            : m_handle(std::exchange(other.m_handle, nullptr))
+        {
+        }
+
+        task& operator=(task&& other) noexcept
+        {
+            if (this != &other)
+            {
+                if (m_handle)
+                {
+                    m_handle.destroy();
+                }
+                m_handle = std::exchange(other.m_handle, nullptr);
+            }
+            return *this;
+        }
+
+        auto operator co_await() && noexcept
+        {
+            struct awaiter
+            {
+                std::coroutine_handle<promise_type> m_handle;
+
+                bool await_ready() const noexcept
+                {
+                    return m_handle.done();
+                }
+
+                std::coroutine_handle<> await_suspend(std::coroutine_handle<> continuation) noexcept
+                {
+                    // Start the task, it resumes the continuation when it completes
+                    m_handle.promise().m_continuation = continuation;
+                    return m_handle;
+                }
+
+                T await_resume()
+                {
+                    return m_handle.promise().take_result();
+                }
+            };
+
+            return awaiter {m_handle};
+        }
+
+    private:
+        std::coroutine_handle<promise_type> m_handle;
+    };
+
+    namespace details
+    {
+        template <typename T>
+        task<T> task_promise<T>::get_return_object() noexcept
+        {
+            return task<T>(std::coroutine_handle<task_promise<T>>::from_promise(*this));
+        }
+
+        inline task<void> task_promise<void>::get_return_object() noexcept
+        {
+            return task<void>(std::coroutine_handle<task_promise<void>>::from_promise(*this));
+        }
+
+        //
+        // A coroutine that starts right away and frees itself when it completes, used to drive a task
+        // from code that isn't a coroutine.
+        //
+        struct detached_task
+        {
+            struct promise_type : task_promise_base
+            {
+                detached_task get_return_object() noexcept
+                {
+                    return {};
+                }
+
+                std::suspend_never initial_suspend() noexcept
+                {
+                    return {};
+                }
+
+                std::suspend_never final_suspend() noexcept
+                {
+                    return {};
+                }
+
+                void return_void() noexcept
+                {
+                }
+
+                void unhandled_exception() noexcept
+                {
+                    // run_detached catches everything
+                    std::terminate();
+                }
+            };
+        };
+
+        template <typename T>
+        detached_task run_detached(task<T> work, std::shared_ptr<promise<T>> resultPromise)
+        {
+            try
+            {
+                if constexpr (std::is_void_v<T>)
+                {
+                    co_await std::move(work);
+                    resultPromise->set_value();
+                }
+                else
+                {
+                    resultPromise->set_value(co_await std::move(work));
+                }
+            }
+            catch (...)
+            {
+                resultPromise->set_exception(std::current_exception());
+            }
+        }
+    }
+
+    //
+    // Starts a task on the calling thread (until its first suspension point), and returns a future
+    // for its result. This is the bridge from regular code, e.g. an enclave export, into coroutines.
+    //
+    template <typename T>
+    [[nodiscard]] future<T> start(task<T> work)
+    {
+        auto resultPromise = std::make_shared<veil::vtl1::promise<T>>();
+        auto fut = resultPromise->get_future();
+        details::run_detached(std::move(work), std::move(resultPromise));
+        return fut;
+    }
+}
@@ -0,0 +1,131 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace veil::vtl1::implementation
+{
+    //
+    // Move-only void() callable, like std::move_only_function, that stores callables of up to
+    // c_inlineSize bytes inline instead of on the heap. Tasks only ever store a reference to their
+    // task_state, so queuing a task never allocates a callable. Also holds the callbacks registered on
+    // a future's shared_state (see future.vtl1.h).
+    //
+    class task_function
+    {
+    public:
+        static inline constexpr size_t c_inlineSize = 48;
+
+        task_function() noexcept = default;
+
+        template <typename F>
+            requires (!std::is_same_v<std::decay_t<F>, task_function>)
+        task_function(F&& f)
+        {
+            using callable_type = std::decay_t<F>;
+
+            if constexpr (stored_inline<callable_type>)
+            {
+                new (m_storage) callable_type(std::forward<F>(f));
+                m_operations = &c_inlineOperations<callable_type>;
+            }
+            else
+            {
+                auto callable = new callable_type(std::forward<F>(f));
+                new (m_storage) callable_type*(callable);
+                m_operations = &c_heapOperations<callable_type>;
+            }
+        }
+
+        ~task_function()
+        {
+            reset();
+        }
+
+        // Delete copy
+        task_function(const task_function&) = delete;
+        task_function& operator=(const task_function&) = delete;
+
+        // Allow move
+        task_function(task_function&& other) noexcept
+        {
+            move_from(other);
+        }
+
+        task_function& operator=(task_function&& other) noexcept
+        {
+            if (this != &other)
+            {
+                reset();
+                move_from(other);
+            }
+            return *this;
+        }
+
+        explicit operator bool() const noexcept
+        {
+            return m_operations != nullptr;
+        }
+
+        void operator()()
+        {
+            m_operations->invoke(m_storage);
+        }
+
+    private:
+        struct operations
+        {
+            void (*invoke)(void* storage);
+            void (*move)(void* destination, void* source) noexcept;
+            void (*destroy)(void* storage) noexcept;
+        };
+
+        template <typename F>
+        static inline constexpr bool stored_inline = sizeof(F) <= c_inlineSize && alignof(F) <= alignof(std::max_align_t) && std::is_nothrow_move_constructible_v<F>;
+
+        template <typename F>
+        static inline constexpr operations c_inlineOperations
+        {
+            [](void* storage) { (*static_cast<F*>(storage))(); },
+            [](void* destination, void* source) noexcept
+            {
+                new (destination) F(std::move(*static_cast<F*>(source)));
+                static_cast<F*>(source)->~F();
+            },
+            [](void* storage) noexcept { static_cast<F*>(storage)->~F(); },
+        };
+
+        template <typename F>
+        static inline constexpr operations c_heapOperations
+        {
+            [](void* storage) { (**static_cast<F**>(storage))(); },
+            [](void* destination, void* source) noexcept { new (destination) F*(*static_cast<F**>(source)); },
+            [](void* storage) noexcept { delete *static_cast<F**>(storage); },
+        };
+
+        void move_from(task_function& other) noexcept
+        {
+            if (other.m_operations)
+            {
+                other.m_operations->move(m_storage, other.m_storage);
+                m_operations = std::exchange(other.m_operations, nullptr);
+            }
+        }
+
+        void reset() noexcept
+        {
+            if (auto operations = std::exchange(m_operations, nullptr))
+            {
+                operations->destroy(m_storage);
+            }
+        }
+
+        alignas(std::max_align_t) std::byte m_storage[c_inlineSize];
+        const operations* m_operations {};
+    };
+}
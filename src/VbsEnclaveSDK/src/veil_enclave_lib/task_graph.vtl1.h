@@ -0,0 +1,429 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <future>
+#include <initializer_list>
+#include <memory>
+#include <span>
+#include <vector>
+
+#include "future.vtl1.h"
+#include "taskpool.vtl1.h"
+
+/*
+
+[Feature]
+    Provides a dependency graph of tasks (veil::vtl1::task_graph) that runs on a veil::vtl1::taskpool.
+    Each node is queued as soon as the nodes it depends on have completed, so pipelines such as
+    unseal -> derive keys -> decrypt records -> aggregate -> reseal don't need tasks that block on
+    future::get() (which ties up one of the enclave's few threads per waiting step).
+
+[Usage]
+
+    void usage(veil::vtl1::taskpool& taskpool, pipeline_state& state)
+    {
+        auto graph = veil::vtl1::task_graph {};
+
+        auto unseal = graph.add_node([&]() { state.key = unseal_key(state.sealedKey); });
+        auto derive = graph.add_node([&]() { state.subkeys = derive_subkeys(state.key); }, {unseal});
+
+        auto decrypted = std::vector<veil::vtl1::task_graph::node_id> {};
+        for (size_t i = 0; i < state.records.size(); i++) {
+            decrypted.push_back(graph.add_node([&, i]() { decrypt_in_place(state.subkeys, state.records[i]); }, {derive}));
+        }
+
+        auto aggregate = graph.add_node([&]() { state.summary = summarize(state.records); }, decrypted);
+        graph.add_node([&]() { state.sealedSummary = reseal(state.summary); }, {aggregate});
+
+        // Runs every node once, the future completes when the last one is done
+        graph.run(taskpool).get();
+
+        // The same graph runs again without being rebuilt
+        load_next_batch(state);
+        graph.run(taskpool).get();
+    }
+
+[Implementation]
+
+    Nodes only depend on nodes that were added before them, so a graph can't have cycles. The nodes
+    (work, successors and dependency counts) are kept in a definition that's shared by every run.
+
+    Each run has its own state with an atomic counter of pending dependencies per node. Nodes without
+    dependencies are queued with a single taskpool.queue_tasks call. When a node completes, it
+    decrements its successors' counters. The successors that reach zero are ready: one of them runs
+    next on the same thread, and the rest are queued with a single queue_tasks call.
+
+    The state of a run that has finished is reset and reused by the next run, so running a recurring
+    pipeline doesn't allocate per node. Runs that overlap get their own state.
+
+[Behavior]
+
+    The first exception thrown by a node (or by queuing nodes on the taskpool) is reported by the run's
+    future. Nodes that haven't started by then are skipped (their successors are still released, so the
+    run completes). A node that's dropped without running, e.g. by taskpool.cancel_queued_tasks, fails
+    the run with std::future_errc::broken_promise, unless there's an exception to report instead.
+
+    Nodes added while a run is in progress only take part in later runs. The taskpool must outlive
+    the run. The task_graph itself isn't thread safe, but it can be destroyed (or run again) while a
+    run is in progress.
+
+*/
+
+namespace veil::vtl1
+{
+    namespace details
+    {
+        struct task_graph_node
+        {
+            std::function<void()> m_work;
+            std::vector<size_t> m_successors;
+            uint32_t m_dependencyCount {};
+        };
+
+        using task_graph_definition = std::vector<task_graph_node>;
+
+        //
+        // State of one run of a task_graph, shared by the node tasks queued on the taskpool.
+        //
+        class task_graph_run : public std::enable_shared_from_this<task_graph_run>
+        {
+        public:
+            explicit task_graph_run(std::shared_ptr<const task_graph_definition> definition)
+                : m_definition(std::move(definition)),
+                  m_pending(std::make_unique<std::atomic<uint32_t>[]>(m_definition->size()))
+            {
+            }
+
+            // Delete copy
+            task_graph_run(const task_graph_run&) = delete;
+            task_graph_run& operator=(const task_graph_run&) = delete;
+
+            // Delete move
+            task_graph_run(task_graph_run&&) = delete;
+            task_graph_run& operator=(task_graph_run&&) = delete;
+
+            const std::shared_ptr<const task_graph_definition>& definition() const noexcept
+            {
+                return m_definition;
+            }
+
+            // Whether every node has completed and the future is ready, so the state can be reused
+            bool is_finished() const noexcept
+            {
+                return m_finished.load(std::memory_order_acquire);
+            }
+
+            // Resets the counters for a new run, and queues the nodes that have no dependencies
+            future<void> start(veil::vtl1::taskpool& taskpool, task_priority priority)
+            {
+                auto& nodes = *m_definition;
+                for (size_t node = 0; node < nodes.size(); node++)
+                {
+                    m_pending[node].store(nodes[node].m_dependencyCount, std::memory_order_relaxed);
+                }
+                // One more than the nodes, held until the roots are launched (see below)
+                m_remaining.store(nodes.size() + 1, std::memory_order_relaxed);
+                m_failed.store(false, std::memory_order_relaxed);
+                m_dropped.store(false, std::memory_order_relaxed);
+                m_exceptionClaimed.store(false, std::memory_order_relaxed);
+                m_exception = nullptr;
+                m_finished.store(false, std::memory_order_relaxed);
+                m_taskpool = &taskpool;
+                m_priority = priority;
+                m_promise = promise<void> {};
+                auto result = m_promise.get_future();
+
+                auto roots = std::vector<node_launch> {};
+                for (size_t node = 0; node < nodes.size(); node++)
+                {
+                    if (nodes[node].m_dependencyCount == 0)
+                    {
+                        roots.emplace_back(shared_from_this(), node);
+                    }
+                }
+                try
+                {
+                    launch(std::move(roots));
+                }
+                catch (...)
+                {
+                    // The roots that weren't queued release the rest of the graph, and the run reports the error
+                    fail(std::current_exception());
+                }
+
+                // The run can only complete once the error of a failed launch is recorded, otherwise the
+                // dropped roots would complete it with broken_promise first
+                if (m_remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                {
+                    complete();
+                }
+
+                return result;
+            }
+
+        private:
+            //
+            // The callable queued for a node. It runs the node, or fails the run if the taskpool drops
+            // it without running it.
+            //
+            struct node_launch
+            {
+                node_launch(std::shared_ptr<task_graph_run> run, size_t node) noexcept
+                    : m_run(std::move(run)), m_node(node)
+                {
+                }
+
+                ~node_launch()
+                {
+                    if (m_run)
+                    {
+                        m_run->drop();
+                        m_run->run_from(m_node);
+                    }
+                }
+
+                // Delete copy
+                node_launch(const node_launch&) = delete;
+                node_launch& operator=(const node_launch&) = delete;
+
+                // Allow move construction
+                node_launch(node_launch&& other) noexcept
+                    : m_run(std::exchange(other.m_run, nullptr)), m_node(other.m_node)
+                {
+                }
+                node_launch& operator=(node_launch&&) = delete;
+
+                void operator()()
+                {
+                    // Keep the run alive until run_from returns
+                    auto run = std::exchange(m_run, nullptr);
+                    run->run_from(m_node);
+                }
+
+                std::shared_ptr<task_graph_run> m_run;
+                size_t m_node;
+            };
+
+            void launch(std::vector<node_launch> launches)
+            {
+                if (launches.empty())
+                {
+                    return;
+                }
+
+                // A launch that doesn't make it onto the taskpool fails the run from its destructor
+                for (auto& future : m_taskpool->queue_tasks(m_priority, std::move(launches)))
+                {
+                    future.detach();
+                }
+            }
+
+            // Runs a node, then keeps running successors that become ready on this thread
+            void run_from(size_t node) noexcept
+            {
+                auto& nodes = *m_definition;
+                auto ready = std::vector<size_t> {node};
+                while (!ready.empty())
+                {
+                    node = ready.back();
+                    ready.pop_back();
+
+                    if (!m_failed.load(std::memory_order_acquire))
+                    {
+                        try
+                        {
+                            nodes[node].m_work();
+                        }
+                        catch (...)
+                        {
+                            fail(std::current_exception());
+                        }
+                    }
+
+                    // Release the successors before counting the node as done, so the run can't complete early
+                    auto readyCount = ready.size();
+                    for (auto successor : nodes[node].m_successors)
+                    {
+                        if (m_pending[successor].fetch_sub(1, std::memory_order_acq_rel) == 1)
+                        {
+                            ready.push_back(successor);
+                        }
+                    }
+
+                    if (m_remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                    {
+                        complete();
+                        return;
+                    }
+
+                    // Keep one of the newly ready successors for this thread, and queue the others. Once
+                    // the run has failed, nodes are only released, which is cheaper to do right here.
+                    if (ready.size() - readyCount > 1 && !m_failed.load(std::memory_order_acquire))
+                    {
+                        auto launches = std::vector<node_launch> {};
+                        for (auto i = readyCount; i < ready.size() - 1; i++)
+                        {
+                            launches.emplace_back(shared_from_this(), ready[i]);
+                        }
+                        ready.erase(ready.begin() + readyCount, ready.end() - 1);
+
+                        try
+                        {
+                            launch(std::move(launches));
+                        }
+                        catch (...)
+                        {
+                            fail(std::current_exception());
+                        }
+                    }
+                }
+            }
+
+            // Records the first exception, and skips the nodes that haven't started
+            void fail(std::exception_ptr exception) noexcept
+            {
+                if (!m_exceptionClaimed.exchange(true, std::memory_order_acq_rel))
+                {
+                    m_exception = std::move(exception);
+                }
+                m_failed.store(true, std::memory_order_release);
+            }
+
+            // A node was dropped without running: skips the nodes that haven't started, and fails the run
+            // with broken_promise unless it has an exception to report
+            void drop() noexcept
+            {
+                m_dropped.store(true, std::memory_order_relaxed);
+                m_failed.store(true, std::memory_order_release);
+            }
+
+            void complete() noexcept
+            {
+                if (m_exception)
+                {
+                    m_promise.set_exception(m_exception);
+                }
+                else if (m_dropped.load(std::memory_order_relaxed))
+                {
+                    m_promise.set_exception(std::make_exception_ptr(std::future_error(std::future_errc::broken_promise)));
+                }
+                else
+                {
+                    m_promise.set_value();
+                }
+                m_finished.store(true, std::memory_order_release);
+            }
+
+            std::shared_ptr<const task_graph_definition> m_definition;
+            std::unique_ptr<std::atomic<uint32_t>[]> m_pending;
+            std::atomic<size_t> m_remaining {};
+            std::atomic<bool> m_failed {};
+            std::atomic<bool> m_dropped {};
+            std::atomic<bool> m_exceptionClaimed {};
+            std::exception_ptr m_exception;
+            std::atomic<bool> m_finished {};
+            veil::vtl1::taskpool* m_taskpool {};
+            task_priority m_priority {task_priority::normal};
+            promise<void> m_promise;
+        };
+    }
+
+    //
+    // A graph of tasks that run on a taskpool once their dependencies have completed. Build it once with
+    // add_node, then run it as many times as needed.
+    //
+    class task_graph
+    {
+    public:
+        using node_id = size_t;
+
+        task_graph() = default;
+
+        // Delete copy
+        task_graph(const task_graph&) = delete;
+        task_graph& operator=(const task_graph&) = delete;
+
+        // Allow move
+        task_graph(task_graph&&) = default;
+        task_graph& operator=(task_graph&&) = default;
+
+        //
+        // Adds a node that runs work once every node in dependencies has completed. Dependencies must be
+        // nodes that were already added, which keeps the graph acyclic.
+        //
+        node_id add_node(std::function<void()> work, std::span<const node_id> dependencies)
+        {
+            THROW_HR_IF(E_INVALIDARG, !work);
+
+            auto& nodes = mutable_definition();
+            auto node = nodes.size();
+            for (auto dependency : dependencies)
+            {
+                THROW_HR_IF(E_INVALIDARG, dependency >= node);
+            }
+
+            nodes.push_back({std::move(work), {}, static_cast<uint32_t>(dependencies.size())});
+            for (auto dependency : dependencies)
+            {
+                nodes[dependency].m_successors.push_back(node);
+            }
+            return node;
+        }
+
+        node_id add_node(std::function<void()> work, std::initializer_list<node_id> dependencies = {})
+        {
+            return add_node(std::move(work), std::span<const node_id>(dependencies.begin(), dependencies.size()));
+        }
+
+        size_t size() const noexcept
+        {
+            return m_definition ? m_definition->size() : 0;
+        }
+
+        //
+        // Runs every node of the graph once on the taskpool. The returned future completes when every
+        // node has run, with the first exception a node threw (if any).
+        //
+        [[nodiscard]] future<void> run(veil::vtl1::taskpool& taskpool, task_priority priority = task_priority::normal)
+        {
+            if (size() == 0)
+            {
+                auto done = promise<void> {};
+                auto result = done.get_future();
+                done.set_value();
+                return result;
+            }
+
+            // Reuse the last run's state unless it's still running (or the graph has changed since)
+            if (!m_lastRun || !m_lastRun->is_finished() || m_lastRun->definition() != m_definition)
+            {
+                m_lastRun = std::make_shared<details::task_graph_run>(m_definition);
+            }
+            return m_lastRun->start(taskpool, priority);
+        }
+
+    private:
+        // Runs that are still in progress keep the definition they started with
+        details::task_graph_definition& mutable_definition()
+        {
+            m_lastRun.reset();
+            if (!m_definition)
+            {
+                m_definition = std::make_shared<details::task_graph_definition>();
+            }
+            else if (m_definition.use_count() > 1)
+            {
+                m_definition = std::make_shared<details::task_graph_definition>(*m_definition);
+            }
+            return *m_definition;
+        }
+
+        std::shared_ptr<details::task_graph_definition> m_definition;
+        std::shared_ptr<details::task_graph_run> m_lastRun;
+    };
+}
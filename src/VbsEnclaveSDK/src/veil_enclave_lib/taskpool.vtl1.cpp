@@ -14,6 +14,7 @@
 #include <VbsEnclave\Enclave\Stubs\Untrusted.h>
 
 #include "taskpool.any.h"
+#include "taskpool_telemetry.any.h"
 #include "taskpool.vtl1.h"
 
 
@@ -53,6 +54,60 @@ namespace veil_abi
 
             THROW_HR(HRESULT_FROM_WIN32(ERROR_RESOURCE_NOT_ONLINE)); // ERROR_NOT_READY? ERROR_INVALID_STATE?
         }
+
+        HRESULT taskpool_push_ready_tasks(_In_ const std::uint64_t taskpool_instance_vtl1, _In_ const std::vector<std::uint64_t>& task_ids)
+        {
+            auto taskpoolId = taskpool_instance_vtl1;
+
+            if (auto objectProxy = veil::vtl1::implementation::get_taskpool_object_table().resolve_strong_reference(taskpoolId))
+            {
+                auto& taskpoolInstance = objectProxy->object();
+
+                // Hand the due tasks to the VTL1 workers
+                taskpoolInstance.push_ready_tasks(task_ids);
+
+                return S_OK;
+            }
+
+            THROW_HR(HRESULT_FROM_WIN32(ERROR_RESOURCE_NOT_ONLINE));
+        }
+
+        HRESULT taskpool_run_worker_loop(_In_ const std::uint64_t taskpool_instance_vtl1)
+        {
+            auto taskpoolId = taskpool_instance_vtl1;
+
+            if (auto objectProxy = veil::vtl1::implementation::get_taskpool_object_table().resolve_strong_reference(taskpoolId))
+            {
+                // The strong reference is held until the loop returns, which the taskpool's dtor
+                //  triggers before it blocks on releasing the object_proxy.
+                auto& taskpoolInstance = objectProxy->object();
+
+                // Run tasks from the enclave-side queue until the taskpool stops it
+                taskpoolInstance.run_worker_loop();
+
+                return S_OK;
+            }
+
+            THROW_HR(HRESULT_FROM_WIN32(ERROR_RESOURCE_NOT_ONLINE));
+        }
+
+        HRESULT taskpool_get_telemetry(_In_ const std::uint64_t taskpool_instance_vtl1, _Out_ std::vector<std::uint64_t>& telemetry)
+        {
+            auto taskpoolId = taskpool_instance_vtl1;
+
+            if (auto objectProxy = veil::vtl1::implementation::get_taskpool_object_table().resolve_strong_reference(taskpoolId))
+            {
+                auto& taskpoolInstance = objectProxy->object();
+
+                // The host merges in the VTL0 side itself
+                telemetry = veil::any::implementation::taskpool_telemetry_abi::to_abi(taskpoolInstance.vtl1_telemetry());
+
+                return S_OK;
+            }
+
+            // Don't throw, the host skips taskpools that are going away
+            return HRESULT_FROM_WIN32(ERROR_RESOURCE_NOT_ONLINE);
+        }
     }
 }
 
@@ -60,7 +115,7 @@ namespace veil::vtl1::implementation::taskpool::callouts
 {
     namespace abi = veil::any::implementation::taskpool;
 
-    HRESULT taskpool_make(_In_ const void* enclave, _In_ const std::uint64_t taskpool_instance_vtl1, _In_ const std::uint32_t thread_count, _In_ const bool must_finish_all_queued_tasks, _Out_  void** taskpool_instance_vtl0)
+    HRESULT taskpool_make(_In_ const void* enclave, _In_ const std::uint64_t taskpool_instance_vtl1, _In_ const std::uint32_t thread_count, _In_ const bool must_finish_all_queued_tasks, _In_ const bool use_enclave_worker_loop, _In_ const std::uint32_t max_thread_count, _In_ const std::uint32_t grow_after_milliseconds, _In_ const std::uint32_t idle_timeout_milliseconds, _Out_  void** taskpool_instance_vtl0)
     {
         auto taskpoolInstanceVtl0 = uintptr_t {};
         RETURN_IF_FAILED(veil_abi::Untrusted::Stubs::taskpool_make(
@@ -68,6 +123,10 @@ namespace veil::vtl1::implementation::taskpool::callouts
             taskpool_instance_vtl1,
             thread_count,
             must_finish_all_queued_tasks,
+            use_enclave_worker_loop,
+            max_thread_count,
+            grow_after_milliseconds,
+            idle_timeout_milliseconds,
             taskpoolInstanceVtl0));
         *taskpool_instance_vtl0 = abi::from_abi(taskpoolInstanceVtl0);
         return S_OK;
@@ -79,9 +138,21 @@ namespace veil::vtl1::implementation::taskpool::callouts
         return S_OK;
     }
 
-    HRESULT taskpool_schedule_task(_In_ const void* taskpool_instance_vtl0, _In_ const std::uint64_t task_id)
+    HRESULT taskpool_schedule_task(_In_ const void* taskpool_instance_vtl0, _In_ const std::uint64_t task_id, _In_ const std::uint32_t priority)
     {
-        RETURN_IF_FAILED(veil_abi::Untrusted::Stubs::taskpool_schedule_task(abi::to_abi(taskpool_instance_vtl0), task_id));
+        RETURN_IF_FAILED(veil_abi::Untrusted::Stubs::taskpool_schedule_task(abi::to_abi(taskpool_instance_vtl0), task_id, priority));
+        return S_OK;
+    }
+
+    HRESULT taskpool_schedule_tasks(_In_ const void* taskpool_instance_vtl0, _In_ const std::vector<std::uint64_t>& task_ids, _In_ const std::uint32_t priority)
+    {
+        RETURN_IF_FAILED(veil_abi::Untrusted::Stubs::taskpool_schedule_tasks(abi::to_abi(taskpool_instance_vtl0), task_ids, priority));
+        return S_OK;
+    }
+
+    HRESULT taskpool_schedule_task_after(_In_ const void* taskpool_instance_vtl0, _In_ const std::uint64_t task_id, _In_ const std::uint64_t delay_milliseconds)
+    {
+        RETURN_IF_FAILED(veil_abi::Untrusted::Stubs::taskpool_schedule_task_after(abi::to_abi(taskpool_instance_vtl0), task_id, delay_milliseconds));
         return S_OK;
     }
 
@@ -91,4 +162,16 @@ namespace veil::vtl1::implementation::taskpool::callouts
         return S_OK;
     }
 
+    HRESULT taskpool_enable_telemetry(_In_ const void* taskpool_instance_vtl0, _In_ const bool enabled)
+    {
+        RETURN_IF_FAILED(veil_abi::Untrusted::Stubs::taskpool_enable_telemetry(abi::to_abi(taskpool_instance_vtl0), enabled));
+        return S_OK;
+    }
+
+    HRESULT taskpool_get_telemetry(_In_ const void* taskpool_instance_vtl0, _Out_ std::vector<std::uint64_t>& telemetry)
+    {
+        RETURN_IF_FAILED(veil_abi::Untrusted::Stubs::taskpool_get_telemetry(abi::to_abi(taskpool_instance_vtl0), telemetry));
+        return S_OK;
+    }
+
 }
@@ -3,11 +3,22 @@
 
 #pragma once
 
+#include <array>
+#include <chrono>
+#include <coroutine>
 #include <functional>
 #include <map>
+#include <optional>
+#include <ranges>
+#include <vector>
 
 #include "future.vtl1.h"
+#include "memory_pool.vtl1.h"
 #include "object_table.vtl1.h"
+#include "priority_lanes.any.h"
+#include "task_function.vtl1.h"
+#include "taskpool_telemetry.any.h"
+#include "utils.vtl1.h"
 
 /*
 
@@ -47,6 +58,46 @@
             //handle error
         }
 
+        // Queue a batch of tasks with a single VTL0 callout, instead of one per task
+        auto work = std::vector<std::function<int()>>{};
+        for (int i = 0; i < 100; i++) {
+            work.push_back([i]() { return i * i; });
+        }
+        auto tasks = taskpool.queue_tasks(std::move(work));
+        for (auto& task : tasks) {
+            int square = task.get();
+        }
+
+        // Coroutines can hop onto the taskpool, and co_await its tasks (see task.vtl1.h)
+        //      co_await taskpool.schedule();
+        //      int y = co_await taskpool.queue_task([]() { return 7; });
+
+        // Run a task once a delay has passed, instead of calling veil::vtl1::sleep on an enclave thread
+        auto retry = taskpool.queue_task_after(std::chrono::milliseconds(250), []() {
+            return try_again();
+        });
+
+        // Run a task every period, until the returned handle is cancelled or destroyed
+        auto expiry = taskpool.queue_periodic(std::chrono::seconds(30), []() {
+            evict_expired_cache_entries();
+        });
+
+        // Let the thread count follow the load, instead of picking a fixed count up front
+        auto adaptive = veil::vtl1::taskpool(veil::vtl1::taskpool_thread_limits {.minThreadCount = 1, .maxThreadCount = 8});
+
+        // Latency sensitive work jumps ahead of queued background work (which still gets to run)
+        auto reply = taskpool.queue_task(veil::vtl1::task_priority::high, []() {
+            return answer_request();
+        });
+        auto compaction = taskpool.queue_task(veil::vtl1::task_priority::low, []() {
+            compact_storage();
+        });
+
+        // Find out where tasks spend their time (the host can query it too, see veil::vtl0::taskpool_telemetry)
+        taskpool.enable_telemetry();
+        veil::any::taskpool_telemetry stats = taskpool.telemetry();
+        uint64_t p99QueueWait = stats.queueWait.percentile_microseconds(99);
+
 [Implementation]
 
     This is a taskpool designed to be used in VTL1.  VTL1 cannot dynamically create threads
@@ -61,6 +112,17 @@
         4. VTL1 is now running on a different thread and has the task id(!!)
         5. VTL1 retrieves the task (lambda) using the task id and runs the task's lambda
 
+    Enclave worker loop flow mechanics (taskpool_dispatch::enclave_worker_loop):
+        0. VTL1 taskpool asks VTL0 to create the backing threads
+        1. Each VTL0 backing thread calls into the enclave (CallEnclave) once, and parks in a VTL1 worker loop
+        2. VTL1 app enclave consumer calls taskpool's queue_task(lambda)
+        3. VTL1 taskpool stores the task (lambda) /w a task id, and pushes the task id onto an enclave-side queue
+        4. A parked VTL1 worker wakes up, pops the task id and runs the task's lambda
+
+    The worker loop removes the VTL1->VTL0->VTL1 round trip per task, which matters when tasks are
+    small (e.g. crypto on a single buffer). The cost is that each backing thread occupies an enclave
+    thread for the lifetime of the taskpool, see the note about thread count below.
+
 [Behavior]
 
     Blocking destructor:
@@ -68,6 +130,41 @@
     Letting a taskpool fall out of scope will block until the taskpool's queue is
     cleared (i.e. until all tasks are done or unscheduled).
 
+    Priorities:
+
+    Tasks are queued into one of three lanes (high, normal, low), normal unless a veil::vtl1::task_priority
+    is given. Free threads take from the most urgent lane first, but each time a lane is passed over
+    it ages, and once it has been passed over c_agingLimit times it goes next (see priority_lanes.any.h).
+    Priority only orders tasks that are waiting, a running task is never preempted. With per_task_call
+    dispatch, priority is applied per backing thread deque (threads steal tasks of a more urgent lane
+    from each other before running their own). Delayed and periodic tasks run in the normal lane.
+
+    Thread count:
+
+    A taskpool created with taskpool_thread_limits starts minThreadCount backing threads, and adds one
+    (up to maxThreadCount) whenever a task has waited longer than growAfter for a free thread. Threads
+    that have been idle for idleTimeout retire, down to minThreadCount. The maximum is capped by the
+    enclave's thread budget (IMAGE_ENCLAVE_CONFIG.NumberOfThreads - 1), which is shared with every other
+    taskpool and caller of the enclave, so keep the maximums of concurrently used taskpools in line.
+
+    Telemetry:
+
+    Queue depths (current and maximum, per lane), the backing thread count, the number of cancelled
+    tasks, the number of task records allocated from the enclave heap and the number of callouts made
+    to schedule tasks are always kept.
+    enable_telemetry() also records histograms of queue wait (from queueing, or a delay running out,
+    to a thread taking the task) and run time, and the number of threads running a task. Queue wait
+    is measured by the VTL0 backing threads (or by the enclave-side queue with
+    taskpool_dispatch::enclave_worker_loop) and run time in run_task, just after the task has
+    completed its future. While disabled, telemetry costs a relaxed atomic load per task.
+
+    Delayed and periodic tasks:
+
+    Delays are tracked by a timer wheel in VTL0 (see timer_wheel.vtl0.h), and the task is only
+    dispatched into the enclave once it's due. Delayed tasks that aren't due yet when the taskpool
+    is destroyed (or when cancel_queued_tasks is called) are dropped. Their futures are completed
+    with std::future_errc::broken_promise, like every other task that's dropped without running.
+
 */
 
 // fwd decls
@@ -84,15 +181,332 @@ namespace veil::vtl1::implementation
 
 namespace veil::vtl1::implementation::taskpool::callouts
 {
-    HRESULT taskpool_make(_In_ const void* enclave, _In_ const std::uint64_t taskpool_instance_vtl1, _In_ const std::uint32_t thread_count, _In_ const bool must_finish_all_queued_tasks, _Out_  void** taskpool_instance_vtl0);
+    HRESULT taskpool_make(_In_ const void* enclave, _In_ const std::uint64_t taskpool_instance_vtl1, _In_ const std::uint32_t thread_count, _In_ const bool must_finish_all_queued_tasks, _In_ const bool use_enclave_worker_loop, _In_ const std::uint32_t max_thread_count, _In_ const std::uint32_t grow_after_milliseconds, _In_ const std::uint32_t idle_timeout_milliseconds, _Out_  void** taskpool_instance_vtl0);
     HRESULT taskpool_delete(_In_ const void* taskpool_instance_vtl0);
-    HRESULT taskpool_schedule_task(_In_ const void* taskpool_instance_vtl0, _In_ const std::uint64_t task_id);
+    HRESULT taskpool_schedule_task(_In_ const void* taskpool_instance_vtl0, _In_ const std::uint64_t task_id, _In_ const std::uint32_t priority);
+    HRESULT taskpool_schedule_tasks(_In_ const void* taskpool_instance_vtl0, _In_ const std::vector<std::uint64_t>& task_ids, _In_ const std::uint32_t priority);
+    HRESULT taskpool_schedule_task_after(_In_ const void* taskpool_instance_vtl0, _In_ const std::uint64_t task_id, _In_ const std::uint64_t delay_milliseconds);
     HRESULT taskpool_cancel_queued_tasks(_In_ const void* taskpool_instance_vtl0);
+    HRESULT taskpool_enable_telemetry(_In_ const void* taskpool_instance_vtl0, _In_ const bool enabled);
+    HRESULT taskpool_get_telemetry(_In_ const void* taskpool_instance_vtl0, _Out_ std::vector<std::uint64_t>& telemetry);
+}
+
+namespace veil::vtl1::implementation
+{
+    // The exception a dropped task's future is completed with. It's made once, by the first taskpool's
+    // constructor, so dropping a task never has to allocate an exception.
+    inline const std::exception_ptr& broken_promise_exception()
+    {
+        static const auto s_brokenPromise = std::make_exception_ptr(std::future_error(std::future_errc::broken_promise));
+        return s_brokenPromise;
+    }
+
+    //
+    // A queued task's callable fused with the shared_state of its future, so a task is a single
+    // allocation (from the taskpool's memory pool). The callable is destroyed as soon as it has run,
+    // while the state lives on for as long as the future does.
+    //
+    template <typename T, typename F>
+    struct task_state : veil::vtl1::details::shared_state<T>
+    {
+        explicit task_state(F&& callable)
+            : m_callable(std::move(callable))
+        {
+        }
+
+        explicit task_state(const F& callable)
+            : m_callable(callable)
+        {
+        }
+
+        // Completes the future with broken_promise, for a task that's dropped without running
+        void abandon() noexcept
+        {
+            m_callable.reset();
+            this->try_set_exception(std::exception_ptr(broken_promise_exception()));
+        }
+
+        void run() noexcept
+        {
+            try
+            {
+                if constexpr (std::is_void_v<T>)
+                {
+                    (*m_callable)();
+                    m_callable.reset();
+                    this->set_value();
+                }
+                else
+                {
+                    auto value = (*m_callable)();
+                    m_callable.reset();
+                    this->set_value(std::move(value));
+                }
+            }
+            catch (...)
+            {
+                m_callable.reset();
+                this->set_exception(std::current_exception());
+            }
+        }
+
+    private:
+        std::optional<F> m_callable;
+    };
+
+    struct periodic_state_base
+    {
+        std::atomic<bool> m_cancelled {};
+    };
+
+    // A callable that taskpool::queue_periodic re-queues after every run
+    template <typename F>
+    struct periodic_state : periodic_state_base
+    {
+        explicit periodic_state(F callable)
+            : m_callable(std::move(callable))
+        {
+        }
+
+        F m_callable;
+    };
+
+    //
+    // Queue of task ids that lives in the enclave, for taskpool_dispatch::enclave_worker_loop.
+    // VTL1 workers block on it while idle, so handing a task to a worker never leaves the enclave.
+    // Task ids are kept in priority lanes, like the VTL0 backing threads' deques.
+    //
+    struct taskpool_ready_queue
+    {
+        struct ready_task
+        {
+            uint64_t m_taskId;
+
+            // performance_counter_microseconds() when queued, 0 while telemetry is disabled
+            uint64_t m_queuedAt;
+        };
+
+        taskpool_ready_queue(size_t workerCount)
+            : m_workerCount(workerCount)
+        {
+        }
+
+        // Delete copy
+        taskpool_ready_queue(const taskpool_ready_queue&) = delete;
+        taskpool_ready_queue& operator=(const taskpool_ready_queue&) = delete;
+
+        // Delete move
+        taskpool_ready_queue(taskpool_ready_queue&& other) = delete;
+        taskpool_ready_queue& operator=(taskpool_ready_queue&& other) = delete;
+
+        void push(uint64_t taskId, size_t lane, uint64_t queuedAt = 0)
+        {
+            {
+                auto lock = m_lock.lock_exclusive();
+                if (m_stop)
+                {
+                    THROW_HR(HRESULT_FROM_WIN32(ERROR_CANCELLED));
+                }
+                m_taskIds.push(lane, ready_task {taskId, queuedAt});
+                update_max_depth(lane);
+            }
+            m_cv.notify_one();
+        }
+
+        void push_all(const std::vector<uint64_t>& taskIds, size_t lane, uint64_t queuedAt = 0)
+        {
+            {
+                auto lock = m_lock.lock_exclusive();
+                if (m_stop)
+                {
+                    THROW_HR(HRESULT_FROM_WIN32(ERROR_CANCELLED));
+                }
+                for (auto taskId : taskIds)
+                {
+                    m_taskIds.push(lane, ready_task {taskId, queuedAt});
+                }
+                update_max_depth(lane);
+            }
+
+            // Only wake as many workers as there are new tasks
+            if (taskIds.size() >= m_workerCount)
+            {
+                m_cv.notify_all();
+                return;
+            }
+
+            for (size_t i = 0; i < taskIds.size(); i++)
+            {
+                m_cv.notify_one();
+            }
+        }
+
+        // Blocks until a task id is available. Returns std::nullopt once the queue is stopped and the
+        // worker should leave the enclave (immediately, or after the queue drains if all queued tasks
+        // must finish).
+        std::optional<ready_task> wait_and_pop(bool mustFinishAllQueuedTasks)
+        {
+            auto lock = m_lock.lock_exclusive();
+            while (!m_stop && m_taskIds.empty())
+            {
+                m_cv.wait(lock);
+            }
+
+            if (m_taskIds.empty() || (m_stop && !mustFinishAllQueuedTasks))
+            {
+                return std::nullopt;
+            }
+
+            auto task = ready_task {};
+            m_taskIds.try_pop(task);
+            return task;
+        }
+
+        // Number of task ids waiting in a lane, and the most that have been waiting in it at once
+        size_t depth(size_t lane) const
+        {
+            auto lock = m_lock.lock_shared();
+            return m_taskIds.size(lane);
+        }
+
+        size_t max_depth(size_t lane) const
+        {
+            auto lock = m_lock.lock_shared();
+            return m_maxDepth[task_lanes::clamp_lane(lane)];
+        }
+
+        void clear()
+        {
+            auto lock = m_lock.lock_exclusive();
+            m_taskIds.clear();
+        }
+
+        void stop()
+        {
+            {
+                auto lock = m_lock.lock_exclusive();
+                m_stop = true;
+            }
+            m_cv.notify_all();
+        }
+
+    private:
+        using task_lanes = veil::any::implementation::priority_lanes<ready_task>;
+
+        void update_max_depth(size_t lane)
+        {
+            lane = task_lanes::clamp_lane(lane);
+            m_maxDepth[lane] = std::max(m_maxDepth[lane], m_taskIds.size(lane));
+        }
+
+        task_lanes m_taskIds;
+        std::array<size_t, task_lanes::c_laneCount> m_maxDepth {};
+        const size_t m_workerCount;
+        bool m_stop{};
+        mutable wil::srwlock m_lock;
+        wil::condition_variable m_cv;
+    };
 }
 
 // impl
 namespace veil::vtl1
 {
+    //
+    // Handle to a task queued with taskpool::queue_periodic. The task stops repeating once the handle
+    // is cancelled or destroyed (a run that's already started still finishes).
+    //
+    class periodic_task
+    {
+    public:
+        periodic_task() = default;
+
+        explicit periodic_task(std::shared_ptr<veil::vtl1::implementation::periodic_state_base> state) noexcept
+            : m_state(std::move(state))
+        {
+        }
+
+        ~periodic_task()
+        {
+            cancel();
+        }
+
+        // Delete copy
+        periodic_task(const periodic_task&) = delete;
+        periodic_task& operator=(const periodic_task&) = delete;
+
+        // Allow move
+        periodic_task(periodic_task&& other) noexcept = default;
+        periodic_task& operator=(periodic_task&& other) noexcept
+        {
+            if (this != &other)
+            {
+                cancel();
+                m_state = std::move(other.m_state);
+            }
+            return *this;
+        }
+
+        void cancel() noexcept
+        {
+            if (m_state)
+            {
+                m_state->m_cancelled = true;
+            }
+        }
+
+    private:
+        std::shared_ptr<veil::vtl1::implementation::periodic_state_base> m_state;
+    };
+
+    //
+    // Which lane a task is queued into. Lanes are drained with strict priority plus aging: a task
+    // runs before every task of a less urgent lane, except that a lane that has been passed over
+    // veil::any::implementation::priority_lanes<>::c_agingLimit times in a row goes next, so low
+    // priority tasks can't be starved.
+    //
+    enum class task_priority : uint32_t
+    {
+        high,
+        normal,
+        low,
+    };
+
+    static_assert(static_cast<size_t>(task_priority::low) + 1 == veil::any::implementation::priority_lanes<uint64_t>::c_laneCount);
+
+    //
+    // Thread count bounds for a taskpool whose backing threads follow the load (per_task_call dispatch
+    // only, with enclave_worker_loop the taskpool always runs minThreadCount threads).
+    //
+    struct taskpool_thread_limits
+    {
+        // Threads that are always running
+        uint32_t minThreadCount = 1;
+
+        // The most threads that can run, 0 for as many as the enclave's thread budget allows. It's
+        // capped at enclave_thread_budget() - 1, but never below minThreadCount.
+        uint32_t maxThreadCount = 0;
+
+        // A thread is added once a queued task has waited this long for a free thread
+        std::chrono::milliseconds growAfter = std::chrono::milliseconds(10);
+
+        // A thread above minThreadCount retires once it's been idle this long
+        std::chrono::milliseconds idleTimeout = std::chrono::seconds(30);
+    };
+
+    //
+    // How queued tasks get onto a thread.
+    //
+    enum class taskpool_dispatch
+    {
+        // Each task id is handed to VTL0, and a VTL0 backing thread calls into the enclave to run it.
+        per_task_call,
+
+        // Each VTL0 backing thread calls into the enclave once and runs tasks from an enclave-side queue
+        // until the taskpool is destroyed. Every backing thread occupies an enclave thread while the
+        // taskpool is alive.
+        enclave_worker_loop,
+    };
+
     struct taskpool
     {
     public:
@@ -110,17 +524,44 @@ namespace veil::vtl1
         // 
         //   i.e. It's not fatal, merely wasteful, to park extra VTL0 threads.
         //
+        //   With taskpool_dispatch::enclave_worker_loop the backing threads never leave the enclave, so
+        //   the limit is strict: the thread count plus every other thread that needs to call into the
+        //   enclave (including the one that destroys the taskpool) must fit in NumberOfThreads. A backing
+        //   thread that finds no free enclave thread logs the failure and retries, with a growing delay,
+        //   until the taskpool is destroyed.
+        //
+        //   Taskpools created with taskpool_thread_limits cap their maximum at NumberOfThreads - 1
+        //   (see veil::vtl1::enclave_thread_budget) for you.
+        //
+
+        taskpool(uint32_t threadCount, bool mustFinishAllQueuedTasks = true, taskpool_dispatch dispatch = taskpool_dispatch::per_task_call)
+            : taskpool(taskpool_thread_limits {threadCount, threadCount}, mustFinishAllQueuedTasks, dispatch)
+        {
+        }
 
-        taskpool(uint32_t threadCount, bool mustFinishAllQueuedTasks = true)
-            : m_keepaliveMechanism(*this)
+        taskpool(const taskpool_thread_limits& threadLimits, bool mustFinishAllQueuedTasks = true, taskpool_dispatch dispatch = taskpool_dispatch::per_task_call)
+            : m_readyTasks(max_thread_count(threadLimits, dispatch)), m_threadCount(max_thread_count(threadLimits, dispatch)), m_mustFinishAllQueuedTasks(mustFinishAllQueuedTasks), m_dispatch(dispatch), m_keepaliveMechanism(*this)
         {
+            // Make the exception dropped tasks complete with up front, where failing can still be reported
+            veil::vtl1::implementation::broken_promise_exception();
+
             // Store this taskpool (weakly) into a global table of taskpools (and get a unique id)
             m_objectTableEntryId = veil::vtl1::implementation::get_taskpool_object_table().store(m_keepaliveMechanism.get_weak());
 
             void* enclave = veil::vtl1::enclave_information().BaseAddress;
 
             // Call out to VTL0 to create the backing threads
-            THROW_IF_FAILED(veil::vtl1::implementation::taskpool::callouts::taskpool_make(enclave, static_cast<uint64_t>(m_objectTableEntryId), threadCount, mustFinishAllQueuedTasks, &m_taskpoolInstanceVtl0));
+            bool useEnclaveWorkerLoop = m_dispatch == taskpool_dispatch::enclave_worker_loop;
+            THROW_IF_FAILED(veil::vtl1::implementation::taskpool::callouts::taskpool_make(
+                enclave,
+                static_cast<uint64_t>(m_objectTableEntryId),
+                threadLimits.minThreadCount,
+                mustFinishAllQueuedTasks,
+                useEnclaveWorkerLoop,
+                m_threadCount,
+                to_milliseconds_abi(threadLimits.growAfter),
+                to_milliseconds_abi(threadLimits.idleTimeout),
+                &m_taskpoolInstanceVtl0));
         }
 
         // Delete copy
@@ -133,6 +574,12 @@ namespace veil::vtl1
 
         ~taskpool()
         {
+            // Wake the VTL1 workers so they return to VTL0, otherwise the backing threads can't be joined
+            if (m_dispatch == taskpool_dispatch::enclave_worker_loop)
+            {
+                m_readyTasks.stop();
+            }
+
             // Call out to VTL0 to delete the backing threads
             THROW_IF_FAILED(veil::vtl1::implementation::taskpool::callouts::taskpool_delete(m_taskpoolInstanceVtl0));
 
@@ -147,53 +594,312 @@ namespace veil::vtl1
         }
 
         template <typename F>
-        [[nodiscard]] auto queue_task(F&& f) -> veil::vtl1::future<decltype(f())>
+        [[nodiscard]] auto queue_task(F&& f) -> veil::vtl1::future<std::invoke_result_t<std::decay_t<F>&>>
+        {
+            return queue_task(task_priority::normal, std::forward<F>(f));
+        }
+
+        template <typename F>
+        [[nodiscard]] auto queue_task(task_priority priority, F&& f) -> veil::vtl1::future<std::invoke_result_t<std::decay_t<F>&>>
         {
-            using return_type = decltype(f());
+            auto [func, fut] = make_task(std::forward<F>(f));
 
-            // Make a promise + future pair.
-            //  - The future will be given to caller for waiting-on/getting the task result (or exception).
-            //  - The promise will be given to the task lambda to set task result (or exception).
-            auto promise = std::make_shared<veil::vtl1::promise<return_type>>();
-            auto fut = promise->get_future();
+            // Store the task in an object table, getting an id we can share with VTL0
+            auto taskId = m_tasks.store(std::move(func));
 
-            auto func = [f = std::move(f), p = std::move(promise)]()
+            if (m_dispatch == taskpool_dispatch::enclave_worker_loop)
             {
-                if constexpr (std::is_same_v<return_type, void>)
+                // Hand the task to a VTL1 worker without leaving the enclave
+                try
                 {
-                    // Handle void return type
-                    try
+                    m_readyTasks.push(taskId, static_cast<size_t>(priority), telemetry_timestamp());
+                }
+                catch (...)
+                {
+                    // Drop the task, so its future is completed rather than left stored until the taskpool goes away
+                    m_tasks.try_take(taskId);
+                    throw;
+                }
+            }
+            else
+            {
+                // Call out to VTL0 to get the task scheduled (into the priority lane of a VTL0 deque) so it can eventually be scheduled on a VTL0 backing thread.
+                m_scheduleCalloutCount.fetch_add(1, std::memory_order_relaxed);
+                auto hr = veil::vtl1::implementation::taskpool::callouts::taskpool_schedule_task(m_taskpoolInstanceVtl0, taskId, static_cast<uint32_t>(priority));
+                if (FAILED(hr))
+                {
+                    // Drop the task, so its future is completed rather than left stored until the taskpool goes away
+                    m_tasks.try_take(taskId);
+                    THROW_HR(hr);
+                }
+            }
+
+            return std::move(fut);
+        }
+
+        //
+        // Queues every callable in the range, returning their futures in the same order.
+        //
+        // All tasks are stored under a single lock and scheduled with a single callout (or a single push
+        // onto the enclave-side queue), so fanning out many small tasks doesn't pay a VTL transition
+        // per task. Callables are moved out of the range if it's an rvalue, otherwise they're copied.
+        //
+        template <std::ranges::input_range R>
+        [[nodiscard]] auto queue_tasks(R&& functions) -> std::vector<veil::vtl1::future<std::invoke_result_t<std::ranges::range_value_t<R>&>>>
+        {
+            return queue_tasks(task_priority::normal, std::forward<R>(functions));
+        }
+
+        template <std::ranges::input_range R>
+        [[nodiscard]] auto queue_tasks(task_priority priority, R&& functions) -> std::vector<veil::vtl1::future<std::invoke_result_t<std::ranges::range_value_t<R>&>>>
+        {
+            using function_type = std::ranges::range_value_t<R>;
+            using return_type = std::invoke_result_t<function_type&>;
+
+            auto funcs = std::vector<veil::vtl1::implementation::task_function>{};
+            auto futs = std::vector<veil::vtl1::future<return_type>>{};
+            if constexpr (std::ranges::sized_range<R>)
+            {
+                funcs.reserve(std::ranges::size(functions));
+                futs.reserve(std::ranges::size(functions));
+            }
+
+            auto addTask = [&](function_type&& callable)
+            {
+                auto [func, fut] = make_task(std::move(callable));
+                funcs.push_back(std::move(func));
+                futs.push_back(std::move(fut));
+            };
+
+            for (auto&& f : functions)
+            {
+                if constexpr (std::is_lvalue_reference_v<R>)
+                {
+                    addTask(function_type(f));
+                }
+                else
+                {
+                    addTask(std::move(f));
+                }
+            }
+
+            if (funcs.empty())
+            {
+                return futs;
+            }
+
+            // Store the tasks in an object table, getting ids we can share with VTL0
+            auto taskIds = m_tasks.store_all(std::move(funcs));
+
+            if (m_dispatch == taskpool_dispatch::enclave_worker_loop)
+            {
+                // Hand the tasks to the VTL1 workers without leaving the enclave
+                try
+                {
+                    m_readyTasks.push_all(taskIds, static_cast<size_t>(priority), telemetry_timestamp());
+                }
+                catch (...)
+                {
+                    // Drop the tasks, so their futures are completed rather than left stored until the taskpool goes away
+                    for (auto taskId : taskIds)
                     {
-                        f();
-                        p->set_value();
+                        m_tasks.try_take(taskId);
                     }
-                    catch (...)
+                    throw;
+                }
+            }
+            else
+            {
+                // Call out to VTL0 once to get all the tasks scheduled
+                m_scheduleCalloutCount.fetch_add(1, std::memory_order_relaxed);
+                auto hr = veil::vtl1::implementation::taskpool::callouts::taskpool_schedule_tasks(m_taskpoolInstanceVtl0, taskIds, static_cast<uint32_t>(priority));
+                if (FAILED(hr))
+                {
+                    // Drop the tasks, so their futures are completed rather than left stored until the taskpool goes away
+                    for (auto taskId : taskIds)
                     {
-                        p->set_exception(std::current_exception());
+                        m_tasks.try_take(taskId);
                     }
+                    THROW_HR(hr);
                 }
-                else
+            }
+
+            return futs;
+        }
+
+        //
+        // Awaitable that resumes the awaiting coroutine on one of the taskpool's threads,
+        //
+        //      co_await taskpool.schedule();
+        //
+        // If the task is dropped without running (cancel_queued_tasks or the taskpool going away), the
+        // coroutine is resumed on the dropping thread and co_await throws std::future_error(broken_promise),
+        // so the coroutine unwinds and its frame is freed. If queuing the task fails, co_await throws the
+        // error queuing it failed with instead.
+        //
+        [[nodiscard]] auto schedule() noexcept
+        {
+            struct awaiter
+            {
+                enum class resume_state : uint32_t
+                {
+                    queuing,
+                    waiting,
+                    queued,
+                    dropped,
+                };
+
+                // The queued task, resumes the coroutine when it runs or when it's dropped. While the
+                // awaiting thread is still in queue_task, that thread is the one that resumes a dropped
+                // coroutine (so it can hand over the error), and a task that runs before then blocks with
+                // std::atomic::wait until it returns.
+                struct resumer
+                {
+                    resumer(std::coroutine_handle<> handle, std::atomic<resume_state>* state) noexcept
+                        : m_handle(handle), m_state(state)
+                    {
+                    }
+
+                    ~resumer()
+                    {
+                        if (m_handle)
+                        {
+                            auto handle = std::exchange(m_handle, nullptr);
+                            if (m_state->exchange(resume_state::dropped, std::memory_order_acq_rel) == resume_state::queued)
+                            {
+                                handle.resume();
+                            }
+                        }
+                    }
+
+                    // Delete copy
+                    resumer(const resumer&) = delete;
+                    resumer& operator=(const resumer&) = delete;
+
+                    // Allow move construction
+                    resumer(resumer&& other) noexcept
+                        : m_handle(std::exchange(other.m_handle, nullptr)), m_state(other.m_state)
+                    {
+                    }
+                    resumer& operator=(resumer&&) = delete;
+
+                    void operator()()
+                    {
+                        auto handle = std::exchange(m_handle, nullptr);
+                        auto state = resume_state::queuing;
+                        if (m_state->compare_exchange_strong(state, resume_state::waiting, std::memory_order_acq_rel))
+                        {
+                            m_state->wait(resume_state::waiting, std::memory_order_acquire);
+                        }
+                        handle.resume();
+                    }
+
+                    std::coroutine_handle<> m_handle;
+                    std::atomic<resume_state>* m_state;
+                };
+
+                veil::vtl1::taskpool& m_taskpool;
+                std::atomic<resume_state> m_state {resume_state::queuing};
+                std::exception_ptr m_error {};
+
+                bool await_ready() const noexcept
+                {
+                    return false;
+                }
+
+                bool await_suspend(std::coroutine_handle<> handle) noexcept
                 {
-                    // Handle non-void return type
                     try
                     {
-                        auto value = f();
-                        p->set_value(std::move(value));
+                        m_taskpool.queue_task(resumer {handle, &m_state}).detach();
                     }
                     catch (...)
                     {
-                        p->set_exception(std::current_exception());
+                        // queue_task drops the task on every failure path (taking it back out of the task
+                        // table if it was stored), its resumer left the coroutine for this thread to resume
+                        m_error = std::current_exception();
+                    }
+
+                    // Once the state is published the frame can't be touched, the task may already have resumed
+                    // the coroutine. If it was dropped while queuing, resume the coroutine right away instead.
+                    auto state = resume_state::queuing;
+                    if (m_state.compare_exchange_strong(state, resume_state::queued, std::memory_order_acq_rel))
+                    {
+                        return true;
+                    }
+
+                    if (state == resume_state::waiting)
+                    {
+                        // The task already ran and is blocked until the state is published. Wake it through
+                        // the address alone, notify only uses it as a key (WakeByAddressSingle) and never reads
+                        // the frame the woken task may already have resumed and freed.
+                        auto stateAddress = &m_state;
+                        stateAddress->store(resume_state::queued, std::memory_order_release);
+                        stateAddress->notify_one();
+                        return true;
+                    }
+
+                    return false;
+                }
+
+                void await_resume() const
+                {
+                    if (m_state.load(std::memory_order_acquire) == resume_state::dropped)
+                    {
+                        if (m_error)
+                        {
+                            std::rethrow_exception(m_error);
+                        }
+                        throw std::future_error(std::future_errc::broken_promise);
                     }
                 }
             };
 
+            return awaiter {*this};
+        }
+
+        // The most threads the taskpool runs at once
+        uint32_t thread_count() const noexcept
+        {
+            return m_threadCount;
+        }
+
+        //
+        // Queues a task that's dispatched once delay has passed. The delay is tracked in VTL0, so no
+        // enclave thread is held while waiting (unlike veil::vtl1::sleep).
+        //
+        template <typename F>
+        [[nodiscard]] auto queue_task_after(std::chrono::milliseconds delay, F&& f) -> veil::vtl1::future<std::invoke_result_t<std::decay_t<F>&>>
+        {
+            auto [func, fut] = make_task(std::forward<F>(f));
+
             // Store the task in an object table, getting an id we can share with VTL0
             auto taskId = m_tasks.store(std::move(func));
 
-            // Call out to VTL0 to get the task scheduled (into the VTL0 std::deque instance) so it can eventually be scheduled on a VTL0 backing thread.
-            THROW_IF_FAILED(veil::vtl1::implementation::taskpool::callouts::taskpool_schedule_task(m_taskpoolInstanceVtl0, taskId));
+            // Call out to VTL0 to start the timer, it schedules the task once it's due
+            m_scheduleCalloutCount.fetch_add(1, std::memory_order_relaxed);
+            auto hr = veil::vtl1::implementation::taskpool::callouts::taskpool_schedule_task_after(m_taskpoolInstanceVtl0, taskId, static_cast<uint64_t>(std::max(delay.count(), std::chrono::milliseconds::rep {0})));
+            if (FAILED(hr))
+            {
+                // Drop the task, so its future is completed rather than left waiting on a timer that doesn't exist
+                m_tasks.try_take(taskId);
+                THROW_HR(hr);
+            }
 
-            return fut;
+            return std::move(fut);
+        }
+
+        //
+        // Runs f every period (measured from the end of the previous run, the first run is one period
+        // from now) until the returned handle is cancelled or destroyed. Each run is a delayed task, see
+        // queue_task_after. An exception thrown by f stops the repetition.
+        //
+        template <typename F>
+        [[nodiscard]] periodic_task queue_periodic(std::chrono::milliseconds period, F&& f)
+        {
+            auto state = std::make_shared<veil::vtl1::implementation::periodic_state<std::decay_t<F>>>(std::forward<F>(f));
+            queue_periodic_run(period, state);
+            return periodic_task(std::move(state));
         }
 
         void run_task(UINT64 taskHandle)
@@ -202,7 +908,8 @@ namespace veil::vtl1
             auto task = m_tasks.try_take(taskHandle);
             if (!task)
             {
-                if (taskHandle < m_cancelledId)
+                // Cancelled (or already taken) tasks leave an expired handle behind in the table
+                if (m_tasks.is_expired(taskHandle))
                 {
                     return;
                 }
@@ -211,25 +918,238 @@ namespace veil::vtl1
 
             auto& task_lambda = task.value();
 
-            // Finally run the task, which is a std::function<void()> that,
-            //  1. Runs the captured user-provided lambda
-            //  2. Runs the promise setter (so the user's future is live)
+            if (!m_telemetryEnabled.load(std::memory_order_relaxed))
+            {
+                // Finally run the task, which is a task_function that,
+                //  1. Runs the captured user-provided lambda
+                //  2. Sets the task_state's value (so the user's future is live)
+                task_lambda();
+                return;
+            }
+
+            auto activeThreadCount = ++m_activeThreadCount;
+            auto maxActiveThreadCount = m_maxActiveThreadCount.load(std::memory_order_relaxed);
+            while (activeThreadCount > maxActiveThreadCount && !m_maxActiveThreadCount.compare_exchange_weak(maxActiveThreadCount, activeThreadCount, std::memory_order_relaxed))
+            {
+            }
+
+            // The task_function is noexcept (exceptions go to the future)
+            auto start = veil::vtl1::performance_counter_microseconds();
             task_lambda();
+            m_runTime.record(veil::vtl1::performance_counter_microseconds() - start);
+
+            m_activeThreadCount--;
+
+            // The task's reference on its task_state is released...
+        }
+
+        // Runs on a VTL0 backing thread that called into the enclave, until the taskpool is destroyed
+        void run_worker_loop()
+        {
+            THROW_HR_IF(E_ILLEGAL_METHOD_CALL, m_dispatch != taskpool_dispatch::enclave_worker_loop);
 
-            // The task, std::function<void()>, is freed...
+            while (auto task = m_readyTasks.wait_and_pop(m_mustFinishAllQueuedTasks))
+            {
+                if (task->m_queuedAt != 0 && m_telemetryEnabled.load(std::memory_order_relaxed))
+                {
+                    m_queueWait.record(veil::vtl1::performance_counter_microseconds() - task->m_queuedAt);
+                }
+                run_task(task->m_taskId);
+            }
+        }
+
+        // Called from VTL0 when delayed tasks are due, for taskpool_dispatch::enclave_worker_loop
+        void push_ready_tasks(const std::vector<uint64_t>& taskIds)
+        {
+            THROW_HR_IF(E_ILLEGAL_METHOD_CALL, m_dispatch != taskpool_dispatch::enclave_worker_loop);
+            m_readyTasks.push_all(taskIds, static_cast<size_t>(task_priority::normal), telemetry_timestamp());
         }
 
         void cancel_queued_tasks()
         {
-            m_cancelledId = m_tasks.peek_next_id();
-            m_tasks.clear();
+            m_cancelledTaskCount += m_tasks.clear();
+
+            if (m_dispatch == taskpool_dispatch::enclave_worker_loop)
+            {
+                m_readyTasks.clear();
+                return;
+            }
 
             THROW_IF_FAILED(veil::vtl1::implementation::taskpool::callouts::taskpool_cancel_queued_tasks(m_taskpoolInstanceVtl0));
         }
 
+        //
+        // Turns recording of the queue wait and run time histograms (and active thread counts) on or
+        // off, for this taskpool's VTL1 and VTL0 sides. See "Telemetry" above.
+        //
+        void enable_telemetry(bool enabled = true)
+        {
+            m_telemetryEnabled = enabled;
+            THROW_IF_FAILED(veil::vtl1::implementation::taskpool::callouts::taskpool_enable_telemetry(m_taskpoolInstanceVtl0, enabled));
+        }
+
+        // Snapshot of the taskpool's counters, combining what's kept in VTL1 with what's kept in VTL0
+        veil::any::taskpool_telemetry telemetry() const
+        {
+            auto telemetryVtl0 = std::vector<uint64_t> {};
+            THROW_IF_FAILED(veil::vtl1::implementation::taskpool::callouts::taskpool_get_telemetry(m_taskpoolInstanceVtl0, telemetryVtl0));
+
+            auto telemetry = vtl1_telemetry();
+            telemetry.merge(veil::any::implementation::taskpool_telemetry_abi::from_abi(telemetryVtl0));
+            return telemetry;
+        }
+
+        // The VTL1 side of telemetry(), also handed to the host by veil::vtl0::taskpool_telemetry
+        veil::any::taskpool_telemetry vtl1_telemetry() const
+        {
+            auto telemetry = veil::any::taskpool_telemetry {};
+            telemetry.queueWait = m_queueWait.snapshot();
+            telemetry.runTime = m_runTime.snapshot();
+            if (m_dispatch == taskpool_dispatch::enclave_worker_loop)
+            {
+                for (size_t lane = 0; lane < telemetry.queueDepth.size(); lane++)
+                {
+                    telemetry.queueDepth[lane] = m_readyTasks.depth(lane);
+                    telemetry.maxQueueDepth[lane] = m_readyTasks.max_depth(lane);
+                }
+            }
+            telemetry.activeThreadCount = m_activeThreadCount;
+            telemetry.maxActiveThreadCount = m_maxActiveThreadCount;
+            telemetry.cancelledTaskCount = m_cancelledTaskCount;
+            telemetry.taskHeapAllocationCount = m_taskMemory->heap_allocation_count();
+            telemetry.scheduleCalloutCount = m_scheduleCalloutCount;
+            return telemetry;
+        }
+
     private:
-        // Task objects (but the actual queue order is managed in vtl0)
-        veil::vtl1::unique_object_table<std::function<void()>> m_tasks;
+        static uint32_t max_thread_count(const taskpool_thread_limits& threadLimits, taskpool_dispatch dispatch)
+        {
+            // The enclave worker loop's threads never leave the enclave, so there's no adapting
+            if (dispatch == taskpool_dispatch::enclave_worker_loop || threadLimits.maxThreadCount == threadLimits.minThreadCount)
+            {
+                return threadLimits.minThreadCount;
+            }
+
+            // Leave the enclave a thread to call in with (see the note about thread count)
+            auto budget = veil::vtl1::enclave_thread_budget();
+            auto maxThreadCount = budget > 1 ? budget - 1 : 1;
+            if (threadLimits.maxThreadCount != 0)
+            {
+                maxThreadCount = std::min(maxThreadCount, threadLimits.maxThreadCount);
+            }
+            return std::max(maxThreadCount, threadLimits.minThreadCount);
+        }
+
+        static uint32_t to_milliseconds_abi(std::chrono::milliseconds duration)
+        {
+            return static_cast<uint32_t>(std::clamp<std::chrono::milliseconds::rep>(duration.count(), 0, UINT32_MAX));
+        }
+
+        // When a task was handed to the enclave-side queue, only read while telemetry is enabled
+        uint64_t telemetry_timestamp() const noexcept
+        {
+            return m_telemetryEnabled.load(std::memory_order_relaxed) ? veil::vtl1::performance_counter_microseconds() : 0;
+        }
+
+        //
+        // Wraps a callable in a task_function that stores its result (or exception) into the task's
+        // state, and returns the task with a future on that state.
+        //
+        // The callable and the state share one allocation from m_taskMemory, and the task_function only
+        // holds a reference to it (stored inline), so queuing a task doesn't hit the heap once the pool
+        // has warmed up.
+        //
+        template <typename F>
+        auto make_task(F&& f) -> std::pair<veil::vtl1::implementation::task_function, veil::vtl1::future<std::invoke_result_t<std::decay_t<F>&>>>
+        {
+            using callable_type = std::decay_t<F>;
+            using return_type = std::invoke_result_t<callable_type&>;
+            using state_type = veil::vtl1::implementation::task_state<return_type, callable_type>;
+
+            auto state = std::allocate_shared<state_type>(veil::vtl1::details::pool_allocator<state_type>(m_taskMemory), std::forward<F>(f));
+            auto fut = veil::vtl1::future<return_type>(state);
+
+            auto func = veil::vtl1::implementation::task_function(task_runner<state_type> {std::move(state)});
+
+            return {std::move(func), std::move(fut)};
+        }
+
+        //
+        // The task_function stored for a task. Dropping it without running (cancellation, or the
+        // taskpool going away) completes the task's future with broken_promise, so nobody waits on
+        // it forever.
+        //
+        template <typename State>
+        struct task_runner
+        {
+            explicit task_runner(std::shared_ptr<State> state) noexcept
+                : m_state(std::move(state))
+            {
+            }
+
+            ~task_runner()
+            {
+                if (m_state)
+                {
+                    m_state->abandon();
+                }
+            }
+
+            // Delete copy
+            task_runner(const task_runner&) = delete;
+            task_runner& operator=(const task_runner&) = delete;
+
+            // Allow move construction (assigning over a pending task would drop it)
+            task_runner(task_runner&& other) noexcept = default;
+            task_runner& operator=(task_runner&& other) = delete;
+
+            void operator()()
+            {
+                std::exchange(m_state, nullptr)->run();
+            }
+
+            std::shared_ptr<State> m_state;
+        };
+
+        template <typename F>
+        void queue_periodic_run(std::chrono::milliseconds period, std::shared_ptr<veil::vtl1::implementation::periodic_state<F>> state)
+        {
+            queue_task_after(period, [this, period, state]()
+            {
+                if (state->m_cancelled)
+                {
+                    return;
+                }
+
+                state->m_callable();
+
+                if (!state->m_cancelled)
+                {
+                    queue_periodic_run(period, state);
+                }
+            }).detach();
+        }
+
+        // Task objects (but the actual queue order is managed in vtl0, or in m_readyTasks for the enclave worker loop)
+        veil::vtl1::unique_object_table<veil::vtl1::implementation::task_function> m_tasks;
+
+        // Task records (task_state), shared with the futures since they can outlive the taskpool
+        std::shared_ptr<veil::vtl1::details::size_class_pool> m_taskMemory = std::make_shared<veil::vtl1::details::size_class_pool>();
+
+        // Queue order for taskpool_dispatch::enclave_worker_loop
+        veil::vtl1::implementation::taskpool_ready_queue m_readyTasks;
+        const uint32_t m_threadCount;
+        const bool m_mustFinishAllQueuedTasks;
+        const taskpool_dispatch m_dispatch;
+
+        // Telemetry (the VTL0 side keeps its own, see taskpool_backing_threads)
+        std::atomic<bool> m_telemetryEnabled {};
+        veil::any::implementation::duration_histogram_recorder m_queueWait;
+        veil::any::implementation::duration_histogram_recorder m_runTime;
+        std::atomic<uint64_t> m_activeThreadCount {};
+        std::atomic<uint64_t> m_maxActiveThreadCount {};
+        std::atomic<uint64_t> m_cancelledTaskCount {};
+        std::atomic<uint64_t> m_scheduleCalloutCount {};
 
         // Backing threads in vtl0
         void* m_taskpoolInstanceVtl0{};
@@ -237,7 +1157,5 @@ namespace veil::vtl1
         // Required for secure lifetime management and to avoid passing contexts (void*) pointers to vtl0
         veil::vtl1::keepalive_mechanism<taskpool> m_keepaliveMechanism;
         size_t m_objectTableEntryId{};
-
-        std::atomic<size_t> m_cancelledId{};
     };
 }
@@ -76,6 +76,9 @@ namespace veil::vtl1
     }
 }
 
+// Every enclave image defines its configuration (see the enclave's dllmain.cpp)
+extern "C" const IMAGE_ENCLAVE_CONFIG __enclave_config;
+
 namespace veil::vtl1
 {
     inline ENCLAVE_INFORMATION& enclave_information()
@@ -89,6 +92,32 @@ namespace veil::vtl1
         return enclaveInformation;
     }
 
+    // The most threads that can be in the enclave at once (IMAGE_ENCLAVE_CONFIG.NumberOfThreads).
+    // ENCLAVE_INFORMATION doesn't carry it, so it's read from the image's configuration.
+    inline uint32_t enclave_thread_budget() noexcept
+    {
+        return __enclave_config.NumberOfThreads;
+    }
+
+    // Microseconds on the high-resolution performance counter, for timing work inside the enclave
+    inline uint64_t performance_counter_microseconds() noexcept
+    {
+        static const auto frequency = []()
+        {
+            LARGE_INTEGER frequency {};
+            QueryPerformanceFrequency(&frequency);
+            return frequency.QuadPart > 0 ? frequency.QuadPart : 1;
+        }();
+
+        LARGE_INTEGER counter {};
+        QueryPerformanceCounter(&counter);
+
+        // Split the conversion so counter * 1000000 doesn't overflow
+        auto seconds = counter.QuadPart / frequency;
+        auto remainder = counter.QuadPart % frequency;
+        return static_cast<uint64_t>(seconds * 1000000 + remainder * 1000000 / frequency);
+    }
+
     inline bool is_enclave_full_debug_enabled()
     {
         static bool fullDebugEnabled = [] ()
@@ -3,13 +3,488 @@
 
 #include "pch.h"
 
+#include <cwchar>
+#include <iostream>
+
 #include "logger.vtl0.h"
+#include "utils.vtl0.h"
 
 #include <VbsEnclave\HostApp\Implementation\Untrusted.h>
 
 namespace veil::vtl0::logger
 {
-    std::mutex logMutex;
+    log_writer::log_writer(const log_writer_options& options)
+        : m_options(options)
+    {
+        m_writerThread = std::thread([this]() { writer_proc(); });
+    }
+
+    log_writer::~log_writer()
+    {
+        {
+            std::lock_guard lock(m_mutex);
+            m_stop = true;
+        }
+        m_queued.notify_one();
+        m_writerThread.join();
+    }
+
+    void log_writer::write(std::filesystem::path path, std::wstring text)
+    {
+        {
+            std::lock_guard lock(m_mutex);
+            m_records.push_back({std::move(path), std::move(text)});
+            m_queuedCount++;
+        }
+        m_queued.notify_one();
+    }
+
+    void log_writer::write_binary(std::filesystem::path path, std::vector<uint8_t> records, uint64_t timestamp)
+    {
+        auto record = log_record {std::move(path), {}, std::move(records), timestamp, std::chrono::system_clock::now()};
+        {
+            std::lock_guard lock(m_mutex);
+            m_records.push_back(std::move(record));
+            m_queuedCount++;
+        }
+        m_queued.notify_one();
+    }
+
+    void log_writer::flush()
+    {
+        std::unique_lock lock(m_mutex);
+        auto queuedCount = m_queuedCount;
+        m_written.wait(lock, [&]() { return m_writtenCount >= queuedCount; });
+    }
+
+    log_writer& log_writer::default_writer()
+    {
+        static log_writer writer;
+        return writer;
+    }
+
+    void log_writer::writer_proc()
+    {
+        auto records = std::vector<log_record> {};
+        while (true)
+        {
+            {
+                std::unique_lock lock(m_mutex);
+                m_queued.wait(lock, [&]() { return m_stop || !m_records.empty(); });
+                if (m_records.empty())
+                {
+                    // Stopping, and everything has been written
+                    break;
+                }
+
+                // Take everything queued so far, and hand back the last batch's vector so neither side reallocates
+                std::swap(records, m_records);
+            }
+
+            // Nothing may escape this thread, it would terminate the host (and flush() callers
+            // would wait forever for the records to be written), so a record that fails is dropped
+            for (auto& record : records)
+            {
+                try
+                {
+                    write_record(record);
+                }
+                catch (...)
+                {
+                    m_droppedCount.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+            flush_files();
+
+            {
+                std::lock_guard lock(m_mutex);
+                m_writtenCount += records.size();
+            }
+            m_written.notify_all();
+            records.clear();
+        }
+
+        m_files.clear();
+    }
+
+    void log_writer::write_record(log_record& record)
+    {
+        if (!record.m_binaryRecords.empty())
+        {
+            format_binary_records(record);
+        }
+
+        if (record.m_path.empty())
+        {
+            auto lock = std::scoped_lock<std::mutex>(veil::vtl0::implementation::g_printMutex);
+            std::wcout << record.m_text << std::flush;
+            return;
+        }
+
+        auto file = get_file(record.m_path);
+        if (file && m_options.maxFileSize != 0 && file->m_size != 0 && file->m_size + record.m_text.size() > m_options.maxFileSize)
+        {
+            rotate(record.m_path);
+            file = get_file(record.m_path);
+        }
+
+        if (!file)
+        {
+            m_droppedCount.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        file->m_stream.write(record.m_text.data(), record.m_text.size());
+        if (!file->m_stream)
+        {
+            // Reopen the file for the next record
+            m_files.erase(record.m_path);
+            m_droppedCount.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        file->m_size += record.m_text.size();
+    }
+
+    void log_writer::format_binary_records(log_record& record)
+    {
+        // Each file (or the console) keeps the format strings its binary_log has defined
+        auto& decoder = m_decoders[record.m_path];
+        decoder.decode(record.m_binaryRecords, [&](uint64_t timestamp, const std::wstring& message)
+        {
+            if (record.m_path.empty())
+            {
+                record.m_text += L"FROM VTL1: ";
+            }
+            else
+            {
+                auto age = std::chrono::microseconds(record.m_timestamp > timestamp ? record.m_timestamp - timestamp : 0);
+                auto loggedAt = record.m_receivedAt - std::chrono::duration_cast<std::chrono::system_clock::duration>(age);
+                record.m_text += logger::CreateTimestamp(std::chrono::system_clock::to_time_t(loggedAt)) + L": ";
+            }
+            record.m_text += message;
+            record.m_text += L"\n";
+        });
+        record.m_binaryRecords.clear();
+    }
+
+    log_writer::open_file* log_writer::get_file(const std::filesystem::path& path)
+    {
+        if (auto it = m_files.find(path); it != m_files.end())
+        {
+            return &it->second;
+        }
+
+        if (m_files.size() >= m_options.maxOpenFiles)
+        {
+            flush_files();
+            m_files.clear();
+        }
+
+        // Create the directory if it doesn't exist
+        std::error_code error;
+        auto dirPath = path.parent_path();
+        if (!dirPath.empty())
+        {
+            std::filesystem::create_directories(dirPath, error);
+        }
+
+        auto& file = m_files[path];
+        file.m_stream.open(path, std::ios::app);
+        if (!file.m_stream.is_open())
+        {
+            m_files.erase(path);
+            return nullptr;
+        }
+
+        // The buffer can only be set once the file is open and before anything is written to it.
+        // If the stream doesn't take it, keep writing through its default buffer.
+        file.m_buffer = std::make_unique<wchar_t[]>(m_options.bufferSize);
+        if (!file.m_stream.rdbuf()->pubsetbuf(file.m_buffer.get(), m_options.bufferSize))
+        {
+            file.m_buffer.reset();
+        }
+
+        auto size = std::filesystem::file_size(path, error);
+        file.m_size = error ? 0 : size;
+        return &file;
+    }
+
+    void log_writer::rotate(const std::filesystem::path& path)
+    {
+        m_files.erase(path);
+
+        std::error_code error;
+        if (m_options.maxRotatedFiles == 0)
+        {
+            std::filesystem::remove(path, error);
+            return;
+        }
+
+        // <name><ext> becomes <name>.1<ext>, <name>.1<ext> becomes <name>.2<ext> and so on
+        auto rotatedPath = [&](uint32_t index)
+        {
+            auto rotated = path;
+            rotated.replace_filename(path.stem().wstring() + L"." + std::to_wstring(index) + path.extension().wstring());
+            return rotated;
+        };
+
+        std::filesystem::remove(rotatedPath(m_options.maxRotatedFiles), error);
+        for (auto index = m_options.maxRotatedFiles; index > 1; index--)
+        {
+            std::filesystem::rename(rotatedPath(index - 1), rotatedPath(index), error);
+        }
+        std::filesystem::rename(path, rotatedPath(1), error);
+    }
+
+    void log_writer::flush_files()
+    {
+        for (auto& [path, file] : m_files)
+        {
+            file.m_stream.flush();
+        }
+    }
+
+    namespace
+    {
+        // Formats a single value with a printf conversion specification
+        template <typename T>
+        std::wstring format_value(const std::wstring& specification, T value)
+        {
+            auto buffer = std::vector<wchar_t>(256);
+            while (true)
+            {
+                auto written = std::swprintf(buffer.data(), buffer.size(), specification.c_str(), value);
+                if (written >= 0 && static_cast<size_t>(written) < buffer.size())
+                {
+                    return std::wstring(buffer.data(), written);
+                }
+                if (buffer.size() >= 64 * 1024)
+                {
+                    return {};
+                }
+                buffer.resize(buffer.size() * 2);
+            }
+        }
+
+        //
+        // Formats the next argument for a conversion. specification holds the flags, width and precision,
+        // the length modifier is picked from the argument's recorded type.
+        //
+        std::wstring format_argument(veil::any::binary_log::record_reader& reader, std::wstring specification, wchar_t conversion)
+        {
+            using veil::any::binary_log::argument_type;
+
+            auto type = reader.read_value<argument_type>();
+            if (!type)
+            {
+                return L"<missing>";
+            }
+
+            auto isInteger = std::wcschr(L"diouxXc", conversion) != nullptr;
+            auto isSigned = conversion == L'd' || conversion == L'i';
+            auto isFloat = std::wcschr(L"fFeEgGaA", conversion) != nullptr;
+            auto integerConversion = isInteger ? conversion : L'd';
+            switch (*type)
+            {
+                case argument_type::int32:
+                case argument_type::uint32:
+                case argument_type::int64:
+                case argument_type::uint64:
+                {
+                    // Widen 32 bit values to 64 bits the way the conversion reads them (sign extended for %d and %i)
+                    auto value = uint64_t {};
+                    if (*type == argument_type::int32 || *type == argument_type::uint32)
+                    {
+                        auto raw = reader.read_value<uint32_t>().value_or(0);
+                        value = isSigned ? static_cast<uint64_t>(static_cast<int64_t>(static_cast<int32_t>(raw))) : raw;
+                    }
+                    else
+                    {
+                        value = reader.read_value<uint64_t>().value_or(0);
+                    }
+
+                    if (integerConversion == L'c')
+                    {
+                        return format_value(specification + L"lc", static_cast<wint_t>(value));
+                    }
+                    if (isFloat)
+                    {
+                        return format_value(specification + conversion, static_cast<double>(static_cast<int64_t>(value)));
+                    }
+                    return format_value(specification + L"ll" + integerConversion, value);
+                }
+
+                case argument_type::float64:
+                {
+                    auto value = reader.read_value<double>().value_or(0);
+                    return format_value(specification + (isFloat ? conversion : L'g'), value);
+                }
+
+                case argument_type::pointer:
+                {
+                    auto value = reader.read_value<uint64_t>().value_or(0);
+                    if (isInteger)
+                    {
+                        return format_value(specification + L"ll" + integerConversion, value);
+                    }
+                    return format_value(specification + L"p", reinterpret_cast<void*>(static_cast<uintptr_t>(value)));
+                }
+
+                case argument_type::string:
+                case argument_type::wstring:
+                {
+                    auto length = reader.read_value<uint16_t>();
+                    auto value = length ? reader.read_characters(*length, *type == argument_type::string) : std::nullopt;
+                    if (!value)
+                    {
+                        return L"<missing>";
+                    }
+                    if (specification == L"%")
+                    {
+                        return *value;
+                    }
+                    return format_value(specification + L"ls", value->c_str());
+                }
+            }
+
+            return L"<unknown argument>";
+        }
+    }
+
+    void binary_log_decoder::define(uint32_t formatId, std::span<const uint8_t> formatString)
+    {
+        auto reader = veil::any::binary_log::record_reader(formatString);
+        if (auto format = reader.read_characters(formatString.size() / sizeof(uint16_t), false))
+        {
+            m_formats[formatId] = std::move(*format);
+        }
+    }
+
+    std::wstring binary_log_decoder::format(uint32_t formatId, std::span<const uint8_t> arguments) const
+    {
+        auto it = m_formats.find(formatId);
+        if (it == m_formats.end())
+        {
+            return L"<unknown format " + format_value(L"%08X", formatId) + L">";
+        }
+
+        const auto& format = it->second;
+        auto reader = veil::any::binary_log::record_reader(arguments);
+        auto text = std::wstring {};
+        size_t i = 0;
+        while (i < format.size())
+        {
+            if (format[i] != L'%')
+            {
+                text += format[i++];
+                continue;
+            }
+
+            if (i + 1 < format.size() && format[i + 1] == L'%')
+            {
+                text += L'%';
+                i += 2;
+                continue;
+            }
+
+            // %[flags][width][.precision][length]conversion, a '*' width or precision takes an argument
+            auto specification = std::wstring(L"%");
+            i++;
+            while (i < format.size() && std::wcschr(L"-+ #0", format[i]) && format[i] != L'\0')
+            {
+                specification += format[i++];
+            }
+
+            // The width, then the precision, are each either digits or a single '*'
+            auto read_star_argument = [&]()
+            {
+                auto type = reader.read_value<veil::any::binary_log::argument_type>();
+                return type == veil::any::binary_log::argument_type::int32 || type == veil::any::binary_log::argument_type::uint32
+                    ? reader.read_value<int32_t>().value_or(0)
+                    : static_cast<int32_t>(reader.read_value<int64_t>().value_or(0));
+            };
+            auto append_digits = [&]()
+            {
+                while (i < format.size() && std::iswdigit(format[i]))
+                {
+                    specification += format[i++];
+                }
+            };
+
+            if (i < format.size() && format[i] == L'*')
+            {
+                // A negative width left-justifies
+                auto width = static_cast<int64_t>(read_star_argument());
+                if (width < 0)
+                {
+                    specification += L'-';
+                }
+                specification += std::to_wstring(width < 0 ? -width : width);
+                i++;
+            }
+            else
+            {
+                append_digits();
+            }
+
+            if (i < format.size() && format[i] == L'.')
+            {
+                specification += format[i++];
+                if (i < format.size() && format[i] == L'*')
+                {
+                    // A negative precision is taken as if it were omitted
+                    auto precision = read_star_argument();
+                    if (precision < 0)
+                    {
+                        specification.pop_back();
+                    }
+                    else
+                    {
+                        specification += std::to_wstring(precision);
+                    }
+                    i++;
+                }
+                else
+                {
+                    append_digits();
+                }
+            }
+
+            // Skip the length modifier (h, hh, l, ll, I32, I64, j, z, t, L, w)
+            while (i < format.size() && std::wcschr(L"hljztLIw", format[i]) && format[i] != L'\0')
+            {
+                if (format[i] == L'I' && i + 2 < format.size() && std::iswdigit(format[i + 1]))
+                {
+                    i += 2;
+                }
+                i++;
+            }
+
+            if (i >= format.size())
+            {
+                break;
+            }
+
+            auto conversion = format[i++];
+            if (conversion == L'n')
+            {
+                continue;
+            }
+
+            // Records can be decoded offline from any saved bytes, so the format string isn't trusted.
+            // Anything swprintf would reject (e.g. a second '.', or a NUL character) isn't passed to it.
+            if (conversion == L'\0' || !std::wcschr(L"diouxXcCsSpfFeEgGaA", conversion))
+            {
+                // Still consume the argument, so the ones after it line up with their conversions
+                format_argument(reader, L"%", L's');
+                text += L"<bad format>";
+                continue;
+            }
+            text += format_argument(reader, std::move(specification), conversion);
+        }
+
+        return text;
+    }
 }
 
 HRESULT veil_abi::Untrusted::Implementation::add_log(_In_ const std::wstring& log, _In_ const std::wstring& log_file_path)
@@ -17,3 +492,18 @@ HRESULT veil_abi::Untrusted::Implementation::add_log(_In_ const std::wstring& lo
     veil::vtl0::logger::logger::AddTimestampedLog(log, log_file_path);
     return S_OK;
 }
+
+HRESULT veil_abi::Untrusted::Implementation::add_logs(_In_ const std::vector<std::wstring>& logs, _In_ const std::vector<std::wstring>& log_file_paths, _In_ const std::vector<std::uint64_t>& age_microseconds)
+{
+    RETURN_HR_IF(E_INVALIDARG, log_file_paths.size() != logs.size() || age_microseconds.size() != logs.size());
+
+    veil::vtl0::logger::logger::AddTimestampedLogs(logs, log_file_paths, age_microseconds);
+    return S_OK;
+}
+
+HRESULT veil_abi::Untrusted::Implementation::add_binary_logs(_In_ const std::vector<std::uint8_t>& records, _In_ const std::wstring& log_file_path, _In_ const std::uint64_t timestamp)
+{
+    // Formatted on the writer thread
+    veil::vtl0::logger::log_writer::default_writer().write_binary(log_file_path, records, timestamp);
+    return S_OK;
+}
@@ -3,23 +3,173 @@
 
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <filesystem>
 #include <fstream>
+#include <map>
+#include <memory>
+#include <span>
 #include <string>
 #include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
 #include <wil/resource.h>
 
+#include "..\veil_any_inc\binary_log.any.h"
 #include "..\veil_any_inc\logger.any.h"
 
 namespace veil::vtl0
 {
     namespace logger
     {
-        extern std::mutex logMutex;
+        //
+        // Formats binary log records (see binary_log.any.h and veil::vtl1::logger::binary_log), keeping
+        // the format strings defined so far. Records saved as is can be formatted offline with it too.
+        //
+        class binary_log_decoder
+        {
+            public:
+            // Calls onMessage(timestamp, text) for each message, in order
+            template <typename F>
+            void decode(std::span<const uint8_t> records, F&& onMessage)
+            {
+                auto reader = veil::any::binary_log::record_reader(records);
+                while (auto record = reader.read_record())
+                {
+                    auto& [header, payload] = *record;
+                    if (header.type == veil::any::binary_log::record_type::definition)
+                    {
+                        define(header.formatId, payload);
+                    }
+                    else if (header.type == veil::any::binary_log::record_type::message)
+                    {
+                        onMessage(header.timestamp, format(header.formatId, payload));
+                    }
+                }
+            }
+
+            void define(uint32_t formatId, std::span<const uint8_t> formatString);
+
+            // Formats a message's arguments with the printf style format string of formatId. Conversions
+            // swprintf can't take (e.g. %1.2.3d) are printed as <bad format>.
+            std::wstring format(uint32_t formatId, std::span<const uint8_t> arguments) const;
+
+            private:
+            std::unordered_map<uint32_t, std::wstring> m_formats;
+        };
+
+        struct log_writer_options
+        {
+            // Size (in characters) a log file may reach before it's rotated, i.e. renamed to <name>.1<ext>. 0 to never rotate.
+            uint64_t maxFileSize = 16 * 1024 * 1024;
+
+            // Number of rotated files kept per log, the oldest is deleted
+            uint32_t maxRotatedFiles = 4;
+
+            // Size of each open file's write buffer, in characters
+            size_t bufferSize = 64 * 1024;
+
+            // Number of files kept open, all of them are closed when another one has to be opened
+            size_t maxOpenFiles = 16;
+        };
+
+        //
+        // Writes log records to files on a dedicated thread. Callers only queue the record, the writer
+        // thread keeps each file open and writes everything that was queued meanwhile in one go.
+        // Records are written in the order they were queued. A record whose file can't be opened or
+        // written to is dropped (see dropped_count), the file is opened again for the next one.
+        //
+        class log_writer
+        {
+            public:
+            explicit log_writer(const log_writer_options& options = {});
+
+            // Writes every queued record, then stops the writer thread
+            ~log_writer();
+
+            // Delete copy
+            log_writer(const log_writer&) = delete;
+            log_writer& operator=(const log_writer&) = delete;
+
+            // Delete move
+            log_writer(log_writer&&) = delete;
+            log_writer& operator=(log_writer&&) = delete;
+
+            // Queues text to be appended to the file at path, or printed to the console if path is empty
+            void write(std::filesystem::path path, std::wstring text);
+
+            //
+            // Queues binary log records, which are formatted on the writer thread. timestamp is the enclave's
+            // performance counter (in microseconds) when they were sent, to tell how long ago each was logged.
+            //
+            void write_binary(std::filesystem::path path, std::vector<uint8_t> records, uint64_t timestamp);
+
+            // Waits until every record queued before the call has been written and flushed to its file
+            void flush();
+
+            // Records that couldn't be written, because their file couldn't be opened or written to, or formatting them failed
+            uint64_t dropped_count() const noexcept
+            {
+                return m_droppedCount.load(std::memory_order_relaxed);
+            }
+
+            // The writer the logger class writes with
+            static log_writer& default_writer();
+
+            private:
+            struct log_record
+            {
+                std::filesystem::path m_path;
+                std::wstring m_text;
+
+                // Binary records, formatted into m_text by the writer thread
+                std::vector<uint8_t> m_binaryRecords;
+                uint64_t m_timestamp {};
+                std::chrono::system_clock::time_point m_receivedAt;
+            };
+
+            struct open_file
+            {
+                std::unique_ptr<wchar_t[]> m_buffer;
+                std::wofstream m_stream;
+                uint64_t m_size {};
+            };
+
+            void writer_proc();
+            void write_record(log_record& record);
+            void format_binary_records(log_record& record);
+            open_file* get_file(const std::filesystem::path& path);
+            void rotate(const std::filesystem::path& path);
+            void flush_files();
+
+            const log_writer_options m_options;
+
+            // Queue, guarded by m_mutex. Records are numbered in queue order, so flush() knows when
+            // the records it waits for have been written.
+            std::mutex m_mutex;
+            std::condition_variable m_queued;
+            std::condition_variable m_written;
+            std::vector<log_record> m_records;
+            uint64_t m_queuedCount {};
+            uint64_t m_writtenCount {};
+            bool m_stop = false;
+
+            // Only used by the writer thread
+            std::map<std::filesystem::path, open_file> m_files;
+            std::map<std::filesystem::path, binary_log_decoder> m_decoders;
+
+            std::atomic<uint64_t> m_droppedCount {};
+            std::thread m_writerThread;
+        };
 
         class logger
         {
+            friend class log_writer;
+
             private:
             std::wstring provider;
             std::wstring guid;
@@ -47,17 +197,30 @@ namespace veil::vtl0
             static std::wstring CreateTimestamp()
             {
                 // Get the current time
-                std::time_t now = std::time(nullptr);
+                return CreateTimestamp(std::time(nullptr));
+            }
+
+            static std::wstring CreateTimestamp(std::time_t time)
+            {
+                // Logs made within the same second share their timestamp
+                thread_local std::time_t lastTime = -1;
+                thread_local std::wstring lastTimestamp;
+                if (time == lastTime)
+                {
+                    return lastTimestamp;
+                }
 
                 // Convert to local time
                 std::tm localTime;
-                localtime_s(&localTime, &now);
+                localtime_s(&localTime, &time);
 
                 // Format the time as a wide string
                 std::wostringstream timestamp;
                 timestamp << std::put_time(&localTime, L"%Y-%m-%d %H:%M:%S");
 
-                return timestamp.str(); // Return the formatted timestamp as std::wstring
+                lastTime = time;
+                lastTimestamp = timestamp.str();
+                return lastTimestamp; // Return the formatted timestamp as std::wstring
             }
 
             void SaveLog(const std::wstring& log)
@@ -65,23 +228,11 @@ namespace veil::vtl0
                 SaveLog(log, logFilePath);
             }
 
+            // Asynchronous: the log is only queued, the writer thread writes it later (see Flush)
             static void SaveLog(const std::wstring& log, const std::wstring& logPath)
             {
-                std::filesystem::path filePath(logPath);
-                std::filesystem::path dirPath = filePath.parent_path();
-
-                std::scoped_lock lock(logMutex);
-
-                // Create the directory if it doesn't exist
-                if (!dirPath.empty() && !std::filesystem::exists(dirPath))
-                {
-                    std::filesystem::create_directories(dirPath);
-                }
-
-                std::wofstream wofs(filePath, std::ios::app);
-
-                wofs << log;
-                wofs.close();
+                // The writer thread creates the directory and keeps the file open
+                log_writer::default_writer().write(logPath, log);
             }
 
             public:
@@ -116,6 +267,43 @@ namespace veil::vtl0
                 SaveLog(timestampedLog, logFilePath);
             }
 
+            // Batch callback from Enclave via Host, ageMicroseconds is how long ago each log was made in the enclave
+            static void AddTimestampedLogs(std::span<const std::wstring> logs, std::span<const std::wstring> logFilePaths, std::span<const uint64_t> ageMicroseconds)
+            {
+                auto now = std::chrono::system_clock::now();
+
+                size_t first = 0;
+                while (first < logs.size())
+                {
+                    // Write consecutive logs for the same file together
+                    size_t last = first + 1;
+                    while (last < logs.size() && logFilePaths[last] == logFilePaths[first])
+                    {
+                        last++;
+                    }
+
+                    std::wstring timestampedLogs;
+                    for (size_t i = first; i < last; i++)
+                    {
+                        auto loggedAt = now - std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::microseconds(ageMicroseconds[i]));
+                        timestampedLogs += CreateTimestamp(std::chrono::system_clock::to_time_t(loggedAt)) + L": " + logs[i] + L"\n";
+                    }
+                    SaveLog(timestampedLogs, logFilePaths[first]);
+
+                    first = last;
+                }
+            }
+
+            //
+            // Logs are written to their files asynchronously, by the log writer thread. Waits until every
+            // log added before the call (by any logger, or from the enclave) has been written and flushed,
+            // e.g. before the process exits.
+            //
+            static void Flush()
+            {
+                log_writer::default_writer().flush();
+            }
+
             // Getters
             veil::any::logger::eventLevel GetLogLevel()
             {
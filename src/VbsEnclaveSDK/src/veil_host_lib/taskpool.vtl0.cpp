@@ -9,14 +9,24 @@
 #include <VbsEnclave\HostApp\Stubs\Trusted.h>
 
 #include "taskpool.any.h"
+#include "taskpool_telemetry.any.h"
 #include "taskpool.vtl0.h"
 
 
 namespace abi = veil::any::implementation::taskpool;
+namespace telemetry_abi = veil::any::implementation::taskpool_telemetry_abi;
 
-HRESULT veil_abi::Untrusted::Implementation::taskpool_make(_In_ uintptr_t enclave, _In_ std::uint64_t taskpool_instance_vtl1, _In_ std::uint32_t thread_count, _In_ bool must_finish_all_queued_tasks, _Out_  uintptr_t& taskpool_instance_vtl0)
+HRESULT veil_abi::Untrusted::Implementation::taskpool_make(_In_ uintptr_t enclave, _In_ std::uint64_t taskpool_instance_vtl1, _In_ std::uint32_t thread_count, _In_ bool must_finish_all_queued_tasks, _In_ bool use_enclave_worker_loop, _In_ std::uint32_t max_thread_count, _In_ std::uint32_t grow_after_milliseconds, _In_ std::uint32_t idle_timeout_milliseconds, _Out_  uintptr_t& taskpool_instance_vtl0)
 {
-    auto taskpoolInstanceVtl0 = std::make_unique<veil::vtl0::implementation::taskpool_backing_threads>(abi::from_abi(enclave), taskpool_instance_vtl1, thread_count, must_finish_all_queued_tasks);
+    auto taskpoolInstanceVtl0 = std::make_unique<veil::vtl0::implementation::taskpool_backing_threads>(
+        abi::from_abi(enclave),
+        taskpool_instance_vtl1,
+        thread_count,
+        must_finish_all_queued_tasks,
+        use_enclave_worker_loop,
+        max_thread_count,
+        std::chrono::milliseconds(grow_after_milliseconds),
+        std::chrono::milliseconds(idle_timeout_milliseconds));
     taskpool_instance_vtl0 = reinterpret_cast<uint64_t>(taskpoolInstanceVtl0.release()); // let the vtl0 counterpart be owned by vtl1 taskpool
     return S_OK;
 }
@@ -29,10 +39,24 @@ HRESULT veil_abi::Untrusted::Implementation::taskpool_delete(_In_ uintptr_t task
     return S_OK;
 }
 
-HRESULT veil_abi::Untrusted::Implementation::taskpool_schedule_task(_In_ uintptr_t taskpool_instance_vtl0, _In_ std::uint64_t task_id)
+HRESULT veil_abi::Untrusted::Implementation::taskpool_schedule_task(_In_ uintptr_t taskpool_instance_vtl0, _In_ std::uint64_t task_id, _In_ std::uint32_t priority)
 {
     auto taskpoolInstance = reinterpret_cast<veil::vtl0::implementation::taskpool_backing_threads*>(taskpool_instance_vtl0);
-    taskpoolInstance->queue_task(task_id);
+    taskpoolInstance->queue_task(task_id, priority);
+    return S_OK;
+}
+
+HRESULT veil_abi::Untrusted::Implementation::taskpool_schedule_tasks(_In_ uintptr_t taskpool_instance_vtl0, _In_ const std::vector<std::uint64_t>& task_ids, _In_ std::uint32_t priority)
+{
+    auto taskpoolInstance = reinterpret_cast<veil::vtl0::implementation::taskpool_backing_threads*>(taskpool_instance_vtl0);
+    taskpoolInstance->queue_tasks(task_ids, priority);
+    return S_OK;
+}
+
+HRESULT veil_abi::Untrusted::Implementation::taskpool_schedule_task_after(_In_ uintptr_t taskpool_instance_vtl0, _In_ std::uint64_t task_id, _In_ std::uint64_t delay_milliseconds)
+{
+    auto taskpoolInstance = reinterpret_cast<veil::vtl0::implementation::taskpool_backing_threads*>(taskpool_instance_vtl0);
+    taskpoolInstance->queue_task_after(task_id, std::chrono::milliseconds(delay_milliseconds));
     return S_OK;
 }
 
@@ -44,6 +68,95 @@ HRESULT veil_abi::Untrusted::Implementation::taskpool_cancel_queued_tasks(_In_ u
     return S_OK;
 }
 
+HRESULT veil_abi::Untrusted::Implementation::taskpool_enable_telemetry(_In_ uintptr_t taskpool_instance_vtl0, _In_ bool enabled)
+{
+    auto taskpoolInstance = reinterpret_cast<veil::vtl0::implementation::taskpool_backing_threads*>(taskpool_instance_vtl0);
+    taskpoolInstance->enable_telemetry(enabled);
+    return S_OK;
+}
+
+HRESULT veil_abi::Untrusted::Implementation::taskpool_get_telemetry(_In_ uintptr_t taskpool_instance_vtl0, _Out_ std::vector<std::uint64_t>& telemetry)
+{
+    auto taskpoolInstance = reinterpret_cast<veil::vtl0::implementation::taskpool_backing_threads*>(taskpool_instance_vtl0);
+    telemetry = telemetry_abi::to_abi(taskpoolInstance->telemetry());
+    return S_OK;
+}
+
+namespace veil::vtl0::implementation
+{
+    namespace
+    {
+        struct taskpool_registry
+        {
+            std::mutex m_mutex;
+            std::vector<taskpool_backing_threads*> m_taskpools;
+        };
+
+        taskpool_registry& get_taskpool_registry()
+        {
+            static taskpool_registry s_registry;
+            return s_registry;
+        }
+    }
+
+    void register_taskpool(taskpool_backing_threads* taskpool)
+    {
+        auto& registry = get_taskpool_registry();
+        std::lock_guard lock(registry.m_mutex);
+        registry.m_taskpools.push_back(taskpool);
+    }
+
+    void unregister_taskpool(taskpool_backing_threads* taskpool)
+    {
+        auto& registry = get_taskpool_registry();
+        std::lock_guard lock(registry.m_mutex);
+        std::erase(registry.m_taskpools, taskpool);
+    }
+}
+
+namespace veil::vtl0
+{
+    std::vector<veil::any::taskpool_telemetry> taskpool_telemetry(void* enclave)
+    {
+        struct taskpool_snapshot
+        {
+            uint64_t m_taskpoolInstance_vtl1;
+            veil::any::taskpool_telemetry m_telemetry;
+        };
+
+        // Take the vtl0 side under the registry lock, which keeps the taskpools alive
+        auto snapshots = std::vector<taskpool_snapshot> {};
+        {
+            auto& registry = implementation::get_taskpool_registry();
+            std::lock_guard lock(registry.m_mutex);
+            for (auto taskpool : registry.m_taskpools)
+            {
+                if (taskpool->enclave() == enclave)
+                {
+                    snapshots.push_back({taskpool->taskpool_instance_vtl1(), taskpool->telemetry()});
+                }
+            }
+        }
+
+        // Then call into the enclave for the vtl1 side, skipping taskpools destroyed in the meantime
+        auto telemetry = std::vector<veil::any::taskpool_telemetry> {};
+        for (auto& snapshot : snapshots)
+        {
+            auto telemetryVtl1 = std::vector<uint64_t> {};
+            auto hr = implementation::callins::taskpool_get_telemetry(enclave, snapshot.m_taskpoolInstance_vtl1, telemetryVtl1);
+            if (hr == HRESULT_FROM_WIN32(ERROR_RESOURCE_NOT_ONLINE))
+            {
+                continue;
+            }
+            THROW_IF_FAILED(hr);
+
+            snapshot.m_telemetry.merge(telemetry_abi::from_abi(telemetryVtl1));
+            telemetry.push_back(snapshot.m_telemetry);
+        }
+        return telemetry;
+    }
+}
+
 namespace veil::vtl0::implementation::callins
 {
 HRESULT taskpool_run_task(_In_ void* enclave, _In_ const std::uint64_t taskpool_instance_vtl1, _In_ const std::uint64_t task_id)
@@ -55,4 +168,33 @@ HRESULT taskpool_run_task(_In_ void* enclave, _In_ const std::uint64_t taskpool_
         THROW_IF_FAILED(enclaveInterface.taskpool_run_task(taskpool_instance_vtl1, task_id));
         return S_OK;
     }
+
+    HRESULT taskpool_run_worker_loop(_In_ void* enclave, _In_ const std::uint64_t taskpool_instance_vtl1)
+    {
+        // Initialize enclave interface (once per backing thread, rather than once per task)
+        auto enclaveInterface = veil_abi::Trusted::Stubs::export_interface(enclave);
+        RETURN_IF_FAILED(enclaveInterface.RegisterVtl0Callbacks());
+
+        // Blocks until the vtl1 taskpool stops its worker loop
+        RETURN_IF_FAILED(enclaveInterface.taskpool_run_worker_loop(taskpool_instance_vtl1));
+        return S_OK;
+    }
+
+    HRESULT taskpool_push_ready_tasks(_In_ void* enclave, _In_ const std::uint64_t taskpool_instance_vtl1, _In_ const std::vector<std::uint64_t>& task_ids)
+    {
+        auto enclaveInterface = veil_abi::Trusted::Stubs::export_interface(enclave);
+        RETURN_IF_FAILED(enclaveInterface.RegisterVtl0Callbacks());
+
+        RETURN_IF_FAILED(enclaveInterface.taskpool_push_ready_tasks(taskpool_instance_vtl1, task_ids));
+        return S_OK;
+    }
+
+    HRESULT taskpool_get_telemetry(_In_ void* enclave, _In_ const std::uint64_t taskpool_instance_vtl1, _Out_ std::vector<std::uint64_t>& telemetry)
+    {
+        auto enclaveInterface = veil_abi::Trusted::Stubs::export_interface(enclave);
+        RETURN_IF_FAILED(enclaveInterface.RegisterVtl0Callbacks());
+
+        RETURN_IF_FAILED(enclaveInterface.taskpool_get_telemetry(taskpool_instance_vtl1, telemetry));
+        return S_OK;
+    }
 }
@@ -3,12 +3,24 @@
 
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <future>
+#include <memory>
 #include <mutex>
-#include <queue>
+#include <optional>
+#include <semaphore>
+#include <span>
 #include <thread>
 #include <vector>
 
+#include "priority_lanes.any.h"
+#include "taskpool_telemetry.any.h"
+#include "timer_wheel.vtl0.h"
+
 //
 // See taskpool.vtl1.h for usage.
 //
@@ -16,114 +28,1040 @@
 namespace veil::vtl0::implementation::callins
 {
     HRESULT taskpool_run_task(_In_ void* enclave, _In_ const std::uint64_t taskpool_instance_vtl1, _In_ const std::uint64_t task_id);
+    HRESULT taskpool_run_worker_loop(_In_ void* enclave, _In_ const std::uint64_t taskpool_instance_vtl1);
+    HRESULT taskpool_push_ready_tasks(_In_ void* enclave, _In_ const std::uint64_t taskpool_instance_vtl1, _In_ const std::vector<std::uint64_t>& task_ids);
+    HRESULT taskpool_get_telemetry(_In_ void* enclave, _In_ const std::uint64_t taskpool_instance_vtl1, _Out_ std::vector<std::uint64_t>& telemetry);
+}
+
+namespace veil::vtl0
+{
+    // Telemetry of every live taskpool in an enclave, see veil::vtl1::taskpool::telemetry. Histograms
+    // stay empty unless the enclave turned telemetry on for that taskpool.
+    std::vector<veil::any::taskpool_telemetry> taskpool_telemetry(void* enclave);
 }
 
 namespace veil::vtl0::implementation
 {
+    struct taskpool_backing_threads;
+
+    // Live taskpools, so the host can query their telemetry
+    void register_taskpool(taskpool_backing_threads* taskpool);
+    void unregister_taskpool(taskpool_backing_threads* taskpool);
+}
+
+namespace veil::vtl0::implementation
+{
+    //
     // vtl0 threads that back the vtl1 taskpool implementation. See taskpool.vtl1.h
+    //
+    // Each backing thread owns a deque of task handles. Task handles scheduled from outside the pool
+    // (i.e. from any thread that isn't one of its backing threads) are pushed onto a lock-free injection
+    // list, which an idle thread takes in one exchange and moves into its own deque. Task handles
+    // scheduled by a task running on a backing thread go straight onto that thread's deque. Threads
+    // that run out of work steal from the other deques, spin briefly, and then park. Each parked thread
+    // has its own semaphore, so scheduling wakes exactly one parked thread instead of all of them.
+    //
+    // Every task handle is scheduled into a priority lane (see veil::vtl1::task_priority), and each
+    // deque is a set of lanes drained with strict priority plus aging (see priority_lanes.any.h). A
+    // thread leaves its own tasks for later when a more urgent lane only has tasks on other threads'
+    // deques, and steals those first. Each lane keeps a count of the task handles waiting in it.
+    //
+    // Delayed task handles are kept in a timer wheel, serviced by a timer thread that's started with
+    // the first delayed task. Once due, they're scheduled like any other task handle (or handed to the
+    // VTL1 worker loop), so nothing holds an enclave thread while a delay runs down.
+    //
+    // When maxThreadCount is above threadCount, the thread count adapts to the load: a thread is added
+    // once a task has waited longer than growAfter for a free thread (checked when a thread takes a
+    // task, and by the timer thread in case every thread is stuck in a long task), and a thread that's
+    // been parked for idleTimeout retires, down to threadCount threads. Not available with the
+    // enclave worker loop, whose threads never leave the enclave.
+    //
+    // Entering the enclave to run a task fails when it has no thread free, e.g. when the thread count
+    // outgrew the enclave's thread budget, which other callers share. The task then goes back on its
+    // lane, the thread count stops growing, and the thread retires (or, if it's one of the threadCount
+    // threads, waits with a growing delay before taking another task).
+    //
+    // Telemetry: the lane counters and thread count are always kept. While telemetry is enabled, the
+    // time each task handle waited between being scheduled and a thread taking it is also recorded.
+    //
     struct taskpool_backing_threads
     {
     public:
-        taskpool_backing_threads(void* enclave, uint64_t taskpoolInstance_vtl1, size_t threadCount = 1, bool mustFinishAllQueuedTasks = true)
-            : m_enclave(enclave), m_taskpoolInstance_vtl1(taskpoolInstance_vtl1), m_mustFinishAllQueuedTasks(mustFinishAllQueuedTasks)
+        taskpool_backing_threads(
+            void* enclave,
+            uint64_t taskpoolInstance_vtl1,
+            size_t threadCount = 1,
+            bool mustFinishAllQueuedTasks = true,
+            bool useEnclaveWorkerLoop = false,
+            size_t maxThreadCount = 0,
+            std::chrono::milliseconds growAfter = std::chrono::milliseconds(10),
+            std::chrono::milliseconds idleTimeout = std::chrono::seconds(30))
+            : m_enclave(enclave),
+              m_taskpoolInstance_vtl1(taskpoolInstance_vtl1),
+              m_mustFinishAllQueuedTasks(mustFinishAllQueuedTasks),
+              m_useEnclaveWorkerLoop(useEnclaveWorkerLoop),
+              m_minThreadCount(threadCount),
+              m_maxThreadCount(useEnclaveWorkerLoop ? threadCount : std::max(threadCount, maxThreadCount)),
+              m_growAfter(growAfter),
+              m_idleTimeout(idleTimeout),
+              m_threadLimit(m_maxThreadCount)
         {
-            for (size_t i = 0; i < threadCount; i++)
+            // Every thread that may ever run gets its worker up front, so other threads can look at
+            // the workers without synchronizing with threads being added and retired
+            for (size_t i = 0; i < m_maxThreadCount; i++)
             {
-                m_threads.emplace_back([this]() { thread_proc(); });
+                m_workers.push_back(std::make_unique<worker>());
             }
+            m_threads.resize(m_maxThreadCount);
+
+            {
+                std::lock_guard lock(m_threadsMutex);
+                for (size_t i = 0; i < m_minThreadCount; i++)
+                {
+                    start_thread(i);
+                }
+            }
+
+            register_taskpool(this);
         }
 
         // Delete copy
         taskpool_backing_threads(const taskpool_backing_threads&) = delete;
         taskpool_backing_threads& operator=(const taskpool_backing_threads&) = delete;
 
-        // Allow move
-        taskpool_backing_threads(taskpool_backing_threads&& other) = default;
-        taskpool_backing_threads& operator=(taskpool_backing_threads&& other) = default;
+        // Delete move
+        taskpool_backing_threads(taskpool_backing_threads&& other) = delete;
+        taskpool_backing_threads& operator=(taskpool_backing_threads&& other) = delete;
 
         ~taskpool_backing_threads()
         {
+            unregister_taskpool(this);
+
+            // Stop the timer thread first, delayed tasks that aren't due yet are dropped
+            {
+                std::lock_guard lock(m_timerMutex);
+                m_timerStop = true;
+            }
+            m_timerWake.notify_one();
+            if (m_timerThread.joinable())
+            {
+                m_timerThread.join();
+            }
+
+            // No threads are added once stopping, so m_threads can be walked without the lock
             {
-                std::unique_lock lock(m_mutex);
+                std::lock_guard lock(m_threadsMutex);
                 m_stop = true;
             }
-            m_cv.notify_all();
+            m_stopWake.notify_all();
+            wake_all_idle();
             for (auto& t : m_threads)
             {
-                t.join();
+                if (t.joinable())
+                {
+                    t.join();
+                }
             }
+            delete_injected(m_injected.exchange(nullptr));
         }
 
-        void queue_task(uint64_t task_handle)
+        // Lane of task_priority::normal, for task handles that aren't given a priority
+        static inline constexpr uint32_t c_defaultPriority = 1;
+
+        void queue_task(uint64_t task_handle, uint32_t priority = c_defaultPriority)
         {
+            queue_tasks({&task_handle, 1}, priority);
+        }
+
+        void queue_tasks(std::span<const uint64_t> task_handles, uint32_t priority = c_defaultPriority)
+        {
+            if (m_stop)
+            {
+                THROW_HR(HRESULT_FROM_WIN32(ERROR_CANCELLED));
+            }
+
+            if (task_handles.empty())
+            {
+                return;
+            }
+
+            auto lane = task_lanes::clamp_lane(priority);
+            auto queuedAt = clock::now();
+
+            // Count the tasks before they are visible, so a thread that is about to park always sees them
+            add_queued(lane, task_handles.size());
+
+            if (t_currentPool == this)
             {
-                std::lock_guard lock(m_mutex);
-                if (m_stop)
+                // Scheduled by a task running on one of our backing threads, keep it local
+                auto& self = *m_workers[t_currentWorkerIndex];
+                std::lock_guard lock(self.m_mutex);
+                for (auto task_handle : task_handles)
+                {
+                    self.m_taskHandles.push(lane, queued_task {task_handle, queuedAt, lane});
+                }
+            }
+            else
+            {
+                inject(task_handles, lane, queuedAt);
+            }
+
+            // Only wake as many threads as there are new tasks
+            auto wakeCount = std::min(task_handles.size(), m_workers.size());
+            size_t wokenCount = 0;
+            while (wokenCount < wakeCount && wake_one_idle())
+            {
+                wokenCount++;
+            }
+
+            // Some tasks have to wait for a busy thread, check on them once they've waited too long
+            if (wokenCount < task_handles.size() && can_add_thread())
+            {
+                arm_growth_check();
+            }
+        }
+
+        void queue_task_after(uint64_t task_handle, std::chrono::milliseconds delay)
+        {
+            {
+                // Checked under the timer lock, so no timer (or timer thread) is added once the destructor
+                // has stopped the timer thread
+                std::lock_guard lock(m_timerMutex);
+                if (m_timerStop)
                 {
                     THROW_HR(HRESULT_FROM_WIN32(ERROR_CANCELLED));
                 }
-                m_taskHandles.push(task_handle);
+                m_timers.schedule(task_handle, clock::now() + delay);
+                ensure_timer_thread();
             }
-            m_cv.notify_one();
+
+            // The new timer may be due before the timer thread's current wake time
+            m_timerWake.notify_one();
         }
 
         void cancel_queued_tasks()
         {
-            std::lock_guard lock(m_mutex);
-            std::queue<uint64_t>{}.swap(m_taskHandles); // i.e. m_taskHandles.clear()
+            {
+                std::lock_guard lock(m_timerMutex);
+                m_timers.clear();
+            }
+
+            delete_injected(m_injected.exchange(nullptr));
+
+            for (auto& worker : m_workers)
+            {
+                std::lock_guard lock(worker->m_mutex);
+                for (size_t lane = 0; lane < c_laneCount; lane++)
+                {
+                    m_lanes[lane].m_depth -= worker->m_taskHandles.size(lane);
+                }
+                worker->m_taskHandles.clear();
+            }
+        }
+
+        // Number of task handles waiting in a priority lane, i.e. scheduled but not yet picked up by a
+        // backing thread (delayed tasks only count once they're due)
+        size_t queue_depth(uint32_t priority) const noexcept
+        {
+            return m_lanes[task_lanes::clamp_lane(priority)].m_depth;
+        }
+
+        // The most task handles that have been waiting in a priority lane at once
+        size_t max_queue_depth(uint32_t priority) const noexcept
+        {
+            return m_lanes[task_lanes::clamp_lane(priority)].m_maxDepth;
+        }
+
+        // Number of backing threads currently running (between threadCount and maxThreadCount)
+        size_t thread_count() const noexcept
+        {
+            return m_threadCount;
+        }
+
+        void* enclave() const noexcept
+        {
+            return m_enclave;
+        }
+
+        uint64_t taskpool_instance_vtl1() const noexcept
+        {
+            return m_taskpoolInstance_vtl1;
+        }
+
+        void enable_telemetry(bool enabled) noexcept
+        {
+            m_telemetryEnabled = enabled;
+        }
+
+        // The vtl0 side of the taskpool's telemetry (queue wait, queue depths and thread count)
+        veil::any::taskpool_telemetry telemetry() const
+        {
+            auto telemetry = veil::any::taskpool_telemetry {};
+            telemetry.queueWait = m_queueWait.snapshot();
+            for (size_t lane = 0; lane < c_laneCount; lane++)
+            {
+                telemetry.queueDepth[lane] = m_lanes[lane].m_depth;
+                telemetry.maxQueueDepth[lane] = m_lanes[lane].m_maxDepth;
+            }
+            telemetry.threadCount = m_threadCount;
+            return telemetry;
         }
 
     private:
-        void thread_proc()
+        using clock = timer_wheel::clock;
+
+        struct queued_task
+        {
+            uint64_t m_taskHandle;
+            clock::time_point m_queuedAt;
+            size_t m_lane;
+        };
+
+        using task_lanes = veil::any::implementation::priority_lanes<queued_task>;
+        static inline constexpr size_t c_laneCount = task_lanes::c_laneCount;
+
+        struct worker
+        {
+            std::mutex m_mutex;
+            task_lanes m_taskHandles;
+            std::binary_semaphore m_wake {0};
+
+            // Whether a thread runs this worker, guarded by m_threadsMutex
+            bool m_running {};
+        };
+
+        struct injected_task
+        {
+            queued_task m_task;
+            injected_task* m_next;
+        };
+
+        struct lane_counters
         {
+            std::atomic<size_t> m_depth {};
+            std::atomic<size_t> m_maxDepth {};
+        };
+
+        // Number of times an idle thread checks for new work before parking
+        static inline constexpr size_t c_spinCount = 64;
+
+        // Delays between attempts to enter the enclave worker loop, or to dispatch due tasks
+        static inline constexpr std::chrono::milliseconds c_minRetryDelay {1};
+        static inline constexpr std::chrono::milliseconds c_maxRetryDelay {1000};
+
+        void thread_proc(size_t workerIndex)
+        {
+            if (m_useEnclaveWorkerLoop)
+            {
+                run_enclave_worker_loop();
+                return;
+            }
+
+            t_currentPool = this;
+            t_currentWorkerIndex = workerIndex;
+
+            auto retryDelay = c_minRetryDelay;
             while (true)
             {
-                // Wait for task
+                // Maybe terminate thread
+                if (m_stop && !m_mustFinishAllQueuedTasks)
                 {
-                    std::unique_lock lock(m_mutex);
-                    m_cv.wait(lock, [this]() { return m_stop || !m_taskHandles.empty(); });
+                    break;
                 }
 
-                // Maybe terminate thread
-                if (m_stop)
+                // Dequeue task
+                queued_task task;
+                if (!try_take_task(workerIndex, task))
                 {
-                    if (!m_mustFinishAllQueuedTasks)
+                    if (m_stop)
                     {
                         break;
                     }
 
-                    std::unique_lock lock(m_mutex);
-                    if (m_taskHandles.empty())
+                    if (!spin_for_work() && !park(workerIndex))
                     {
+                        // Idle for too long, retire
                         break;
                     }
+                    continue;
                 }
 
-                // Dequeue task
-                uint64_t taskHandle;
+                auto telemetryEnabled = m_telemetryEnabled.load(std::memory_order_relaxed);
+                if (is_adaptive() || telemetryEnabled)
                 {
-                    std::unique_lock lock(m_mutex);
-                    if (m_taskHandles.empty())
+                    auto now = clock::now();
+                    auto waited = now - task.m_queuedAt;
+                    if (telemetryEnabled)
                     {
-                        continue;
+                        m_queueWait.record(std::chrono::duration_cast<std::chrono::microseconds>(waited).count());
+                    }
+
+                    // Tasks that are still queued have waited at least as long as this one
+                    if (is_adaptive())
+                    {
+                        m_lastTakeTime = now.time_since_epoch().count();
+                        if (waited >= m_growAfter && queued_count() > 0 && m_idleCount == 0)
+                        {
+                            try_add_thread();
+                        }
                     }
-                    taskHandle = std::move(m_taskHandles.front());
-                    m_taskHandles.pop();
                 }
 
                 // Run task
                 //      Signal VTL1 to run the task - this is a blocking call, even if there is no VTL1 thread ready
-                THROW_IF_FAILED(veil::vtl0::implementation::callins::taskpool_run_task(m_enclave, m_taskpoolInstance_vtl1, taskHandle));
+                auto hr = run_task(task.m_taskHandle);
+                if (SUCCEEDED(hr))
+                {
+                    retryDelay = c_minRetryDelay;
+                }
+                else if (!on_run_task_failed(hr, workerIndex, task, retryDelay))
+                {
+                    // Added for load the enclave couldn't take, retire
+                    break;
+                }
+            }
+
+            t_currentPool = nullptr;
+        }
+
+        HRESULT run_task(uint64_t task_handle) noexcept
+        {
+            try
+            {
+                return veil::vtl0::implementation::callins::taskpool_run_task(m_enclave, m_taskpoolInstance_vtl1, task_handle);
+            }
+            catch (...)
+            {
+                return wil::ResultFromCaughtException();
+            }
+        }
+
+        // Failures entering the enclave that go away once the enclave has the threads or memory again
+        static bool is_transient_failure(HRESULT hr) noexcept
+        {
+            switch (hr)
+            {
+            case E_OUTOFMEMORY:
+            case HRESULT_FROM_WIN32(ERROR_NOT_ENOUGH_MEMORY):
+            case HRESULT_FROM_WIN32(ERROR_OUTOFMEMORY):
+            case HRESULT_FROM_WIN32(ERROR_COMMITMENT_LIMIT):
+            case HRESULT_FROM_WIN32(ERROR_NO_SYSTEM_RESOURCES):
+            case HRESULT_FROM_WIN32(ERROR_INSUFFICIENT_RESOURCES):
+            case HRESULT_FROM_WIN32(ERROR_BUSY):
+                return true;
+            default:
+                return false;
+            }
+        }
+
+        //
+        // Handles a task that failed to run, rather than throwing out of the thread (which would terminate
+        // the host process). If the enclave couldn't be entered for lack of threads or memory, the task goes
+        // back on its lane for another thread to take, and the thread count stops growing at what the enclave
+        // could take. Returns false if the thread should retire, otherwise the thread waits with a growing
+        // delay before going on. Any other failure would fail again, so the task is dropped.
+        //
+        bool on_run_task_failed(HRESULT hr, size_t workerIndex, const queued_task& task, std::chrono::milliseconds& retryDelay)
+        {
+            LOG_IF_FAILED(hr);
+
+            // The vtl1 taskpool is gone or stopping, or the task can't run (e.g. its handle is unknown). The
+            // vtl1 taskpool completes a task's future with broken_promise when it's destroyed, retrying could
+            // keep the taskpool from ever being destroyed.
+            if (m_stop || !is_transient_failure(hr))
+            {
+                return true;
+            }
+
+            requeue_task(task);
+
+            {
+                std::lock_guard lock(m_threadsMutex);
+                if (m_threadCount > m_minThreadCount)
+                {
+                    m_threadCount--;
+                    m_workers[workerIndex]->m_running = false;
+                    m_threadLimit = m_threadCount.load();
+                    return false;
+                }
+                m_threadLimit = m_minThreadCount;
+            }
+
+            std::unique_lock lock(m_threadsMutex);
+            m_stopWake.wait_for(lock, retryDelay, [this]() { return m_stop.load(); });
+            retryDelay = std::min(retryDelay * 2, c_maxRetryDelay);
+            return true;
+        }
+
+        // Puts a task that was taken back on its lane, via the injection list since the thread that took
+        // it may retire
+        void requeue_task(const queued_task& task) noexcept
+        {
+            add_queued(task.m_lane, 1);
+            try
+            {
+                inject({&task.m_taskHandle, 1}, task.m_lane, task.m_queuedAt);
+            }
+            catch (...)
+            {
+                // The task stays stored in the vtl1 taskpool, which completes its future with
+                // broken_promise when it's cancelled or destroyed
+                m_lanes[task.m_lane].m_depth--;
+                LOG_CAUGHT_EXCEPTION();
+                return;
+            }
+            wake_one_idle();
+        }
+
+        //
+        // Enters the enclave once, the VTL1 worker loop dequeues and runs tasks until the vtl1 taskpool is
+        // destroyed. Entering fails when no enclave thread is free (e.g. every TCS is busy in other worker
+        // loops), so a failure is logged and retried with a growing delay until the taskpool stops,
+        // rather than thrown out of the thread (which would terminate the host process).
+        //
+        void run_enclave_worker_loop()
+        {
+            auto retryDelay = c_minRetryDelay;
+            while (!m_stop)
+            {
+                HRESULT hr;
+                try
+                {
+                    hr = veil::vtl0::implementation::callins::taskpool_run_worker_loop(m_enclave, m_taskpoolInstance_vtl1);
+                }
+                catch (...)
+                {
+                    hr = wil::ResultFromCaughtException();
+                }
+
+                // The loop ran until the vtl1 taskpool stopped it, or the vtl1 taskpool is already gone
+                if (SUCCEEDED(hr) || hr == HRESULT_FROM_WIN32(ERROR_RESOURCE_NOT_ONLINE))
+                {
+                    return;
+                }
+                LOG_IF_FAILED(hr);
+
+                std::unique_lock lock(m_threadsMutex);
+                m_stopWake.wait_for(lock, retryDelay, [this]() { return m_stop.load(); });
+                retryDelay = std::min(retryDelay * 2, c_maxRetryDelay);
+            }
+        }
+
+        void timer_proc()
+        {
+            auto dueTaskHandles = std::vector<uint64_t> {};
+            auto retryDelay = c_minRetryDelay;
+
+            std::unique_lock lock(m_timerMutex);
+            while (!m_timerStop)
+            {
+                auto now = clock::now();
+                m_timers.advance(now, dueTaskHandles);
+                if (!dueTaskHandles.empty())
+                {
+                    lock.unlock();
+                    auto hr = dispatch_due_tasks(dueTaskHandles);
+                    lock.lock();
+
+                    if (FAILED(hr))
+                    {
+                        // Re-arm the tasks rather than throwing out of the timer thread (which would
+                        // terminate the host process), they're dispatched again after a growing delay
+                        LOG_IF_FAILED(hr);
+                        rearm_due_tasks(dueTaskHandles, clock::now() + retryDelay);
+                        retryDelay = std::min(retryDelay * 2, c_maxRetryDelay);
+                    }
+                    else
+                    {
+                        retryDelay = c_minRetryDelay;
+                    }
+                    dueTaskHandles.clear();
+                    continue;
+                }
+
+                if (m_growthCheckTime && now >= *m_growthCheckTime)
+                {
+                    auto armedAt = *m_growthCheckTime - m_growAfter;
+                    m_growthCheckTime.reset();
+                    lock.unlock();
+                    check_for_stall(armedAt);
+                    lock.lock();
+                    continue;
+                }
+
+                auto wakeTime = m_timers.next_wake_time();
+                if (m_growthCheckTime && (!wakeTime || *m_growthCheckTime < *wakeTime))
+                {
+                    wakeTime = m_growthCheckTime;
+                }
+
+                if (wakeTime)
+                {
+                    m_timerWake.wait_until(lock, *wakeTime);
+                }
+                else
+                {
+                    m_timerWake.wait(lock);
+                }
+            }
+        }
+
+        //
+        // Hands due tasks to the backing threads. Tasks that are refused because the taskpool is being
+        // destroyed count as dispatched, they'd never run anyway. Never throws, it runs on the timer thread.
+        //
+        HRESULT dispatch_due_tasks(const std::vector<uint64_t>& task_handles) noexcept
+        {
+            auto hr = S_OK;
+            try
+            {
+                if (m_useEnclaveWorkerLoop)
+                {
+                    // The backing threads are parked in the VTL1 worker loop, so hand the tasks to its queue
+                    hr = veil::vtl0::implementation::callins::taskpool_push_ready_tasks(m_enclave, m_taskpoolInstance_vtl1, task_handles);
+                }
+                else
+                {
+                    queue_tasks(task_handles);
+                }
+            }
+            catch (...)
+            {
+                hr = wil::ResultFromCaughtException();
+            }
+
+            return hr == HRESULT_FROM_WIN32(ERROR_CANCELLED) ? S_OK : hr;
+        }
+
+        // Puts tasks whose dispatch failed back on the timer wheel, must be called with m_timerMutex held
+        void rearm_due_tasks(const std::vector<uint64_t>& task_handles, clock::time_point due) noexcept
+        {
+            for (auto task_handle : task_handles)
+            {
+                try
+                {
+                    m_timers.schedule(task_handle, due);
+                }
+                catch (...)
+                {
+                    // The task stays stored in the vtl1 taskpool, which completes its future with
+                    // broken_promise when it's cancelled or destroyed
+                    LOG_CAUGHT_EXCEPTION();
+                }
+            }
+        }
+
+        // Must be called with m_timerMutex held
+        void ensure_timer_thread()
+        {
+            if (!m_timerThread.joinable())
+            {
+                m_timerThread = std::jthread([this]() { timer_proc(); });
             }
         }
 
+        bool is_adaptive() const noexcept
+        {
+            return m_maxThreadCount > m_minThreadCount;
+        }
+
+        bool can_add_thread() const noexcept
+        {
+            return m_threadCount < m_threadLimit;
+        }
+
+        // Must be called with m_threadsMutex held
+        void start_thread(size_t workerIndex)
+        {
+            // A retired thread may still be on its way out
+            auto& thread = m_threads[workerIndex];
+            if (thread.joinable())
+            {
+                thread.join();
+            }
+
+            m_workers[workerIndex]->m_running = true;
+            m_threadCount++;
+            thread = std::jthread([this, workerIndex]() { thread_proc(workerIndex); });
+        }
+
+        void try_add_thread()
+        {
+            std::lock_guard lock(m_threadsMutex);
+            if (m_stop || !can_add_thread())
+            {
+                return;
+            }
+
+            for (size_t i = 0; i < m_workers.size(); i++)
+            {
+                if (!m_workers[i]->m_running)
+                {
+                    start_thread(i);
+                    return;
+                }
+            }
+        }
+
+        // Has the timer thread check on queued tasks once they've waited m_growAfter
+        void arm_growth_check()
+        {
+            {
+                std::lock_guard lock(m_timerMutex);
+                if (m_timerStop || m_growthCheckTime)
+                {
+                    return;
+                }
+                m_growthCheckTime = clock::now() + m_growAfter;
+                ensure_timer_thread();
+            }
+            m_timerWake.notify_one();
+        }
+
+        // Adds a thread if tasks were queued when the check was armed, and no thread has taken a task since
+        // (i.e. every thread is busy with a long task)
+        void check_for_stall(clock::time_point armedAt)
+        {
+            if (queued_count() == 0 || m_idleCount > 0)
+            {
+                return;
+            }
+
+            if (m_lastTakeTime.load() <= armedAt.time_since_epoch().count())
+            {
+                try_add_thread();
+            }
+
+            if (can_add_thread())
+            {
+                arm_growth_check();
+            }
+        }
+
+        bool try_take_task(size_t workerIndex, queued_task& task)
+        {
+            auto& self = *m_workers[workerIndex];
+
+            // 1. Tasks scheduled from outside the pool go onto our deque, into their lanes
+            if (auto injected = m_injected.exchange(nullptr))
+            {
+                take_injected(self, injected);
+            }
+
+            auto urgentLane = most_urgent_queued_lane();
+            if (urgentLane == c_laneCount)
+            {
+                return false;
+            }
+
+            // 2. Our own deque, unless a more urgent lane only has tasks on other threads' deques
+            if (try_pop_own(self, urgentLane, task))
+            {
+                return true;
+            }
+
+            // 3. Steal from the other backing threads, most urgent lane first
+            for (auto lane = urgentLane; lane < c_laneCount; lane++)
+            {
+                if (m_lanes[lane].m_depth == 0)
+                {
+                    continue;
+                }
+
+                for (size_t i = 1; i < m_workers.size(); i++)
+                {
+                    auto& victim = *m_workers[(workerIndex + i) % m_workers.size()];
+                    if (try_steal(victim, lane, task))
+                    {
+                        // Our own less urgent tasks were passed over, so they age as if we'd popped
+                        // our own deque. Otherwise a thread whose deque only holds low priority tasks
+                        // could keep stealing more urgent ones and never run its own.
+                        std::lock_guard lock(self.m_mutex);
+                        self.m_taskHandles.age_below(lane);
+                        return true;
+                    }
+                }
+            }
+
+            // 4. Nothing more urgent was left to steal, so run our own after all
+            return try_pop_own(self, c_laneCount, task);
+        }
+
+        bool try_steal(worker& victim, size_t lane, queued_task& task)
+        {
+            std::lock_guard lock(victim.m_mutex);
+            if (!victim.m_taskHandles.try_pop_lane(lane, task))
+            {
+                return false;
+            }
+
+            m_lanes[lane].m_depth--;
+            return true;
+        }
+
+        bool try_pop_own(worker& self, size_t leastUrgentLane, queued_task& task)
+        {
+            std::lock_guard lock(self.m_mutex);
+
+            // A lane that has aged goes first regardless
+            auto lane = self.m_taskHandles.next_lane();
+            if (lane == c_laneCount || (lane > leastUrgentLane && !self.m_taskHandles.has_aged(lane)))
+            {
+                return false;
+            }
+
+            self.m_taskHandles.try_pop(task);
+            m_lanes[lane].m_depth--;
+            return true;
+        }
+
+        size_t most_urgent_queued_lane() const noexcept
+        {
+            for (size_t lane = 0; lane < c_laneCount; lane++)
+            {
+                if (m_lanes[lane].m_depth > 0)
+                {
+                    return lane;
+                }
+            }
+            return c_laneCount;
+        }
+
+        size_t queued_count() const noexcept
+        {
+            size_t count = 0;
+            for (auto& lane : m_lanes)
+            {
+                count += lane.m_depth;
+            }
+            return count;
+        }
+
+        void add_queued(size_t lane, size_t count) noexcept
+        {
+            auto depth = m_lanes[lane].m_depth += count;
+            auto maxDepth = m_lanes[lane].m_maxDepth.load();
+            while (depth > maxDepth && !m_lanes[lane].m_maxDepth.compare_exchange_weak(maxDepth, depth))
+            {
+            }
+        }
+
+        void inject(std::span<const uint64_t> task_handles, size_t lane, clock::time_point queuedAt)
+        {
+            // Link the tasks up front so the whole batch is published with a single compare-exchange.
+            // The list is LIFO, so it is built newest first.
+            injected_task* first = nullptr;
+            injected_task* last = nullptr;
+            for (auto task_handle : task_handles)
+            {
+                first = new injected_task {{task_handle, queuedAt, lane}, first};
+                if (!last)
+                {
+                    last = first;
+                }
+            }
+
+            last->m_next = m_injected.load();
+            while (!m_injected.compare_exchange_weak(last->m_next, first))
+            {
+            }
+        }
+
+        // Moves the injected tasks onto our deque, where they're ordered by priority and other threads can steal them
+        void take_injected(worker& self, injected_task* injected)
+        {
+            // Reverse the list into scheduling order
+            injected_task* oldest = nullptr;
+            size_t count = 0;
+            while (injected)
+            {
+                auto next = injected->m_next;
+                injected->m_next = oldest;
+                oldest = injected;
+                injected = next;
+                count++;
+            }
+
+            {
+                std::lock_guard lock(self.m_mutex);
+                for (auto node = oldest; node; node = node->m_next)
+                {
+                    self.m_taskHandles.push(node->m_task.m_lane, node->m_task);
+                }
+            }
+
+            while (oldest)
+            {
+                delete std::exchange(oldest, oldest->m_next);
+            }
+
+            // There's more work than this thread can run right now
+            if (count > 1)
+            {
+                wake_one_idle();
+            }
+        }
+
+        void delete_injected(injected_task* injected)
+        {
+            while (injected)
+            {
+                m_lanes[injected->m_task.m_lane].m_depth--;
+                delete std::exchange(injected, injected->m_next);
+            }
+        }
+
+        bool spin_for_work()
+        {
+            for (size_t i = 0; i < c_spinCount; i++)
+            {
+                if (queued_count() > 0 || m_stop)
+                {
+                    return true;
+                }
+                std::this_thread::yield();
+            }
+            return false;
+        }
+
+        // Returns false if the thread was parked for m_idleTimeout and should retire
+        bool park(size_t workerIndex)
+        {
+            {
+                std::lock_guard lock(m_idleMutex);
+                m_idleWorkers.push_back(workerIndex);
+                m_idleCount++;
+            }
+
+            // Work scheduled before we were on the idle list wouldn't have woken us, so check once more
+            if (queued_count() > 0 || m_stop)
+            {
+                std::unique_lock lock(m_idleMutex);
+                auto it = std::find(m_idleWorkers.begin(), m_idleWorkers.end(), workerIndex);
+                if (it != m_idleWorkers.end())
+                {
+                    m_idleWorkers.erase(it);
+                    m_idleCount--;
+                    return true;
+                }
+
+                // Someone already took us off the idle list and is waking us, consume the wake
+            }
+
+            auto& wake = m_workers[workerIndex]->m_wake;
+            if (!is_adaptive())
+            {
+                wake.acquire();
+                return true;
+            }
+
+            while (!wake.try_acquire_for(m_idleTimeout))
+            {
+                if (try_retire(workerIndex))
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        bool try_retire(size_t workerIndex)
+        {
+            std::lock_guard idleLock(m_idleMutex);
+            auto it = std::find(m_idleWorkers.begin(), m_idleWorkers.end(), workerIndex);
+            if (it == m_idleWorkers.end())
+            {
+                // Someone took us off the idle list and is waking us
+                return false;
+            }
+
+            std::lock_guard threadsLock(m_threadsMutex);
+            if (m_stop || m_threadCount <= m_minThreadCount)
+            {
+                return false;
+            }
+
+            // Our deque is empty: only this thread puts tasks on it, and it was parked
+            m_idleWorkers.erase(it);
+            m_idleCount--;
+            m_threadCount--;
+            m_workers[workerIndex]->m_running = false;
+            return true;
+        }
+
+        bool wake_one_idle()
+        {
+            if (m_idleCount == 0)
+            {
+                return false;
+            }
+
+            size_t workerIndex;
+            {
+                std::lock_guard lock(m_idleMutex);
+                if (m_idleWorkers.empty())
+                {
+                    return false;
+                }
+                workerIndex = m_idleWorkers.back();
+                m_idleWorkers.pop_back();
+                m_idleCount--;
+            }
+
+            m_workers[workerIndex]->m_wake.release();
+            return true;
+        }
+
+        void wake_all_idle()
+        {
+            std::lock_guard lock(m_idleMutex);
+            for (auto workerIndex : m_idleWorkers)
+            {
+                m_workers[workerIndex]->m_wake.release();
+            }
+            m_idleWorkers.clear();
+            m_idleCount = 0;
+        }
+
+        static inline thread_local taskpool_backing_threads* t_currentPool {};
+        static inline thread_local size_t t_currentWorkerIndex {};
+
         void* m_enclave{};
         uint64_t m_taskpoolInstance_vtl1{};
-        std::queue<uint64_t> m_taskHandles;
-        std::mutex m_mutex;
-        std::condition_variable m_cv;
+        std::vector<std::unique_ptr<worker>> m_workers;
+        std::atomic<injected_task*> m_injected {};
+        std::array<lane_counters, c_laneCount> m_lanes;
+        std::mutex m_idleMutex;
+        std::vector<size_t> m_idleWorkers;
+        std::atomic<size_t> m_idleCount {};
         std::atomic<bool> m_stop = false;
         const bool m_mustFinishAllQueuedTasks;
+        const bool m_useEnclaveWorkerLoop;
+
+        // Threads, m_threads has a slot per worker and only changes under m_threadsMutex
+        const size_t m_minThreadCount;
+        const size_t m_maxThreadCount;
+        const std::chrono::milliseconds m_growAfter;
+        const std::chrono::milliseconds m_idleTimeout;
+        std::mutex m_threadsMutex;
+        std::condition_variable m_stopWake;
         std::vector<std::jthread> m_threads;
+        std::atomic<size_t> m_threadCount {};
+        std::atomic<clock::rep> m_lastTakeTime {};
+
+        // Most threads that may run, lowered from m_maxThreadCount once the enclave couldn't be entered
+        std::atomic<size_t> m_threadLimit {};
+
+        // Telemetry
+        std::atomic<bool> m_telemetryEnabled {};
+        veil::any::implementation::duration_histogram_recorder m_queueWait;
+
+        // Delayed tasks
+        std::mutex m_timerMutex;
+        std::condition_variable m_timerWake;
+        timer_wheel m_timers;
+        bool m_timerStop = false;
+        std::optional<clock::time_point> m_growthCheckTime;
+        std::jthread m_timerThread;
     };
 }
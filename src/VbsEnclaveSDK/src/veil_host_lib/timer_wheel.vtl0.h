@@ -0,0 +1,187 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+namespace veil::vtl0::implementation
+{
+    //
+    // Hierarchical timer wheel that tracks when values (e.g. vtl1 task handles) are due.
+    //
+    // Time is split into ticks. Level 0 has a slot per tick for the next 64 ticks, level 1 a slot per
+    // 64 ticks for the next 64^2 ticks, and so on. A timer is filed in the lowest level that can hold
+    // its due tick, and whenever level 0 wraps around, the next slot of the level above is cascaded
+    // down. Scheduling is O(1), and advancing the wheel is O(1) per tick plus the timers that expire
+    // or cascade. Timers further out than the top level are kept in an overflow list.
+    //
+    // Not thread safe, the owner serializes access.
+    //
+    class timer_wheel
+    {
+    public:
+        using clock = std::chrono::steady_clock;
+
+        explicit timer_wheel(clock::duration tickDuration = std::chrono::milliseconds(1), clock::time_point start = clock::now())
+            : m_tickDuration(tickDuration), m_start(start)
+        {
+        }
+
+        size_t size() const noexcept
+        {
+            return m_count;
+        }
+
+        // Timers are never early: the due time is rounded up to the next tick
+        void schedule(uint64_t value, clock::time_point due)
+        {
+            auto elapsed = due > m_start ? due - m_start : clock::duration::zero();
+            auto dueTick = static_cast<uint64_t>((elapsed + m_tickDuration - clock::duration(1)) / m_tickDuration);
+            insert({value, std::max(dueTick, m_currentTick + 1)});
+            m_count++;
+        }
+
+        // Moves the wheel up to now, appending the values of every timer that's due to expired
+        void advance(clock::time_point now, std::vector<uint64_t>& expired)
+        {
+            auto targetTick = tick_of(now);
+            while (m_currentTick < targetTick)
+            {
+                if (m_count == 0)
+                {
+                    // Nothing to expire or cascade on the way
+                    m_currentTick = targetTick;
+                    return;
+                }
+
+                m_currentTick++;
+                cascade();
+
+                auto& slot = m_levels[0][m_currentTick & c_slotMask];
+                for (auto& timer : slot)
+                {
+                    expired.push_back(timer.m_value);
+                }
+                m_count -= slot.size();
+                slot.clear();
+            }
+        }
+
+        // When advance next has work to do (a timer expiring, or timers cascading to a lower level)
+        std::optional<clock::time_point> next_wake_time() const
+        {
+            if (m_count == 0)
+            {
+                return std::nullopt;
+            }
+
+            auto nextTick = UINT64_MAX;
+            for (size_t level = 0; level < c_levelCount; level++)
+            {
+                auto shift = level * c_slotBits;
+                for (uint64_t i = 1; i <= c_slotCount; i++)
+                {
+                    auto slotTick = ((m_currentTick >> shift) + i) << shift;
+                    if (!m_levels[level][(slotTick >> shift) & c_slotMask].empty())
+                    {
+                        nextTick = std::min(nextTick, slotTick);
+                        break;
+                    }
+                }
+            }
+
+            if (!m_overflow.empty())
+            {
+                auto topShift = c_levelCount * c_slotBits;
+                nextTick = std::min(nextTick, ((m_currentTick >> topShift) + 1) << topShift);
+            }
+
+            return m_start + m_tickDuration * nextTick;
+        }
+
+        void clear()
+        {
+            for (auto& level : m_levels)
+            {
+                for (auto& slot : level)
+                {
+                    slot.clear();
+                }
+            }
+            m_overflow.clear();
+            m_count = 0;
+        }
+
+    private:
+        static inline constexpr size_t c_slotBits = 6;
+        static inline constexpr size_t c_slotCount = size_t {1} << c_slotBits;
+        static inline constexpr uint64_t c_slotMask = c_slotCount - 1;
+        static inline constexpr size_t c_levelCount = 4;
+
+        struct timer
+        {
+            uint64_t m_value;
+            uint64_t m_dueTick;
+        };
+
+        uint64_t tick_of(clock::time_point time) const
+        {
+            return time > m_start ? static_cast<uint64_t>((time - m_start) / m_tickDuration) : 0;
+        }
+
+        void insert(const timer& timer)
+        {
+            auto delta = timer.m_dueTick - m_currentTick;
+            for (size_t level = 0; level < c_levelCount; level++)
+            {
+                auto shift = level * c_slotBits;
+                if (delta < (uint64_t {1} << (shift + c_slotBits)))
+                {
+                    m_levels[level][(timer.m_dueTick >> shift) & c_slotMask].push_back(timer);
+                    return;
+                }
+            }
+            m_overflow.push_back(timer);
+        }
+
+        // Called when moving to a new tick, refiles the timers of every level that's reached a new slot
+        void cascade()
+        {
+            for (size_t level = 1; level <= c_levelCount; level++)
+            {
+                auto shift = level * c_slotBits;
+                if ((m_currentTick & ((uint64_t {1} << shift) - 1)) != 0)
+                {
+                    return;
+                }
+
+                auto timers = std::vector<timer> {};
+                if (level < c_levelCount)
+                {
+                    timers.swap(m_levels[level][(m_currentTick >> shift) & c_slotMask]);
+                }
+                else
+                {
+                    timers.swap(m_overflow);
+                }
+
+                for (auto& timer : timers)
+                {
+                    insert(timer);
+                }
+            }
+        }
+
+        clock::duration m_tickDuration;
+        clock::time_point m_start;
+        uint64_t m_currentTick {};
+        size_t m_count {};
+        std::array<std::array<std::vector<timer>, c_slotCount>, c_levelCount> m_levels;
+        std::vector<timer> m_overflow;
+    };
+}
@@ -0,0 +1,88 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#include <pch.h>
+#include "HeapUsage.h"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace Benchmarks
+{
+    static std::atomic<std::size_t> s_current_bytes {};
+    static std::atomic<std::size_t> s_peak_bytes {};
+
+    // The size of each allocation is stored in front of the memory handed out, so it is
+    // known again when the memory is freed.
+    static inline constexpr std::size_t c_allocation_header_size = alignof(std::max_align_t);
+
+    static void* AllocateAndTrack(std::size_t size)
+    {
+        auto allocation = static_cast<std::byte*>(std::malloc(size + c_allocation_header_size));
+
+        if (!allocation)
+        {
+            return nullptr;
+        }
+
+        *reinterpret_cast<std::size_t*>(allocation) = size;
+        auto current_bytes = s_current_bytes.fetch_add(size, std::memory_order_relaxed) + size;
+        auto peak_bytes = s_peak_bytes.load(std::memory_order_relaxed);
+
+        while (current_bytes > peak_bytes &&
+               !s_peak_bytes.compare_exchange_weak(peak_bytes, current_bytes, std::memory_order_relaxed))
+        {
+        }
+
+        return allocation + c_allocation_header_size;
+    }
+
+    static void FreeAndTrack(void* memory)
+    {
+        if (!memory)
+        {
+            return;
+        }
+
+        auto allocation = static_cast<std::byte*>(memory) - c_allocation_header_size;
+        s_current_bytes.fetch_sub(*reinterpret_cast<std::size_t*>(allocation), std::memory_order_relaxed);
+        std::free(allocation);
+    }
+
+    std::size_t HeapUsage::CurrentBytes()
+    {
+        return s_current_bytes.load(std::memory_order_relaxed);
+    }
+
+    std::size_t HeapUsage::PeakBytes()
+    {
+        return s_peak_bytes.load(std::memory_order_relaxed);
+    }
+
+    void HeapUsage::ResetPeak()
+    {
+        s_peak_bytes.store(s_current_bytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+}
+
+// The array and nothrow forms of the operators call these, so replacing them is
+// enough to track every allocation made by the tooling library.
+void* operator new(std::size_t size)
+{
+    if (auto memory = Benchmarks::AllocateAndTrack(size == 0 ? 1 : size))
+    {
+        return memory;
+    }
+
+    throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept
+{
+    Benchmarks::FreeAndTrack(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept
+{
+    Benchmarks::FreeAndTrack(memory);
+}
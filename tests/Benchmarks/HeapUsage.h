@@ -0,0 +1,21 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+#include <pch.h>
+
+namespace Benchmarks
+{
+    // Tracks the bytes currently allocated through the global operator new, which this project
+    // replaces. The peak can be reset before a phase starts, so the peak heap usage of each phase
+    // can be measured on its own rather than only for the lifetime of the process.
+    class HeapUsage
+    {
+    public:
+        static std::size_t CurrentBytes();
+
+        static std::size_t PeakBytes();
+
+        static void ResetPeak();
+    };
+}
@@ -0,0 +1,96 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#include <pch.h>
+#include "LexerBenchmark.h"
+#include <Edl\LexicalAnalyzer.h>
+#include <chrono>
+
+using namespace EdlProcessor;
+
+namespace Benchmarks
+{
+    static inline constexpr std::uint32_t c_fields_per_struct = 6;
+
+    static std::filesystem::path GenerateLexerEdl(std::uint32_t struct_count, const std::filesystem::path& output_directory)
+    {
+        std::filesystem::create_directories(output_directory);
+        auto edl_path = output_directory / "LexerBenchmark.edl";
+        std::ofstream file(edl_path, std::ios::binary | std::ios::trunc);
+        file << "enclave\r\n{\r\n";
+
+        for (std::uint32_t i = 0; i < struct_count; i++)
+        {
+            file << std::format("    // Struct number {}\r\n    struct Struct{}\r\n    {{\r\n", i, i);
+
+            for (std::uint32_t j = 0; j < c_fields_per_struct; j++)
+            {
+                file << std::format("\tuint32_t field_{}; /* field {} of struct {} */\r\n", j, j, i);
+            }
+
+            file << "    };\r\n";
+        }
+
+        file << "};\r\n";
+
+        return edl_path;
+    }
+
+    void RunLexerBenchmark(
+        std::uint32_t struct_count,
+        std::uint32_t iterations,
+        const std::filesystem::path& output_directory)
+    {
+        using milliseconds = std::chrono::duration<double, std::milli>;
+
+        auto edl_path = GenerateLexerEdl(struct_count, output_directory);
+        std::vector<LexedToken> vectorized_tokens {};
+
+        std::cout << std::format("\nLexer on {} lines ({:.1f} KB):\n", struct_count * 10 + 4, std::filesystem::file_size(edl_path) / 1024.0);
+
+        for (auto mode : { LexingMode::Vectorized, LexingMode::Scalar })
+        {
+            auto best_time = milliseconds::max();
+            std::vector<LexedToken> tokens {};
+            bool is_memory_mapped {};
+
+            for (std::uint32_t iteration = 0; iteration < iterations; iteration++)
+            {
+                auto start_time = std::chrono::steady_clock::now();
+                auto analyzer = LexicalAnalyzer(edl_path, mode);
+                auto lexed_tokens = analyzer.LexedTokens();
+                best_time = std::min<milliseconds>(best_time, std::chrono::steady_clock::now() - start_time);
+
+                tokens.assign(lexed_tokens.begin(), lexed_tokens.end());
+                is_memory_mapped = analyzer.IsMemoryMapped();
+            }
+
+            auto mode_name = (mode == LexingMode::Vectorized) ? "vectorized" : "scalar";
+            std::cout << std::format(
+                "  {:<12}{:>10.2f} ms {:>10} tokens (memory mapped: {})\n",
+                mode_name,
+                best_time.count(),
+                tokens.size(),
+                is_memory_mapped);
+
+            if (mode == LexingMode::Vectorized)
+            {
+                vectorized_tokens = std::move(tokens);
+                continue;
+            }
+
+            auto same_token = [] (const LexedToken& left, const LexedToken& right)
+            {
+                return left.m_offset == right.m_offset &&
+                       left.m_length == right.m_length &&
+                       left.m_line_number == right.m_line_number &&
+                       left.m_column_number == right.m_column_number;
+            };
+
+            if (!std::ranges::equal(tokens, vectorized_tokens, same_token))
+            {
+                throw std::runtime_error("The scalar and vectorized lexers produced different tokens");
+            }
+        }
+    }
+}
@@ -0,0 +1,16 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+#include <pch.h>
+
+namespace Benchmarks
+{
+    // Writes an .edl file with struct_count structs of 10 lines each to the output directory, then
+    // tokenizes it with both lexing modes of the LexicalAnalyzer and prints the fastest time of each.
+    // Throws if the two modes don't produce the same tokens.
+    void RunLexerBenchmark(
+        std::uint32_t struct_count,
+        std::uint32_t iterations,
+        const std::filesystem::path& output_directory);
+}
@@ -0,0 +1,207 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#include <pch.h>
+#include "SyntheticEdlGenerator.h"
+
+namespace Benchmarks
+{
+    SyntheticEdlOptions SyntheticEdlOptions::Scale(std::uint32_t factor) const
+    {
+        SyntheticEdlOptions scaled = *this;
+        scaled.m_struct_count *= factor;
+        scaled.m_enum_count *= factor;
+        scaled.m_function_count *= factor;
+        scaled.m_import_count *= factor;
+
+        return scaled;
+    }
+
+    // Structs and enums are split evenly between the imported files and the main file. Each
+    // file gets a contiguous range of the indices so nested struct chains can stay in one file.
+    struct IndexRange
+    {
+        std::uint32_t m_begin {};
+        std::uint32_t m_end {};
+    };
+
+    static IndexRange GetRangeForFile(std::uint32_t count, std::uint32_t file_index, std::uint32_t file_count)
+    {
+        auto begin = static_cast<std::uint64_t>(count) * file_index / file_count;
+        auto end = static_cast<std::uint64_t>(count) * (file_index + 1) / file_count;
+
+        return { static_cast<std::uint32_t>(begin), static_cast<std::uint32_t>(end) };
+    }
+
+    static std::string GetStructName(std::string_view edl_name, std::uint32_t index)
+    {
+        return std::format("{}Struct{}", edl_name, index);
+    }
+
+    static std::string GetEnumName(std::string_view edl_name, std::uint32_t index)
+    {
+        return std::format("{}Enum{}", edl_name, index);
+    }
+
+    static void AppendEnums(std::ostringstream& edl, std::string_view edl_name, IndexRange enums)
+    {
+        for (auto index = enums.m_begin; index < enums.m_end; index++)
+        {
+            auto enum_name = GetEnumName(edl_name, index);
+            edl << std::format("    enum {}\n    {{\n", enum_name);
+            edl << std::format("        {}_First = 0,\n", enum_name);
+            edl << std::format("        {}_Second,\n", enum_name);
+            edl << std::format("        {}_Third = 0x10,\n", enum_name);
+            edl << "    };\n\n";
+        }
+    }
+
+    static void AppendStructs(
+        std::ostringstream& edl,
+        std::string_view edl_name,
+        const SyntheticEdlOptions& options,
+        IndexRange structs,
+        IndexRange enums)
+    {
+        auto nesting_depth = std::max(options.m_nesting_depth, 1U);
+
+        for (auto index = structs.m_begin; index < structs.m_end; index++)
+        {
+            edl << std::format("    struct {}\n    {{\n", GetStructName(edl_name, index));
+            edl << "        int32_t int32_field;\n";
+            edl << "        uint64_t uint64_field;\n";
+            edl << "        string string_field;\n";
+            edl << "        uint8_t array_field[16];\n";
+
+            if (enums.m_begin < enums.m_end)
+            {
+                auto enum_index = enums.m_begin + (index % (enums.m_end - enums.m_begin));
+                edl << std::format("        {} enum_field;\n", GetEnumName(edl_name, enum_index));
+            }
+
+            // Start a new chain when the previous struct is in another file or the chain
+            // has reached the nesting depth.
+            bool is_nested = (index > structs.m_begin) && ((index - structs.m_begin) % nesting_depth != 0);
+
+            if (is_nested)
+            {
+                edl << std::format("        {} nested_field;\n", GetStructName(edl_name, index - 1));
+            }
+
+            for (std::uint32_t vector_index = 0; vector_index < options.m_vector_count; vector_index++)
+            {
+                if (is_nested && (vector_index % 2 == 1))
+                {
+                    edl << std::format("        vector<{}> vector_field{};\n", GetStructName(edl_name, index - 1), vector_index);
+                }
+                else
+                {
+                    edl << std::format("        vector<int32_t> vector_field{};\n", vector_index);
+                }
+            }
+
+            edl << "    };\n\n";
+        }
+    }
+
+    static void AppendFunctions(
+        std::ostringstream& edl,
+        std::string_view edl_name,
+        std::string_view scope_name,
+        const SyntheticEdlOptions& options)
+    {
+        edl << std::format("    {}\n    {{\n", scope_name);
+
+        for (std::uint32_t index = 0; index < options.m_function_count; index++)
+        {
+            edl << std::format("        HRESULT {}_Function{}(\n", scope_name, index);
+            edl << "            int32_t int32_arg,\n";
+            edl << "            [in] string string_arg,\n";
+
+            if (options.m_struct_count > 0)
+            {
+                auto struct_name = GetStructName(edl_name, index % options.m_struct_count);
+                edl << std::format("            [in] {} struct_arg,\n", struct_name);
+                edl << std::format("            [in, out] {}* struct_ptr_arg,\n", struct_name);
+            }
+
+            if (options.m_enum_count > 0)
+            {
+                edl << std::format("            [in, out] {} enum_arg,\n", GetEnumName(edl_name, index % options.m_enum_count));
+            }
+
+            for (std::uint32_t vector_index = 0; vector_index < options.m_vector_count; vector_index++)
+            {
+                if (options.m_struct_count > 0 && (vector_index % 2 == 1))
+                {
+                    auto struct_name = GetStructName(edl_name, index % options.m_struct_count);
+                    edl << std::format("            [in] vector<{}> vector_arg{},\n", struct_name, vector_index);
+                }
+                else
+                {
+                    edl << std::format("            [out] vector<uint64_t> vector_arg{},\n", vector_index);
+                }
+            }
+
+            edl << "            [out] uint32_t* uint32_ptr_arg);\n\n";
+        }
+
+        edl << "    };\n\n";
+    }
+
+    static void WriteEdlFile(const std::filesystem::path& file_path, const std::ostringstream& edl)
+    {
+        std::ofstream edl_file(file_path, std::ios::binary);
+
+        if (!edl_file.is_open())
+        {
+            throw std::runtime_error(std::format("Unable to create synthetic .edl file '{}'", file_path.generic_string()));
+        }
+
+        edl_file << edl.str();
+    }
+
+    std::filesystem::path GenerateSyntheticEdl(
+        const SyntheticEdlOptions& options,
+        const std::filesystem::path& output_directory,
+        std::string_view edl_name)
+    {
+        std::filesystem::create_directories(output_directory);
+
+        auto file_count = options.m_import_count + 1;
+        auto main_file_index = options.m_import_count;
+
+        for (std::uint32_t import_index = 0; import_index < options.m_import_count; import_index++)
+        {
+            std::ostringstream edl {};
+            edl << "enclave\n{\n";
+            auto enums = GetRangeForFile(options.m_enum_count, import_index, file_count);
+            AppendEnums(edl, edl_name, enums);
+            AppendStructs(edl, edl_name, options, GetRangeForFile(options.m_struct_count, import_index, file_count), enums);
+            edl << "};\n";
+
+            WriteEdlFile(output_directory / std::format("{}_Import{}.edl", edl_name, import_index), edl);
+        }
+
+        std::ostringstream edl {};
+        edl << "enclave\n{\n";
+
+        for (std::uint32_t import_index = 0; import_index < options.m_import_count; import_index++)
+        {
+            edl << std::format("    import \"{}_Import{}.edl\";\n", edl_name, import_index);
+        }
+
+        edl << "\n";
+        auto enums = GetRangeForFile(options.m_enum_count, main_file_index, file_count);
+        AppendEnums(edl, edl_name, enums);
+        AppendStructs(edl, edl_name, options, GetRangeForFile(options.m_struct_count, main_file_index, file_count), enums);
+        AppendFunctions(edl, edl_name, "trusted", options);
+        AppendFunctions(edl, edl_name, "untrusted", options);
+        edl << "};\n";
+
+        auto edl_file_path = output_directory / std::format("{}.edl", edl_name);
+        WriteEdlFile(edl_file_path, edl);
+
+        return edl_file_path;
+    }
+}
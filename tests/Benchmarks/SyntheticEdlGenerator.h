@@ -0,0 +1,41 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+#include <pch.h>
+
+namespace Benchmarks
+{
+    // Controls the shape of a generated .edl file. Counts are for the whole generated
+    // set of files, i.e structs and enums are split between the imported files and the
+    // main .edl file.
+    struct SyntheticEdlOptions
+    {
+        std::uint32_t m_struct_count {};
+        std::uint32_t m_enum_count {};
+
+        // Number of functions in each of the trusted and untrusted scopes.
+        std::uint32_t m_function_count {};
+
+        // Structs are generated in chains where each struct contains the previous one
+        // as a field, up to this many levels deep.
+        std::uint32_t m_nesting_depth {};
+
+        // Number of vector fields in each struct and vector parameters in each function.
+        std::uint32_t m_vector_count {};
+
+        // Number of .edl files imported by the main .edl file.
+        std::uint32_t m_import_count {};
+
+        // Multiplies the struct, enum, function and import counts.
+        SyntheticEdlOptions Scale(std::uint32_t factor) const;
+    };
+
+    // Writes a set of syntactically and semantically valid .edl files to the output directory.
+    // Returns the path of the main .edl file. The imported files are written next to it, so the
+    // output directory should be used as the import directory when parsing it.
+    std::filesystem::path GenerateSyntheticEdl(
+        const SyntheticEdlOptions& options,
+        const std::filesystem::path& output_directory,
+        std::string_view edl_name);
+}
@@ -0,0 +1,436 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#include <pch.h>
+#include "HeapUsage.h"
+#include "LexerBenchmark.h"
+#include "SyntheticEdlGenerator.h"
+#include <Edl\Parser.h>
+#include <CodeGeneration\CodeGeneration.h>
+#include <Utils\PhaseTimer.h>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+
+using namespace Benchmarks;
+using namespace CodeGeneration;
+using namespace EdlProcessor;
+using namespace Helpers;
+
+using milliseconds = std::chrono::duration<double, std::milli>;
+
+static inline constexpr std::size_t c_phase_count = static_cast<std::size_t>(CodeGenerationPhase::Count);
+static inline constexpr double c_bytes_per_megabyte = 1024.0 * 1024.0;
+
+// A phase whose time grows faster than this power of the input size is reported as possibly
+// quadratic. Linear phases have an exponent close to 1 and quadratic phases one close to 2.
+static inline constexpr double c_superlinear_exponent = 1.5;
+
+// Measurements smaller than these are too noisy for their growth to be meaningful.
+static inline constexpr double c_minimum_reported_milliseconds = 1.0;
+static inline constexpr double c_minimum_reported_megabytes = 1.0;
+
+struct BenchmarkOptions
+{
+    SyntheticEdlOptions m_edl_options {
+        .m_struct_count = 200,
+        .m_enum_count = 50,
+        .m_function_count = 100,
+        .m_nesting_depth = 4,
+        .m_vector_count = 2,
+        .m_import_count = 2,
+    };
+
+    std::vector<std::uint32_t> m_scales { 1, 2, 4, 8 };
+    std::uint32_t m_iterations { 3 };
+    std::uint32_t m_lexer_struct_count { 10'000 };
+    std::filesystem::path m_output_directory {};
+    std::filesystem::path m_flatbuffer_compiler_path {};
+    bool m_should_display_help {};
+};
+
+struct BenchmarkResult
+{
+    std::uint32_t m_scale {};
+    std::uintmax_t m_edl_size {};
+    std::array<double, c_phase_count> m_phase_milliseconds {};
+    std::array<std::size_t, c_phase_count> m_phase_peak_bytes {};
+    double m_parse_milliseconds {};
+    double m_generate_milliseconds {};
+};
+
+// The peak heap usage of each phase, above the heap usage when the phase started. Filled in
+// by MeasurePhaseHeapUsage, which PhaseTimings calls whenever a phase starts or stops running.
+static std::array<std::size_t, c_phase_count> s_phase_peak_bytes {};
+static std::size_t s_phase_start_bytes {};
+
+static void MeasurePhaseHeapUsage(CodeGenerationPhase phase, bool is_starting)
+{
+    if (is_starting)
+    {
+        HeapUsage::ResetPeak();
+        s_phase_start_bytes = HeapUsage::CurrentBytes();
+        return;
+    }
+
+    auto peak_bytes = HeapUsage::PeakBytes();
+    auto& phase_peak_bytes = s_phase_peak_bytes[static_cast<std::size_t>(phase)];
+
+    if (peak_bytes > s_phase_start_bytes)
+    {
+        phase_peak_bytes = std::max(phase_peak_bytes, peak_bytes - s_phase_start_bytes);
+    }
+}
+
+static void PrintBenchmarkUsage()
+{
+    std::cout
+        << "Generates synthetic .edl files of increasing size and measures the time and peak heap usage\n"
+        << "of each edlcodegen phase on them. Every count is multiplied by each scale.\n\n"
+        << "Usage: edlcodegen_benchmarks.exe [options]\n"
+        << "  --Structs <count>                  Number of structs. (Default 200)\n"
+        << "  --Enums <count>                    Number of enums. (Default 50)\n"
+        << "  --Functions <count>                Number of trusted and of untrusted functions. (Default 100)\n"
+        << "  --NestingDepth <depth>             Length of the chains of structs nested in each other. Not scaled. (Default 4)\n"
+        << "  --Vectors <count>                  Vector fields per struct and parameters per function. Not scaled. (Default 2)\n"
+        << "  --Imports <count>                  Number of imported .edl files. (Default 2)\n"
+        << "  --Scales <scale,scale,...>         Scales to run. (Default 1,2,4,8)\n"
+        << "  --Iterations <count>               Runs per scale, the fastest run is reported. (Default 3)\n"
+        << "  --LexerStructs <count>             Structs in the .edl file the lexer is run on, 10 lines each. 0 to skip it. (Default 10000)\n"
+        << "  --OutputDirectory <directory>      Where the .edl and generated files are written. (Default %TEMP%\\EdlCodegenBenchmarks)\n"
+        << "  --FlatbuffersCompilerPath <path>   Path to flatc.exe. (Default is the current directory)\n";
+}
+
+static bool TryParseNumber(std::string_view value, std::uint32_t& number)
+{
+    auto result = std::from_chars(value.data(), value.data() + value.size(), number);
+    return result.ec == std::errc {} && result.ptr == value.data() + value.size();
+}
+
+static bool TryParseScales(std::string_view value, std::vector<std::uint32_t>& scales)
+{
+    scales.clear();
+
+    while (!value.empty())
+    {
+        auto separator = value.find(',');
+        std::uint32_t scale {};
+
+        if (!TryParseNumber(value.substr(0, separator), scale) || scale == 0)
+        {
+            return false;
+        }
+
+        scales.push_back(scale);
+        value = (separator == std::string_view::npos) ? std::string_view {} : value.substr(separator + 1);
+    }
+
+    return !scales.empty();
+}
+
+static bool TryParseArguments(int argc, char* argv[], BenchmarkOptions& options)
+{
+    auto& edl_options = options.m_edl_options;
+    std::unordered_map<std::string_view, std::uint32_t*> count_arguments =
+    {
+        { "--Structs", &edl_options.m_struct_count },
+        { "--Enums", &edl_options.m_enum_count },
+        { "--Functions", &edl_options.m_function_count },
+        { "--NestingDepth", &edl_options.m_nesting_depth },
+        { "--Vectors", &edl_options.m_vector_count },
+        { "--Imports", &edl_options.m_import_count },
+        { "--Iterations", &options.m_iterations },
+        { "--LexerStructs", &options.m_lexer_struct_count },
+    };
+
+    for (int index = 1; index < argc; index += 2)
+    {
+        std::string_view argument = argv[index];
+
+        if (argument == "-h" || argument == "--help")
+        {
+            options.m_should_display_help = true;
+            return true;
+        }
+
+        if (index + 1 >= argc)
+        {
+            std::cout << std::format("Missing value for '{}'\n", argument);
+            return false;
+        }
+
+        std::string_view value = argv[index + 1];
+
+        if (auto count_argument = count_arguments.find(argument); count_argument != count_arguments.end())
+        {
+            if (!TryParseNumber(value, *count_argument->second))
+            {
+                std::cout << std::format("'{}' is not a valid count for '{}'\n", value, argument);
+                return false;
+            }
+        }
+        else if (argument == "--Scales")
+        {
+            if (!TryParseScales(value, options.m_scales))
+            {
+                std::cout << std::format("'{}' is not a valid list of scales\n", value);
+                return false;
+            }
+        }
+        else if (argument == "--OutputDirectory")
+        {
+            options.m_output_directory = value;
+        }
+        else if (argument == "--FlatbuffersCompilerPath")
+        {
+            options.m_flatbuffer_compiler_path = value;
+        }
+        else
+        {
+            std::cout << std::format("Unknown argument '{}'\n", argument);
+            return false;
+        }
+    }
+
+    options.m_iterations = std::max(options.m_iterations, 1U);
+
+    if (options.m_output_directory.empty())
+    {
+        options.m_output_directory = std::filesystem::temp_directory_path() / "EdlCodegenBenchmarks";
+    }
+
+    return true;
+}
+
+static BenchmarkResult RunIteration(
+    const BenchmarkOptions& options,
+    const std::filesystem::path& edl_path,
+    const std::filesystem::path& generated_directory)
+{
+    BenchmarkResult result {};
+
+    // Start from an empty output directory so every iteration writes all of its files.
+    std::filesystem::remove_all(generated_directory);
+    PhaseTimings::Instance().Reset();
+    s_phase_peak_bytes = {};
+
+    auto parse_start = std::chrono::steady_clock::now();
+
+    auto edl_parser = EdlParser(edl_path, { edl_path.parent_path() });
+    Edl edl = edl_parser.Parse();
+
+    result.m_parse_milliseconds = milliseconds(std::chrono::steady_clock::now() - parse_start).count();
+
+    auto generate_start = std::chrono::steady_clock::now();
+
+    auto cpp_code_generator = CppCodeGenerator(
+        std::move(edl),
+        generated_directory,
+        ErrorHandlingKind::ErrorCode,
+        VirtualTrustLayerKind::Enclave,
+        {},
+        {},
+        options.m_flatbuffer_compiler_path);
+
+    cpp_code_generator.Generate();
+
+    result.m_generate_milliseconds = milliseconds(std::chrono::steady_clock::now() - generate_start).count();
+    result.m_phase_peak_bytes = s_phase_peak_bytes;
+
+    for (std::size_t phase = 0; phase < c_phase_count; phase++)
+    {
+        result.m_phase_milliseconds[phase] = milliseconds(PhaseTimings::Instance().Get(static_cast<CodeGenerationPhase>(phase))).count();
+    }
+
+    return result;
+}
+
+static BenchmarkResult RunScale(const BenchmarkOptions& options, std::uint32_t scale)
+{
+    auto scale_directory = options.m_output_directory / std::format("Scale{}", scale);
+    auto edl_directory = scale_directory / "Edl";
+    std::filesystem::remove_all(edl_directory);
+
+    auto edl_path = GenerateSyntheticEdl(options.m_edl_options.Scale(scale), edl_directory, "SyntheticBenchmark");
+
+    std::uintmax_t edl_size {};
+
+    for (auto& entry : std::filesystem::directory_iterator(edl_directory))
+    {
+        edl_size += entry.file_size();
+    }
+
+    // Keep the fastest time of each phase. The heap usage is the same for every iteration.
+    BenchmarkResult best_result {};
+
+    for (std::uint32_t iteration = 0; iteration < options.m_iterations; iteration++)
+    {
+        auto result = RunIteration(options, edl_path, scale_directory / "Generated");
+
+        if (iteration == 0)
+        {
+            best_result = result;
+            continue;
+        }
+
+        for (std::size_t phase = 0; phase < c_phase_count; phase++)
+        {
+            best_result.m_phase_milliseconds[phase] = std::min(best_result.m_phase_milliseconds[phase], result.m_phase_milliseconds[phase]);
+        }
+
+        best_result.m_parse_milliseconds = std::min(best_result.m_parse_milliseconds, result.m_parse_milliseconds);
+        best_result.m_generate_milliseconds = std::min(best_result.m_generate_milliseconds, result.m_generate_milliseconds);
+    }
+
+    best_result.m_scale = scale;
+    best_result.m_edl_size = edl_size;
+
+    return best_result;
+}
+
+static void PrintResults(std::span<const BenchmarkResult> results)
+{
+    std::cout << std::format("\nTime in ms:\n{:>6} {:>10}", "scale", "edl KB");
+
+    for (auto& phase_name : c_code_generation_phase_names)
+    {
+        std::cout << std::format(" {:>14}", phase_name);
+    }
+
+    std::cout << std::format(" {:>12} {:>12}\n", "parse", "generate");
+
+    for (auto& result : results)
+    {
+        std::cout << std::format("{:>6} {:>10.1f}", result.m_scale, result.m_edl_size / 1024.0);
+
+        for (auto phase_milliseconds : result.m_phase_milliseconds)
+        {
+            std::cout << std::format(" {:>14.2f}", phase_milliseconds);
+        }
+
+        std::cout << std::format(" {:>12.2f} {:>12.2f}\n", result.m_parse_milliseconds, result.m_generate_milliseconds);
+    }
+
+    std::cout << std::format("\nPeak heap usage in MB:\n{:>6} {:>10}", "scale", "edl KB");
+
+    for (auto& phase_name : c_code_generation_phase_names)
+    {
+        std::cout << std::format(" {:>14}", phase_name);
+    }
+
+    std::cout << "\n";
+
+    for (auto& result : results)
+    {
+        std::cout << std::format("{:>6} {:>10.1f}", result.m_scale, result.m_edl_size / 1024.0);
+
+        for (auto phase_peak_bytes : result.m_phase_peak_bytes)
+        {
+            std::cout << std::format(" {:>14.2f}", phase_peak_bytes / c_bytes_per_megabyte);
+        }
+
+        std::cout << "\n";
+    }
+}
+
+// Reports how fast each phase grows between the smallest and largest scale, as the exponent
+// 'k' in time = size^k.
+static void PrintGrowth(std::span<const BenchmarkResult> results)
+{
+    if (results.size() < 2)
+    {
+        return;
+    }
+
+    // The scales are run in the order they were given, which need not be sorted.
+    auto [smallest_result, largest_result] = std::ranges::minmax_element(results, {}, &BenchmarkResult::m_scale);
+    auto& smallest = *smallest_result;
+    auto& largest = *largest_result;
+    auto size_growth = std::log(static_cast<double>(largest.m_scale) / smallest.m_scale);
+
+    if (size_growth <= 0)
+    {
+        return;
+    }
+
+    std::cout << std::format("\nGrowth from scale {} to scale {} (1.0 is linear, 2.0 is quadratic):\n", smallest.m_scale, largest.m_scale);
+
+    auto print_growth = [&] (std::string_view name, double smallest_value, double largest_value, double minimum_value)
+    {
+        if (smallest_value <= 0 || largest_value < minimum_value)
+        {
+            std::cout << std::format("  {:<24}{:>8}\n", name, "-");
+            return;
+        }
+
+        auto exponent = std::log(largest_value / smallest_value) / size_growth;
+        auto warning = (exponent > c_superlinear_exponent) ? "  <-- grows faster than linear" : "";
+        std::cout << std::format("  {:<24}{:>8.2f}{}\n", name, exponent, warning);
+    };
+
+    for (std::size_t phase = 0; phase < c_phase_count; phase++)
+    {
+        print_growth(
+            std::format("{} ms", c_code_generation_phase_names[phase]),
+            smallest.m_phase_milliseconds[phase],
+            largest.m_phase_milliseconds[phase],
+            c_minimum_reported_milliseconds);
+    }
+
+    print_growth("parse ms", smallest.m_parse_milliseconds, largest.m_parse_milliseconds, c_minimum_reported_milliseconds);
+    print_growth("generate ms", smallest.m_generate_milliseconds, largest.m_generate_milliseconds, c_minimum_reported_milliseconds);
+
+    for (std::size_t phase = 0; phase < c_phase_count; phase++)
+    {
+        print_growth(
+            std::format("{} peak MB", c_code_generation_phase_names[phase]),
+            smallest.m_phase_peak_bytes[phase] / c_bytes_per_megabyte,
+            largest.m_phase_peak_bytes[phase] / c_bytes_per_megabyte,
+            c_minimum_reported_megabytes);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    BenchmarkOptions options {};
+
+    if (!TryParseArguments(argc, argv, options))
+    {
+        PrintBenchmarkUsage();
+        return E_INVALIDARG;
+    }
+
+    if (options.m_should_display_help)
+    {
+        PrintBenchmarkUsage();
+        return S_OK;
+    }
+
+    PhaseTimings::Instance().SetListener(MeasurePhaseHeapUsage);
+
+    try
+    {
+        std::vector<BenchmarkResult> results {};
+
+        for (auto scale : options.m_scales)
+        {
+            std::cout << std::format("Running scale {}...\n", scale);
+            results.push_back(RunScale(options, scale));
+        }
+
+        PrintResults(results);
+        PrintGrowth(results);
+
+        if (options.m_lexer_struct_count != 0)
+        {
+            RunLexerBenchmark(options.m_lexer_struct_count, options.m_iterations, options.m_output_directory / "Lexer");
+        }
+    }
+    catch (const std::exception& exception)
+    {
+        std::cout << std::format("Benchmark failed: {}\n", exception.what());
+        return E_FAIL;
+    }
+
+    return S_OK;
+}
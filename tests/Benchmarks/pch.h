@@ -0,0 +1,37 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#ifndef PCH_H
+#define PCH_H
+#define WIN32_LEAN_AND_MEAN
+
+// C++ headers
+#include <algorithm>
+#include <array>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <span>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+// C headers
+#include <cctype>
+#include <cstdint>
+#include <cstdarg>
+#include <cstddef>
+#include <cstring>
+#include <ctype.h>
+#include <stdio.h>
+#include <winerror.h>
+
+#endif //PCH_H
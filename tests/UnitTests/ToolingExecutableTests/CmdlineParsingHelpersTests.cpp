@@ -215,5 +215,51 @@ TEST_CLASS(CmdlineParsingHelpersTests)
             Assert::AreEqual(static_cast<uint32_t>(ErrorId::OutputDirNoMoreArgs), static_cast<uint32_t>(result));
             Assert::AreEqual(std::string(""), directory.generic_string());
         }
+
+        TEST_METHOD(TestGetBatchFilePathFromArgs_Invalid)
+        {
+            char* args[2] = {first_argument.data(), m_cur_directory.data()};
+            std::filesystem::path batch_file;
+
+            // Call function
+            ErrorId result = GetBatchFilePathFromArgs(m_starting_index, args, m_args_size, batch_file);
+
+            // Check that a directory isn't accepted as a batch file
+            Assert::AreEqual(static_cast<uint32_t>(ErrorId::BatchFileDoesNotExist), static_cast<uint32_t>(result));
+            Assert::AreEqual(std::string(""), batch_file.generic_string());
+        }
+
+        TEST_METHOD(TestGetParseCacheDirectoryFromArgs)
+        {
+            char* args[2] = {first_argument.data(), m_cur_directory.data()};
+            std::filesystem::path parse_cache_directory;
+
+            // Call function
+            ErrorId result = GetParseCacheDirectoryFromArgs(m_starting_index, args, m_args_size, parse_cache_directory);
+
+            Assert::AreEqual(static_cast<uint32_t>(ErrorId::Success), static_cast<uint32_t>(result));
+            Assert::AreEqual(m_cur_directory, parse_cache_directory.generic_string());
+
+            // No more arguments after --ParseCacheDirectory
+            result = GetParseCacheDirectoryFromArgs(m_args_size, args, m_args_size, parse_cache_directory);
+            Assert::AreEqual(static_cast<uint32_t>(ErrorId::ParseCacheDirectoryNoMoreArgs), static_cast<uint32_t>(result));
+        }
+
+        TEST_METHOD(TestSplitCommandLine)
+        {
+            auto arguments = SplitCommandLine(R"(  --EdlPath "C:\my dir\test.edl"   --VirtualTrustLayer Enclave --Namespace "")");
+
+            std::vector<std::string> expected_arguments =
+            {
+                "--EdlPath",
+                "C:\\my dir\\test.edl",
+                "--VirtualTrustLayer",
+                "Enclave",
+                "--Namespace",
+                "",
+            };
+
+            Assert::IsTrue(expected_arguments == arguments);
+        }
     };
 }
@@ -154,5 +154,116 @@ namespace VbsEnclaveToolingTests
                 });
             }
 
+            TEST_METHOD(Parse_Edl_files_with_shared_parse_cache)
+            {
+                auto duplicate_dir = m_base_imports_path / "DuplicateImports";
+                std::vector<std::filesystem::path> directories = {std::filesystem::current_path(), duplicate_dir};
+                auto parse_cache = std::make_shared<EdlParseCache>();
+
+                // B_Duplicate.edl is imported by A_Duplicate.edl, so parsing it first allows
+                // A_Duplicate.edl to reuse it from the cache.
+                EdlParser(duplicate_dir / "B_Duplicate.edl", directories, parse_cache).Parse();
+
+                Edl uncached_edl = EdlParser(m_edl_file_with_duplicate_imports, directories).Parse();
+                Edl cached_edl = EdlParser(m_edl_file_with_duplicate_imports, directories, parse_cache).Parse();
+                Edl reused_edl = EdlParser(m_edl_file_with_duplicate_imports, directories, parse_cache).Parse();
+
+                auto check_edls_match = [] (Edl& expected_edl, Edl& actual_edl)
+                {
+                    Assert::IsTrue(std::ranges::equal(expected_edl.m_developer_types.keys(), actual_edl.m_developer_types.keys()));
+                    Assert::IsTrue(std::ranges::equal(expected_edl.m_trusted_functions.keys(), actual_edl.m_trusted_functions.keys()));
+                    Assert::IsTrue(std::ranges::equal(expected_edl.m_untrusted_functions.keys(), actual_edl.m_untrusted_functions.keys()));
+
+                    // The abi names must not depend on what was parsed before.
+                    for (auto& [signature, function] : expected_edl.m_trusted_functions)
+                    {
+                        Assert::AreEqual(function.abi_m_name, actual_edl.m_trusted_functions.at(signature).abi_m_name);
+                    }
+                };
+
+                check_edls_match(uncached_edl, cached_edl);
+                check_edls_match(uncached_edl, reused_edl);
+            }
+
+            TEST_METHOD(Parse_Edl_files_with_persistent_parse_cache)
+            {
+                auto duplicate_dir = m_base_imports_path / "DuplicateImports";
+                auto cache_dir = std::filesystem::current_path() / "ParseCacheTestOutput";
+                std::vector<std::filesystem::path> directories = {std::filesystem::current_path(), duplicate_dir};
+                std::filesystem::remove_all(cache_dir);
+
+                auto check_edls_match = [] (Edl& expected_edl, Edl& actual_edl)
+                {
+                    Assert::IsTrue(std::ranges::equal(expected_edl.m_developer_types.keys(), actual_edl.m_developer_types.keys()));
+                    Assert::IsTrue(std::ranges::equal(expected_edl.m_trusted_functions.keys(), actual_edl.m_trusted_functions.keys()));
+                    Assert::IsTrue(std::ranges::equal(expected_edl.m_untrusted_functions.keys(), actual_edl.m_untrusted_functions.keys()));
+
+                    for (auto& [signature, function] : expected_edl.m_trusted_functions)
+                    {
+                        auto& actual_function = actual_edl.m_trusted_functions.at(signature);
+                        Assert::AreEqual(function.abi_m_name, actual_function.abi_m_name);
+                        Assert::AreEqual(function.m_parameters.size(), actual_function.m_parameters.size());
+
+                        for (size_t i = 0; i < function.m_parameters.size(); i++)
+                        {
+                            Assert::AreEqual(function.m_parameters[i].m_name, actual_function.m_parameters[i].m_name);
+                            Assert::AreEqual(function.m_parameters[i].GenerateTypeInfoString(), actual_function.m_parameters[i].GenerateTypeInfoString());
+                        }
+                    }
+                };
+
+                Edl uncached_edl = EdlParser(m_edl_file_with_duplicate_imports, directories).Parse();
+                EdlParser(m_edl_file_with_duplicate_imports, directories, std::make_shared<EdlParseCache>(cache_dir)).Parse();
+                Assert::IsFalse(std::filesystem::is_empty(cache_dir));
+
+                // A new cache simulates a later edlcodegen run, which can only find the entries on disk.
+                Edl persisted_edl = EdlParser(m_edl_file_with_duplicate_imports, directories, std::make_shared<EdlParseCache>(cache_dir)).Parse();
+                check_edls_match(uncached_edl, persisted_edl);
+
+                // Truncated entries must be ignored and the .edl files parsed again.
+                for (auto& cache_file : std::filesystem::directory_iterator(cache_dir))
+                {
+                    std::filesystem::resize_file(cache_file.path(), std::filesystem::file_size(cache_file.path()) / 2);
+                }
+
+                Edl truncated_edl = EdlParser(m_edl_file_with_duplicate_imports, directories, std::make_shared<EdlParseCache>(cache_dir)).Parse();
+                check_edls_match(uncached_edl, truncated_edl);
+
+                // Corrupted entries must be ignored and the .edl files parsed again.
+                for (auto& cache_file : std::filesystem::directory_iterator(cache_dir))
+                {
+                    std::ofstream(cache_file.path(), std::ios::binary | std::ios::trunc) << "corrupted";
+                }
+
+                Edl reparsed_edl = EdlParser(m_edl_file_with_duplicate_imports, directories, std::make_shared<EdlParseCache>(cache_dir)).Parse();
+                check_edls_match(uncached_edl, reparsed_edl);
+                std::filesystem::remove_all(cache_dir);
+            }
+
+            TEST_METHOD(Parse_Edl_file_numbers_abi_names_in_declaration_order)
+            {
+                auto order_dir = m_base_imports_path / "DeclarationOrder";
+                std::vector<std::filesystem::path> directories = {order_dir};
+
+                // The functions are numbered in the order they were declared, including the imported
+                // ones at their import statement, whether or not the import came from the cache.
+                auto check_abi_names = [] (Edl& edl)
+                {
+                    Assert::AreEqual(std::string("AUntrustedFirst_0"), edl.m_untrusted_functions.at("AUntrustedFirst()").abi_m_name);
+                    Assert::AreEqual(std::string("BUntrusted_1"), edl.m_untrusted_functions.at("BUntrusted()").abi_m_name);
+                    Assert::AreEqual(std::string("BTrusted_2"), edl.m_trusted_functions.at("BTrusted()").abi_m_name);
+                    Assert::AreEqual(std::string("ATrusted_3"), edl.m_trusted_functions.at("ATrusted()").abi_m_name);
+                    Assert::AreEqual(std::string("AUntrustedLast_4"), edl.m_untrusted_functions.at("AUntrustedLast()").abi_m_name);
+                };
+
+                Edl uncached_edl = EdlParser(order_dir / "A_Order.edl", directories).Parse();
+                check_abi_names(uncached_edl);
+
+                auto parse_cache = std::make_shared<EdlParseCache>();
+                EdlParser(order_dir / "B_Order.edl", directories, parse_cache).Parse();
+                Edl cached_edl = EdlParser(order_dir / "A_Order.edl", directories, parse_cache).Parse();
+                check_abi_names(cached_edl);
+            }
+
     };
 }
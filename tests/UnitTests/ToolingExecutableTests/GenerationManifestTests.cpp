@@ -0,0 +1,150 @@
+// Copyright(c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#include <pch.h>
+#include "CppUnitTest.h"
+#include <CmdlineParsingHelpers.h>
+#include <CodeGeneration\GenerationManifest.h>
+#include <Edl\Parser.h>
+#include <Utils\Helpers.h>
+
+using namespace CodeGeneration;
+using namespace EdlProcessor;
+using namespace Helpers;
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace VbsEnclaveToolingTests
+{
+    TEST_CLASS(GenerationManifestTests)
+    {
+        private:
+            std::filesystem::path m_test_directory = std::filesystem::current_path() / "GenerationManifestTestOutput";
+            std::filesystem::path m_manifest_path = m_test_directory / "Input.edlcodegen.manifest";
+            std::filesystem::path m_input_file = m_test_directory / "Input.edl";
+            std::filesystem::path m_output_file = m_test_directory / "Output.h";
+            std::string m_options = "--Language C++ --VirtualTrustLayer Enclave";
+
+            void WriteFile(const std::filesystem::path& file_path, std::string_view content)
+            {
+                std::ofstream file(file_path);
+                file << content;
+            }
+
+            GeneratedFile SaveOutputFile(std::string_view content)
+            {
+                WriteFile(m_output_file, content);
+                return { m_output_file, ComputeContentHash(content) };
+            }
+
+            void SaveManifest(const GenerationManifest& manifest, const GeneratedFile& output)
+            {
+                std::vector<std::filesystem::path> inputs { m_input_file };
+                std::vector<GeneratedFile> outputs { output };
+                manifest.Save(inputs, outputs);
+            }
+
+        public:
+            TEST_METHOD_INITIALIZE(CreateTestDirectory)
+            {
+                std::filesystem::remove_all(m_test_directory);
+                std::filesystem::create_directories(m_test_directory);
+                WriteFile(m_input_file, "enclave { trusted { void Func(); }; };\n");
+            }
+
+            TEST_METHOD_CLEANUP(RemoveTestDirectory)
+            {
+                std::filesystem::remove_all(m_test_directory);
+            }
+
+            TEST_METHOD(Manifest_is_not_up_to_date_when_missing)
+            {
+                auto manifest = GenerationManifest(m_manifest_path, m_options);
+                Assert::IsFalse(manifest.IsUpToDate());
+            }
+
+            TEST_METHOD(Manifest_is_up_to_date_when_nothing_changed)
+            {
+                auto manifest = GenerationManifest(m_manifest_path, m_options);
+                SaveManifest(manifest, SaveOutputFile("// generated\n"));
+
+                Assert::IsTrue(manifest.IsUpToDate());
+            }
+
+            TEST_METHOD(Manifest_is_not_up_to_date_when_input_changes)
+            {
+                auto manifest = GenerationManifest(m_manifest_path, m_options);
+                SaveManifest(manifest, SaveOutputFile("// generated\n"));
+                WriteFile(m_input_file, "enclave { trusted { void Func2(); }; };\n");
+
+                Assert::IsFalse(manifest.IsUpToDate());
+            }
+
+            TEST_METHOD(Manifest_is_not_up_to_date_when_output_changes_or_is_removed)
+            {
+                auto manifest = GenerationManifest(m_manifest_path, m_options);
+                SaveManifest(manifest, SaveOutputFile("// generated\n"));
+                WriteFile(m_output_file, "// modified by hand\n");
+
+                Assert::IsFalse(manifest.IsUpToDate());
+
+                SaveManifest(manifest, SaveOutputFile("// generated\n"));
+                std::filesystem::remove(m_output_file);
+
+                Assert::IsFalse(manifest.IsUpToDate());
+            }
+
+            TEST_METHOD(Manifest_is_not_up_to_date_when_options_change)
+            {
+                SaveManifest(GenerationManifest(m_manifest_path, m_options), SaveOutputFile("// generated\n"));
+
+                auto manifest = GenerationManifest(m_manifest_path, "--Language C++ --VirtualTrustLayer HostApp");
+                Assert::IsFalse(manifest.IsUpToDate());
+            }
+
+            TEST_METHOD(Stale_outputs_from_previous_run_are_removed)
+            {
+                auto manifest = GenerationManifest(m_manifest_path, m_options);
+                SaveManifest(manifest, SaveOutputFile("// generated\n"));
+
+                auto new_output_file = m_test_directory / "RenamedOutput.h";
+                WriteFile(new_output_file, "// generated\n");
+                SaveManifest(manifest, { new_output_file, ComputeContentHash("// generated\n") });
+
+                Assert::IsFalse(std::filesystem::exists(m_output_file));
+                Assert::IsTrue(std::filesystem::exists(new_output_file));
+                Assert::IsTrue(manifest.IsUpToDate());
+            }
+
+            TEST_METHOD(Manifests_of_edl_files_in_the_same_output_directory_are_kept_apart)
+            {
+                auto first_manifest_path = GetGenerationManifestPath(m_test_directory, VirtualTrustLayerKind::Enclave, "First.edl");
+                auto second_manifest_path = GetGenerationManifestPath(m_test_directory, VirtualTrustLayerKind::Enclave, "Second.edl");
+                Assert::IsTrue(first_manifest_path != second_manifest_path);
+                Assert::IsTrue(first_manifest_path.parent_path() == second_manifest_path.parent_path());
+
+                auto first_manifest = GenerationManifest(first_manifest_path, m_options);
+                SaveManifest(first_manifest, SaveOutputFile("// generated\n"));
+
+                // Generating the second .edl file must not remove the first one's files
+                auto second_output_file = m_test_directory / "SecondOutput.h";
+                WriteFile(second_output_file, "// generated\n");
+                SaveManifest(GenerationManifest(second_manifest_path, m_options), { second_output_file, ComputeContentHash("// generated\n") });
+
+                Assert::IsTrue(std::filesystem::exists(m_output_file));
+                Assert::IsTrue(first_manifest.IsUpToDate());
+            }
+
+            TEST_METHOD(Parser_reports_edl_file_and_its_imports)
+            {
+                auto imports_path = std::filesystem::current_path() / "TestFiles" / "ImportTestFiles";
+                auto edl_file = imports_path / "DuplicateImports" / "A_Duplicate.edl";
+                auto edl_parser = EdlParser(edl_file, { std::filesystem::current_path(), imports_path / "DuplicateImports" });
+                edl_parser.Parse();
+
+                // A_Duplicate.edl imports B, C and D. Duplicate imports should only be reported once.
+                auto parsed_files = edl_parser.ParsedFiles();
+                Assert::AreEqual(size_t(4), parsed_files.size());
+                Assert::IsTrue(std::ranges::find(parsed_files, edl_file) != parsed_files.end());
+            }
+    };
+}
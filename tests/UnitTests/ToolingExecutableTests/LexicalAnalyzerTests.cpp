@@ -124,5 +124,79 @@ TEST_CLASS(LexicalAnalyzerTests)
     {
         TokenizeFile(m_struct_edl_file_name);
     }    
+
+    TEST_METHOD(TestTokenPositionsAfterWhitespaceAndComments)
+    {
+        // Whitespace and comments are skipped in blocks of 16 characters, so the content
+        // crosses block boundaries with tabs, carriage returns and multi-line comments.
+        auto edl_file = std::filesystem::current_path() / "LexerPositionTest.edl";
+        std::ofstream(edl_file, std::ios::binary)
+            << "enclave\r\n                    {\t\t/* comment\nthat spans */ name\r\n"
+            << "// trailing comment with * and / characters\n};";
+
+        auto analyzer = LexicalAnalyzer(edl_file);
+        std::vector<std::tuple<std::string, std::uint32_t, std::uint32_t>> expected_tokens =
+        {
+            { "enclave", 1, 1 },
+            { "{", 2, 21 },
+            { "name", 3, 13 },
+            { "}", 5, 1 },
+            { ";", 5, 2 },
+        };
+
+        for (auto& [text, line, column] : expected_tokens)
+        {
+            Token token = analyzer.GetNextToken();
+            Assert::AreEqual(text, token.ToString());
+            Assert::AreEqual(line, token.m_line_number);
+            Assert::AreEqual(column, token.m_column_number);
+        }
+
+        Assert::IsTrue(analyzer.GetNextToken().IsEof());
+        Assert::IsTrue(analyzer.GetNextToken().IsEof());
+        std::filesystem::remove(edl_file);
+    }
+
+    TEST_METHOD(TestVectorizedAndScalarLexingProduceSameTokens)
+    {
+        // Runs of whitespace and comments of every length up to a few blocks of 16 characters, so
+        // they start and end at every position within a block.
+        constexpr std::uint32_t struct_count = 64;
+        auto edl_file = std::filesystem::current_path() / "LexerModesTest.edl";
+
+        {
+            std::ofstream file(edl_file, std::ios::binary);
+            file << "enclave\r\n{\r\n";
+
+            for (std::uint32_t i = 0; i < struct_count; i++)
+            {
+                file << std::format("// Struct number {}\r\nstruct Struct{}\r\n{{\r\n", i, i);
+                file << std::string(i, (i % 3 == 0) ? '\t' : ' ');
+                file << std::format("uint32_t field_{};{}\n", i, std::string(i % 20, ' '));
+                file << std::format("/*{}*/", std::string(i, (i % 4 == 0) ? '\n' : '*'));
+                file << std::format("\tuint8_t other_{}; /* {}\r\n */\r\n}};\r\n", i, std::string(i % 17, '/'));
+            }
+
+            file << "};";
+        }
+
+        auto vectorized_analyzer = LexicalAnalyzer(edl_file, LexingMode::Vectorized);
+        auto scalar_analyzer = LexicalAnalyzer(edl_file, LexingMode::Scalar);
+        auto vectorized_tokens = vectorized_analyzer.LexedTokens();
+        auto scalar_tokens = scalar_analyzer.LexedTokens();
+
+        Assert::IsFalse(scalar_analyzer.IsMemoryMapped());
+        Assert::AreEqual(scalar_tokens.size(), vectorized_tokens.size());
+
+        for (size_t i = 0; i < scalar_tokens.size(); i++)
+        {
+            Assert::AreEqual(scalar_tokens[i].m_offset, vectorized_tokens[i].m_offset);
+            Assert::AreEqual(scalar_tokens[i].m_length, vectorized_tokens[i].m_length);
+            Assert::AreEqual(scalar_tokens[i].m_line_number, vectorized_tokens[i].m_line_number);
+            Assert::AreEqual(scalar_tokens[i].m_column_number, vectorized_tokens[i].m_column_number);
+        }
+
+        std::filesystem::remove(edl_file);
+    }
 };
 }